@@ -0,0 +1,545 @@
+/* xml-reader-extract.c: Extract repeated records as CSV, TSV or JSON
+ *
+ * Copyright (C) 2008  Emmanuele Bassi  <ebassi@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Author:
+ *   Emmanuele Bassi  <ebassi@gnome.org>
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <errno.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include <xml-reader/xml-reader.h>
+#include <xml-reader/xml-reader-columns.h>
+
+typedef enum {
+  FORMAT_CSV,
+  FORMAT_TSV,
+  FORMAT_JSON_LINES
+} OutputFormat;
+
+static gchar *record_path = NULL;
+static gchar **field_specs = NULL;
+static gchar *format_name = NULL;
+static gchar *output_file = NULL;
+static gint n_threads = 0;
+static gint buffer_size = 1 << 20;
+static gboolean no_header = FALSE;
+static gboolean show_timings = FALSE;
+
+static GOptionEntry entries[] = {
+  { "record", 'r', 0, G_OPTION_ARG_STRING, &record_path,
+    "Path of the record elements, e.g. catalog/item", "PATH" },
+  { "field", 'f', 0, G_OPTION_ARG_STRING_ARRAY, &field_specs,
+    "Field to extract; TYPE is string (default), int64, double or boolean",
+    "NAME=PATH[:TYPE]" },
+  { "format", 'F', 0, G_OPTION_ARG_STRING, &format_name,
+    "Output format: csv (default), tsv or jsonl", "FORMAT" },
+  { "output", 'o', 0, G_OPTION_ARG_FILENAME, &output_file,
+    "Write to FILE instead of the standard output", "FILE" },
+  { "threads", 'j', 0, G_OPTION_ARG_INT, &n_threads,
+    "Number of extraction threads, 0 for one per processor", "N" },
+  { "buffer-size", 'b', 0, G_OPTION_ARG_INT, &buffer_size,
+    "Size of the output buffer, in bytes", "BYTES" },
+  { "no-header", 0, 0, G_OPTION_ARG_NONE, &no_header,
+    "Do not print the column names for csv and tsv", NULL },
+  { "timings", 't', 0, G_OPTION_ARG_NONE, &show_timings,
+    "Print the time spent in each phase on the standard error", NULL },
+  { NULL }
+};
+
+/* returns whether @type names a column type, storing it in @column_type */
+static gboolean
+parse_type (const gchar         *type,
+            XmlReaderColumnType *column_type)
+{
+  if (strcmp (type, "string") == 0)
+    *column_type = XML_READER_COLUMN_STRING;
+  else if (strcmp (type, "int64") == 0 || strcmp (type, "int") == 0)
+    *column_type = XML_READER_COLUMN_INT64;
+  else if (strcmp (type, "double") == 0)
+    *column_type = XML_READER_COLUMN_DOUBLE;
+  else if (strcmp (type, "boolean") == 0 || strcmp (type, "bool") == 0)
+    *column_type = XML_READER_COLUMN_BOOLEAN;
+  else
+    return FALSE;
+
+  return TRUE;
+}
+
+/* the depth of the records selected by @path, the root being at 1 */
+static gint
+count_steps (const gchar *path)
+{
+  gchar **steps = g_strsplit (path, "/", -1);
+  gint i, n_steps = 0;
+
+  for (i = 0; steps[i] != NULL; i++)
+    if (steps[i][0] != '\0' && strcmp (steps[i], ".") != 0)
+      n_steps += 1;
+
+  g_strfreev (steps);
+
+  return n_steps;
+}
+
+static gboolean
+parse_field (const gchar     *spec,
+             XmlReaderField  *field,
+             GError         **error)
+{
+  const gchar *path, *type;
+  gchar *name;
+
+  path = strchr (spec, '=');
+  if (!path || path == spec || path[1] == '\0')
+    {
+      g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+                   "Invalid field `%s', expected NAME=PATH[:TYPE]",
+                   spec);
+      return FALSE;
+    }
+
+  name = g_strndup (spec, path - spec);
+  path += 1;
+
+  field->name = name;
+  field->type = XML_READER_COLUMN_STRING;
+
+  /* the path may hold prefixed names, like dc:title, so only a known
+   * type name after the last colon is a type
+   */
+  type = strrchr (path, ':');
+  if (type && type != path && parse_type (type + 1, &field->type))
+    field->path = g_strndup (path, type - path);
+  else
+    field->path = g_strdup (path);
+
+  return TRUE;
+}
+
+static void
+append_csv_string (GString     *out,
+                   const gchar *str,
+                   gsize        len)
+{
+  gsize i;
+
+  for (i = 0; i < len; i++)
+    if (str[i] == ',' || str[i] == '"' || str[i] == '\n' || str[i] == '\r')
+      break;
+
+  if (i == len)
+    {
+      g_string_append_len (out, str, len);
+      return;
+    }
+
+  g_string_append_c (out, '"');
+  for (i = 0; i < len; i++)
+    {
+      if (str[i] == '"')
+        g_string_append_c (out, '"');
+
+      g_string_append_c (out, str[i]);
+    }
+  g_string_append_c (out, '"');
+}
+
+static void
+append_tsv_string (GString     *out,
+                   const gchar *str,
+                   gsize        len)
+{
+  gsize i;
+
+  for (i = 0; i < len; i++)
+    {
+      switch (str[i])
+        {
+        case '\t':
+          g_string_append (out, "\\t");
+          break;
+
+        case '\n':
+          g_string_append (out, "\\n");
+          break;
+
+        case '\r':
+          g_string_append (out, "\\r");
+          break;
+
+        case '\\':
+          g_string_append (out, "\\\\");
+          break;
+
+        default:
+          g_string_append_c (out, str[i]);
+          break;
+        }
+    }
+}
+
+static void
+append_json_string (GString     *out,
+                    const gchar *str,
+                    gsize        len)
+{
+  gsize i;
+
+  g_string_append_c (out, '"');
+
+  for (i = 0; i < len; i++)
+    {
+      guchar c = str[i];
+
+      if (c == '"' || c == '\\')
+        {
+          g_string_append_c (out, '\\');
+          g_string_append_c (out, c);
+        }
+      else if (c == '\n')
+        g_string_append (out, "\\n");
+      else if (c == '\t')
+        g_string_append (out, "\\t");
+      else if (c == '\r')
+        g_string_append (out, "\\r");
+      else if (c < 0x20)
+        g_string_append_printf (out, "\\u%04x", c);
+      else
+        g_string_append_c (out, c);
+    }
+
+  g_string_append_c (out, '"');
+}
+
+static void
+append_string (GString      *out,
+               OutputFormat  format,
+               const gchar  *str,
+               gsize         len)
+{
+  switch (format)
+    {
+    case FORMAT_CSV:
+      append_csv_string (out, str, len);
+      break;
+
+    case FORMAT_TSV:
+      append_tsv_string (out, str, len);
+      break;
+
+    case FORMAT_JSON_LINES:
+      append_json_string (out, str, len);
+      break;
+    }
+}
+
+static void
+append_value (GString               *out,
+              OutputFormat           format,
+              const XmlReaderColumn *column,
+              guint                  row)
+{
+  gchar buffer[G_ASCII_DTOSTR_BUF_SIZE];
+  gdouble value;
+
+  if (!XML_READER_COLUMN_IS_VALID (column, row))
+    {
+      if (format == FORMAT_JSON_LINES)
+        g_string_append (out, "null");
+      return;
+    }
+
+  switch (column->type)
+    {
+    case XML_READER_COLUMN_INT64:
+      g_string_append_printf (out, "%" G_GINT64_FORMAT,
+                              column->int64_values[row]);
+      break;
+
+    case XML_READER_COLUMN_DOUBLE:
+      value = column->double_values[row];
+
+      /* JSON has no representation for these */
+      if (format == FORMAT_JSON_LINES && (value != value || value - value != 0))
+        g_string_append (out, "null");
+      else
+        g_string_append (out, g_ascii_dtostr (buffer, sizeof (buffer), value));
+      break;
+
+    case XML_READER_COLUMN_BOOLEAN:
+      g_string_append (out, XML_READER_COLUMN_GET_BOOLEAN (column, row)
+                            ? "true"
+                            : "false");
+      break;
+
+    case XML_READER_COLUMN_STRING:
+      append_string (out, format,
+                     column->data + column->offsets[row],
+                     column->offsets[row + 1] - column->offsets[row]);
+      break;
+    }
+}
+
+static gboolean
+flush_output (FILE     *stream,
+              GString  *out,
+              GError  **error)
+{
+  if (out->len > 0 && fwrite (out->str, 1, out->len, stream) != out->len)
+    {
+      g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_IO,
+                   "Unable to write the output: %s",
+                   g_strerror (errno));
+      return FALSE;
+    }
+
+  g_string_truncate (out, 0);
+
+  return TRUE;
+}
+
+static gboolean
+write_columns (FILE                  *stream,
+               OutputFormat           format,
+               const XmlReaderField  *fields,
+               const XmlReaderColumn *columns,
+               guint                  n_columns,
+               GError               **error)
+{
+  const gchar *separator = format == FORMAT_TSV ? "\t" : ",";
+  GString *out;
+  guint n_rows, row, i;
+
+  n_rows = n_columns > 0 ? columns[0].n_rows : 0;
+
+  out = g_string_sized_new (buffer_size + 4096);
+
+  if (format != FORMAT_JSON_LINES && !no_header)
+    {
+      for (i = 0; i < n_columns; i++)
+        {
+          if (i > 0)
+            g_string_append (out, separator);
+
+          append_string (out, format, fields[i].name, strlen (fields[i].name));
+        }
+
+      g_string_append_c (out, '\n');
+    }
+
+  for (row = 0; row < n_rows; row++)
+    {
+      if (format == FORMAT_JSON_LINES)
+        g_string_append_c (out, '{');
+
+      for (i = 0; i < n_columns; i++)
+        {
+          if (i > 0)
+            g_string_append (out, separator);
+
+          if (format == FORMAT_JSON_LINES)
+            {
+              append_json_string (out, fields[i].name, strlen (fields[i].name));
+              g_string_append_c (out, ':');
+            }
+
+          append_value (out, format, &columns[i], row);
+        }
+
+      g_string_append (out, format == FORMAT_JSON_LINES ? "}\n" : "\n");
+
+      if (out->len >= (gsize) buffer_size && !flush_output (stream, out, error))
+        {
+          g_string_free (out, TRUE);
+          return FALSE;
+        }
+    }
+
+  if (!flush_output (stream, out, error))
+    {
+      g_string_free (out, TRUE);
+      return FALSE;
+    }
+
+  g_string_free (out, TRUE);
+
+  return TRUE;
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+  GOptionContext *context;
+  XmlReaderField *fields;
+  XmlReaderColumn *columns;
+  XmlReader *reader;
+  OutputFormat format;
+  GError *error = NULL;
+  FILE *stream;
+  GTimer *timer;
+  guint n_fields, i;
+  gint retval = EXIT_SUCCESS;
+
+  g_type_init ();
+
+  context = g_option_context_new ("FILE - extract repeated records");
+  g_option_context_set_summary (context,
+                                "Extracts the fields of every record element of an XML file\n"
+                                "and writes them as CSV, TSV or JSON Lines.");
+  g_option_context_add_main_entries (context, entries, NULL);
+
+  if (!g_option_context_parse (context, &argc, &argv, &error))
+    {
+      g_printerr ("%s: %s\n", g_get_prgname (), error->message);
+      return EXIT_FAILURE;
+    }
+
+  g_option_context_free (context);
+
+  if (argc != 2 || !record_path || !field_specs)
+    {
+      g_printerr ("Usage: %s --record=PATH --field=NAME=PATH[:TYPE]... FILE\n",
+                  g_get_prgname ());
+      return EXIT_FAILURE;
+    }
+
+  if (!format_name || strcmp (format_name, "csv") == 0)
+    format = FORMAT_CSV;
+  else if (strcmp (format_name, "tsv") == 0)
+    format = FORMAT_TSV;
+  else if (strcmp (format_name, "jsonl") == 0 || strcmp (format_name, "json") == 0)
+    format = FORMAT_JSON_LINES;
+  else
+    {
+      g_printerr ("%s: unknown format `%s'\n", g_get_prgname (), format_name);
+      return EXIT_FAILURE;
+    }
+
+  if (n_threads < 0 || buffer_size <= 0)
+    {
+      g_printerr ("%s: invalid thread count or buffer size\n", g_get_prgname ());
+      return EXIT_FAILURE;
+    }
+
+  n_fields = g_strv_length (field_specs);
+  fields = g_new0 (XmlReaderField, n_fields);
+  for (i = 0; i < n_fields; i++)
+    {
+      if (!parse_field (field_specs[i], &fields[i], &error))
+        {
+          g_printerr ("%s: %s\n", g_get_prgname (), error->message);
+          return EXIT_FAILURE;
+        }
+    }
+
+  timer = g_timer_new ();
+  reader = xml_reader_new ();
+
+  /* the records are parsed, extracted and released a batch at a time,
+   * so that the tree never holds more than a batch of them
+   */
+  if (count_steps (record_path) > 0)
+    xml_reader_set_bounded_memory (reader, count_steps (record_path), 0);
+
+  if (!xml_reader_load_from_file (reader, argv[1], &error))
+    {
+      g_printerr ("%s: %s\n", g_get_prgname (), error->message);
+      return EXIT_FAILURE;
+    }
+
+  /* each phase restarts the timer, so the times do not add up */
+  if (show_timings)
+    {
+      g_printerr ("load: %.3f s\n", g_timer_elapsed (timer, NULL));
+      g_timer_start (timer);
+    }
+
+  columns = xml_reader_extract_columns (reader, record_path,
+                                        fields, n_fields,
+                                        n_threads,
+                                        &error);
+  if (!columns)
+    {
+      g_printerr ("%s: %s\n", g_get_prgname (), error->message);
+      return EXIT_FAILURE;
+    }
+
+  /* the columns do not reference the document */
+  g_object_unref (reader);
+
+  if (show_timings)
+    {
+      g_printerr ("extract: %.3f s (%u records)\n",
+                  g_timer_elapsed (timer, NULL),
+                  n_fields > 0 ? columns[0].n_rows : 0);
+      g_timer_start (timer);
+    }
+
+  if (output_file)
+    {
+      stream = fopen (output_file, "w");
+      if (!stream)
+        {
+          g_printerr ("%s: unable to open `%s': %s\n",
+                      g_get_prgname (), output_file,
+                      g_strerror (errno));
+          return EXIT_FAILURE;
+        }
+    }
+  else
+    stream = stdout;
+
+  /* the output is buffered by write_columns() itself */
+  setvbuf (stream, NULL, _IONBF, 0);
+
+  if (!write_columns (stream, format, fields, columns, n_fields, &error))
+    {
+      g_printerr ("%s: %s\n", g_get_prgname (), error->message);
+      retval = EXIT_FAILURE;
+    }
+
+  if (stream != stdout && fclose (stream) != 0)
+    {
+      g_printerr ("%s: unable to write `%s': %s\n",
+                  g_get_prgname (), output_file,
+                  g_strerror (errno));
+      retval = EXIT_FAILURE;
+    }
+
+  if (show_timings)
+    g_printerr ("write: %.3f s\n", g_timer_elapsed (timer, NULL));
+
+  xml_reader_columns_free (columns, n_fields);
+
+  for (i = 0; i < n_fields; i++)
+    {
+      g_free ((gchar *) fields[i].name);
+      g_free ((gchar *) fields[i].path);
+    }
+
+  g_free (fields);
+  g_timer_destroy (timer);
+
+  return retval;
+}
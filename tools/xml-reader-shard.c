@@ -0,0 +1,100 @@
+/* xml-reader-shard.c: Cut XML files in shards for parallel processing
+ *
+ * Copyright (C) 2008  Emmanuele Bassi  <ebassi@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Author:
+ *   Emmanuele Bassi  <ebassi@gnome.org>
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include <xml-reader/xml-reader.h>
+#include <xml-reader/xml-reader-shard.h>
+
+static gchar *record_path = NULL;
+static gint n_shards = 0;
+static gchar *output_file = NULL;
+
+static GOptionEntry entries[] = {
+  { "record", 'r', 0, G_OPTION_ARG_STRING, &record_path,
+    "Path of the record elements, e.g. catalog/item; the children of the root by default", "PATH" },
+  { "shards", 'n', 0, G_OPTION_ARG_INT, &n_shards,
+    "Number of shards to cut the file in", "N" },
+  { "output", 'o', 0, G_OPTION_ARG_FILENAME, &output_file,
+    "Write the manifest to FILE instead of the standard output", "FILE" },
+  { NULL }
+};
+
+int
+main (int   argc,
+      char *argv[])
+{
+  GOptionContext *context;
+  GError *error = NULL;
+  gchar *manifest;
+  gint retval = EXIT_SUCCESS;
+
+  g_type_init ();
+
+  context = g_option_context_new ("FILE - cut an XML file in shards");
+  g_option_context_set_summary (context,
+                                "Scans an XML file once and writes the manifest of its shards:\n"
+                                "ranges of whole records of about the same size, which separate\n"
+                                "processes can load with xml_reader_load_shard().");
+  g_option_context_add_main_entries (context, entries, NULL);
+
+  if (!g_option_context_parse (context, &argc, &argv, &error))
+    {
+      g_printerr ("%s: %s\n", g_get_prgname (), error->message);
+      return EXIT_FAILURE;
+    }
+
+  g_option_context_free (context);
+
+  if (argc != 2 || n_shards <= 0)
+    {
+      g_printerr ("Usage: %s [--record=PATH] --shards=N [--output=FILE] FILE\n",
+                  g_get_prgname ());
+      return EXIT_FAILURE;
+    }
+
+  manifest = xml_reader_create_shard_manifest (argv[1], record_path, n_shards, &error);
+  if (!manifest)
+    {
+      g_printerr ("%s: %s\n", g_get_prgname (), error->message);
+      return EXIT_FAILURE;
+    }
+
+  if (output_file)
+    {
+      if (!g_file_set_contents (output_file, manifest, -1, &error))
+        {
+          g_printerr ("%s: %s\n", g_get_prgname (), error->message);
+          retval = EXIT_FAILURE;
+        }
+    }
+  else
+    fputs (manifest, stdout);
+
+  g_free (manifest);
+
+  return retval;
+}
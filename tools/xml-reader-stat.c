@@ -0,0 +1,581 @@
+/* xml-reader-stat.c: Profile the shape of XML documents
+ *
+ * Copyright (C) 2008  Emmanuele Bassi  <ebassi@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Author:
+ *   Emmanuele Bassi  <ebassi@gnome.org>
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <libxml/xmlreader.h>
+
+#include <glib.h>
+
+#define XML_TO_CHAR(s)  ((char *) (s))
+
+/* depths beyond this one share the last bucket */
+#define MAX_DEPTH_BUCKETS       64
+
+/* buckets of the logarithmic histograms: 0, 1, 2-3, 4-7, ... */
+#define N_LOG_BUCKETS           33
+
+typedef struct {
+  guint n_children;
+  guint has_text : 1;
+} OpenElement;
+
+typedef struct {
+  gchar *path;
+  guint depth;
+  guint64 count;
+  guint has_children : 1;
+} NameStats;
+
+typedef struct {
+  guint64 n_elements;
+  guint64 n_attributes;
+  guint64 n_text_nodes;
+  guint64 text_bytes;
+  guint64 n_mixed;
+
+  guint max_depth;
+  guint max_fanout;
+  guint max_attributes;
+  guint64 max_text;
+
+  guint64 depths[MAX_DEPTH_BUCKETS];
+  guint64 fanouts[N_LOG_BUCKETS];
+  guint64 attributes[N_LOG_BUCKETS];
+  guint64 text_sizes[N_LOG_BUCKETS];
+
+  /* at most max_names entries, keyed by name */
+  GHashTable *names;
+  gboolean names_overflow;
+  guint64 n_unnamed;
+} DocumentStats;
+
+static gint max_names = 65536;
+static gboolean json_output = FALSE;
+
+static GOptionEntry entries[] = {
+  { "max-names", 'n', 0, G_OPTION_ARG_INT, &max_names,
+    "Maximum number of distinct element names to track", "N" },
+  { "json", 'j', 0, G_OPTION_ARG_NONE, &json_output,
+    "Print the statistics as JSON", NULL },
+  { NULL }
+};
+
+static inline guint
+log_bucket (guint64 value)
+{
+  guint bucket = 0;
+
+  while (value != 0 && bucket < N_LOG_BUCKETS - 1)
+    {
+      value >>= 1;
+      bucket += 1;
+    }
+
+  return bucket;
+}
+
+static void
+name_stats_free (gpointer data)
+{
+  NameStats *stats = data;
+
+  g_free (stats->path);
+  g_slice_free (NameStats, stats);
+}
+
+static gchar *
+build_path (GPtrArray   *names,
+            const gchar *name)
+{
+  GString *path = g_string_new (NULL);
+  guint i;
+
+  for (i = 0; i < names->len; i++)
+    {
+      g_string_append (path, g_ptr_array_index (names, i));
+      g_string_append_c (path, '/');
+    }
+
+  g_string_append (path, name);
+
+  return g_string_free (path, FALSE);
+}
+
+static void
+count_name (DocumentStats *stats,
+            GPtrArray     *open_names,
+            const gchar   *name,
+            guint          depth)
+{
+  NameStats *name_stats;
+
+  name_stats = g_hash_table_lookup (stats->names, name);
+  if (!name_stats)
+    {
+      if (g_hash_table_size (stats->names) >= (guint) max_names)
+        {
+          stats->names_overflow = TRUE;
+          stats->n_unnamed += 1;
+          return;
+        }
+
+      name_stats = g_slice_new (NameStats);
+      name_stats->path = build_path (open_names, name);
+      name_stats->depth = depth;
+      name_stats->count = 0;
+      name_stats->has_children = FALSE;
+
+      g_hash_table_insert (stats->names, g_strdup (name), name_stats);
+    }
+
+  name_stats->count += 1;
+}
+
+/* accounts for the element on top of @open, which is being closed */
+static void
+close_element (DocumentStats *stats,
+               GArray        *open,
+               GPtrArray     *open_names)
+{
+  OpenElement *element = &g_array_index (open, OpenElement, open->len - 1);
+  const gchar *name = g_ptr_array_index (open_names, open_names->len - 1);
+  NameStats *name_stats;
+
+  if (element->n_children > 0 &&
+      (name_stats = g_hash_table_lookup (stats->names, name)) != NULL)
+    name_stats->has_children = TRUE;
+
+  stats->fanouts[log_bucket (element->n_children)] += 1;
+  stats->max_fanout = MAX (stats->max_fanout, element->n_children);
+
+  if (element->has_text && element->n_children > 0)
+    stats->n_mixed += 1;
+
+  g_array_set_size (open, open->len - 1);
+  g_ptr_array_remove_index (open_names, open_names->len - 1);
+}
+
+static gboolean
+is_blank (const gchar *text)
+{
+  for (; *text != '\0'; text++)
+    if (!g_ascii_isspace (*text))
+      return FALSE;
+
+  return TRUE;
+}
+
+static gboolean
+collect_stats (const gchar    *filename,
+               DocumentStats  *stats,
+               GError        **error)
+{
+  xmlTextReaderPtr reader;
+  GArray *open;
+  GPtrArray *open_names;
+  gint res;
+
+  reader = xmlReaderForFile (filename, NULL, XML_PARSE_COMPACT | XML_PARSE_HUGE);
+  if (!reader)
+    {
+      g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_FAILED,
+                   "Unable to open `%s'", filename);
+      return FALSE;
+    }
+
+  open = g_array_new (FALSE, TRUE, sizeof (OpenElement));
+  open_names = g_ptr_array_new_with_free_func (g_free);
+
+  while ((res = xmlTextReaderRead (reader)) == 1)
+    {
+      gint type = xmlTextReaderNodeType (reader);
+
+      if (type == XML_READER_TYPE_ELEMENT)
+        {
+          const gchar *name = XML_TO_CHAR (xmlTextReaderConstName (reader));
+          OpenElement element = { 0, };
+          guint depth = open->len + 1;
+          guint n_attributes = xmlTextReaderAttributeCount (reader);
+
+          stats->n_elements += 1;
+          stats->depths[MIN (depth, MAX_DEPTH_BUCKETS) - 1] += 1;
+          stats->max_depth = MAX (stats->max_depth, depth);
+
+          stats->n_attributes += n_attributes;
+          stats->attributes[log_bucket (n_attributes)] += 1;
+          stats->max_attributes = MAX (stats->max_attributes, n_attributes);
+
+          if (open->len > 0)
+            g_array_index (open, OpenElement, open->len - 1).n_children += 1;
+
+          count_name (stats, open_names, name, depth);
+
+          g_array_append_val (open, element);
+          g_ptr_array_add (open_names, g_strdup (name));
+
+          /* empty elements have no end event */
+          if (xmlTextReaderIsEmptyElement (reader))
+            close_element (stats, open, open_names);
+        }
+      else if (type == XML_READER_TYPE_END_ELEMENT)
+        close_element (stats, open, open_names);
+      else if (type == XML_READER_TYPE_TEXT ||
+               type == XML_READER_TYPE_CDATA ||
+               type == XML_READER_TYPE_SIGNIFICANT_WHITESPACE)
+        {
+          const gchar *text = XML_TO_CHAR (xmlTextReaderConstValue (reader));
+          gsize len = text ? strlen (text) : 0;
+
+          if (len == 0 || is_blank (text))
+            continue;
+
+          stats->n_text_nodes += 1;
+          stats->text_bytes += len;
+          stats->text_sizes[log_bucket (len)] += 1;
+          stats->max_text = MAX (stats->max_text, len);
+
+          if (open->len > 0)
+            g_array_index (open, OpenElement, open->len - 1).has_text = TRUE;
+        }
+    }
+
+  xmlFreeTextReader (reader);
+  g_array_free (open, TRUE);
+  g_ptr_array_free (open_names, TRUE);
+
+  if (res != 0)
+    {
+      g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_FAILED,
+                   "Unable to parse `%s'", filename);
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+static const NameStats *
+most_frequent_name (DocumentStats *stats)
+{
+  GHashTableIter iter;
+  NameStats *name_stats, *retval = NULL;
+
+  g_hash_table_iter_init (&iter, stats->names);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &name_stats))
+    {
+      /* records are repeated elements with fields of their own */
+      if (name_stats->depth < 2 || !name_stats->has_children)
+        continue;
+
+      if (!retval ||
+          name_stats->count > retval->count ||
+          (name_stats->count == retval->count &&
+           name_stats->depth < retval->depth))
+        retval = name_stats;
+    }
+
+  return retval;
+}
+
+static void
+print_log_histogram (const gchar   *title,
+                     const guint64 *buckets)
+{
+  guint i, last = 0;
+
+  for (i = 0; i < N_LOG_BUCKETS; i++)
+    if (buckets[i] != 0)
+      last = i;
+
+  g_print ("%s:\n", title);
+
+  for (i = 0; i <= last; i++)
+    {
+      if (i == 0)
+        g_print ("  %20s  %" G_GUINT64_FORMAT "\n", "0", buckets[i]);
+      else if (i == 1)
+        g_print ("  %20s  %" G_GUINT64_FORMAT "\n", "1", buckets[i]);
+      else
+        {
+          gchar *range = g_strdup_printf ("%" G_GUINT64_FORMAT "-%" G_GUINT64_FORMAT,
+                                          G_GUINT64_CONSTANT (1) << (i - 1),
+                                          (G_GUINT64_CONSTANT (1) << i) - 1);
+
+          g_print ("  %20s  %" G_GUINT64_FORMAT "\n", range, buckets[i]);
+          g_free (range);
+        }
+    }
+}
+
+static void
+print_json_array (const gchar   *name,
+                  const guint64 *values,
+                  guint          n_values)
+{
+  guint i, last = 0;
+
+  for (i = 0; i < n_values; i++)
+    if (values[i] != 0)
+      last = i + 1;
+
+  g_print ("  \"%s\": [", name);
+  for (i = 0; i < last; i++)
+    g_print ("%s%" G_GUINT64_FORMAT, i > 0 ? ", " : "", values[i]);
+  g_print ("],\n");
+}
+
+/* advice about the XmlReader features that fit the document */
+static GPtrArray *
+build_suggestions (DocumentStats *stats)
+{
+  GPtrArray *suggestions = g_ptr_array_new_with_free_func (g_free);
+  const NameStats *records = most_frequent_name (stats);
+  guint64 wide_parents = 0;
+  guint i;
+
+  /* parents with 16 or more children */
+  for (i = 5; i < N_LOG_BUCKETS; i++)
+    wide_parents += stats->fanouts[i];
+
+  if (records && records->count >= 1000)
+    g_ptr_array_add (suggestions,
+                     g_strdup_printf ("<%s> repeats %" G_GUINT64_FORMAT " times: "
+                                      "extract it in bulk with "
+                                      "xml_reader_extract_columns() or "
+                                      "xml-reader-extract --record=%s",
+                                      records->path,
+                                      records->count,
+                                      records->path));
+
+  if (wide_parents > 0)
+    g_ptr_array_add (suggestions,
+                     g_strdup_printf ("%" G_GUINT64_FORMAT " elements have 16 "
+                                      "or more children (at most %u): use "
+                                      "xml_reader_count_elements() and "
+                                      "xml_reader_read_nth_element() for "
+                                      "positional access, and repeat lookups "
+                                      "below the same parent to use its "
+                                      "packed child index",
+                                      wide_parents,
+                                      stats->max_fanout));
+
+  if (stats->n_mixed > 0)
+    g_ptr_array_add (suggestions,
+                     g_strdup_printf ("%" G_GUINT64_FORMAT " elements have mixed "
+                                      "content: xml_reader_get_element_value() "
+                                      "only returns their leading text, use "
+                                      "xml_reader_walk() to see all of it",
+                                      stats->n_mixed));
+
+  if (stats->max_depth >= 32)
+    g_ptr_array_add (suggestions,
+                     g_strdup_printf ("the document nests %u levels deep: "
+                                      "prefer xml_reader_walk() and "
+                                      "xml_reader_read_next_in_document() "
+                                      "over recursive traversals",
+                                      stats->max_depth));
+
+  return suggestions;
+}
+
+static void
+print_text (const gchar   *filename,
+            DocumentStats *stats)
+{
+  GPtrArray *suggestions;
+  guint i;
+
+  g_print ("File: %s\n", filename);
+  g_print ("Elements: %" G_GUINT64_FORMAT "\n", stats->n_elements);
+  g_print ("Distinct element names: %u", g_hash_table_size (stats->names));
+  if (stats->names_overflow)
+    g_print (" (limit reached, %" G_GUINT64_FORMAT " elements not tallied "
+             "by name)", stats->n_unnamed);
+  g_print ("\n");
+  g_print ("Attributes: %" G_GUINT64_FORMAT " (at most %u per element)\n",
+           stats->n_attributes, stats->max_attributes);
+  g_print ("Text nodes: %" G_GUINT64_FORMAT ", %" G_GUINT64_FORMAT " bytes "
+           "(largest %" G_GUINT64_FORMAT ")\n",
+           stats->n_text_nodes, stats->text_bytes, stats->max_text);
+  g_print ("Mixed content: %.2f%% of the elements\n",
+           stats->n_elements > 0
+             ? 100.0 * stats->n_mixed / stats->n_elements
+             : 0.0);
+  g_print ("Maximum depth: %u, maximum fanout: %u\n",
+           stats->max_depth, stats->max_fanout);
+
+  g_print ("Depth:\n");
+  for (i = 0; i < MIN (stats->max_depth, MAX_DEPTH_BUCKETS); i++)
+    g_print ("  %19u%s  %" G_GUINT64_FORMAT "\n",
+             i + 1,
+             i + 1 == MAX_DEPTH_BUCKETS ? "+" : " ",
+             stats->depths[i]);
+
+  print_log_histogram ("Children per element", stats->fanouts);
+  print_log_histogram ("Attributes per element", stats->attributes);
+  print_log_histogram ("Text node size", stats->text_sizes);
+
+  suggestions = build_suggestions (stats);
+  if (suggestions->len > 0)
+    {
+      g_print ("Suggestions:\n");
+      for (i = 0; i < suggestions->len; i++)
+        g_print ("  - %s\n", (gchar *) g_ptr_array_index (suggestions, i));
+    }
+
+  g_ptr_array_free (suggestions, TRUE);
+}
+
+/* the same escaping as the JSON Lines output of xml-reader-extract;
+ * g_strescape() emits octal escapes, which JSON does not have
+ */
+static void
+print_json_string (const gchar *str)
+{
+  GString *out = g_string_new ("\"");
+
+  for (; *str != '\0'; str++)
+    {
+      guchar c = *str;
+
+      if (c == '"' || c == '\\')
+        {
+          g_string_append_c (out, '\\');
+          g_string_append_c (out, c);
+        }
+      else if (c == '\n')
+        g_string_append (out, "\\n");
+      else if (c == '\t')
+        g_string_append (out, "\\t");
+      else if (c == '\r')
+        g_string_append (out, "\\r");
+      else if (c < 0x20)
+        g_string_append_printf (out, "\\u%04x", c);
+      else
+        g_string_append_c (out, c);
+    }
+
+  g_string_append_c (out, '"');
+  g_print ("%s", out->str);
+  g_string_free (out, TRUE);
+}
+
+static void
+print_json (const gchar   *filename,
+            DocumentStats *stats)
+{
+  GPtrArray *suggestions;
+  guint i;
+
+  g_print ("{\n  \"file\": ");
+  print_json_string (filename);
+  g_print (",\n");
+  g_print ("  \"elements\": %" G_GUINT64_FORMAT ",\n", stats->n_elements);
+  g_print ("  \"distinct_names\": %u,\n", g_hash_table_size (stats->names));
+  g_print ("  \"distinct_names_overflow\": %s,\n",
+           stats->names_overflow ? "true" : "false");
+  g_print ("  \"untallied_elements\": %" G_GUINT64_FORMAT ",\n", stats->n_unnamed);
+  g_print ("  \"attributes\": %" G_GUINT64_FORMAT ",\n", stats->n_attributes);
+  g_print ("  \"text_nodes\": %" G_GUINT64_FORMAT ",\n", stats->n_text_nodes);
+  g_print ("  \"text_bytes\": %" G_GUINT64_FORMAT ",\n", stats->text_bytes);
+  g_print ("  \"mixed_elements\": %" G_GUINT64_FORMAT ",\n", stats->n_mixed);
+  g_print ("  \"max_depth\": %u,\n", stats->max_depth);
+  g_print ("  \"max_fanout\": %u,\n", stats->max_fanout);
+  g_print ("  \"max_attributes\": %u,\n", stats->max_attributes);
+  g_print ("  \"max_text\": %" G_GUINT64_FORMAT ",\n", stats->max_text);
+
+  print_json_array ("depth_histogram", stats->depths, MAX_DEPTH_BUCKETS);
+  print_json_array ("fanout_log2_histogram", stats->fanouts, N_LOG_BUCKETS);
+  print_json_array ("attributes_log2_histogram", stats->attributes, N_LOG_BUCKETS);
+  print_json_array ("text_size_log2_histogram", stats->text_sizes, N_LOG_BUCKETS);
+
+  suggestions = build_suggestions (stats);
+
+  g_print ("  \"suggestions\": [");
+  for (i = 0; i < suggestions->len; i++)
+    {
+      g_print ("%s\n    ", i > 0 ? "," : "");
+      print_json_string (g_ptr_array_index (suggestions, i));
+    }
+  g_print ("%s]\n}\n", suggestions->len > 0 ? "\n  " : "");
+
+  g_ptr_array_free (suggestions, TRUE);
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+  GOptionContext *context;
+  GError *error = NULL;
+  gint i, retval = EXIT_SUCCESS;
+
+  context = g_option_context_new ("FILE... - profile the shape of XML documents");
+  g_option_context_set_summary (context,
+                                "Computes the depth, fanout, name, attribute and text\n"
+                                "statistics of XML documents in a single streaming pass.");
+  g_option_context_add_main_entries (context, entries, NULL);
+
+  if (!g_option_context_parse (context, &argc, &argv, &error))
+    {
+      g_printerr ("%s: %s\n", g_get_prgname (), error->message);
+      return EXIT_FAILURE;
+    }
+
+  g_option_context_free (context);
+
+  if (argc < 2 || max_names <= 0)
+    {
+      g_printerr ("Usage: %s [--json] [--max-names=N] FILE...\n",
+                  g_get_prgname ());
+      return EXIT_FAILURE;
+    }
+
+  LIBXML_TEST_VERSION;
+
+  for (i = 1; i < argc; i++)
+    {
+      DocumentStats stats;
+
+      memset (&stats, 0, sizeof (DocumentStats));
+      stats.names = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                           g_free,
+                                           name_stats_free);
+
+      if (!collect_stats (argv[i], &stats, &error))
+        {
+          g_printerr ("%s: %s\n", g_get_prgname (), error->message);
+          g_clear_error (&error);
+          retval = EXIT_FAILURE;
+        }
+      else if (json_output)
+        print_json (argv[i], &stats);
+      else
+        print_text (argv[i], &stats);
+
+      g_hash_table_destroy (stats.names);
+    }
+
+  return retval;
+}
@@ -0,0 +1,161 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include <xml-reader/xml-reader.h>
+#include <xml-reader/xml-reader-arrow.h>
+
+static const gchar *xml_catalog_test =
+"<?xml version=\"1.0\"?>"
+"<catalog>"
+  "<item id=\"1\" stock=\"true\"><title>Ham</title><price>2.5</price></item>"
+  "<item id=\"2\" stock=\"false\"><title>Eggs</title></item>"
+  "<item id=\"3\"><title>Spam</title><price>3</price></item>"
+"</catalog>";
+
+static const XmlReaderField catalog_fields[] = {
+  { "id", "@id", XML_READER_COLUMN_INT64 },
+  { "title", "title", XML_READER_COLUMN_STRING },
+  { "price", "price", XML_READER_COLUMN_DOUBLE },
+  { "stock", "@stock", XML_READER_COLUMN_BOOLEAN },
+};
+
+/* A minimal consumer of the Arrow C data interface, relying only on
+ * the ABI: it prints row @row of the array the way a generic reader
+ * would, from the format strings and the raw buffers.
+ */
+static gboolean
+arrow_get_bit (const void *bitmap,
+               gint64      index_)
+{
+  const guint8 *bytes = bitmap;
+
+  return (bytes[index_ / 8] >> (index_ % 8)) & 1;
+}
+
+static gchar *
+arrow_format_value (const struct ArrowSchema *schema,
+                    const struct ArrowArray  *array,
+                    gint64                    row)
+{
+  gint64 i = array->offset + row;
+
+  if (array->null_count > 0 &&
+      array->buffers[0] != NULL &&
+      !arrow_get_bit (array->buffers[0], i))
+    return g_strdup ("null");
+
+  if (strcmp (schema->format, "l") == 0)
+    return g_strdup_printf ("%" G_GINT64_FORMAT,
+                            ((const gint64 *) array->buffers[1])[i]);
+
+  if (strcmp (schema->format, "g") == 0)
+    return g_strdup_printf ("%g", ((const gdouble *) array->buffers[1])[i]);
+
+  if (strcmp (schema->format, "b") == 0)
+    return g_strdup (arrow_get_bit (array->buffers[1], i) ? "true" : "false");
+
+  if (strcmp (schema->format, "u") == 0)
+    {
+      const gint32 *offsets = array->buffers[1];
+      const gchar *data = array->buffers[2];
+
+      return g_strndup (data + offsets[i], offsets[i + 1] - offsets[i]);
+    }
+
+  return NULL;
+}
+
+static gchar *
+arrow_format_row (const struct ArrowSchema *schema,
+                  const struct ArrowArray  *array,
+                  gint64                    row)
+{
+  GString *buffer = g_string_new (NULL);
+  gint64 i;
+
+  g_assert_cmpstr (schema->format, ==, "+s");
+  g_assert_cmpint (schema->n_children, ==, array->n_children);
+
+  for (i = 0; i < schema->n_children; i++)
+    {
+      gchar *value = arrow_format_value (schema->children[i],
+                                         array->children[i],
+                                         row);
+
+      g_string_append_printf (buffer, "%s%s=%s",
+                              i > 0 ? " " : "",
+                              schema->children[i]->name,
+                              value);
+      g_free (value);
+    }
+
+  return g_string_free (buffer, FALSE);
+}
+
+static void
+test_export (void)
+{
+  static const gchar *expected_rows[] = {
+    "id=1 title=Ham price=2.5 stock=true",
+    "id=2 title=Eggs price=null stock=false",
+    "id=3 title=Spam price=3 stock=null",
+  };
+  XmlReader *reader = xml_reader_new ();
+  struct ArrowSchema schema;
+  struct ArrowArray array;
+  GError *error = NULL;
+  gint64 i;
+
+  g_assert (xml_reader_load_from_data (reader, xml_catalog_test, NULL) != FALSE);
+  g_assert (xml_reader_export_arrow (reader, "catalog/item",
+                                     catalog_fields,
+                                     G_N_ELEMENTS (catalog_fields),
+                                     1,
+                                     &schema, &array,
+                                     &error) != FALSE);
+  g_assert (error == NULL);
+
+  /* the data does not depend on the reader any more */
+  g_object_unref (reader);
+
+  g_assert_cmpint (array.length, ==, G_N_ELEMENTS (expected_rows));
+  g_assert_cmpint (array.children[2]->null_count, ==, 1);
+  g_assert (array.children[1]->buffers[0] == NULL);
+
+  for (i = 0; i < array.length; i++)
+    {
+      gchar *row = arrow_format_row (&schema, &array, i);
+
+      g_assert_cmpstr (row, ==, expected_rows[i]);
+      g_free (row);
+    }
+
+  /* consumers may move a child out and release it on its own */
+  array.children[0]->release (array.children[0]);
+  g_assert (array.children[0]->release == NULL);
+
+  array.release (&array);
+  schema.release (&schema);
+
+  g_assert (array.release == NULL);
+  g_assert (schema.release == NULL);
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+  g_type_init ();
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/arrow/export", test_export);
+
+  return g_test_run ();
+}
@@ -0,0 +1,246 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include <xml-reader/xml-reader.h>
+#include <xml-reader/xml-reader-columns.h>
+
+static const gchar *xml_catalog_test =
+"<?xml version=\"1.0\"?>"
+"<catalog>"
+  "<item id=\"1\" stock=\"true\"><title>Ham</title><price currency=\"EUR\">2.5</price></item>"
+  "<item id=\"2\" stock=\"0\"><title>Eggs &amp; Spam</title></item>"
+  "<item id=\"x\"><title/><price currency=\"USD\">3</price></item>"
+  "<item id=\"99999999999999999999\" stock=\"1\"><price>1e999</price></item>"
+"</catalog>";
+
+static const XmlReaderField catalog_fields[] = {
+  { "id", "@id", XML_READER_COLUMN_INT64 },
+  { "title", "title", XML_READER_COLUMN_STRING },
+  { "price", "price", XML_READER_COLUMN_DOUBLE },
+  { "currency", "price/@currency", XML_READER_COLUMN_STRING },
+  { "stock", "./@stock", XML_READER_COLUMN_BOOLEAN },
+};
+
+static gchar *
+column_get_string (const XmlReaderColumn *column,
+                   guint                  row)
+{
+  return g_strndup (column->data + column->offsets[row],
+                    column->offsets[row + 1] - column->offsets[row]);
+}
+
+static void
+test_extract (void)
+{
+  XmlReader *reader = xml_reader_new ();
+  XmlReaderColumn *columns;
+  GError *error = NULL;
+  gchar *str;
+
+  g_assert (xml_reader_load_from_data (reader, xml_catalog_test, NULL) != FALSE);
+
+  columns = xml_reader_extract_columns (reader, "catalog/item",
+                                        catalog_fields,
+                                        G_N_ELEMENTS (catalog_fields),
+                                        1,
+                                        &error);
+  g_assert (columns != NULL);
+  g_assert (error == NULL);
+
+  g_assert_cmpstr (columns[0].name, ==, "id");
+  g_assert_cmpint (columns[0].n_rows, ==, 4);
+  g_assert_cmpint (columns[0].n_nulls, ==, 2);
+  g_assert_cmpint (columns[0].int64_values[0], ==, 1);
+  g_assert_cmpint (columns[0].int64_values[1], ==, 2);
+  g_assert_cmpint (XML_READER_COLUMN_IS_VALID (&columns[0], 2), ==, FALSE);
+
+  /* out of range numbers are nulls, not saturated values */
+  g_assert_cmpint (XML_READER_COLUMN_IS_VALID (&columns[0], 3), ==, FALSE);
+
+  g_assert_cmpint (columns[1].n_nulls, ==, 1);
+  str = column_get_string (&columns[1], 1);
+  g_assert_cmpstr (str, ==, "Eggs & Spam");
+  g_free (str);
+  g_assert_cmpint (columns[1].offsets[3] - columns[1].offsets[2], ==, 0);
+
+  g_assert_cmpint (columns[2].n_nulls, ==, 2);
+  g_assert_cmpfloat (columns[2].double_values[0], ==, 2.5);
+  g_assert_cmpint (XML_READER_COLUMN_IS_VALID (&columns[2], 1), ==, FALSE);
+  g_assert_cmpfloat (columns[2].double_values[2], ==, 3.0);
+  g_assert_cmpint (XML_READER_COLUMN_IS_VALID (&columns[2], 3), ==, FALSE);
+
+  str = column_get_string (&columns[3], 2);
+  g_assert_cmpstr (str, ==, "USD");
+  g_free (str);
+
+  g_assert_cmpint (columns[4].n_nulls, ==, 1);
+  g_assert_cmpint (XML_READER_COLUMN_GET_BOOLEAN (&columns[4], 0), ==, TRUE);
+  g_assert_cmpint (XML_READER_COLUMN_GET_BOOLEAN (&columns[4], 1), ==, FALSE);
+  g_assert_cmpint (XML_READER_COLUMN_IS_VALID (&columns[4], 1), ==, TRUE);
+
+  xml_reader_columns_free (columns, G_N_ELEMENTS (catalog_fields));
+  g_object_unref (reader);
+}
+
+static void
+test_extract_prefixed (void)
+{
+  static const XmlReaderField fields[] = {
+    { "title", "dc:title", XML_READER_COLUMN_STRING },
+    { "lang", "dc:title/@xml:lang", XML_READER_COLUMN_STRING },
+  };
+  XmlReader *reader = xml_reader_new ();
+  XmlReaderColumn *columns;
+  gchar *str;
+
+  g_assert (xml_reader_load_from_data (reader,
+                                       "<r xmlns:dc=\"http://purl.org/dc/elements/1.1/\">"
+                                       "<i><dc:title xml:lang=\"en\">Ham</dc:title></i>"
+                                       "</r>",
+                                       NULL) != FALSE);
+
+  columns = xml_reader_extract_columns (reader, "r/i", fields, 2, 1, NULL);
+  g_assert (columns != NULL);
+
+  str = column_get_string (&columns[0], 0);
+  g_assert_cmpstr (str, ==, "Ham");
+  g_free (str);
+
+  str = column_get_string (&columns[1], 0);
+  g_assert_cmpstr (str, ==, "en");
+  g_free (str);
+
+  xml_reader_columns_free (columns, 2);
+  g_object_unref (reader);
+}
+
+static void
+test_extract_threaded (void)
+{
+  static const XmlReaderField fields[] = {
+    { "n", "n", XML_READER_COLUMN_INT64 },
+    { "s", "@s", XML_READER_COLUMN_STRING },
+  };
+  XmlReader *reader = xml_reader_new ();
+  XmlReaderColumn *single, *threaded;
+  GString *buffer;
+  gint i, n_records = 20000;
+
+  buffer = g_string_new ("<rows>");
+  for (i = 0; i < n_records; i++)
+    {
+      if (i % 7 == 0)
+        g_string_append_printf (buffer, "<row s=\"%x\"/>", i);
+      else
+        g_string_append_printf (buffer, "<row s=\"%x\"><n>%d</n></row>", i, i);
+    }
+  g_string_append (buffer, "</rows>");
+
+  g_assert (xml_reader_load_from_data (reader, buffer->str, NULL) != FALSE);
+  g_assert (xml_reader_read_start_element (reader, "rows") != FALSE);
+
+  single = xml_reader_extract_columns (reader, "row", fields, 2, 1, NULL);
+  threaded = xml_reader_extract_columns (reader, "row", fields, 2, 4, NULL);
+
+  g_assert_cmpint (threaded[0].n_rows, ==, n_records);
+  g_assert_cmpint (threaded[0].n_nulls, ==, single[0].n_nulls);
+  g_assert (memcmp (single[0].validity, threaded[0].validity, (n_records + 7) / 8) == 0);
+  g_assert (memcmp (single[0].int64_values, threaded[0].int64_values,
+                    n_records * sizeof (gint64)) == 0);
+  g_assert (memcmp (single[1].offsets, threaded[1].offsets,
+                    (n_records + 1) * sizeof (gint32)) == 0);
+  g_assert (memcmp (single[1].data, threaded[1].data, single[1].offsets[n_records]) == 0);
+
+  xml_reader_columns_free (single, 2);
+  xml_reader_columns_free (threaded, 2);
+  g_string_free (buffer, TRUE);
+  g_object_unref (reader);
+}
+
+static void
+test_extract_bounded (void)
+{
+  static const XmlReaderField fields[] = {
+    { "n", "n", XML_READER_COLUMN_INT64 },
+    { "label", "@label", XML_READER_COLUMN_STRING },
+    { "even", "@even", XML_READER_COLUMN_BOOLEAN },
+  };
+  XmlReader *reader = xml_reader_new ();
+  XmlReaderColumn *columns;
+  XmlReaderStatistics stats;
+  GError *error = NULL;
+  GString *buffer;
+  gint i, n_records = 20000;
+
+  buffer = g_string_new ("<rows>");
+  for (i = 0; i < n_records; i++)
+    {
+      if (i % 7 == 0)
+        g_string_append (buffer, "<skipped/>");
+
+      g_string_append_printf (buffer, "<row label=\"r%d\" even=\"%d\"><n>%d</n></row>",
+                              i, i % 2 == 0, i);
+    }
+  g_string_append (buffer, "</rows>");
+
+  /* the records get extracted by batches, and released */
+  xml_reader_set_bounded_memory (reader, 2, 256 * 1024);
+  g_assert (xml_reader_load_from_data (reader, buffer->str, NULL) != FALSE);
+
+  columns = xml_reader_extract_columns (reader, "rows/row", fields, 3, 1, &error);
+  g_assert_no_error (error);
+  g_assert_cmpint (columns[0].n_rows, ==, n_records);
+  g_assert_cmpint (columns[0].n_nulls, ==, 0);
+
+  for (i = 0; i < n_records; i++)
+    {
+      gchar *label = g_strdup_printf ("r%d", i);
+
+      g_assert_cmpint (columns[0].int64_values[i], ==, i);
+      g_assert_cmpint (columns[1].offsets[i + 1] - columns[1].offsets[i], ==, strlen (label));
+      g_assert (memcmp (columns[1].data + columns[1].offsets[i], label, strlen (label)) == 0);
+      g_assert_cmpint (XML_READER_COLUMN_GET_BOOLEAN (&columns[2], i), ==, i % 2 == 0);
+
+      g_free (label);
+    }
+
+  xml_reader_columns_free (columns, 3);
+
+  xml_reader_get_statistics (reader, &stats);
+  g_assert_cmpint (stats.n_released, >=, n_records);
+  g_assert_cmpint (stats.tree_memory_peak, <=, 256 * 1024);
+
+  /* the records kept may take more memory than allowed */
+  xml_reader_set_bounded_memory (reader, 3, 256 * 1024);
+  g_assert (xml_reader_load_from_data (reader, buffer->str, NULL) != FALSE);
+
+  columns = xml_reader_extract_columns (reader, "rows/row", fields, 3, 1, &error);
+  g_assert (columns == NULL);
+  g_assert_error (error, XML_READER_ERROR, XML_READER_ERROR_MEMORY_LIMIT);
+  g_clear_error (&error);
+
+  g_string_free (buffer, TRUE);
+  g_object_unref (reader);
+}
+
+int
+main (int   argc,
+      char *argv[])
+{
+  g_type_init ();
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/columns/extract", test_extract);
+  g_test_add_func ("/columns/prefixed", test_extract_prefixed);
+  g_test_add_func ("/columns/threaded", test_extract_threaded);
+  g_test_add_func ("/columns/bounded-memory", test_extract_bounded);
+
+  return g_test_run ();
+}
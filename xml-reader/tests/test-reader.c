@@ -4,10 +4,19 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
 
 #include <glib.h>
+#include <glib/gstdio.h>
 
 #include <xml-reader/xml-reader.h>
+#include <xml-reader/xml-reader-shard.h>
+
+#include "xml-reader-private.h"
 
 static const gchar *xml_simple_test =
 "<?xml version=\"1.0\"?>"
@@ -75,6 +84,247 @@ test_invalid_walk (void)
   g_object_unref (reader);
 }
 
+static void
+test_try_walk (void)
+{
+  XmlReader *reader = xml_reader_new ();
+
+  g_assert (xml_reader_load_from_data (reader, xml_simple_test, NULL) != FALSE);
+
+  g_assert (xml_reader_read_start_element (reader, "book-info") != FALSE);
+
+  /* the first miss scans the children, the second one hits the filter */
+  g_assert_cmpint (xml_reader_try_start_element (reader, "subtitle"), ==, FALSE);
+  g_assert_cmpint (xml_reader_try_start_element (reader, "subtitle"), ==, FALSE);
+  g_assert_cmpint (xml_reader_get_error (reader, NULL), ==, FALSE);
+  g_assert_cmpstr (xml_reader_get_element_name (reader), ==, "book-info");
+
+  g_assert (xml_reader_try_start_element (reader, "title") != FALSE);
+  g_assert_cmpstr (xml_reader_get_element_value (reader), ==, "An XML Test");
+  xml_reader_read_end_element (reader);
+
+  g_assert (xml_reader_read_start_element (reader, "author") != FALSE);
+  g_assert_cmpstr (xml_reader_get_element_value (reader), ==, "Doe, John");
+  xml_reader_read_end_element (reader);
+
+  g_assert_cmpint (xml_reader_read_start_element (reader, "subtitle"), ==, FALSE);
+  g_assert_cmpint (xml_reader_get_error (reader, NULL), ==, TRUE);
+  xml_reader_read_end_element (reader);
+
+  g_assert_cmpstr (xml_reader_get_element_name (reader), ==, "book-info");
+
+  g_object_unref (reader);
+}
+
+static void
+test_wide_walk (void)
+{
+  XmlReader *reader = xml_reader_new ();
+  GString *buffer;
+  gint i;
+
+  buffer = g_string_new ("<?xml version=\"1.0\"?><items>");
+  for (i = 0; i < 40; i++)
+    g_string_append_printf (buffer, "<item-%d>%d</item-%d>", i, i, i);
+  g_string_append (buffer, "</items>");
+
+  g_assert (xml_reader_load_from_data (reader, buffer->str, NULL) != FALSE);
+  g_assert (xml_reader_read_start_element (reader, "items") != FALSE);
+
+  for (i = 39; i >= 0; i--)
+    {
+      gchar *name = g_strdup_printf ("item-%d", i);
+      gchar *value = g_strdup_printf ("%d", i);
+
+      g_assert (xml_reader_read_start_element (reader, name) != FALSE);
+      g_assert_cmpstr (xml_reader_get_element_value (reader), ==, value);
+      xml_reader_read_end_element (reader);
+
+      g_free (value);
+      g_free (name);
+    }
+
+  g_assert_cmpint (xml_reader_try_start_element (reader, "item-40"), ==, FALSE);
+  g_assert_cmpstr (xml_reader_get_element_name (reader), ==, "items");
+
+  g_string_free (buffer, TRUE);
+  g_object_unref (reader);
+}
+
+static void
+test_positional (void)
+{
+  XmlReader *reader = xml_reader_new ();
+
+  g_assert (xml_reader_load_from_data (reader, xml_attr_test, NULL) != FALSE);
+
+  g_assert_cmpint (xml_reader_count_elements (reader, NULL), ==, 1);
+  g_assert (xml_reader_read_nth_element (reader, "book-info", 0) != FALSE);
+
+  g_assert_cmpint (xml_reader_count_elements (reader, NULL), ==, 2);
+  g_assert_cmpint (xml_reader_count_elements (reader, "author"), ==, 2);
+  g_assert_cmpint (xml_reader_count_elements (reader, "title"), ==, 0);
+
+  g_assert (xml_reader_read_nth_element (reader, "author", 1) != FALSE);
+  g_assert_cmpstr (xml_reader_get_element_value (reader), ==, "Q. John");
+  xml_reader_read_end_element (reader);
+
+  g_assert (xml_reader_read_nth_element (reader, NULL, 0) != FALSE);
+  g_assert_cmpstr (xml_reader_get_element_value (reader), ==, "Doe, John");
+  xml_reader_read_end_element (reader);
+
+  g_assert_cmpint (xml_reader_read_nth_element (reader, "author", 2), ==, FALSE);
+  g_assert_cmpint (xml_reader_get_error (reader, NULL), ==, TRUE);
+  xml_reader_read_end_element (reader);
+  g_assert_cmpstr (xml_reader_get_element_name (reader), ==, "book-info");
+
+  g_object_unref (reader);
+
+  /* nothing loaded yet */
+  reader = xml_reader_new ();
+  g_assert_cmpint (xml_reader_count_elements (reader, NULL), ==, -1);
+  g_assert_cmpint (xml_reader_read_nth_element (reader, NULL, 0), ==, FALSE);
+  g_object_unref (reader);
+}
+
+static void
+test_document_order (void)
+{
+  static const gchar *expected_names[] = {
+    "book-info", "author", "author"
+  };
+  static const gint expected_depths[] = { 1, 2, 2 };
+  XmlReader *reader = xml_reader_new ();
+  gint i;
+
+  g_assert (xml_reader_load_from_data (reader, xml_attr_test, NULL) != FALSE);
+
+  for (i = 0; xml_reader_read_next_in_document (reader); i++)
+    {
+      g_assert_cmpint (i, <, G_N_ELEMENTS (expected_names));
+      g_assert_cmpstr (xml_reader_get_element_name (reader), ==, expected_names[i]);
+      g_assert_cmpint (xml_reader_get_depth (reader), ==, expected_depths[i]);
+    }
+
+  g_assert_cmpint (i, ==, G_N_ELEMENTS (expected_names));
+  g_assert_cmpint (xml_reader_get_depth (reader), ==, 0);
+
+  /* entering an element and leaving it keeps the walk going */
+  g_assert (xml_reader_read_next_in_document (reader) != FALSE);
+  g_assert (xml_reader_read_start_element (reader, "author") != FALSE);
+  g_assert_cmpint (xml_reader_read_attribute_name (reader, "role"), ==, TRUE);
+  g_assert_cmpstr (xml_reader_get_attribute_value (reader), ==, "primary");
+  g_assert (xml_reader_read_next_in_document (reader) != FALSE);
+  g_assert_cmpstr (xml_reader_get_element_value (reader), ==, "Q. John");
+  xml_reader_read_end_element (reader);
+  g_assert_cmpstr (xml_reader_get_element_name (reader), ==, "book-info");
+  g_assert_cmpint (xml_reader_get_depth (reader), ==, 1);
+
+  g_object_unref (reader);
+}
+
+typedef struct {
+  GString *trace;
+  const gchar *skip;
+  const gchar *stop;
+} WalkData;
+
+static XmlReaderVisitResult
+walk_enter (XmlReader   *reader,
+            const gchar *element_name,
+            gpointer     user_data)
+{
+  WalkData *data = user_data;
+
+  g_string_append_printf (data->trace, "<%s:%d", element_name,
+                          xml_reader_get_depth (reader));
+
+  if (g_strcmp0 (element_name, data->stop) == 0)
+    return XML_READER_VISIT_STOP;
+
+  if (g_strcmp0 (element_name, data->skip) == 0)
+    return XML_READER_VISIT_SKIP_SUBTREE;
+
+  return XML_READER_VISIT_CONTINUE;
+}
+
+static XmlReaderVisitResult
+walk_attribute (XmlReader   *reader,
+                const gchar *attribute_name,
+                const gchar *attribute_value,
+                gpointer     user_data)
+{
+  WalkData *data = user_data;
+
+  g_string_append_printf (data->trace, " %s=%s", attribute_name, attribute_value);
+
+  return XML_READER_VISIT_CONTINUE;
+}
+
+static XmlReaderVisitResult
+walk_text (XmlReader   *reader,
+           const gchar *text,
+           gpointer     user_data)
+{
+  WalkData *data = user_data;
+
+  g_string_append_printf (data->trace, "[%s]", text);
+
+  return XML_READER_VISIT_CONTINUE;
+}
+
+static XmlReaderVisitResult
+walk_leave (XmlReader   *reader,
+            const gchar *element_name,
+            gpointer     user_data)
+{
+  WalkData *data = user_data;
+
+  g_string_append_printf (data->trace, "%s>", element_name);
+
+  return XML_READER_VISIT_CONTINUE;
+}
+
+static void
+test_visitor (void)
+{
+  static const XmlReaderVisitor visitor = {
+    walk_enter, walk_attribute, walk_text, walk_leave
+  };
+  XmlReader *reader = xml_reader_new ();
+  WalkData data = { NULL, NULL, NULL };
+
+  g_assert (xml_reader_load_from_data (reader, xml_attr_test, NULL) != FALSE);
+
+  data.trace = g_string_new (NULL);
+  g_assert (xml_reader_walk (reader, &visitor, &data) != FALSE);
+  g_assert_cmpstr (data.trace->str, ==,
+                   "<book-info:1"
+                   "<author:2 role=primary[Doe, John]author>"
+                   "<author:2 role=secondary[Q. John]author>"
+                   "book-info>");
+
+  /* skipping an element still leaves it */
+  data.skip = "author";
+  g_string_truncate (data.trace, 0);
+  g_assert (xml_reader_walk (reader, &visitor, &data) != FALSE);
+  g_assert_cmpstr (data.trace->str, ==,
+                   "<book-info:1<author:2author><author:2author>book-info>");
+
+  /* walking from the cursor, which is restored afterwards */
+  g_assert (xml_reader_read_start_element (reader, "book-info") != FALSE);
+  data.skip = NULL;
+  data.stop = "author";
+  g_string_truncate (data.trace, 0);
+  g_assert (xml_reader_walk (reader, &visitor, &data) == FALSE);
+  g_assert_cmpstr (data.trace->str, ==, "<book-info:1<author:2");
+  g_assert_cmpstr (xml_reader_get_element_name (reader), ==, "book-info");
+  g_assert_cmpint (xml_reader_get_depth (reader), ==, 1);
+
+  g_string_free (data.trace, TRUE);
+  g_object_unref (reader);
+}
+
 static void
 test_attributes (void)
 {
@@ -99,16 +349,1749 @@ test_attributes (void)
   g_object_unref (reader);
 }
 
-int
-main (int   argc,
-      char *argv[])
+static void
+test_adaptive (void)
 {
-  g_type_init ();
-  g_test_init (&argc, &argv, NULL);
+  XmlReader *reader = xml_reader_new ();
+  XmlReaderStatistics stats;
+  GString *buffer;
+  gchar *report;
+  gint i, round;
 
-  g_test_add_func ("/xml-reader/walk", test_walk);
-  g_test_add_func ("/xml-reader/invalid", test_invalid_walk);
-  g_test_add_func ("/xml-reader/attributes", test_attributes);
+  buffer = g_string_new ("<?xml version=\"1.0\"?><items>");
+  for (i = 0; i < 100; i++)
+    g_string_append_printf (buffer, "<item-%d>%d</item-%d>", i, i, i);
+  g_string_append (buffer, "</items>");
+
+  for (round = 0; round < 2; round++)
+    {
+      /* a budget that fits no index at all in the second round */
+      xml_reader_set_adaptive_indexing (reader, TRUE, round == 0 ? 0 : 16);
+
+      g_assert (xml_reader_load_from_data (reader, buffer->str, NULL) != FALSE);
+      g_assert (xml_reader_read_start_element (reader, "items") != FALSE);
+
+      for (i = 99; i >= 0; i--)
+        {
+          gchar *name = g_strdup_printf ("item-%d", i);
+          gchar *value = g_strdup_printf ("%d", i);
+
+          g_assert (xml_reader_read_start_element (reader, name) != FALSE);
+          g_assert_cmpstr (xml_reader_get_element_value (reader), ==, value);
+          xml_reader_read_end_element (reader);
+
+          g_free (value);
+          g_free (name);
+        }
+
+      for (i = 0; i < 4; i++)
+        g_assert_cmpint (xml_reader_try_start_element (reader, "item-100"), ==, FALSE);
+
+      xml_reader_get_statistics (reader, &stats);
+      g_assert_cmpint (stats.n_lookups, ==, 104);
+      g_assert_cmpint (stats.n_misses, ==, 4);
+
+      report = xml_reader_get_index_report (reader);
+
+      if (round == 0)
+        {
+          g_assert_cmpint (stats.n_child_arrays, ==, 1);
+          g_assert_cmpint (stats.n_name_maps, ==, 1);
+          g_assert_cmpint (stats.n_filters, ==, 1);
+          g_assert_cmpint (stats.n_declined, ==, 0);
+          g_assert (stats.index_memory > 0);
+          g_assert (strstr (report, "/items: packed 100 children") != NULL);
+        }
+      else
+        {
+          g_assert_cmpint (stats.n_child_arrays, ==, 0);
+          g_assert_cmpint (stats.n_filters, ==, 0);
+          g_assert_cmpint (stats.n_declined, ==, 2);
+          g_assert (strstr (report, "over the memory budget") != NULL);
+        }
+
+      g_free (report);
+    }
+
+  g_string_free (buffer, TRUE);
+  g_object_unref (reader);
+}
+
+static void
+test_succinct (void)
+{
+  XmlReader *reader = xml_reader_new ();
+  XmlReader *succinct = xml_reader_new ();
+  GString *buffer;
+  gint i, j;
+
+  /* sections large enough for sibling skips to cross several chunks */
+  buffer = g_string_new ("<?xml version=\"1.0\" encoding=\"UTF-8\"?>"
+                         "<!-- catalog --><catalog xmlns:x=\"urn:x\">");
+  for (i = 0; i < 3; i++)
+    {
+      g_string_append_printf (buffer, "<section id=\"s%d\">", i);
+      for (j = 0; j < 8000 * (i + 1); j++)
+        g_string_append_printf (buffer,
+                                "<x:item n=\"%d\" label='a&amp;b'>%d &lt; %d"
+                                "<sub/></x:item>",
+                                j, j, j + 1);
+      g_string_append (buffer, "<![CDATA[ignored]]></section>");
+    }
+  g_string_append (buffer, "<tail>end</tail></catalog>");
+
+  xml_reader_set_succinct (succinct, TRUE);
+
+  g_assert (xml_reader_load_from_data (reader, buffer->str, NULL) != FALSE);
+  g_assert (xml_reader_load_from_data (succinct, buffer->str, NULL) != FALSE);
+
+  while (xml_reader_read_next_in_document (reader))
+    {
+      g_assert (xml_reader_read_next_in_document (succinct) != FALSE);
+
+      g_assert_cmpint (xml_reader_get_depth (succinct), ==, xml_reader_get_depth (reader));
+      g_assert_cmpstr (xml_reader_get_element_name (succinct), ==, xml_reader_get_element_name (reader));
+      g_assert_cmpstr (xml_reader_get_element_value (succinct), ==, xml_reader_get_element_value (reader));
+      g_assert_cmpint (xml_reader_count_attributes (succinct), ==, xml_reader_count_attributes (reader));
+
+      for (i = 0; i < xml_reader_count_attributes (reader); i++)
+        {
+          g_assert (xml_reader_read_attribute_pos (reader, i) != FALSE);
+          g_assert (xml_reader_read_attribute_pos (succinct, i) != FALSE);
+          g_assert_cmpstr (xml_reader_get_attribute_value (succinct), ==, xml_reader_get_attribute_value (reader));
+        }
+    }
+
+  g_assert_cmpint (xml_reader_read_next_in_document (succinct), ==, FALSE);
+  g_assert_cmpint (xml_reader_get_depth (succinct), ==, 0);
+
+  g_assert (xml_reader_read_start_element (succinct, "catalog") != FALSE);
+  g_assert_cmpint (xml_reader_count_elements (succinct, "section"), ==, 3);
+  g_assert_cmpint (xml_reader_count_elements (succinct, NULL), ==, 4);
+
+  g_assert (xml_reader_read_start_element (succinct, "tail") != FALSE);
+  g_assert_cmpstr (xml_reader_get_element_value (succinct), ==, "end");
+  xml_reader_read_end_element (succinct);
+
+  g_assert (xml_reader_read_nth_element (succinct, "section", 2) != FALSE);
+  g_assert (xml_reader_read_attribute_name (succinct, "id") != FALSE);
+  g_assert_cmpstr (xml_reader_get_attribute_value (succinct), ==, "s2");
+  g_assert_cmpint (xml_reader_count_elements (succinct, "item"), ==, 24000);
+
+  g_assert (xml_reader_read_nth_element (succinct, "item", 23999) != FALSE);
+  g_assert_cmpstr (xml_reader_get_element_value (succinct), ==, "23999 < 24000");
+  g_assert (xml_reader_read_attribute_name (succinct, "label") != FALSE);
+  g_assert_cmpstr (xml_reader_get_attribute_value (succinct), ==, "a&b");
+  xml_reader_read_end_element (succinct);
+
+  g_assert_cmpint (xml_reader_read_start_element (succinct, "missing"), ==, FALSE);
+  g_assert_cmpint (xml_reader_get_error (succinct, NULL), ==, TRUE);
+  xml_reader_read_end_element (succinct);
+  g_assert_cmpstr (xml_reader_get_element_name (succinct), ==, "section");
+  g_assert_cmpint (xml_reader_try_start_element (succinct, "tail"), ==, FALSE);
+
+  g_assert_cmpint (xml_reader_load_from_data (succinct, "<a><b></a>", NULL), ==, FALSE);
+
+  g_string_free (buffer, TRUE);
+  g_object_unref (succinct);
+  g_object_unref (reader);
+}
+
+static void
+test_dedup (void)
+{
+  XmlReader *reader = xml_reader_new ();
+  XmlReaderStatistics stats;
+  const gchar *first;
+  GString *buffer;
+  gint i;
+
+  buffer = g_string_new ("<?xml version=\"1.0\"?><orders>");
+  for (i = 0; i < 100; i++)
+    g_string_append_printf (buffer,
+                            "<order status=\"shipped-to-customer-%d\">"
+                            "<currency>EUR-european-currency</currency>"
+                            "<id>order-reference-number-%d</id></order>",
+                            i % 2, i);
+  g_string_append (buffer, "</orders>");
+
+  xml_reader_set_deduplication (reader, TRUE, 0);
+  g_assert (xml_reader_load_from_data (reader, buffer->str, NULL) != FALSE);
+
+  xml_reader_get_statistics (reader, &stats);
+  g_assert_cmpint (stats.n_dedup_values, ==, 300);
+  g_assert_cmpint (stats.n_dedup_unique, ==, 103);
+  g_assert (stats.dedup_bytes_saved > 0);
+  g_assert (stats.dedup_ratio > 0.6);
+
+  g_assert (xml_reader_read_start_element (reader, "orders") != FALSE);
+
+  g_assert (xml_reader_read_nth_element (reader, "order", 0) != FALSE);
+  g_assert (xml_reader_read_start_element (reader, "currency") != FALSE);
+  first = xml_reader_get_element_value (reader);
+  g_assert_cmpstr (first, ==, "EUR-european-currency");
+  xml_reader_read_end_element (reader);
+  xml_reader_read_end_element (reader);
+
+  g_assert (xml_reader_read_nth_element (reader, "order", 99) != FALSE);
+  g_assert (xml_reader_read_attribute_name (reader, "status") != FALSE);
+  g_assert_cmpstr (xml_reader_get_attribute_value (reader), ==, "shipped-to-customer-1");
+  g_assert (xml_reader_read_start_element (reader, "currency") != FALSE);
+  g_assert (xml_reader_get_element_value (reader) == first);
+  xml_reader_read_end_element (reader);
+  g_assert (xml_reader_read_start_element (reader, "id") != FALSE);
+  g_assert_cmpstr (xml_reader_get_element_value (reader), ==, "order-reference-number-99");
+  xml_reader_read_end_element (reader);
+  xml_reader_read_end_element (reader);
+
+  /* values longer than the limit are left alone */
+  xml_reader_set_deduplication (reader, TRUE, 4);
+  g_assert (xml_reader_load_from_data (reader, buffer->str, NULL) != FALSE);
+  xml_reader_get_statistics (reader, &stats);
+  g_assert_cmpint (stats.n_dedup_values, ==, 0);
+
+  g_string_free (buffer, TRUE);
+  g_object_unref (reader);
+}
+
+static void
+test_out_of_core (void)
+{
+  XmlReader *reader = xml_reader_new ();
+  XmlReader *stored = xml_reader_new ();
+  GError *error = NULL;
+  GString *buffer;
+  gchar *filename;
+  gint i, pass;
+
+  buffer = g_string_new ("<?xml version=\"1.0\"?><log>");
+  for (i = 0; i < 50000; i++)
+    g_string_append_printf (buffer, "<entry level=\"%d\"><msg>%d</msg></entry>",
+                            i % 3, i);
+  g_string_append (buffer, "</log>");
+
+  filename = g_build_filename (g_get_tmp_dir (), "test-out-of-core.xml", NULL);
+  g_assert (g_file_set_contents (filename, buffer->str, buffer->len, NULL) != FALSE);
+
+  g_assert (xml_reader_load_from_data (reader, buffer->str, NULL) != FALSE);
+
+  xml_reader_set_out_of_core (stored, TRUE, NULL);
+  xml_reader_set_access_pattern (stored, XML_READER_ACCESS_SEQUENTIAL);
+
+  for (pass = 0; pass < 2; pass++)
+    {
+      if (pass == 0)
+        g_assert (xml_reader_load_from_data (stored, buffer->str, NULL) != FALSE);
+      else
+        g_assert (xml_reader_load_from_file (stored, filename, NULL) != FALSE);
+
+      while (xml_reader_read_next_in_document (reader))
+        {
+          g_assert (xml_reader_read_next_in_document (stored) != FALSE);
+          g_assert_cmpint (xml_reader_get_depth (stored), ==, xml_reader_get_depth (reader));
+          g_assert_cmpstr (xml_reader_get_element_name (stored), ==, xml_reader_get_element_name (reader));
+          g_assert_cmpstr (xml_reader_get_element_value (stored), ==, xml_reader_get_element_value (reader));
+        }
+
+      g_assert_cmpint (xml_reader_read_next_in_document (stored), ==, FALSE);
+    }
+
+  xml_reader_set_access_pattern (stored, XML_READER_ACCESS_RANDOM);
+  g_assert (xml_reader_read_start_element (stored, "log") != FALSE);
+  g_assert (xml_reader_read_nth_element (stored, "entry", 49999) != FALSE);
+  g_assert (xml_reader_read_attribute_name (stored, "level") != FALSE);
+  g_assert_cmpstr (xml_reader_get_attribute_value (stored), ==, "1");
+
+  xml_reader_set_out_of_core (stored, TRUE, "/nonexistent/directory");
+  g_assert_cmpint (xml_reader_load_from_data (stored, buffer->str, &error), ==, FALSE);
+  g_assert_error (error, XML_READER_ERROR, XML_READER_ERROR_INVALID);
+  g_error_free (error);
+
+  g_unlink (filename);
+  g_free (filename);
+  g_string_free (buffer, TRUE);
+  g_object_unref (stored);
+  g_object_unref (reader);
+}
+
+static const gchar *xml_raw_test =
+"<?xml version=\"1.0\"?>\n"
+"<feed>\n"
+"  <item id=\"a&gt;b\" note='x > y'><title>One &amp; two</title><!-- <skip> --><empty/></item>\n"
+"  <item id=\"2\" ><![CDATA[<raw>]]><empty /></item >\n"
+"</feed>\n";
+
+static void
+assert_xml (const gchar *xml,
+            gsize        length,
+            const gchar *expected)
+{
+  g_assert (xml != NULL);
+  g_assert_cmpint (length, ==, strlen (expected));
+  g_assert (memcmp (xml, expected, length) == 0);
+}
+
+static void
+test_raw_xml (void)
+{
+  XmlReader *reader = xml_reader_new ();
+  const gchar *xml;
+  GBytes *bytes;
+  gsize length;
+  gint pass;
+
+  for (pass = 0; pass < 2; pass++)
+    {
+      xml_reader_set_keep_source (reader, pass == 0);
+      xml_reader_set_succinct (reader, pass == 1);
+
+      g_assert (xml_reader_load_from_data (reader, xml_raw_test, NULL) != FALSE);
+      g_assert (xml_reader_read_start_element (reader, "feed") != FALSE);
+
+      g_assert (xml_reader_read_nth_element (reader, "item", 0) != FALSE);
+      xml = xml_reader_get_outer_xml (reader, &length);
+      assert_xml (xml, length, "<item id=\"a&gt;b\" note='x > y'><title>One &amp; two</title><!-- <skip> --><empty/></item>");
+      xml = xml_reader_get_inner_xml (reader, &length);
+      assert_xml (xml, length, "<title>One &amp; two</title><!-- <skip> --><empty/>");
+
+      g_assert (xml_reader_read_start_element (reader, "empty") != FALSE);
+      xml = xml_reader_get_outer_xml (reader, &length);
+      assert_xml (xml, length, "<empty/>");
+      xml = xml_reader_get_inner_xml (reader, &length);
+      assert_xml (xml, length, "");
+      xml_reader_read_end_element (reader);
+      xml_reader_read_end_element (reader);
+
+      g_assert (xml_reader_read_nth_element (reader, "item", 1) != FALSE);
+      bytes = xml_reader_get_outer_xml_bytes (reader);
+      xml = g_bytes_get_data (bytes, &length);
+      assert_xml (xml, length, "<item id=\"2\" ><![CDATA[<raw>]]><empty /></item >");
+      g_bytes_unref (bytes);
+      bytes = xml_reader_get_inner_xml_bytes (reader);
+      xml = g_bytes_get_data (bytes, &length);
+      assert_xml (xml, length, "<![CDATA[<raw>]]><empty />");
+
+      /* the slice outlives the document */
+      g_assert (xml_reader_load_from_data (reader, xml_simple_test, NULL) != FALSE);
+      xml = g_bytes_get_data (bytes, &length);
+      assert_xml (xml, length, "<![CDATA[<raw>]]><empty />");
+      g_bytes_unref (bytes);
+    }
+
+  /* without the source the elements are serialized again */
+  xml_reader_set_keep_source (reader, FALSE);
+  xml_reader_set_succinct (reader, FALSE);
+
+  g_assert (xml_reader_load_from_data (reader, xml_raw_test, NULL) != FALSE);
+  g_assert (xml_reader_read_start_element (reader, "feed") != FALSE);
+  g_assert (xml_reader_read_nth_element (reader, "item", 0) != FALSE);
+  xml = xml_reader_get_inner_xml (reader, &length);
+  assert_xml (xml, length, "<title>One &amp; two</title><!-- <skip> --><empty/>");
+  g_assert (xml_reader_read_start_element (reader, "title") != FALSE);
+  xml = xml_reader_get_outer_xml (reader, &length);
+  assert_xml (xml, length, "<title>One &amp; two</title>");
+
+  g_object_unref (reader);
+}
+
+static gboolean
+is_slice_of (GBytes *bytes,
+             GBytes *source)
+{
+  const gchar *data = g_bytes_get_data (bytes, NULL);
+  gsize length;
+  const gchar *source_data = g_bytes_get_data (source, &length);
+
+  return data >= source_data && data < source_data + length;
+}
+
+static void
+test_bytes (void)
+{
+  static const gchar xml[] =
+    "<?xml version=\"1.0\"?>"
+    "<doc xmlns:x=\"urn:x\">"
+    "<item x:id=\"plain\" note=\"a &amp; b\">verbatim</item>"
+    "<item>escaped &lt;here&gt;</item>"
+    "</doc>";
+  XmlReader *reader = xml_reader_new ();
+  GBytes *source, *value;
+  gint pass;
+
+  /* not terminated */
+  source = g_bytes_new (xml, sizeof (xml) - 1);
+
+  for (pass = 0; pass < 2; pass++)
+    {
+      xml_reader_set_succinct (reader, pass == 1);
+
+      g_assert (xml_reader_load_from_bytes (reader, source, NULL) != FALSE);
+      g_assert (xml_reader_read_start_element (reader, "doc") != FALSE);
+      g_assert (xml_reader_read_nth_element (reader, "item", 0) != FALSE);
+
+      value = xml_reader_get_element_value_bytes (reader);
+      g_assert (is_slice_of (value, source) != FALSE);
+      g_assert_cmpint (g_bytes_get_size (value), ==, strlen ("verbatim"));
+      g_assert (memcmp (g_bytes_get_data (value, NULL), "verbatim", 8) == 0);
+      g_bytes_unref (value);
+
+      g_assert (xml_reader_read_attribute_name (reader, "id") != FALSE);
+      value = xml_reader_get_attribute_value_bytes (reader);
+      g_assert (is_slice_of (value, source) != FALSE);
+      g_assert_cmpint (g_bytes_get_size (value), ==, strlen ("plain"));
+      g_bytes_unref (value);
+
+      g_assert (xml_reader_read_attribute_name (reader, "note") != FALSE);
+      value = xml_reader_get_attribute_value_bytes (reader);
+      g_assert (is_slice_of (value, source) == FALSE);
+      g_assert_cmpint (g_bytes_get_size (value), ==, strlen ("a & b"));
+      g_assert (memcmp (g_bytes_get_data (value, NULL), "a & b", 5) == 0);
+      g_bytes_unref (value);
+
+      xml_reader_read_end_element (reader);
+
+      g_assert (xml_reader_read_nth_element (reader, "item", 1) != FALSE);
+      value = xml_reader_get_element_value_bytes (reader);
+      g_assert (is_slice_of (value, source) == FALSE);
+      g_assert_cmpint (g_bytes_get_size (value), ==, strlen ("escaped <here>"));
+      g_bytes_unref (value);
+    }
+
+  g_bytes_unref (source);
+  g_object_unref (reader);
+}
+
+static void
+test_vectors (void)
+{
+  XmlReader *reader = xml_reader_new ();
+  XmlReader *joined = xml_reader_new ();
+  XmlReaderVector *vectors;
+  GString *buffer;
+  gsize offset;
+  guint n_vectors, i;
+  gint pass;
+
+  buffer = g_string_new ("<?xml version=\"1.0\" encoding=\"UTF-8\"?><list>");
+  for (i = 0; i < 2000; i++)
+    g_string_append_printf (buffer, "<item id=\"%u\">caf\xc3\xa9 &amp; %u</item>", i, i);
+  g_string_append (buffer, "</list>");
+
+  /* small, uneven pieces, splitting names, references and characters */
+  vectors = g_new (XmlReaderVector, buffer->len);
+  for (n_vectors = 0, offset = 0; offset < buffer->len; n_vectors++)
+    {
+      vectors[n_vectors].buffer = buffer->str + offset;
+      vectors[n_vectors].size = MIN (1 + n_vectors % 13, buffer->len - offset);
+      offset += vectors[n_vectors].size;
+    }
+
+  for (pass = 0; pass < 2; pass++)
+    {
+      g_assert (xml_reader_load_from_data (joined, buffer->str, NULL) != FALSE);
+
+      xml_reader_set_succinct (reader, pass == 1);
+      g_assert (xml_reader_load_from_vectors (reader, vectors, n_vectors, NULL) != FALSE);
+
+      g_assert (xml_reader_read_start_element (joined, "list") != FALSE);
+      g_assert (xml_reader_read_start_element (reader, "list") != FALSE);
+      g_assert_cmpint (xml_reader_count_elements (reader, "item"), ==, 2000);
+
+      while (xml_reader_read_next_in_document (joined))
+        {
+          g_assert (xml_reader_read_next_in_document (reader) != FALSE);
+          g_assert_cmpstr (xml_reader_get_element_name (reader), ==, xml_reader_get_element_name (joined));
+          g_assert_cmpstr (xml_reader_get_element_value (reader), ==, xml_reader_get_element_value (joined));
+        }
+
+      g_assert_cmpint (xml_reader_read_next_in_document (reader), ==, FALSE);
+    }
+
+  g_free (vectors);
+  g_string_free (buffer, TRUE);
+
+#ifdef HAVE_SYS_MMAN_H
+  {
+    XmlReaderVector halted[2];
+    gint depth = 0;
+
+    /* libxml2 halts past 256 levels; the vectors after that point must
+     * not be read, which the unreadable page catches
+     */
+    buffer = g_string_new ("<?xml version=\"1.0\"?>");
+    for (i = 0; i < 300; i++)
+      g_string_append (buffer, "<n>");
+
+    halted[0].buffer = buffer->str;
+    halted[0].size = buffer->len;
+    halted[1].buffer = mmap (NULL, 4096, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    halted[1].size = 4096;
+    g_assert (halted[1].buffer != MAP_FAILED);
+
+    xml_reader_set_succinct (reader, FALSE);
+    g_assert (xml_reader_load_from_vectors (reader, halted, 2, NULL) != FALSE);
+
+    while (xml_reader_read_next_in_document (reader))
+      depth = MAX (depth, xml_reader_get_depth (reader));
+    g_assert_cmpint (depth, >, 0);
+    g_assert_cmpint (depth, <, 300);
+
+    munmap ((gpointer) halted[1].buffer, 4096);
+    g_string_free (buffer, TRUE);
+  }
+#endif
+
+  g_object_unref (joined);
+  g_object_unref (reader);
+}
+
+static const gchar xml_stream_test[] =
+"<?xml version=\"1.0\"?>\n<msg id=\"1\"><body>one</body></msg>\n"
+"<msg id=\"2\"><body>two &lt;&gt;</body></msg>"
+"<!-- a comment --><msg id=\"3\" note='>'/>\n"
+"\xef\xbb\xbf<?xml version=\"1.0\"?><msg id=\"4\"><![CDATA[</msg>]]></msg>\n"
+"<msg id=\"5\"><body>truncated";
+
+static void
+test_documents (void)
+{
+  XmlReader *reader = xml_reader_new ();
+  GError *error = NULL;
+  const gchar *xml;
+  GBytes *stream;
+  gsize length;
+  gint pass, i;
+
+  stream = g_bytes_new (xml_stream_test, sizeof (xml_stream_test) - 1);
+
+  for (pass = 0; pass < 2; pass++)
+    {
+      xml_reader_set_succinct (reader, pass == 1);
+      xml_reader_open_documents (reader, stream);
+
+      for (i = 1; i <= 4; i++)
+        {
+          gchar *id = g_strdup_printf ("%d", i);
+
+          g_assert (xml_reader_next_document (reader, NULL) != FALSE);
+          g_assert (xml_reader_read_start_element (reader, "msg") != FALSE);
+          g_assert (xml_reader_read_attribute_name (reader, "id") != FALSE);
+          g_assert_cmpstr (xml_reader_get_attribute_value (reader), ==, id);
+
+          g_free (id);
+        }
+
+      xml = xml_reader_get_inner_xml (reader, &length);
+      assert_xml (xml, length, "<![CDATA[</msg>]]>");
+
+      g_assert_cmpint (xml_reader_next_document (reader, &error), ==, FALSE);
+      g_assert_error (error, XML_READER_ERROR, XML_READER_ERROR_INVALID);
+      g_clear_error (&error);
+
+      g_assert_cmpint (xml_reader_next_document (reader, &error), ==, FALSE);
+      g_assert_no_error (error);
+    }
+
+  g_bytes_unref (stream);
+  g_object_unref (reader);
+}
+
+static void
+append_to_file (const gchar *filename,
+                 const gchar *data)
+{
+  FILE *file = fopen (filename, "ab");
+
+  g_assert (file != NULL);
+  g_assert_cmpint (fwrite (data, 1, strlen (data), file), ==, strlen (data));
+  fclose (file);
+}
+
+static void
+test_follow (void)
+{
+  XmlReader *reader = xml_reader_new ();
+  GError *error = NULL;
+  gchar *filename;
+
+  filename = g_build_filename (g_get_tmp_dir (), "test-follow.xml", NULL);
+  g_assert (g_file_set_contents (filename, "<?xml version=\"1.0\"?>\n<log xmlns:x=\"urn:x\"", -1, NULL) != FALSE);
+
+  g_assert (xml_reader_follow_file (reader, filename, 10, &error) != FALSE);
+  g_assert_no_error (error);
+
+  /* neither the root nor a record are complete */
+  g_assert_cmpint (xml_reader_next_record (reader, 0, NULL), ==, FALSE);
+
+  append_to_file (filename, ">\n  <!-- started -->\n  <event id=\"1\"><x:msg>one</x:msg>");
+  g_assert_cmpint (xml_reader_next_record (reader, 20, NULL), ==, FALSE);
+  g_assert (xml_reader_is_following (reader) != FALSE);
+
+  append_to_file (filename, "</event>\n  <event id=\"2\"/><event id=\"3\">");
+
+  g_assert (xml_reader_next_record (reader, 0, &error) != FALSE);
+  g_assert_no_error (error);
+  g_assert (xml_reader_read_start_element (reader, "log") != FALSE);
+  g_assert_cmpint (xml_reader_count_elements (reader, "event"), ==, 1);
+  g_assert (xml_reader_read_start_element (reader, "event") != FALSE);
+  g_assert (xml_reader_read_attribute_name (reader, "id") != FALSE);
+  g_assert_cmpstr (xml_reader_get_attribute_value (reader), ==, "1");
+  g_assert (xml_reader_read_start_element (reader, "msg") != FALSE);
+  g_assert_cmpstr (xml_reader_get_element_value (reader), ==, "one");
+
+  g_assert (xml_reader_next_record (reader, 0, NULL) != FALSE);
+  g_assert (xml_reader_read_start_element (reader, "log") != FALSE);
+  g_assert (xml_reader_read_start_element (reader, "event") != FALSE);
+  g_assert (xml_reader_read_attribute_name (reader, "id") != FALSE);
+  g_assert_cmpstr (xml_reader_get_attribute_value (reader), ==, "2");
+
+  g_assert_cmpint (xml_reader_next_record (reader, 0, NULL), ==, FALSE);
+
+  append_to_file (filename, "<![CDATA[</event>]]></event>\n</log>\n");
+
+  g_assert (xml_reader_next_record (reader, -1, NULL) != FALSE);
+  g_assert (xml_reader_read_start_element (reader, "log") != FALSE);
+  g_assert (xml_reader_read_start_element (reader, "event") != FALSE);
+  g_assert (xml_reader_read_attribute_name (reader, "id") != FALSE);
+  g_assert_cmpstr (xml_reader_get_attribute_value (reader), ==, "3");
+
+  /* the root element is closed */
+  g_assert_cmpint (xml_reader_next_record (reader, -1, &error), ==, FALSE);
+  g_assert_no_error (error);
+  g_assert_cmpint (xml_reader_is_following (reader), ==, FALSE);
+
+  g_unlink (filename);
+  g_free (filename);
+  g_object_unref (reader);
+}
+
+static void
+test_follow_large (void)
+{
+  XmlReader *reader = xml_reader_new ();
+  XmlReaderStatistics stats;
+  GString *buffer;
+  gchar *filename;
+  gint i, n_records = 50000;
+
+  buffer = g_string_new ("<log>\n");
+  for (i = 0; i < n_records; i++)
+    g_string_append_printf (buffer, "  <event id=\"%d\"><msg>event number %d</msg></event>\n", i, i);
+  g_string_append (buffer, "</log>\n");
+
+  filename = g_build_filename (g_get_tmp_dir (), "test-follow-large.xml", NULL);
+  g_assert (g_file_set_contents (filename, buffer->str, buffer->len, NULL) != FALSE);
+  g_assert_cmpint (buffer->len, >, 2 * 1024 * 1024);
+
+  g_assert (xml_reader_follow_file (reader, filename, 10, NULL) != FALSE);
+
+  /* the file is read as the records are needed, not as a whole */
+  for (i = 0; i < n_records; i++)
+    {
+      g_assert (xml_reader_next_record (reader, 0, NULL) != FALSE);
+
+      xml_reader_get_statistics (reader, &stats);
+      g_assert_cmpint (stats.follow_memory, <=, 256 * 1024);
+    }
+
+  g_assert (xml_reader_read_start_element (reader, "log") != FALSE);
+  g_assert (xml_reader_read_start_element (reader, "event") != FALSE);
+  g_assert (xml_reader_read_attribute_name (reader, "id") != FALSE);
+  g_assert_cmpint (atoi (xml_reader_get_attribute_value (reader)), ==, n_records - 1);
+
+  g_assert_cmpint (xml_reader_next_record (reader, 0, NULL), ==, FALSE);
+  g_assert_cmpint (xml_reader_is_following (reader), ==, FALSE);
+
+  g_unlink (filename);
+  g_free (filename);
+  g_string_free (buffer, TRUE);
+  g_object_unref (reader);
+}
+
+static void
+test_checkpoint (void)
+{
+  XmlReader *reader = xml_reader_new ();
+  GError *error = NULL;
+  GBytes *checkpoint;
+  gchar *filename;
+
+  filename = g_build_filename (g_get_tmp_dir (), "test-checkpoint.xml", NULL);
+  g_assert (g_file_set_contents (filename,
+                                 "<?xml version=\"1.0\" encoding=\"ISO-8859-1\"?>\n"
+                                 "<log xmlns=\"urn:log\">\n"
+                                 "<event id=\"1\">caf\xe9</event>\n"
+                                 "<event id=\"2\">na\xefve</event>\n"
+                                 "</log>\n",
+                                 -1, NULL) != FALSE);
+
+  g_assert (xml_reader_get_checkpoint (reader) == NULL);
+
+  g_assert (xml_reader_follow_file (reader, filename, 10, NULL) != FALSE);
+  g_assert (xml_reader_next_record (reader, -1, NULL) != FALSE);
+  g_assert (xml_reader_read_start_element (reader, "log") != FALSE);
+  g_assert (xml_reader_read_start_element (reader, "event") != FALSE);
+  g_assert_cmpstr (xml_reader_get_element_value (reader), ==, "caf\xc3\xa9");
+
+  checkpoint = xml_reader_get_checkpoint (reader);
+  g_assert (checkpoint != NULL);
+  g_object_unref (reader);
+
+  /* a new reader goes on with the next record, in the same encoding */
+  reader = xml_reader_new ();
+  g_assert (xml_reader_resume_from_checkpoint (reader, filename, checkpoint, 10, &error) != FALSE);
+  g_assert_no_error (error);
+
+  g_assert (xml_reader_next_record (reader, -1, NULL) != FALSE);
+  g_assert (xml_reader_read_start_element (reader, "log") != FALSE);
+  g_assert (xml_reader_read_start_element (reader, "event") != FALSE);
+  g_assert_cmpstr (xml_reader_get_element_value (reader), ==, "na\xc3\xafve");
+  g_assert (xml_reader_read_attribute_name (reader, "id") != FALSE);
+  g_assert_cmpstr (xml_reader_get_attribute_value (reader), ==, "2");
+
+  g_assert_cmpint (xml_reader_next_record (reader, -1, NULL), ==, FALSE);
+  g_bytes_unref (checkpoint);
+
+  checkpoint = g_bytes_new ("junk", 4);
+  g_assert_cmpint (xml_reader_resume_from_checkpoint (reader, filename, checkpoint, 10, &error), ==, FALSE);
+  g_assert_error (error, XML_READER_ERROR, XML_READER_ERROR_INVALID);
+  g_clear_error (&error);
+  g_bytes_unref (checkpoint);
+
+  g_unlink (filename);
+  g_free (filename);
+  g_object_unref (reader);
+}
+
+static gint
+record_get_id (XmlReader *reader)
+{
+  gint id;
+
+  g_assert (xml_reader_read_start_element (reader, "log") != FALSE);
+  g_assert (xml_reader_read_start_element (reader, "event") != FALSE);
+  g_assert (xml_reader_read_attribute_name (reader, "id") != FALSE);
+  id = atoi (xml_reader_get_attribute_value (reader));
+  xml_reader_read_end_element (reader);
+
+  return id;
+}
+
+static void
+test_checkpoint_large (void)
+{
+  XmlReader *reader = xml_reader_new ();
+  XmlReaderStatistics stats;
+  GError *error = NULL;
+  GBytes *checkpoint;
+  GString *buffer;
+  gchar *filename;
+  gint i, n_records = 40000;
+
+  buffer = g_string_new ("<?xml version=\"1.0\"?>\n<log>\n");
+  for (i = 0; i < n_records; i++)
+    g_string_append_printf (buffer, "<event id=\"%d\"><msg>event number %d</msg></event>\n", i, i);
+  g_string_append (buffer, "</log>\n");
+
+  filename = g_build_filename (g_get_tmp_dir (), "test-checkpoint-large.xml", NULL);
+  g_assert (g_file_set_contents (filename, buffer->str, buffer->len, NULL) != FALSE);
+  g_assert_cmpint (buffer->len, >, 2 * 1024 * 1024);
+
+  /* stop in the middle of the file, with data read past the record */
+  g_assert (xml_reader_follow_file (reader, filename, 10, NULL) != FALSE);
+  for (i = 0; i < n_records / 2 + 7; i++)
+    {
+      g_assert (xml_reader_next_record (reader, 0, NULL) != FALSE);
+      g_assert_cmpint (record_get_id (reader), ==, i);
+    }
+
+  checkpoint = xml_reader_get_checkpoint (reader);
+  g_assert (checkpoint != NULL);
+  g_object_unref (reader);
+
+  reader = xml_reader_new ();
+  g_assert (xml_reader_resume_from_checkpoint (reader, filename, checkpoint, 10, &error) != FALSE);
+  g_assert_no_error (error);
+
+  for (; i < n_records; i++)
+    {
+      g_assert (xml_reader_next_record (reader, 0, NULL) != FALSE);
+      g_assert_cmpint (record_get_id (reader), ==, i);
+
+      xml_reader_get_statistics (reader, &stats);
+      g_assert_cmpint (stats.follow_memory, <=, 256 * 1024);
+    }
+
+  g_assert_cmpint (xml_reader_next_record (reader, 0, NULL), ==, FALSE);
+  g_assert_cmpint (xml_reader_is_following (reader), ==, FALSE);
+
+  g_bytes_unref (checkpoint);
+  g_unlink (filename);
+  g_free (filename);
+  g_string_free (buffer, TRUE);
+  g_object_unref (reader);
+}
+
+/* moves the cursor on the item at @pos in the current section, which
+ * has to be the item @n of the section @section
+ */
+static void
+checkpoint_read_item (XmlReader *reader,
+                      gint       pos,
+                      gint       section,
+                      gint       n)
+{
+  gchar *value;
+
+  g_assert (xml_reader_read_nth_element (reader, "item", pos) != FALSE);
+
+  value = g_strdup_printf ("s%d item %d", section, n);
+  g_assert_cmpstr (xml_reader_get_element_value (reader), ==, value);
+  g_free (value);
+
+  value = g_strdup_printf ("t%d", n);
+  g_assert (xml_reader_read_attribute_name (reader, "tag") != FALSE);
+  g_assert_cmpstr (xml_reader_get_attribute_value (reader), ==, value);
+  g_free (value);
+}
+
+static void
+test_checkpoint_nested (void)
+{
+  XmlReader *reader = xml_reader_new ();
+  GError *error = NULL;
+  GBytes *windowed, *kept, *checkpoint;
+  GVariant *variant;
+  GString *buffer;
+  gchar *filename;
+  gint i, s, n_sections = 3, n_items = 50;
+
+  buffer = g_string_new ("<?xml version=\"1.0\"?>\n"
+                         "<!DOCTYPE catalog [<!ENTITY co \"ACME\">]>\n"
+                         "<catalog xmlns=\"urn:catalog\" xmlns:x=\"urn:extra\" "
+                         "x:owner=\"&co; &amp; sons\">\n");
+  for (s = 0; s < n_sections; s++)
+    {
+      g_string_append_printf (buffer, "<section id=\"s%d\" title=\"a&#10;b&quot;\">\n", s);
+      for (i = 0; i < n_items; i++)
+        g_string_append_printf (buffer, "  <item x:tag=\"t%d\">s%d item %d</item>\n", i, s, i);
+      g_string_append (buffer, "  <note by=\"&co;\"/>\n</section>\n");
+    }
+  g_string_append (buffer, "</catalog>\n");
+
+  filename = g_build_filename (g_get_tmp_dir (), "test-checkpoint-nested.xml", NULL);
+  g_assert (g_file_set_contents (filename, buffer->str, buffer->len, NULL) != FALSE);
+
+  /* in bounded memory mode, the items are released as they are left */
+  xml_reader_set_bounded_memory (reader, 3, 0);
+  g_assert (xml_reader_load_from_file (reader, filename, &error) != FALSE);
+  g_assert_no_error (error);
+
+  g_assert (xml_reader_read_start_element (reader, "catalog") != FALSE);
+  g_assert (xml_reader_get_checkpoint (reader) == NULL);
+
+  g_assert (xml_reader_read_nth_element (reader, "section", 0) != FALSE);
+  for (i = 0; i < n_items; i++)
+    {
+      checkpoint_read_item (reader, 0, 0, i);
+      xml_reader_read_end_element (reader);
+    }
+  xml_reader_read_end_element (reader);
+
+  g_assert (xml_reader_read_nth_element (reader, "section", 1) != FALSE);
+  for (i = 0; i < 20; i++)
+    {
+      checkpoint_read_item (reader, 0, 1, i);
+      xml_reader_read_end_element (reader);
+    }
+
+  checkpoint_read_item (reader, 0, 1, 20);
+  windowed = xml_reader_get_checkpoint (reader);
+  g_assert (windowed != NULL);
+
+  /* the same position, with the offsets of the kept source */
+  g_object_unref (reader);
+  reader = xml_reader_new ();
+  xml_reader_set_keep_source (reader, TRUE);
+  g_assert (xml_reader_load_from_file (reader, filename, NULL) != FALSE);
+
+  g_assert (xml_reader_read_start_element (reader, "catalog") != FALSE);
+  g_assert (xml_reader_read_nth_element (reader, "section", 1) != FALSE);
+  checkpoint_read_item (reader, 20, 1, 20);
+
+  kept = xml_reader_get_checkpoint (reader);
+  g_assert (kept != NULL);
+  g_assert (g_bytes_equal (windowed, kept) != FALSE);
+  g_bytes_unref (kept);
+
+  /* the enclosing elements, their attributes and the entities of the
+   * document type carry over
+   */
+  g_object_unref (reader);
+  reader = xml_reader_new ();
+  xml_reader_set_bounded_memory (reader, 3, 0);
+  g_assert (xml_reader_load_from_checkpoint (reader, filename, windowed, &error) != FALSE);
+  g_assert_no_error (error);
+
+  g_assert (xml_reader_read_start_element (reader, "catalog") != FALSE);
+  g_assert (xml_reader_read_attribute_name (reader, "owner") != FALSE);
+  g_assert_cmpstr (xml_reader_get_attribute_value (reader), ==, "ACME & sons");
+
+  g_assert (xml_reader_read_nth_element (reader, "section", 0) != FALSE);
+  g_assert (xml_reader_read_attribute_name (reader, "id") != FALSE);
+  g_assert_cmpstr (xml_reader_get_attribute_value (reader), ==, "s1");
+  g_assert (xml_reader_read_attribute_name (reader, "title") != FALSE);
+  g_assert_cmpstr (xml_reader_get_attribute_value (reader), ==, "a\nb\"");
+
+  for (i = 21; i < n_items; i++)
+    {
+      checkpoint_read_item (reader, 0, 1, i);
+      xml_reader_read_end_element (reader);
+    }
+  g_assert (xml_reader_read_start_element (reader, "note") != FALSE);
+  g_assert (xml_reader_read_attribute_name (reader, "by") != FALSE);
+  g_assert_cmpstr (xml_reader_get_attribute_value (reader), ==, "ACME");
+  xml_reader_read_end_element (reader);
+  xml_reader_read_end_element (reader);
+
+  /* a checkpoint taken in a resumed document is in the file too */
+  g_assert (xml_reader_read_nth_element (reader, "section", 1) != FALSE);
+  for (i = 0; i < 10; i++)
+    {
+      checkpoint_read_item (reader, 0, 2, i);
+      xml_reader_read_end_element (reader);
+    }
+
+  checkpoint_read_item (reader, 0, 2, 10);
+  checkpoint = xml_reader_get_checkpoint (reader);
+  g_assert (checkpoint != NULL);
+
+  g_object_unref (reader);
+  reader = xml_reader_new ();
+  g_assert (xml_reader_load_from_checkpoint (reader, filename, checkpoint, &error) != FALSE);
+  g_assert_no_error (error);
+
+  g_assert (xml_reader_read_start_element (reader, "catalog") != FALSE);
+  g_assert (xml_reader_read_nth_element (reader, "section", 0) != FALSE);
+  g_assert_cmpint (xml_reader_count_elements (reader, "item"), ==, n_items - 11);
+  checkpoint_read_item (reader, 0, 2, 11);
+  xml_reader_read_end_element (reader);
+  g_bytes_unref (checkpoint);
+
+  /* the records of a followed file are the children of the root */
+  g_assert (xml_reader_resume_from_checkpoint (reader, filename, windowed, 10, &error) == FALSE);
+  g_assert_error (error, XML_READER_ERROR, XML_READER_ERROR_INVALID);
+  g_clear_error (&error);
+
+  variant = g_variant_ref_sink (g_variant_new ("(st^ay)", "xml-reader-checkpoint-1",
+                                               (guint64) buffer->len + 1, "<catalog>"));
+  checkpoint = g_bytes_new (g_variant_get_data (variant), g_variant_get_size (variant));
+  g_assert (xml_reader_load_from_checkpoint (reader, filename, checkpoint, &error) == FALSE);
+  g_assert_error (error, XML_READER_ERROR, XML_READER_ERROR_INVALID);
+  g_clear_error (&error);
+  g_bytes_unref (checkpoint);
+  g_variant_unref (variant);
+
+  /* buffers have no file to resume */
+  g_assert (xml_reader_load_from_data (reader, buffer->str, NULL) != FALSE);
+  g_assert (xml_reader_read_start_element (reader, "catalog") != FALSE);
+  g_assert (xml_reader_read_nth_element (reader, "section", 0) != FALSE);
+  g_assert (xml_reader_read_nth_element (reader, "item", 0) != FALSE);
+  g_assert (xml_reader_get_checkpoint (reader) == NULL);
+
+  g_bytes_unref (windowed);
+  g_unlink (filename);
+  g_free (filename);
+  g_string_free (buffer, TRUE);
+  g_object_unref (reader);
+}
+
+static void
+test_shards (void)
+{
+  XmlReader *reader = xml_reader_new ();
+  GError *error = NULL;
+  GString *buffer;
+  gchar *filename, *manifest, *region;
+  guint n_shards, shard;
+  gint i, next_id = 0;
+
+  buffer = g_string_new ("<?xml version=\"1.0\" encoding=\"ISO-8859-1\"?>\n"
+                         "<!-- <export> -->\n"
+                         "<x:export xmlns:x=\"urn:x\" xmlns=\"urn:items\">\n"
+                         "<x:header><item id=\"-1\"/></x:header>\n");
+  for (i = 0; i < 1000; i++)
+    {
+      if (i % 300 == 0)
+        g_string_append_printf (buffer, "%s<x:region name=\"r%d\">\n",
+                                i > 0 ? "</x:region>\n" : "",
+                                i / 300);
+
+      g_string_append_printf (buffer, "<item id=\"%d\"%s><name>caf\xe9 %d</name></item>\n",
+                              i, i % 7 == 0 ? " note='>'" : "", i);
+    }
+  g_string_append (buffer, "</x:region>\n<x:footer/>\n</x:export>\n");
+
+  filename = g_build_filename (g_get_tmp_dir (), "test-shards.xml", NULL);
+  g_assert (g_file_set_contents (filename, buffer->str, buffer->len, NULL) != FALSE);
+
+  manifest = xml_reader_create_shard_manifest (filename, "export/region/item", 4, &error);
+  g_assert_no_error (error);
+  g_assert (manifest != NULL);
+
+  n_shards = xml_reader_count_shards (manifest, NULL);
+  g_assert_cmpint (n_shards, ==, 4);
+
+  /* the shards hold every record once, in order */
+  for (shard = 0; shard < n_shards; shard++)
+    {
+      g_assert (xml_reader_load_shard (reader, manifest, shard, NULL, &error) != FALSE);
+      g_assert_no_error (error);
+
+      while (xml_reader_read_next_in_document (reader))
+        {
+          gchar *id;
+
+          if (strcmp (xml_reader_get_element_name (reader), "item") != 0)
+            continue;
+
+          id = g_strdup_printf ("%d", next_id);
+          g_assert (xml_reader_read_attribute_name (reader, "id") != FALSE);
+          g_assert_cmpstr (xml_reader_get_attribute_value (reader), ==, id);
+          g_free (id);
+
+          next_id += 1;
+        }
+    }
+
+  g_assert_cmpint (next_id, ==, 1000);
+
+  /* the ancestors are the ones of the records */
+  g_assert (xml_reader_load_shard (reader, manifest, n_shards - 1, filename, NULL) != FALSE);
+  g_assert (xml_reader_read_start_element (reader, "export") != FALSE);
+  g_assert (xml_reader_read_start_element (reader, "region") != FALSE);
+  g_assert (xml_reader_read_attribute_name (reader, "name") != FALSE);
+  region = g_strdup (xml_reader_get_attribute_value (reader));
+  g_assert (xml_reader_read_start_element (reader, "item") != FALSE);
+  g_assert (xml_reader_read_attribute_name (reader, "id") != FALSE);
+  i = atoi (xml_reader_get_attribute_value (reader));
+  g_assert_cmpint (i, >, 0);
+  g_assert_cmpint (region[1] - '0', ==, i / 300);
+  g_free (region);
+  g_assert (xml_reader_read_start_element (reader, "name") != FALSE);
+  g_assert (g_str_has_prefix (xml_reader_get_element_value (reader), "caf\xc3\xa9") != FALSE);
+
+  g_assert_cmpint (xml_reader_load_shard (reader, manifest, n_shards, NULL, &error), ==, FALSE);
+  g_assert_error (error, XML_READER_ERROR, XML_READER_ERROR_INVALID);
+  g_clear_error (&error);
+
+  /* the file changed since the manifest was made */
+  g_assert (g_file_set_contents (filename, buffer->str, buffer->len - 1, NULL) != FALSE);
+  g_assert_cmpint (xml_reader_load_shard (reader, manifest, 0, NULL, &error), ==, FALSE);
+  g_assert_error (error, XML_READER_ERROR, XML_READER_ERROR_INVALID);
+  g_clear_error (&error);
+
+  g_free (manifest);
+
+  manifest = xml_reader_create_shard_manifest (filename, "export/item", 4, &error);
+  g_assert_no_error (error);
+  g_assert_cmpint (xml_reader_count_shards (manifest, NULL), ==, 0);
+  g_free (manifest);
+
+  g_unlink (filename);
+  g_free (filename);
+  g_string_free (buffer, TRUE);
+  g_object_unref (reader);
+}
+
+static void
+test_bounded_memory (void)
+{
+  XmlReader *reader = xml_reader_new ();
+  XmlReaderStatistics stats;
+  GError *error = NULL;
+  GString *buffer;
+  gchar *filename;
+  const gchar *xml;
+  gsize length;
+  gint i, n_items;
+
+  buffer = g_string_new ("<?xml version=\"1.0\"?>\n"
+                         "<catalog><header>Products</header>");
+  for (i = 0; i < 5000; i++)
+    g_string_append_printf (buffer, "<item id=\"%d\"><name>Product %d</name></item>%s",
+                            i, i, i % 3 == 0 ? "; " : "");
+  g_string_append (buffer, "</catalog>\n");
+
+  filename = g_build_filename (g_get_tmp_dir (), "test-bounded-memory.xml", NULL);
+  g_assert (g_file_set_contents (filename, buffer->str, buffer->len, NULL) != FALSE);
+
+  /* the records get released as the cursor leaves them */
+  xml_reader_set_bounded_memory (reader, 2, 0);
+  g_assert (xml_reader_load_from_file (reader, filename, &error) != FALSE);
+  g_assert_no_error (error);
+
+  g_assert (xml_reader_read_start_element (reader, "catalog") != FALSE);
+  g_assert (xml_reader_read_start_element (reader, "header") != FALSE);
+  g_assert_cmpstr (xml_reader_get_element_value (reader), ==, "Products");
+  xml_reader_read_end_element (reader);
+
+  n_items = 0;
+  while (xml_reader_try_start_element (reader, "item"))
+    {
+      gchar *id = g_strdup_printf ("%d", n_items);
+
+      g_assert (xml_reader_read_attribute_name (reader, "id") != FALSE);
+      g_assert_cmpstr (xml_reader_get_attribute_value (reader), ==, id);
+
+      if (n_items == 1234)
+        {
+          const gchar *expected = "<item id=\"1234\"><name>Product 1234</name></item>";
+
+          xml = xml_reader_get_outer_xml (reader, &length);
+          g_assert_cmpint (length, ==, strlen (expected));
+          g_assert (memcmp (xml, expected, length) == 0);
+        }
+
+      g_assert (xml_reader_read_start_element (reader, "name") != FALSE);
+      g_assert (g_str_has_suffix (xml_reader_get_element_value (reader), id) != FALSE);
+      xml_reader_read_end_element (reader);
+      xml_reader_read_end_element (reader);
+
+      g_free (id);
+      n_items += 1;
+    }
+
+  g_assert_cmpint (n_items, ==, 5000);
+  g_assert_cmpint (xml_reader_count_elements (reader, NULL), ==, 0);
+
+  xml_reader_get_statistics (reader, &stats);
+  g_assert_cmpint (stats.n_released, ==, 5001);
+  g_assert_cmpint (stats.tree_memory_peak, >, 0);
+  g_assert_cmpint (stats.tree_memory_peak, <, buffer->len / 4);
+  g_assert_cmpint (stats.tree_memory, <, 4096);
+
+  /* and so they do when walking the document */
+  g_assert (xml_reader_load_from_data (reader, buffer->str, NULL) != FALSE);
+
+  n_items = 0;
+  while (xml_reader_read_next_in_document (reader))
+    if (strcmp (xml_reader_get_element_name (reader), "item") == 0)
+      n_items += 1;
+
+  g_assert_cmpint (n_items, ==, 5000);
+
+  xml_reader_get_statistics (reader, &stats);
+  g_assert_cmpint (stats.n_released, ==, 5001);
+  g_assert_cmpint (stats.tree_memory_peak, <, buffer->len / 4);
+
+  /* and so they do when loading vectors */
+  {
+    XmlReaderVector vectors[3];
+
+    vectors[0].buffer = buffer->str;
+    vectors[0].size = 1000;
+    vectors[1].buffer = buffer->str + 1000;
+    vectors[1].size = buffer->len / 2 - 1000;
+    vectors[2].buffer = buffer->str + buffer->len / 2;
+    vectors[2].size = buffer->len - buffer->len / 2;
+
+    g_assert (xml_reader_load_from_vectors (reader, vectors, 3, NULL) != FALSE);
+
+    n_items = 0;
+    while (xml_reader_read_next_in_document (reader))
+      if (strcmp (xml_reader_get_element_name (reader), "item") == 0)
+        n_items += 1;
+
+    g_assert_cmpint (n_items, ==, 5000);
+
+    xml_reader_get_statistics (reader, &stats);
+    g_assert_cmpint (stats.n_released, ==, 5001);
+    g_assert_cmpint (stats.tree_memory_peak, <, buffer->len / 4);
+  }
+
+  /* the succinct representation has no tree to release */
+  xml_reader_set_succinct (reader, TRUE);
+  g_assert_cmpint (xml_reader_load_from_file (reader, filename, &error), ==, FALSE);
+  g_assert_error (error, XML_READER_ERROR, XML_READER_ERROR_INVALID);
+  g_clear_error (&error);
+  xml_reader_set_succinct (reader, FALSE);
+
+  /* the elements kept count against the limit */
+  xml_reader_set_bounded_memory (reader, 2, 64 * 1024);
+  g_assert (xml_reader_load_from_file (reader, filename, NULL) != FALSE);
+  g_assert (xml_reader_read_start_element (reader, "catalog") != FALSE);
+  g_assert (xml_reader_read_start_element (reader, "item") != FALSE);
+  xml_reader_read_end_element (reader);
+  g_assert_cmpint (xml_reader_count_elements (reader, "item"), ==, -1);
+  g_assert (xml_reader_get_error (reader, &error) != FALSE);
+  g_assert_error (error, XML_READER_ERROR, XML_READER_ERROR_MEMORY_LIMIT);
+  g_clear_error (&error);
+
+  xml_reader_get_statistics (reader, &stats);
+  g_assert_cmpint (stats.tree_memory_peak, >, 64 * 1024);
+  g_assert_cmpint (stats.tree_memory_peak, <, 64 * 1024 + 4096);
+
+  /* the documents are parsed whole again */
+  xml_reader_set_bounded_memory (reader, 0, 0);
+  g_assert (xml_reader_load_from_file (reader, filename, NULL) != FALSE);
+  g_assert (xml_reader_read_start_element (reader, "catalog") != FALSE);
+  g_assert_cmpint (xml_reader_count_elements (reader, "item"), ==, 5000);
+
+  g_unlink (filename);
+  g_free (filename);
+  g_string_free (buffer, TRUE);
+  g_object_unref (reader);
+}
+
+static void
+loaded_in_idle (XmlReader    *reader,
+                const GError *error,
+                gpointer      user_data)
+{
+  g_assert_no_error ((GError *) error);
+  g_assert (xml_reader_is_loading (reader) == FALSE);
+
+  g_main_loop_quit (user_data);
+}
+
+static void
+test_load_step (void)
+{
+  XmlReader *reader = xml_reader_new ();
+  GError *error = NULL;
+  GMainLoop *loop;
+  GString *buffer;
+  GBytes *bytes;
+  gchar *filename;
+  gint i, n_steps;
+
+  buffer = g_string_new ("<?xml version=\"1.0\"?><list>");
+  for (i = 0; i < 20000; i++)
+    g_string_append_printf (buffer, "<item id=\"%d\">value %d</item>", i, i);
+  g_string_append (buffer, "</list>");
+
+  /* the shortest steps parse one chunk each */
+  bytes = g_bytes_new (buffer->str, buffer->len);
+  xml_reader_begin_load_from_bytes (reader, bytes);
+  g_assert (xml_reader_is_loading (reader) != FALSE);
+
+  n_steps = 0;
+  while (xml_reader_load_step (reader, 0, &error))
+    n_steps += 1;
+
+  g_assert_no_error (error);
+  g_assert_cmpint (n_steps, ==, buffer->len / (64 * 1024));
+  g_assert (xml_reader_is_loading (reader) == FALSE);
+  g_assert (xml_reader_load_step (reader, 0, NULL) == FALSE);
+
+  g_assert (xml_reader_read_start_element (reader, "list") != FALSE);
+  g_assert_cmpint (xml_reader_count_elements (reader, "item"), ==, 20000);
+  g_assert (xml_reader_read_nth_element (reader, "item", 19999) != FALSE);
+  g_assert_cmpstr (xml_reader_get_element_value (reader), ==, "value 19999");
+
+  /* loading discards the pending load */
+  xml_reader_begin_load_from_bytes (reader, bytes);
+  g_assert (xml_reader_load_step (reader, 0, NULL) != FALSE);
+  g_assert (xml_reader_load_from_data (reader, "<list/>", NULL) != FALSE);
+  g_assert (xml_reader_is_loading (reader) == FALSE);
+  g_assert_cmpint (xml_reader_count_elements (reader, "list"), ==, 1);
+
+  /* the modes needing the whole document load it in the first step */
+  xml_reader_set_succinct (reader, TRUE);
+  xml_reader_begin_load_from_bytes (reader, bytes);
+  g_assert (xml_reader_load_step (reader, 0, NULL) == FALSE);
+  g_assert (xml_reader_read_start_element (reader, "list") != FALSE);
+  g_assert_cmpint (xml_reader_count_elements (reader, "item"), ==, 20000);
+  xml_reader_set_succinct (reader, FALSE);
+
+  /* and so does an idle source */
+  filename = g_build_filename (g_get_tmp_dir (), "test-load-step.xml", NULL);
+  g_assert (g_file_set_contents (filename, buffer->str, buffer->len, NULL) != FALSE);
+
+  loop = g_main_loop_new (NULL, FALSE);
+
+  g_assert (xml_reader_begin_load_from_file (reader, filename, &error) != FALSE);
+  g_assert_no_error (error);
+  xml_reader_load_in_idle (reader, NULL, 1000, loaded_in_idle, loop, NULL);
+  g_main_loop_run (loop);
+
+  g_assert (xml_reader_read_start_element (reader, "list") != FALSE);
+  g_assert_cmpint (xml_reader_count_elements (reader, "item"), ==, 20000);
+
+  g_assert (g_file_set_contents (filename, "", 0, NULL) != FALSE);
+  g_assert_cmpint (xml_reader_begin_load_from_file (reader, filename, &error), ==, FALSE);
+  g_assert_error (error, XML_READER_ERROR, XML_READER_ERROR_EMPTY_FILE);
+  g_clear_error (&error);
+
+  g_main_loop_unref (loop);
+  g_unlink (filename);
+  g_free (filename);
+  g_bytes_unref (bytes);
+  g_string_free (buffer, TRUE);
+  g_object_unref (reader);
+}
+
+typedef struct {
+  gint n_reports;
+  gint n_notified;
+  goffset bytes_read;
+  goffset total_bytes;
+  guint64 n_elements;
+} ProgressData;
+
+static void
+count_progress (XmlReader *reader,
+                goffset    bytes_read,
+                goffset    total_bytes,
+                guint64    n_elements,
+                gpointer   user_data)
+{
+  ProgressData *data = user_data;
+
+  g_assert_cmpint (bytes_read, >=, data->bytes_read);
+  g_assert_cmpint (bytes_read, <=, total_bytes);
+  g_assert_cmpint (n_elements, >=, data->n_elements);
+
+  data->n_reports += 1;
+  data->bytes_read = bytes_read;
+  data->total_bytes = total_bytes;
+  data->n_elements = n_elements;
+}
+
+static void
+progress_notified (gpointer user_data)
+{
+  ProgressData *data = user_data;
+
+  data->n_notified += 1;
+}
+
+static void
+test_progress (void)
+{
+  XmlReader *reader = xml_reader_new ();
+  ProgressData data = { 0, };
+  GString *buffer;
+  GBytes *bytes;
+  gint i;
+
+  buffer = g_string_new ("<?xml version=\"1.0\"?><list>");
+  for (i = 0; i < 20000; i++)
+    g_string_append_printf (buffer, "<item id=\"%d\">value %d</item>", i, i);
+  g_string_append (buffer, "</list>");
+
+  /* without an interval, every look at the clock reports */
+  xml_reader_set_progress_func (reader, 0, count_progress, &data, progress_notified);
+
+  g_assert (xml_reader_load_from_data (reader, buffer->str, NULL) != FALSE);
+  g_assert_cmpint (data.n_reports, ==, 20001 / 64 + 1);
+  g_assert_cmpint (data.bytes_read, ==, buffer->len);
+  g_assert_cmpint (data.total_bytes, ==, buffer->len);
+  g_assert_cmpint (data.n_elements, ==, 20001);
+
+  /* a step at a time */
+  memset (&data, 0, sizeof (data));
+  bytes = g_bytes_new (buffer->str, buffer->len);
+  xml_reader_begin_load_from_bytes (reader, bytes);
+  g_assert (xml_reader_load_step (reader, 0, NULL) != FALSE);
+  g_assert_cmpint (data.n_reports, >, 0);
+  g_assert_cmpint (data.bytes_read, <, buffer->len);
+
+  while (xml_reader_load_step (reader, 0, NULL))
+    ;
+
+  g_assert_cmpint (data.bytes_read, ==, buffer->len);
+  g_assert_cmpint (data.n_elements, ==, 20001);
+
+  /* only the end of the parse gets reported within a long interval */
+  memset (&data, 0, sizeof (data));
+  xml_reader_set_progress_func (reader, 3600 * 1000, count_progress, &data, NULL);
+  g_assert_cmpint (data.n_notified, ==, 1);
+
+  g_assert (xml_reader_load_from_bytes (reader, bytes, NULL) != FALSE);
+  g_assert_cmpint (data.n_reports, ==, 1);
+  g_assert_cmpint (data.n_elements, ==, 20001);
+
+  xml_reader_set_progress_func (reader, 0, NULL, NULL, NULL);
+
+  g_assert (xml_reader_load_from_bytes (reader, bytes, NULL) != FALSE);
+  g_assert_cmpint (data.n_reports, ==, 1);
+
+  g_bytes_unref (bytes);
+  g_string_free (buffer, TRUE);
+  g_object_unref (reader);
+}
+
+/* loads @buffer with and without the succinct mode, expecting @code */
+static void
+assert_limit_error (XmlReader      *reader,
+                    const gchar    *buffer,
+                    XmlReaderError  code)
+{
+  GError *error = NULL;
+  gint pass;
+
+  for (pass = 0; pass < 2; pass++)
+    {
+      xml_reader_set_succinct (reader, pass == 1);
+
+      g_assert_cmpint (xml_reader_load_from_data (reader, buffer, &error), ==, FALSE);
+      g_assert_error (error, XML_READER_ERROR, code);
+      g_clear_error (&error);
+    }
+
+  xml_reader_set_succinct (reader, FALSE);
+}
+
+static void
+test_limits (void)
+{
+  XmlReader *reader = xml_reader_new ();
+  XmlReaderLimits limits = { 0, };
+  GError *error = NULL;
+  GString *buffer;
+  GBytes *bytes;
+  gint i;
+
+  /* depth */
+  buffer = g_string_new (NULL);
+  for (i = 0; i < 100; i++)
+    g_string_append (buffer, "<a>");
+  for (i = 0; i < 100; i++)
+    g_string_append (buffer, "</a>");
+
+  limits.max_depth = 50;
+  xml_reader_set_limits (reader, &limits);
+  assert_limit_error (reader, buffer->str, XML_READER_ERROR_DEPTH_LIMIT);
+
+  limits.max_depth = 100;
+  xml_reader_set_limits (reader, &limits);
+  g_assert (xml_reader_load_from_data (reader, buffer->str, NULL) != FALSE);
+  g_string_free (buffer, TRUE);
+
+  /* nodes */
+  buffer = g_string_new ("<list>");
+  for (i = 0; i < 1000; i++)
+    g_string_append_printf (buffer, "<item id=\"%d\">value %d</item>", i, i);
+  g_string_append (buffer, "</list>");
+
+  limits.max_nodes = 1000;
+  xml_reader_set_limits (reader, &limits);
+  assert_limit_error (reader, buffer->str, XML_READER_ERROR_NODE_LIMIT);
+
+  /* the parse stops at the limit, even a step at a time */
+  bytes = g_bytes_new (buffer->str, buffer->len);
+  xml_reader_begin_load_from_bytes (reader, bytes);
+  g_assert (xml_reader_load_step (reader, 0, &error) == FALSE);
+  g_assert_error (error, XML_READER_ERROR, XML_READER_ERROR_NODE_LIMIT);
+  g_clear_error (&error);
+
+  /* and in bounded memory mode the cursor stops at it */
+  xml_reader_set_bounded_memory (reader, 2, 0);
+  g_assert (xml_reader_load_from_data (reader, buffer->str, NULL) != FALSE);
+  g_assert (xml_reader_read_start_element (reader, "list") != FALSE);
+
+  i = 0;
+  while (xml_reader_try_start_element (reader, "item"))
+    {
+      xml_reader_read_end_element (reader);
+      i += 1;
+    }
+
+  g_assert_cmpint (i, <, 500);
+  g_assert (xml_reader_get_error (reader, &error) != FALSE);
+  g_assert_error (error, XML_READER_ERROR, XML_READER_ERROR_NODE_LIMIT);
+  g_clear_error (&error);
+  xml_reader_set_bounded_memory (reader, 0, 0);
+
+  limits.max_nodes = 3000;
+  xml_reader_set_limits (reader, &limits);
+  g_assert (xml_reader_load_from_data (reader, buffer->str, NULL) != FALSE);
+  g_bytes_unref (bytes);
+  g_string_free (buffer, TRUE);
+
+  /* attributes */
+  buffer = g_string_new ("<list><item");
+  for (i = 0; i < 20; i++)
+    g_string_append_printf (buffer, " a%d=\"%d\"", i, i);
+  g_string_append (buffer, "/></list>");
+
+  limits.max_attributes = 10;
+  xml_reader_set_limits (reader, &limits);
+  assert_limit_error (reader, buffer->str, XML_READER_ERROR_ATTRIBUTE_LIMIT);
+
+  limits.max_attributes = 20;
+  xml_reader_set_limits (reader, &limits);
+  g_assert (xml_reader_load_from_data (reader, buffer->str, NULL) != FALSE);
+  g_string_free (buffer, TRUE);
+
+  /* texts, whatever the chunks the parser hands them in */
+  limits.max_text_length = 4096;
+  xml_reader_set_limits (reader, &limits);
+
+  buffer = g_string_new ("<list><item>");
+  for (i = 0; i < 4097; i++)
+    g_string_append_c (buffer, i % 100 == 0 ? ' ' : 'x');
+  g_string_append (buffer, "</item></list>");
+  assert_limit_error (reader, buffer->str, XML_READER_ERROR_TEXT_LIMIT);
+  g_string_free (buffer, TRUE);
+
+  buffer = g_string_new ("<list><item value=\"");
+  for (i = 0; i < 4097; i++)
+    g_string_append_c (buffer, 'x');
+  g_string_append (buffer, "\"/></list>");
+  assert_limit_error (reader, buffer->str, XML_READER_ERROR_TEXT_LIMIT);
+  g_string_free (buffer, TRUE);
+
+  buffer = g_string_new ("<list>");
+  for (i = 0; i < 1000; i++)
+    g_string_append (buffer, "<item>0123456789</item>");
+  g_string_append (buffer, "</list>");
+  g_assert (xml_reader_load_from_data (reader, buffer->str, NULL) != FALSE);
+  g_string_free (buffer, TRUE);
+
+  /* entities */
+  limits.max_entity_expansion = 10000;
+  xml_reader_set_limits (reader, &limits);
+
+  g_assert (xml_reader_load_from_data (reader,
+                                       "<!DOCTYPE list [<!ENTITY e \"value\">]>"
+                                       "<list><item>&e; &e;</item></list>",
+                                       NULL) != FALSE);
+  g_assert (xml_reader_read_start_element (reader, "list") != FALSE);
+  g_assert_cmpint (xml_reader_count_elements (reader, "item"), ==, 1);
+
+  buffer = g_string_new ("<!DOCTYPE list ["
+                         "<!ENTITY a \"aaaaaaaaaa\">"
+                         "<!ENTITY b \"&a;&a;&a;&a;&a;&a;&a;&a;&a;&a;\">"
+                         "]><list><item>");
+  for (i = 0; i < 200; i++)
+    g_string_append (buffer, "&b;");
+  g_string_append (buffer, "</item></list>");
+
+  g_assert_cmpint (xml_reader_load_from_data (reader, buffer->str, &error), ==, FALSE);
+  g_assert_error (error, XML_READER_ERROR, XML_READER_ERROR_ENTITY_LIMIT);
+  g_clear_error (&error);
+
+  limits.max_entity_expansion = 20000;
+  xml_reader_set_limits (reader, &limits);
+  g_assert (xml_reader_load_from_data (reader, buffer->str, NULL) != FALSE);
+
+  xml_reader_set_limits (reader, NULL);
+  g_assert (xml_reader_load_from_data (reader, buffer->str, NULL) != FALSE);
+  g_string_free (buffer, TRUE);
+
+  g_object_unref (reader);
+}
+
+#ifdef HAVE_ZLIB
+static guint32
+update_crc32 (guint32      crc,
+              const gchar *data,
+              gsize        length)
+{
+  gsize i;
+  gint k;
+
+  crc = ~crc;
+  for (i = 0; i < length; i++)
+    {
+      crc ^= (guchar) data[i];
+      for (k = 0; k < 8; k++)
+        crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+    }
+
+  return ~crc;
+}
+
+static void
+append_uint32_le (GString *buffer,
+                  guint32  value)
+{
+  gint i;
+
+  for (i = 0; i < 4; i++)
+    g_string_append_c (buffer, (value >> (i * 8)) & 0xff);
+}
+
+/* appends @data as a gzip member made of stored deflate blocks */
+static void
+append_gzip_member (GString     *gzip,
+                    const gchar *data,
+                    gsize        length)
+{
+  static const gchar header[] = { 0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 0x03 };
+  gsize offset = 0;
+
+  g_string_append_len (gzip, header, sizeof (header));
+
+  do
+    {
+      gsize block = MIN (length - offset, 65535);
+
+      g_string_append_c (gzip, offset + block == length ? 1 : 0);
+      g_string_append_c (gzip, block & 0xff);
+      g_string_append_c (gzip, block >> 8);
+      g_string_append_c (gzip, ~block & 0xff);
+      g_string_append_c (gzip, (~block >> 8) & 0xff);
+      g_string_append_len (gzip, data + offset, block);
+
+      offset += block;
+    }
+  while (offset < length);
+
+  append_uint32_le (gzip, update_crc32 (0, data, length));
+  append_uint32_le (gzip, length);
+}
+
+static void
+test_gzip (void)
+{
+  XmlReader *reader = xml_reader_new ();
+  XmlReaderStatistics stats;
+  GError *error = NULL;
+  GString *buffer, *gzip;
+  gchar *filename;
+  gboolean loading;
+  gsize half;
+  gint i, pass;
+
+  buffer = g_string_new ("<?xml version=\"1.0\"?><list>");
+  for (i = 0; i < 20000; i++)
+    g_string_append_printf (buffer, "<item id=\"%d\">value %d</item>", i, i);
+  g_string_append (buffer, "</list>");
+
+  /* two members, split in the middle of an element */
+  half = buffer->len / 2;
+  gzip = g_string_new (NULL);
+  append_gzip_member (gzip, buffer->str, half);
+  append_gzip_member (gzip, buffer->str + half, buffer->len - half);
+
+  filename = g_build_filename (g_get_tmp_dir (), "test-gzip.xml.gz", NULL);
+  g_assert (g_file_set_contents (filename, gzip->str, gzip->len, NULL) != FALSE);
+
+  for (pass = 0; pass < 3; pass++)
+    {
+      xml_reader_set_succinct (reader, pass == 2);
+
+      /* the file gets decompressed a step at a time too */
+      if (pass == 1)
+        {
+          g_assert (xml_reader_begin_load_from_file (reader, filename, NULL) != FALSE);
+          while (xml_reader_load_step (reader, 0, &error))
+            ;
+          g_assert_no_error (error);
+        }
+      else
+        g_assert (xml_reader_load_from_file (reader, filename, NULL) != FALSE);
+
+      g_assert (xml_reader_read_start_element (reader, "list") != FALSE);
+      g_assert_cmpint (xml_reader_count_elements (reader, "item"), ==, 20000);
+      g_assert (xml_reader_read_nth_element (reader, "item", 19999) != FALSE);
+      g_assert_cmpstr (xml_reader_get_element_value (reader), ==, "value 19999");
+    }
+
+  /* the file gets decompressed as the cursor moves in bounded memory */
+  xml_reader_set_succinct (reader, FALSE);
+  xml_reader_set_bounded_memory (reader, 2, 0);
+  g_assert (xml_reader_load_from_file (reader, filename, NULL) != FALSE);
+  g_assert (xml_reader_read_start_element (reader, "list") != FALSE);
+
+  for (i = 0; i < 20000; i++)
+    {
+      gchar *value = g_strdup_printf ("value %d", i);
+
+      g_assert (xml_reader_read_start_element (reader, "item") != FALSE);
+      g_assert_cmpstr (xml_reader_get_element_value (reader), ==, value);
+      xml_reader_read_end_element (reader);
+
+      g_free (value);
+    }
+
+  xml_reader_get_statistics (reader, &stats);
+  g_assert_cmpint (stats.n_released, ==, 20000);
+  g_assert_cmpint (stats.tree_memory_peak, <, buffer->len / 4);
+
+  xml_reader_set_bounded_memory (reader, 0, 0);
+
+  /* a step does not wait for a slow decompression beyond its budget */
+  _xml_reader_set_decompress_delay (200000);
+
+  g_assert (xml_reader_begin_load_from_file (reader, filename, NULL) != FALSE);
+  do
+    {
+      gint64 start = g_get_monotonic_time ();
+
+      loading = xml_reader_load_step (reader, 2000, &error);
+      g_assert_cmpint (g_get_monotonic_time () - start, <, 2000 + 100000);
+    }
+  while (loading);
+  g_assert_no_error (error);
+
+  _xml_reader_set_decompress_delay (0);
+
+  g_assert (xml_reader_read_start_element (reader, "list") != FALSE);
+  g_assert_cmpint (xml_reader_count_elements (reader, "item"), ==, 20000);
+
+  g_assert (g_file_set_contents (filename, gzip->str, gzip->len - 100, NULL) != FALSE);
+  g_assert_cmpint (xml_reader_load_from_file (reader, filename, &error), ==, FALSE);
+  g_assert_error (error, XML_READER_ERROR, XML_READER_ERROR_INVALID);
+  g_clear_error (&error);
+
+  /* in bounded memory mode, the error comes with the end of the data */
+  xml_reader_set_bounded_memory (reader, 2, 0);
+  g_assert (xml_reader_load_from_file (reader, filename, NULL) != FALSE);
+  while (xml_reader_read_next_in_document (reader))
+    ;
+  g_assert (xml_reader_get_error (reader, &error) != FALSE);
+  g_assert_error (error, XML_READER_ERROR, XML_READER_ERROR_INVALID);
+  g_error_free (error);
+
+  g_unlink (filename);
+  g_free (filename);
+  g_string_free (gzip, TRUE);
+  g_string_free (buffer, TRUE);
+  g_object_unref (reader);
+}
+#endif /* HAVE_ZLIB */
+
+int
+main (int   argc,
+      char *argv[])
+{
+  g_type_init ();
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/xml-reader/walk", test_walk);
+  g_test_add_func ("/xml-reader/invalid", test_invalid_walk);
+  g_test_add_func ("/xml-reader/try", test_try_walk);
+  g_test_add_func ("/xml-reader/wide", test_wide_walk);
+  g_test_add_func ("/xml-reader/positional", test_positional);
+  g_test_add_func ("/xml-reader/document-order", test_document_order);
+  g_test_add_func ("/xml-reader/visitor", test_visitor);
+  g_test_add_func ("/xml-reader/attributes", test_attributes);
+  g_test_add_func ("/xml-reader/adaptive", test_adaptive);
+  g_test_add_func ("/xml-reader/succinct", test_succinct);
+  g_test_add_func ("/xml-reader/dedup", test_dedup);
+  g_test_add_func ("/xml-reader/out-of-core", test_out_of_core);
+  g_test_add_func ("/xml-reader/raw-xml", test_raw_xml);
+  g_test_add_func ("/xml-reader/bytes", test_bytes);
+  g_test_add_func ("/xml-reader/vectors", test_vectors);
+  g_test_add_func ("/xml-reader/documents", test_documents);
+  g_test_add_func ("/xml-reader/follow", test_follow);
+  g_test_add_func ("/xml-reader/follow-large", test_follow_large);
+  g_test_add_func ("/xml-reader/checkpoint", test_checkpoint);
+  g_test_add_func ("/xml-reader/checkpoint-large", test_checkpoint_large);
+  g_test_add_func ("/xml-reader/checkpoint-nested", test_checkpoint_nested);
+  g_test_add_func ("/xml-reader/shards", test_shards);
+  g_test_add_func ("/xml-reader/bounded-memory", test_bounded_memory);
+  g_test_add_func ("/xml-reader/load-step", test_load_step);
+  g_test_add_func ("/xml-reader/progress", test_progress);
+  g_test_add_func ("/xml-reader/limits", test_limits);
+#ifdef HAVE_ZLIB
+  g_test_add_func ("/xml-reader/gzip", test_gzip);
+#endif
 
   return g_test_run ();
 }
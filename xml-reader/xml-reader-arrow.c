@@ -0,0 +1,258 @@
+/* xml-reader-arrow.c: Arrow C data interface export
+ *
+ * Copyright (C) 2008  Emmanuele Bassi  <ebassi@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Author:
+ *   Emmanuele Bassi  <ebassi@gnome.org>
+ */
+
+/**
+ * SECTION:xml-reader-arrow
+ * @short_description: Arrow C data interface export
+ *
+ * xml_reader_export_arrow() extracts repeated records like
+ * xml_reader_extract_columns() does, and hands the columns over as a
+ * struct array of the
+ * <ulink url="https://arrow.apache.org/docs/format/CDataInterface.html">Arrow
+ * C data interface</ulink>, which analytics engines can import without
+ * copying the values. The interface structures are declared by
+ * xml-reader-arrow.h itself, so no Arrow library is needed.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+
+#include <glib.h>
+
+#include "xml-reader-arrow.h"
+
+static const gchar *
+column_format (XmlReaderColumnType type)
+{
+  switch (type)
+    {
+    case XML_READER_COLUMN_INT64:
+      return "l";
+
+    case XML_READER_COLUMN_DOUBLE:
+      return "g";
+
+    case XML_READER_COLUMN_BOOLEAN:
+      return "b";
+
+    case XML_READER_COLUMN_STRING:
+      return "u";
+    }
+
+  g_assert_not_reached ();
+
+  return NULL;
+}
+
+static void
+release_schema (struct ArrowSchema *schema)
+{
+  gint64 i;
+
+  for (i = 0; i < schema->n_children; i++)
+    {
+      struct ArrowSchema *child = schema->children[i];
+
+      if (child->release != NULL)
+        child->release (child);
+
+      g_free (child);
+    }
+
+  g_free (schema->children);
+  g_free ((gchar *) schema->name);
+
+  schema->release = NULL;
+}
+
+/* the private data of a column array is the column itself, which owns
+ * the buffers
+ */
+static void
+release_column_array (struct ArrowArray *array)
+{
+  XmlReaderColumn *column = array->private_data;
+
+  xml_reader_columns_free (column, 1);
+  g_free (array->buffers);
+
+  array->release = NULL;
+}
+
+static void
+release_struct_array (struct ArrowArray *array)
+{
+  gint64 i;
+
+  for (i = 0; i < array->n_children; i++)
+    {
+      struct ArrowArray *child = array->children[i];
+
+      if (child->release != NULL)
+        child->release (child);
+
+      g_free (child);
+    }
+
+  g_free (array->children);
+  g_free (array->buffers);
+
+  array->release = NULL;
+}
+
+static void
+schema_init (struct ArrowSchema *schema,
+             const gchar        *format,
+             const gchar        *name,
+             gint64              flags,
+             gint64              n_children)
+{
+  memset (schema, 0, sizeof (struct ArrowSchema));
+
+  schema->format = format;
+  schema->name = g_strdup (name);
+  schema->flags = flags;
+  schema->n_children = n_children;
+  schema->children = g_new0 (struct ArrowSchema *, MAX (n_children, 1));
+  schema->release = release_schema;
+}
+
+/* moves the buffers of @column into @array */
+static void
+column_array_init (struct ArrowArray *array,
+                   XmlReaderColumn   *column)
+{
+  memset (array, 0, sizeof (struct ArrowArray));
+
+  array->length = column->n_rows;
+  array->null_count = column->n_nulls;
+  array->buffers = g_new0 (gconstpointer, 3);
+
+  /* the validity bitmap may be omitted when there are no nulls */
+  array->buffers[0] = column->n_nulls > 0 ? column->validity : NULL;
+
+  switch (column->type)
+    {
+    case XML_READER_COLUMN_INT64:
+      array->n_buffers = 2;
+      array->buffers[1] = column->int64_values;
+      break;
+
+    case XML_READER_COLUMN_DOUBLE:
+      array->n_buffers = 2;
+      array->buffers[1] = column->double_values;
+      break;
+
+    case XML_READER_COLUMN_BOOLEAN:
+      array->n_buffers = 2;
+      array->buffers[1] = column->boolean_values;
+      break;
+
+    case XML_READER_COLUMN_STRING:
+      array->n_buffers = 3;
+      array->buffers[1] = column->offsets;
+      array->buffers[2] = column->data;
+      break;
+    }
+
+  array->private_data = g_new (XmlReaderColumn, 1);
+  *((XmlReaderColumn *) array->private_data) = *column;
+  array->release = release_column_array;
+}
+
+/**
+ * xml_reader_export_arrow:
+ * @reader: a #XmlReader
+ * @record_path: the path of the records, as a list of element names
+ *   separated by slashes
+ * @fields: the columns to extract
+ * @n_fields: the number of @fields
+ * @n_threads: the number of threads to use, or 0 to use one per
+ *   processor
+ * @schema: return location for the schema of the exported data
+ * @array: return location for the exported data
+ * @error: return location for a #GError, or %NULL
+ *
+ * Extracts @fields from every element matching @record_path, like
+ * xml_reader_extract_columns(), and exports them as an Arrow struct
+ * array with one nullable child per field: int64 ("l"), float64
+ * ("g"), boolean ("b") or utf8 ("u").
+ *
+ * The column buffers are handed over as they are, without copies. The
+ * consumer owns @schema and @array and must call their release
+ * callbacks once done, as mandated by the Arrow C data interface.
+ *
+ * Return value: %TRUE if @schema and @array were filled
+ */
+gboolean
+xml_reader_export_arrow (XmlReader            *reader,
+                         const gchar          *record_path,
+                         const XmlReaderField *fields,
+                         guint                 n_fields,
+                         guint                 n_threads,
+                         struct ArrowSchema   *schema,
+                         struct ArrowArray    *array,
+                         GError              **error)
+{
+  XmlReaderColumn *columns;
+  guint n_rows, i;
+
+  g_return_val_if_fail (XML_IS_READER (reader), FALSE);
+  g_return_val_if_fail (schema != NULL, FALSE);
+  g_return_val_if_fail (array != NULL, FALSE);
+
+  columns = xml_reader_extract_columns (reader, record_path,
+                                        fields, n_fields,
+                                        n_threads,
+                                        error);
+  if (!columns)
+    return FALSE;
+
+  n_rows = n_fields > 0 ? columns[0].n_rows : 0;
+
+  schema_init (schema, "+s", "", 0, n_fields);
+
+  memset (array, 0, sizeof (struct ArrowArray));
+  array->length = n_rows;
+  array->n_buffers = 1;
+  array->buffers = g_new0 (gconstpointer, 1);
+  array->n_children = n_fields;
+  array->children = g_new0 (struct ArrowArray *, MAX (n_fields, 1));
+  array->release = release_struct_array;
+
+  for (i = 0; i < n_fields; i++)
+    {
+      schema->children[i] = g_new (struct ArrowSchema, 1);
+      schema_init (schema->children[i],
+                   column_format (columns[i].type),
+                   columns[i].name,
+                   ARROW_FLAG_NULLABLE,
+                   0);
+
+      array->children[i] = g_new (struct ArrowArray, 1);
+      column_array_init (array->children[i], &columns[i]);
+    }
+
+  /* the buffers now belong to the arrays */
+  g_free (columns);
+
+  return TRUE;
+}
@@ -0,0 +1,86 @@
+/* xml-reader-arrow.h: Arrow C data interface export
+ *
+ * Copyright (C) 2008  Emmanuele Bassi  <ebassi@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Author:
+ *   Emmanuele Bassi  <ebassi@gnome.org>
+ */
+
+#ifndef __XML_READER_ARROW_H__
+#define __XML_READER_ARROW_H__
+
+#include <stdint.h>
+
+#include <xml-reader/xml-reader.h>
+#include <xml-reader/xml-reader-columns.h>
+
+G_BEGIN_DECLS
+
+/* The structures of the Arrow C data interface, as published by the
+ * Apache Arrow project; they are ABI stable and guarded by the same
+ * macro as the Arrow headers, so both can be included together.
+ */
+#ifndef ARROW_C_DATA_INTERFACE
+#define ARROW_C_DATA_INTERFACE
+
+#define ARROW_FLAG_DICTIONARY_ORDERED 1
+#define ARROW_FLAG_NULLABLE 2
+#define ARROW_FLAG_MAP_KEYS_SORTED 4
+
+struct ArrowSchema {
+  /* Array type description */
+  const char* format;
+  const char* name;
+  const char* metadata;
+  int64_t flags;
+  int64_t n_children;
+  struct ArrowSchema** children;
+  struct ArrowSchema* dictionary;
+
+  /* Release callback */
+  void (*release)(struct ArrowSchema*);
+  /* Opaque producer-specific data */
+  void* private_data;
+};
+
+struct ArrowArray {
+  /* Array data description */
+  int64_t length;
+  int64_t null_count;
+  int64_t offset;
+  int64_t n_buffers;
+  int64_t n_children;
+  const void** buffers;
+  struct ArrowArray** children;
+  struct ArrowArray* dictionary;
+
+  /* Release callback */
+  void (*release)(struct ArrowArray*);
+  /* Opaque producer-specific data */
+  void* private_data;
+};
+
+#endif /* ARROW_C_DATA_INTERFACE */
+
+gboolean xml_reader_export_arrow (XmlReader            *reader,
+                                  const gchar          *record_path,
+                                  const XmlReaderField *fields,
+                                  guint                 n_fields,
+                                  guint                 n_threads,
+                                  struct ArrowSchema   *schema,
+                                  struct ArrowArray    *array,
+                                  GError              **error);
+
+G_END_DECLS
+
+#endif /* __XML_READER_ARROW_H__ */
@@ -0,0 +1,983 @@
+/* xml-reader-columns.c: Columnar extraction of repeated records
+ *
+ * Copyright (C) 2008  Emmanuele Bassi  <ebassi@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Author:
+ *   Emmanuele Bassi  <ebassi@gnome.org>
+ */
+
+/**
+ * SECTION:xml-reader-columns
+ * @short_description: Columnar extraction of repeated records
+ *
+ * Documents made of many sibling records, like a catalog of
+ * &lt;item&gt; elements, are often consumed one field at a time:
+ * every record is entered with the cursor API and each field is read
+ * and converted. xml_reader_extract_columns() does the same work in a
+ * single pass over the records, optionally split across threads, and
+ * stores each field in a typed column.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include <libxml/tree.h>
+
+#include <glib.h>
+
+#include "xml-reader-columns.h"
+#include "xml-reader-private.h"
+
+/* below this number of records per thread, threads cost more than
+ * they save
+ */
+#define MIN_RECORDS_PER_THREAD  4096
+
+/* the records extracted at once in bounded memory mode */
+#define STREAM_BATCH_RECORDS    4096
+
+typedef struct _FieldPath       FieldPath;
+typedef struct _ExtractJob      ExtractJob;
+typedef struct _ExtractSlice    ExtractSlice;
+typedef struct _StreamJob       StreamJob;
+
+struct _FieldPath
+{
+  /* element names leading to the value, "." is skipped */
+  gchar **steps;
+
+  /* the attribute holding the value, if any */
+  const gchar *attribute;
+};
+
+struct _ExtractJob
+{
+  GPtrArray *records;
+
+  const XmlReaderField *fields;
+  FieldPath *paths;
+  guint n_fields;
+
+  XmlReaderColumn *columns;
+};
+
+struct _ExtractSlice
+{
+  ExtractJob *job;
+
+  guint start;
+  guint end;
+
+  /* per column: the number of missing values and, for string columns,
+   * the characters of the rows of this slice, and whether one of them
+   * was too long for the offsets
+   */
+  guint *n_nulls;
+  GString **strings;
+  gboolean *too_long;
+};
+
+/* the extraction of a document parsed in bounded memory mode: the
+ * records at @depth parsed so far, and the columns of those before
+ */
+struct _StreamJob
+{
+  XmlReader *reader;
+
+  const XmlReaderField *fields;
+  guint n_fields;
+  guint n_threads;
+
+  GPtrArray *records;
+  gint depth;
+
+  XmlReaderColumn *columns;
+};
+
+/* the number of processors online; g_get_num_processors() needs a
+ * newer GLib than the one required
+ */
+static guint
+count_processors (void)
+{
+#if defined (HAVE_UNISTD_H) && defined (_SC_NPROCESSORS_ONLN)
+  glong n = sysconf (_SC_NPROCESSORS_ONLN);
+
+  if (n > 0)
+    return n;
+#endif
+
+  return 1;
+}
+
+static void
+field_path_init (FieldPath   *path,
+                 const gchar *spec)
+{
+  gchar **steps, **step, **out;
+
+  steps = g_strsplit (spec, "/", -1);
+
+  path->attribute = NULL;
+
+  for (step = out = steps; *step != NULL; step++)
+    {
+      if (**step == '\0' || strcmp (*step, ".") == 0)
+        g_free (*step);
+      else if (**step == '@' && *(step + 1) == NULL)
+        {
+          path->attribute = *step + 1;
+          *out++ = *step;
+        }
+      else
+        *out++ = *step;
+    }
+
+  *out = NULL;
+
+  path->steps = steps;
+}
+
+/* the attribute, if any, is kept as the last step */
+static inline guint
+field_path_n_elements (const FieldPath *path)
+{
+  guint n = g_strv_length (path->steps);
+
+  return path->attribute ? n - 1 : n;
+}
+
+/* @name matches either the local name or, for a prefixed node, the
+ * qualified name, like dc:title
+ */
+static gboolean
+name_matches (xmlNsPtr       ns,
+              const xmlChar *local_name,
+              const gchar   *name)
+{
+  const gchar *prefix;
+  gsize prefix_len;
+
+  if (strcmp (XML_TO_CHAR (local_name), name) == 0)
+    return TRUE;
+
+  if (ns == NULL || ns->prefix == NULL)
+    return FALSE;
+
+  prefix = XML_TO_CHAR (ns->prefix);
+  prefix_len = strlen (prefix);
+
+  return strncmp (name, prefix, prefix_len) == 0 &&
+         name[prefix_len] == ':' &&
+         strcmp (name + prefix_len + 1, XML_TO_CHAR (local_name)) == 0;
+}
+
+static inline gboolean
+node_matches (xmlNodePtr   node,
+              const gchar *name)
+{
+  return node->type == XML_ELEMENT_NODE &&
+         (strcmp (name, "*") == 0 ||
+          name_matches (node->ns, node->name, name));
+}
+
+/* returns the value of @path inside @record, or %NULL if it is missing;
+ * only reads the tree, so it can run on several threads at once
+ */
+static const gchar *
+field_path_resolve (const FieldPath  *path,
+                    xmlNodePtr        record,
+                    xmlChar         **copy)
+{
+  xmlNodePtr node = record, child;
+  guint i, n_elements;
+
+  *copy = NULL;
+
+  n_elements = field_path_n_elements (path);
+  for (i = 0; i < n_elements; i++)
+    {
+      for (child = node->xmlChildrenNode; child != NULL; child = child->next)
+        if (node_matches (child, path->steps[i]))
+          break;
+
+      if (child == NULL)
+        return NULL;
+
+      node = child;
+    }
+
+  if (path->attribute)
+    {
+      xmlAttrPtr attr;
+
+      for (attr = node->properties; attr != NULL; attr = attr->next)
+        if (name_matches (attr->ns, attr->name, path->attribute))
+          return _xml_reader_peek_attribute_value (attr, copy);
+
+      return NULL;
+    }
+
+  child = node->xmlChildrenNode;
+  if (child && xmlNodeIsText (child))
+    return XML_TO_CHAR (child->content);
+
+  return "";
+}
+
+static gboolean
+parse_boolean (const gchar *value,
+               gboolean    *retval)
+{
+  while (g_ascii_isspace (*value))
+    value++;
+
+  if (strncmp (value, "true", 4) == 0)
+    {
+      *retval = TRUE;
+      value += 4;
+    }
+  else if (strncmp (value, "false", 5) == 0)
+    {
+      *retval = FALSE;
+      value += 5;
+    }
+  else if (*value == '1' || *value == '0')
+    {
+      *retval = (*value == '1');
+      value += 1;
+    }
+  else
+    return FALSE;
+
+  while (g_ascii_isspace (*value))
+    value++;
+
+  return *value == '\0';
+}
+
+/* a number must take the whole value, surrounding blanks aside */
+static inline gboolean
+is_number_end (const gchar *value,
+               const gchar *end)
+{
+  if (end == value)
+    return FALSE;
+
+  while (g_ascii_isspace (*end))
+    end++;
+
+  return *end == '\0';
+}
+
+static inline void
+set_bit (guint8 *bitmap,
+         guint   bit)
+{
+  bitmap[bit >> 3] |= 1 << (bit & 7);
+}
+
+/* stores @value, or a null if it is %NULL or does not convert to the
+ * column type, out of range numbers included, in @row of @column
+ */
+static void
+column_store (XmlReaderColumn *column,
+              ExtractSlice    *slice,
+              guint            field,
+              guint            row,
+              const gchar     *value)
+{
+  gchar *end;
+  gboolean bool_value;
+  gsize len;
+
+  if (value == NULL)
+    goto null;
+
+  switch (column->type)
+    {
+    case XML_READER_COLUMN_INT64:
+      errno = 0;
+      column->int64_values[row] = g_ascii_strtoll (value, &end, 10);
+      if (!is_number_end (value, end) || errno == ERANGE)
+        goto null;
+      break;
+
+    case XML_READER_COLUMN_DOUBLE:
+      errno = 0;
+      column->double_values[row] = g_ascii_strtod (value, &end);
+      if (!is_number_end (value, end) || errno == ERANGE)
+        goto null;
+      break;
+
+    case XML_READER_COLUMN_BOOLEAN:
+      if (!parse_boolean (value, &bool_value))
+        goto null;
+      if (bool_value)
+        set_bit (column->boolean_values, row);
+      break;
+
+    case XML_READER_COLUMN_STRING:
+      /* the length for now; the offsets are summed up once every
+       * slice is done
+       */
+      len = strlen (value);
+      if (len > G_MAXINT32)
+        {
+          slice->too_long[field] = TRUE;
+          goto null;
+        }
+
+      g_string_append_len (slice->strings[field], value, len);
+      column->offsets[row + 1] = len;
+      break;
+    }
+
+  set_bit (column->validity, row);
+
+  return;
+
+null:
+  slice->n_nulls[field] += 1;
+}
+
+static gpointer
+extract_slice (gpointer data)
+{
+  ExtractSlice *slice = data;
+  ExtractJob *job = slice->job;
+  guint row, field;
+
+  for (row = slice->start; row < slice->end; row++)
+    {
+      xmlNodePtr record = g_ptr_array_index (job->records, row);
+
+      for (field = 0; field < job->n_fields; field++)
+        {
+          const gchar *value;
+          xmlChar *copy;
+
+          value = field_path_resolve (&job->paths[field], record, &copy);
+          column_store (&job->columns[field], slice, field, row, value);
+
+          if (copy)
+            xmlFree (copy);
+        }
+    }
+
+  return NULL;
+}
+
+/* collects the elements matching @record_path below @context */
+static GPtrArray *
+collect_records (xmlNodePtr   context,
+                 const gchar *record_path)
+{
+  GPtrArray *level, *next;
+  gchar **steps, **step;
+  guint i;
+
+  level = g_ptr_array_new ();
+  g_ptr_array_add (level, context);
+
+  steps = g_strsplit (record_path, "/", -1);
+  for (step = steps; *step != NULL; step++)
+    {
+      if (**step == '\0' || strcmp (*step, ".") == 0)
+        continue;
+
+      next = g_ptr_array_new ();
+
+      for (i = 0; i < level->len; i++)
+        {
+          xmlNodePtr node = g_ptr_array_index (level, i);
+          xmlNodePtr child;
+
+          for (child = node->xmlChildrenNode; child != NULL; child = child->next)
+            if (node_matches (child, *step))
+              g_ptr_array_add (next, child);
+        }
+
+      g_ptr_array_free (level, TRUE);
+      level = next;
+    }
+
+  g_strfreev (steps);
+
+  return level;
+}
+
+static void
+column_init (XmlReaderColumn      *column,
+             const XmlReaderField *field,
+             guint                 n_rows)
+{
+  gsize bitmap_size = (n_rows + 7) / 8;
+
+  memset (column, 0, sizeof (XmlReaderColumn));
+
+  column->name = g_strdup (field->name);
+  column->type = field->type;
+  column->n_rows = n_rows;
+  column->validity = g_malloc0 (MAX (bitmap_size, 1));
+
+  switch (field->type)
+    {
+    case XML_READER_COLUMN_INT64:
+      column->int64_values = g_new0 (gint64, MAX (n_rows, 1));
+      break;
+
+    case XML_READER_COLUMN_DOUBLE:
+      column->double_values = g_new0 (gdouble, MAX (n_rows, 1));
+      break;
+
+    case XML_READER_COLUMN_BOOLEAN:
+      column->boolean_values = g_malloc0 (MAX (bitmap_size, 1));
+      break;
+
+    case XML_READER_COLUMN_STRING:
+      column->offsets = g_new0 (gint32, n_rows + 1);
+      break;
+    }
+}
+
+/* turns the string lengths into offsets and joins the characters of
+ * every slice
+ */
+static gboolean
+column_finish_strings (XmlReaderColumn  *column,
+                       ExtractSlice     *slices,
+                       guint             n_slices,
+                       guint             field,
+                       GError          **error)
+{
+  gsize total = 0;
+  guint i;
+
+  for (i = 0; i < n_slices; i++)
+    {
+      if (slices[i].too_long[field])
+        total = G_MAXSIZE;
+      else if (total != G_MAXSIZE)
+        total += slices[i].strings[field]->len;
+    }
+
+  if (total > G_MAXINT32)
+    {
+      g_set_error (error, XML_READER_ERROR,
+                   XML_READER_ERROR_INVALID,
+                   "The values of column `%s' exceed 2GB",
+                   column->name);
+      return FALSE;
+    }
+
+  column->data = g_malloc (MAX (total, 1));
+
+  total = 0;
+  for (i = 0; i < n_slices; i++)
+    {
+      memcpy (column->data + total,
+              slices[i].strings[field]->str,
+              slices[i].strings[field]->len);
+      total += slices[i].strings[field]->len;
+    }
+
+  column->offsets[0] = 0;
+  for (i = 0; i < column->n_rows; i++)
+    column->offsets[i + 1] += column->offsets[i];
+
+  return TRUE;
+}
+
+/* extracts @fields from each of @records into new columns */
+static XmlReaderColumn *
+extract_records (GPtrArray             *records,
+                 const XmlReaderField  *fields,
+                 guint                  n_fields,
+                 guint                  n_threads,
+                 GError               **error)
+{
+  XmlReaderColumn *columns;
+  ExtractSlice *slices;
+  ExtractJob job;
+  GThread **threads;
+  guint n_rows, n_slices, rows_per_slice, i, j;
+  gboolean retval = TRUE;
+
+  job.records = records;
+  job.fields = fields;
+  job.n_fields = n_fields;
+  job.paths = g_new (FieldPath, n_fields);
+  job.columns = columns = g_new (XmlReaderColumn, n_fields);
+
+  n_rows = job.records->len;
+
+  for (i = 0; i < n_fields; i++)
+    {
+      field_path_init (&job.paths[i], fields[i].path);
+      column_init (&columns[i], &fields[i], n_rows);
+    }
+
+  if (n_threads == 0)
+    n_threads = count_processors ();
+
+  n_slices = MAX (1, MIN (n_threads, n_rows / MIN_RECORDS_PER_THREAD));
+
+  /* slices start on a byte boundary of the bitmaps, so that threads
+   * never write to the same byte
+   */
+  rows_per_slice = (n_rows + n_slices - 1) / n_slices;
+  rows_per_slice = (rows_per_slice + 7) & ~7;
+
+  slices = g_new0 (ExtractSlice, n_slices);
+  for (i = 0; i < n_slices; i++)
+    {
+      slices[i].job = &job;
+      slices[i].start = MIN (i * rows_per_slice, n_rows);
+      slices[i].end = MIN (slices[i].start + rows_per_slice, n_rows);
+      slices[i].n_nulls = g_new0 (guint, n_fields);
+      slices[i].strings = g_new0 (GString *, n_fields);
+      slices[i].too_long = g_new0 (gboolean, n_fields);
+
+      for (j = 0; j < n_fields; j++)
+        if (fields[j].type == XML_READER_COLUMN_STRING)
+          slices[i].strings[j] = g_string_new (NULL);
+    }
+
+  /* the first slice runs on the calling thread */
+  threads = g_new0 (GThread *, n_slices);
+  for (i = 1; i < n_slices; i++)
+    threads[i] = g_thread_new ("xml-reader-columns", extract_slice, &slices[i]);
+
+  extract_slice (&slices[0]);
+
+  for (i = 1; i < n_slices; i++)
+    g_thread_join (threads[i]);
+
+  for (j = 0; j < n_fields; j++)
+    {
+      for (i = 0; i < n_slices; i++)
+        columns[j].n_nulls += slices[i].n_nulls[j];
+
+      if (retval && fields[j].type == XML_READER_COLUMN_STRING)
+        retval = column_finish_strings (&columns[j], slices, n_slices, j, error);
+    }
+
+  for (i = 0; i < n_slices; i++)
+    {
+      for (j = 0; j < n_fields; j++)
+        if (slices[i].strings[j])
+          g_string_free (slices[i].strings[j], TRUE);
+
+      g_free (slices[i].strings);
+      g_free (slices[i].too_long);
+      g_free (slices[i].n_nulls);
+    }
+
+  for (i = 0; i < n_fields; i++)
+    g_strfreev (job.paths[i].steps);
+
+  g_free (threads);
+  g_free (slices);
+  g_free (job.paths);
+
+  if (!retval)
+    {
+      xml_reader_columns_free (columns, n_fields);
+      return NULL;
+    }
+
+  return columns;
+}
+
+/* appends the @src_len bits of @src after the first @dest_len bits of
+ * @dest, which has room for them
+ */
+static void
+bitmap_append (guint8       *dest,
+               guint         dest_len,
+               const guint8 *src,
+               guint         src_len)
+{
+  guint i;
+
+  for (i = 0; i < src_len; i++)
+    {
+      guint row = dest_len + i;
+
+      if (row % 8 == 0)
+        dest[row / 8] = 0;
+
+      if ((src[i / 8] >> (i % 8)) & 1)
+        dest[row / 8] |= 1 << (row % 8);
+    }
+}
+
+/* appends the rows of @src to those of @dest */
+static gboolean
+column_append (XmlReaderColumn        *dest,
+               const XmlReaderColumn  *src,
+               GError                **error)
+{
+  guint n_rows = dest->n_rows + src->n_rows;
+  gsize bitmap_size = MAX ((n_rows + 7) / 8, 1);
+  gsize data_len = 0;
+  guint i;
+
+  if (dest->type == XML_READER_COLUMN_STRING)
+    {
+      data_len = (gsize) dest->offsets[dest->n_rows] + src->offsets[src->n_rows];
+
+      if (data_len > G_MAXINT32)
+        {
+          g_set_error (error, XML_READER_ERROR,
+                       XML_READER_ERROR_INVALID,
+                       "The values of column `%s' exceed 2GB",
+                       dest->name);
+          return FALSE;
+        }
+    }
+
+  dest->validity = g_realloc (dest->validity, bitmap_size);
+  bitmap_append (dest->validity, dest->n_rows, src->validity, src->n_rows);
+
+  switch (dest->type)
+    {
+    case XML_READER_COLUMN_INT64:
+      dest->int64_values = g_renew (gint64, dest->int64_values, MAX (n_rows, 1));
+      memcpy (dest->int64_values + dest->n_rows, src->int64_values,
+              src->n_rows * sizeof (gint64));
+      break;
+
+    case XML_READER_COLUMN_DOUBLE:
+      dest->double_values = g_renew (gdouble, dest->double_values, MAX (n_rows, 1));
+      memcpy (dest->double_values + dest->n_rows, src->double_values,
+              src->n_rows * sizeof (gdouble));
+      break;
+
+    case XML_READER_COLUMN_BOOLEAN:
+      dest->boolean_values = g_realloc (dest->boolean_values, bitmap_size);
+      bitmap_append (dest->boolean_values, dest->n_rows,
+                     src->boolean_values, src->n_rows);
+      break;
+
+    case XML_READER_COLUMN_STRING:
+      dest->offsets = g_renew (gint32, dest->offsets, n_rows + 1);
+      for (i = 1; i <= src->n_rows; i++)
+        dest->offsets[dest->n_rows + i] = dest->offsets[dest->n_rows] + src->offsets[i];
+
+      dest->data = g_realloc (dest->data, MAX (data_len, 1));
+      memcpy (dest->data + dest->offsets[dest->n_rows], src->data,
+              src->offsets[src->n_rows]);
+      break;
+    }
+
+  dest->n_rows = n_rows;
+  dest->n_nulls += src->n_nulls;
+
+  return TRUE;
+}
+
+/* extracts the records of @stream parsed so far, which get released
+ * if they are at the release depth, and appends them to its columns
+ */
+static gboolean
+stream_flush (StreamJob  *stream,
+              GError    **error)
+{
+  XmlReaderColumn *columns;
+  gboolean retval = TRUE;
+  guint i;
+
+  columns = extract_records (stream->records,
+                             stream->fields, stream->n_fields,
+                             stream->n_threads,
+                             error);
+  if (!columns)
+    return FALSE;
+
+  if (stream->columns == NULL)
+    stream->columns = columns;
+  else
+    {
+      for (i = 0; retval && i < stream->n_fields; i++)
+        retval = column_append (&stream->columns[i], &columns[i], error);
+
+      xml_reader_columns_free (columns, stream->n_fields);
+    }
+
+  for (i = 0; i < stream->records->len; i++)
+    _xml_reader_window_release (stream->reader,
+                                g_ptr_array_index (stream->records, i),
+                                stream->depth);
+
+  g_ptr_array_set_size (stream->records, 0);
+
+  return retval;
+}
+
+/* whether the records of @stream parsed so far make a batch, by their
+ * number or by the memory the document takes
+ */
+static gboolean
+stream_is_full (StreamJob *stream)
+{
+  XmlReaderPrivate *priv = stream->reader->priv;
+
+  if (stream->records->len >= STREAM_BATCH_RECORDS)
+    return TRUE;
+
+  return priv->memory_limit > 0 && priv->stats.tree_memory > priv->memory_limit / 2;
+}
+
+/* extracts the elements matching @steps below @parent, at @depth, or
+ * @parent itself once there are no steps left, as the document gets
+ * parsed; the elements left behind at the release depth are released
+ */
+static gboolean
+stream_records (StreamJob    *stream,
+                xmlNodePtr    parent,
+                gchar       **steps,
+                gint          depth,
+                GError      **error)
+{
+  XmlReader *reader = stream->reader;
+  xmlNodePtr child, next;
+
+  while (*steps != NULL && (**steps == '\0' || strcmp (*steps, ".") == 0))
+    steps++;
+
+  if (*steps == NULL)
+    {
+      if (_xml_reader_window_complete (reader, parent))
+        {
+          stream->depth = depth;
+          g_ptr_array_add (stream->records, parent);
+        }
+
+      return TRUE;
+    }
+
+  for (child = _xml_reader_next_element (reader, parent, NULL);
+       child != NULL;
+       child = next)
+    {
+      guint n_records = stream->records->len;
+
+      if (node_matches (child, *steps) &&
+          !stream_records (stream, child, steps + 1, depth + 1, error))
+        return FALSE;
+
+      /* @child is complete once the next element started */
+      next = _xml_reader_next_element (reader, parent, child);
+
+      if (stream->records->len > n_records &&
+          g_ptr_array_index (stream->records, n_records) == child)
+        {
+          /* a record, released along with its batch */
+          if (stream_is_full (stream) && !stream_flush (stream, error))
+            return FALSE;
+        }
+      else if (depth + 1 == reader->priv->release_depth)
+        {
+          /* the records inside go first */
+          if (stream->records->len > n_records &&
+              !stream_flush (stream, error))
+            return FALSE;
+
+          _xml_reader_window_release (reader, child, depth + 1);
+        }
+      else if (stream_is_full (stream) && !stream_flush (stream, error))
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
+/**
+ * xml_reader_extract_columns:
+ * @reader: a #XmlReader
+ * @record_path: the path of the records, as a list of element names
+ *   separated by slashes
+ * @fields: the columns to extract
+ * @n_fields: the number of @fields
+ * @n_threads: the number of threads to use, or 0 to use one per
+ *   processor
+ * @error: return location for a #GError, or %NULL
+ *
+ * Extracts the values of @fields from every element matching
+ * @record_path into typed columns, one per field.
+ *
+ * @record_path is resolved from the element the cursor is on or, if the
+ * cursor has not been moved yet, from the document, in which case its
+ * first step is the root element. Every element matching a step is
+ * searched for the next one, so "catalog/section/item" selects the
+ * items of all the sections; the name "*" matches any element. Names
+ * match the local name of a node or its prefixed name, like "dc:title".
+ *
+ * In bounded memory mode, see xml_reader_set_bounded_memory(), the
+ * records are extracted by batches as the document gets parsed, and
+ * the records and the elements left behind that are at the release
+ * depth get released; the records already released are not extracted.
+ *
+ * Values that are missing, or that cannot be converted to the type of
+ * their column, are stored as nulls. The records are processed in a
+ * single pass; documents with many records are split in contiguous
+ * ranges processed by up to @n_threads threads.
+ *
+ * |[
+ *   static const XmlReaderField fields[] = {
+ *     { "id", "@id", XML_READER_COLUMN_INT64 },
+ *     { "title", "title", XML_READER_COLUMN_STRING },
+ *     { "price", "price", XML_READER_COLUMN_DOUBLE },
+ *   };
+ *   XmlReaderColumn *columns;
+ *
+ *   columns = xml_reader_extract_columns (reader, "catalog/item",
+ *                                         fields, G_N_ELEMENTS (fields),
+ *                                         0,
+ *                                         &amp;error);
+ * ]|
+ *
+ * Return value: a newly allocated array of @n_fields columns, to be
+ *   freed with xml_reader_columns_free(), or %NULL on failure
+ */
+XmlReaderColumn *
+xml_reader_extract_columns (XmlReader            *reader,
+                            const gchar          *record_path,
+                            const XmlReaderField *fields,
+                            guint                 n_fields,
+                            guint                 n_threads,
+                            GError              **error)
+{
+  XmlReaderPrivate *priv;
+  XmlReaderColumn *columns;
+  GPtrArray *records;
+  xmlNodePtr context;
+
+  g_return_val_if_fail (XML_IS_READER (reader), NULL);
+  g_return_val_if_fail (record_path != NULL, NULL);
+  g_return_val_if_fail (fields != NULL || n_fields == 0, NULL);
+
+  priv = reader->priv;
+
+  if (priv->succinct)
+    {
+      g_set_error_literal (error, XML_READER_ERROR,
+                           XML_READER_ERROR_INVALID,
+                           "Columns cannot be extracted in succinct mode");
+      return NULL;
+    }
+
+  if (xml_reader_get_error (reader, NULL) || !priv->current_doc)
+    {
+      g_set_error (error, XML_READER_ERROR,
+                   XML_READER_ERROR_UNKNOWN_NODE,
+                   "The reader is not positioned on a document");
+      return NULL;
+    }
+
+  if (priv->node_cursor)
+    context = priv->node_cursor;
+  else
+    context = (xmlNodePtr) priv->current_doc;
+
+  if (priv->windowed)
+    {
+      StreamJob stream;
+      gchar **steps;
+      gboolean retval;
+
+      stream.reader = reader;
+      stream.fields = fields;
+      stream.n_fields = n_fields;
+      stream.n_threads = n_threads;
+      stream.records = g_ptr_array_new ();
+      stream.depth = 0;
+      stream.columns = NULL;
+
+      steps = g_strsplit (record_path, "/", -1);
+      retval = stream_records (&stream, context, steps,
+                               priv->node_cursor != NULL ? priv->depth : 0,
+                               error);
+      g_strfreev (steps);
+
+      if (retval && xml_reader_get_error (reader, NULL))
+        {
+          g_set_error_literal (error, XML_READER_ERROR,
+                               priv->last_error,
+                               "The document exceeds its limits before the last record");
+          retval = FALSE;
+        }
+
+      /* the last batch, which is empty without any record */
+      if (retval && (stream.records->len > 0 || stream.columns == NULL))
+        retval = stream_flush (&stream, error);
+
+      g_ptr_array_free (stream.records, TRUE);
+
+      if (!retval)
+        {
+          xml_reader_columns_free (stream.columns, n_fields);
+          return NULL;
+        }
+
+      return stream.columns;
+    }
+
+  records = collect_records (context, record_path);
+  columns = extract_records (records, fields, n_fields, n_threads, error);
+  g_ptr_array_free (records, TRUE);
+
+  return columns;
+}
+
+/**
+ * xml_reader_columns_free:
+ * @columns: an array of #XmlReaderColumn
+ * @n_columns: the number of @columns
+ *
+ * Frees the columns returned by xml_reader_extract_columns(), along
+ * with their buffers.
+ */
+void
+xml_reader_columns_free (XmlReaderColumn *columns,
+                         guint            n_columns)
+{
+  guint i;
+
+  if (columns == NULL)
+    return;
+
+  for (i = 0; i < n_columns; i++)
+    {
+      g_free (columns[i].name);
+      g_free (columns[i].validity);
+      g_free (columns[i].int64_values);
+      g_free (columns[i].double_values);
+      g_free (columns[i].boolean_values);
+      g_free (columns[i].offsets);
+      g_free (columns[i].data);
+    }
+
+  g_free (columns);
+}
@@ -0,0 +1,136 @@
+/* xml-reader-columns.h: Columnar extraction of repeated records
+ *
+ * Copyright (C) 2008  Emmanuele Bassi  <ebassi@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Author:
+ *   Emmanuele Bassi  <ebassi@gnome.org>
+ */
+
+#ifndef __XML_READER_COLUMNS_H__
+#define __XML_READER_COLUMNS_H__
+
+#include <xml-reader/xml-reader.h>
+
+G_BEGIN_DECLS
+
+/**
+ * XmlReaderColumnType:
+ * @XML_READER_COLUMN_INT64: 64 bit signed integers
+ * @XML_READER_COLUMN_DOUBLE: double precision floating point numbers
+ * @XML_READER_COLUMN_BOOLEAN: booleans, written as "true", "false", "1"
+ *   or "0"
+ * @XML_READER_COLUMN_STRING: UTF-8 strings
+ *
+ * The types of the values of a #XmlReaderColumn.
+ */
+typedef enum {
+  XML_READER_COLUMN_INT64,
+  XML_READER_COLUMN_DOUBLE,
+  XML_READER_COLUMN_BOOLEAN,
+  XML_READER_COLUMN_STRING
+} XmlReaderColumnType;
+
+typedef struct _XmlReaderField          XmlReaderField;
+typedef struct _XmlReaderColumn         XmlReaderColumn;
+
+/**
+ * XmlReaderField:
+ * @name: the name of the column
+ * @path: the location of the value, relative to the record element: a
+ *   list of element names separated by slashes, optionally ending with
+ *   an attribute name prefixed by "@"; "." is the record itself
+ * @type: the type of the column
+ *
+ * Describes a column to extract with xml_reader_extract_columns().
+ * For instance, the path "price/@currency" selects the "currency"
+ * attribute of the first &lt;price&gt; child of each record.
+ */
+struct _XmlReaderField
+{
+  const gchar *name;
+  const gchar *path;
+  XmlReaderColumnType type;
+};
+
+/**
+ * XmlReaderColumn:
+ * @name: the name of the column
+ * @type: the type of the column
+ * @n_rows: the number of rows
+ * @n_nulls: the number of rows without a value
+ * @validity: bitmap with a bit set for every row that has a value
+ * @int64_values: the values of a %XML_READER_COLUMN_INT64 column
+ * @double_values: the values of a %XML_READER_COLUMN_DOUBLE column
+ * @boolean_values: the values of a %XML_READER_COLUMN_BOOLEAN column,
+ *   as a bitmap
+ * @offsets: for a %XML_READER_COLUMN_STRING column, @n_rows + 1 offsets
+ *   inside @data; the value of row i starts at offsets[i] and ends
+ *   before offsets[i + 1]
+ * @data: the characters of a %XML_READER_COLUMN_STRING column, stored
+ *   contiguously and without nul terminators
+ *
+ * A column of values extracted by xml_reader_extract_columns(). The
+ * buffers that do not apply to the column type are %NULL. Bitmaps hold
+ * the bit of row i in bit (i % 8) of byte (i / 8); see
+ * XML_READER_COLUMN_IS_VALID() and XML_READER_COLUMN_GET_BOOLEAN().
+ */
+struct _XmlReaderColumn
+{
+  gchar *name;
+  XmlReaderColumnType type;
+
+  guint n_rows;
+  guint n_nulls;
+
+  guint8 *validity;
+
+  gint64 *int64_values;
+  gdouble *double_values;
+  guint8 *boolean_values;
+
+  gint32 *offsets;
+  gchar *data;
+};
+
+/**
+ * XML_READER_COLUMN_IS_VALID:
+ * @column: a #XmlReaderColumn
+ * @row: a row index
+ *
+ * Evaluates to %TRUE if @row of @column has a value.
+ */
+#define XML_READER_COLUMN_IS_VALID(column,row) \
+        ((((column)->validity[(row) >> 3]) >> ((row) & 7)) & 1)
+
+/**
+ * XML_READER_COLUMN_GET_BOOLEAN:
+ * @column: a #XmlReaderColumn of type %XML_READER_COLUMN_BOOLEAN
+ * @row: a row index
+ *
+ * Evaluates to the boolean value of @row of @column.
+ */
+#define XML_READER_COLUMN_GET_BOOLEAN(column,row) \
+        ((((column)->boolean_values[(row) >> 3]) >> ((row) & 7)) & 1)
+
+XmlReaderColumn *xml_reader_extract_columns (XmlReader            *reader,
+                                             const gchar          *record_path,
+                                             const XmlReaderField *fields,
+                                             guint                 n_fields,
+                                             guint                 n_threads,
+                                             GError              **error);
+void             xml_reader_columns_free    (XmlReaderColumn      *columns,
+                                             guint                 n_columns);
+
+G_END_DECLS
+
+#endif /* __XML_READER_COLUMNS_H__ */
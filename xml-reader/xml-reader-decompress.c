@@ -0,0 +1,500 @@
+/* xml-reader-decompress.c: Compressed input
+ *
+ * Copyright (C) 2008  Emmanuele Bassi  <ebassi@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Author:
+ *   Emmanuele Bassi  <ebassi@gnome.org>
+ */
+
+/* Compressed files are inflated by a thread of their own into a ring
+ * of buffers, which the parser consumes as they get filled: the two
+ * run on different processors, and only the buffers of the ring are
+ * ever allocated, whatever the size of the document.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include <glib.h>
+
+#include "xml-reader-private.h"
+
+/* size and number of the buffers handed from the thread to the parser */
+#define DECOMPRESS_BUFFER_SIZE  (256 * 1024)
+#define DECOMPRESS_N_BUFFERS    4
+
+typedef struct {
+  gchar *data;
+  gsize size;
+} DecompressChunk;
+
+struct _XmlReaderDecompressor
+{
+  XmlReaderCompression compression;
+
+  const gchar *input;
+  gsize input_len;
+
+  GThread *thread;
+
+  /* the empty buffers, for the thread, and the filled ones, for the
+   * parser; a chunk without data marks the end of the output
+   */
+  GAsyncQueue *free_chunks;
+  GAsyncQueue *full_chunks;
+
+  DecompressChunk chunks[DECOMPRESS_N_BUFFERS];
+  DecompressChunk end;
+
+  /* the chunk held by the parser */
+  DecompressChunk *current;
+
+  volatile gint cancelled;
+  gboolean finished;
+
+  /* set by the thread before the end of the output */
+  gchar *error_message;
+};
+
+/* how long the thread sleeps before handing each buffer over */
+static volatile gint decompress_delay = 0;
+
+/* makes the decompressing threads slower than the parser, by @usec
+ * microseconds per buffer; for testing
+ */
+void
+_xml_reader_set_decompress_delay (guint usec)
+{
+  g_atomic_int_set (&decompress_delay, usec);
+}
+
+XmlReaderCompression
+_xml_reader_detect_compression (const gchar *data,
+                                gsize        length)
+{
+  const guchar *magic = (const guchar *) data;
+
+  if (length >= 2 && magic[0] == 0x1f && magic[1] == 0x8b)
+    return XML_READER_COMPRESSION_GZIP;
+
+  if (length >= 4 &&
+      magic[0] == 0x28 && magic[1] == 0xb5 &&
+      magic[2] == 0x2f && magic[3] == 0xfd)
+    return XML_READER_COMPRESSION_ZSTD;
+
+  return XML_READER_COMPRESSION_NONE;
+}
+
+/* hands @chunk, filled, over to the parser */
+static void
+decompressor_push_chunk (XmlReaderDecompressor *decompressor,
+                         DecompressChunk       *chunk)
+{
+  gint delay = g_atomic_int_get (&decompress_delay);
+
+  if (delay > 0 && chunk != &decompressor->end)
+    g_usleep (delay);
+
+  g_async_queue_push (decompressor->full_chunks, chunk);
+}
+
+/* returns an empty buffer, or %NULL if the parser is gone */
+static DecompressChunk *
+decompressor_take_chunk (XmlReaderDecompressor *decompressor)
+{
+  DecompressChunk *chunk;
+
+  if (g_atomic_int_get (&decompressor->cancelled))
+    return NULL;
+
+  chunk = g_async_queue_pop (decompressor->free_chunks);
+  chunk->size = 0;
+
+  return chunk;
+}
+
+static void
+decompressor_set_error (XmlReaderDecompressor *decompressor,
+                        const gchar           *message)
+{
+  decompressor->error_message = g_strdup (message);
+}
+
+#ifdef HAVE_ZLIB
+static gboolean
+decompress_gzip (XmlReaderDecompressor *decompressor)
+{
+  const gchar *input = decompressor->input;
+  gsize remaining = decompressor->input_len;
+  DecompressChunk *chunk = NULL;
+  gboolean retval = TRUE;
+  z_stream stream;
+
+  memset (&stream, 0, sizeof (z_stream));
+
+  /* 32 makes zlib expect a gzip header */
+  if (inflateInit2 (&stream, 15 + 32) != Z_OK)
+    {
+      decompressor_set_error (decompressor, "Unable to initialize zlib");
+      return FALSE;
+    }
+
+  while (TRUE)
+    {
+      int res;
+
+      if (chunk == NULL)
+        {
+          chunk = decompressor_take_chunk (decompressor);
+          if (chunk == NULL)
+            break;
+
+          stream.next_out = (Bytef *) chunk->data;
+          stream.avail_out = DECOMPRESS_BUFFER_SIZE;
+        }
+
+      if (stream.avail_in == 0)
+        {
+          stream.next_in = (Bytef *) input;
+          stream.avail_in = MIN (remaining, G_MAXUINT);
+
+          input += stream.avail_in;
+          remaining -= stream.avail_in;
+        }
+
+      res = inflate (&stream, Z_NO_FLUSH);
+      chunk->size = DECOMPRESS_BUFFER_SIZE - stream.avail_out;
+
+      if (res == Z_STREAM_END)
+        {
+          if (stream.avail_in == 0 && remaining == 0)
+            break;
+
+          /* a gzip file can hold more than one member */
+          inflateReset (&stream);
+        }
+      else if (res != Z_OK)
+        {
+          decompressor_set_error (decompressor,
+                                  res == Z_BUF_ERROR ? "Truncated gzip data"
+                                  : stream.msg != NULL ? stream.msg
+                                  : "Invalid gzip data");
+          retval = FALSE;
+          break;
+        }
+
+      if (stream.avail_out == 0)
+        {
+          decompressor_push_chunk (decompressor, chunk);
+          chunk = NULL;
+        }
+    }
+
+  if (chunk != NULL)
+    {
+      if (retval && chunk->size > 0)
+        decompressor_push_chunk (decompressor, chunk);
+      else
+        g_async_queue_push (decompressor->free_chunks, chunk);
+    }
+
+  inflateEnd (&stream);
+
+  return retval;
+}
+#endif /* HAVE_ZLIB */
+
+#ifdef HAVE_ZSTD
+static gboolean
+decompress_zstd (XmlReaderDecompressor *decompressor)
+{
+  ZSTD_inBuffer in = { decompressor->input, decompressor->input_len, 0 };
+  DecompressChunk *chunk = NULL;
+  gboolean retval = TRUE;
+  ZSTD_DStream *stream;
+
+  stream = ZSTD_createDStream ();
+  if (stream == NULL || ZSTD_isError (ZSTD_initDStream (stream)))
+    {
+      decompressor_set_error (decompressor, "Unable to initialize zstd");
+      ZSTD_freeDStream (stream);
+      return FALSE;
+    }
+
+  while (TRUE)
+    {
+      ZSTD_outBuffer out;
+      size_t res;
+
+      if (chunk == NULL)
+        {
+          chunk = decompressor_take_chunk (decompressor);
+          if (chunk == NULL)
+            break;
+        }
+
+      out.dst = chunk->data;
+      out.size = DECOMPRESS_BUFFER_SIZE;
+      out.pos = chunk->size;
+
+      res = ZSTD_decompressStream (stream, &out, &in);
+      if (ZSTD_isError (res))
+        {
+          decompressor_set_error (decompressor, ZSTD_getErrorName (res));
+          retval = FALSE;
+          break;
+        }
+
+      /* the last frame has been flushed */
+      if (in.pos == in.size && res == 0)
+        {
+          chunk->size = out.pos;
+          break;
+        }
+
+      if (in.pos == in.size && out.pos == chunk->size && out.pos < out.size)
+        {
+          decompressor_set_error (decompressor, "Truncated zstd data");
+          retval = FALSE;
+          break;
+        }
+
+      chunk->size = out.pos;
+
+      if (out.pos == out.size)
+        {
+          decompressor_push_chunk (decompressor, chunk);
+          chunk = NULL;
+        }
+    }
+
+  if (chunk != NULL)
+    {
+      if (retval && chunk->size > 0)
+        decompressor_push_chunk (decompressor, chunk);
+      else
+        g_async_queue_push (decompressor->free_chunks, chunk);
+    }
+
+  ZSTD_freeDStream (stream);
+
+  return retval;
+}
+#endif /* HAVE_ZSTD */
+
+static gpointer
+decompressor_thread (gpointer data)
+{
+  XmlReaderDecompressor *decompressor = data;
+
+  switch (decompressor->compression)
+    {
+#ifdef HAVE_ZLIB
+    case XML_READER_COMPRESSION_GZIP:
+      decompress_gzip (decompressor);
+      break;
+#endif
+
+#ifdef HAVE_ZSTD
+    case XML_READER_COMPRESSION_ZSTD:
+      decompress_zstd (decompressor);
+      break;
+#endif
+
+    default:
+      g_assert_not_reached ();
+      break;
+    }
+
+  decompressor_push_chunk (decompressor, &decompressor->end);
+
+  return NULL;
+}
+
+/* starts decompressing @length bytes of @data, which must stay
+ * available until the decompressor is freed
+ */
+XmlReaderDecompressor *
+_xml_reader_decompressor_new (XmlReaderCompression   compression,
+                              const gchar           *data,
+                              gsize                  length,
+                              GError               **error)
+{
+  XmlReaderDecompressor *decompressor;
+  guint i;
+
+  switch (compression)
+    {
+    case XML_READER_COMPRESSION_GZIP:
+#ifndef HAVE_ZLIB
+      g_set_error_literal (error, XML_READER_ERROR,
+                           XML_READER_ERROR_INVALID,
+                           "Support for gzip compressed input is not available");
+      return NULL;
+#endif
+      break;
+
+    case XML_READER_COMPRESSION_ZSTD:
+#ifndef HAVE_ZSTD
+      g_set_error_literal (error, XML_READER_ERROR,
+                           XML_READER_ERROR_INVALID,
+                           "Support for zstd compressed input is not available");
+      return NULL;
+#endif
+      break;
+
+    case XML_READER_COMPRESSION_NONE:
+      g_assert_not_reached ();
+      break;
+    }
+
+  decompressor = g_slice_new0 (XmlReaderDecompressor);
+  decompressor->compression = compression;
+  decompressor->input = data;
+  decompressor->input_len = length;
+
+  decompressor->free_chunks = g_async_queue_new ();
+  decompressor->full_chunks = g_async_queue_new ();
+
+  for (i = 0; i < DECOMPRESS_N_BUFFERS; i++)
+    {
+      decompressor->chunks[i].data = g_malloc (DECOMPRESS_BUFFER_SIZE);
+      g_async_queue_push (decompressor->free_chunks, &decompressor->chunks[i]);
+    }
+
+  decompressor->thread = g_thread_try_new ("xml-reader-decompress",
+                                           decompressor_thread,
+                                           decompressor,
+                                           error);
+  if (decompressor->thread == NULL)
+    {
+      decompressor->finished = TRUE;
+      _xml_reader_decompressor_free (decompressor, NULL);
+      return NULL;
+    }
+
+  return decompressor;
+}
+
+/* returns the next piece of the decompressed data, valid until the next
+ * call, or %NULL at the end of the data
+ */
+const gchar *
+_xml_reader_decompressor_read (XmlReaderDecompressor *decompressor,
+                               gsize                 *size)
+{
+  return _xml_reader_decompressor_read_until (decompressor, -1, size, NULL);
+}
+
+/* the same, waiting for the next piece until @deadline at most, in
+ * monotonic time, unless it is -1; if it is not ready by then, %NULL
+ * is returned and @pending is set to %TRUE
+ */
+const gchar *
+_xml_reader_decompressor_read_until (XmlReaderDecompressor *decompressor,
+                                     gint64                 deadline,
+                                     gsize                 *size,
+                                     gboolean              *pending)
+{
+  DecompressChunk *chunk;
+
+  if (pending != NULL)
+    *pending = FALSE;
+
+  if (decompressor->current != NULL)
+    {
+      g_async_queue_push (decompressor->free_chunks, decompressor->current);
+      decompressor->current = NULL;
+    }
+
+  if (decompressor->finished)
+    return NULL;
+
+  if (deadline < 0)
+    chunk = g_async_queue_pop (decompressor->full_chunks);
+  else
+    {
+      gint64 remaining = deadline - g_get_monotonic_time ();
+
+      chunk = g_async_queue_timeout_pop (decompressor->full_chunks,
+                                         MAX (remaining, 0));
+      if (chunk == NULL)
+        {
+          if (pending != NULL)
+            *pending = TRUE;
+
+          return NULL;
+        }
+    }
+
+  if (chunk == &decompressor->end)
+    {
+      decompressor->finished = TRUE;
+      return NULL;
+    }
+
+  decompressor->current = chunk;
+  *size = chunk->size;
+
+  return chunk->data;
+}
+
+/* stops the decompression, which may not be over, and returns whether
+ * it succeeded
+ */
+gboolean
+_xml_reader_decompressor_free (XmlReaderDecompressor  *decompressor,
+                               GError                **error)
+{
+  gboolean retval;
+  gsize size;
+  guint i;
+
+  g_atomic_int_set (&decompressor->cancelled, TRUE);
+
+  /* the thread may be waiting for a buffer */
+  while (_xml_reader_decompressor_read (decompressor, &size) != NULL)
+    ;
+
+  if (decompressor->thread != NULL)
+    g_thread_join (decompressor->thread);
+
+  retval = decompressor->error_message == NULL;
+  if (!retval)
+    g_set_error_literal (error, XML_READER_ERROR,
+                         XML_READER_ERROR_INVALID,
+                         decompressor->error_message);
+
+  for (i = 0; i < DECOMPRESS_N_BUFFERS; i++)
+    g_free (decompressor->chunks[i].data);
+
+  g_async_queue_unref (decompressor->free_chunks);
+  g_async_queue_unref (decompressor->full_chunks);
+
+  g_free (decompressor->error_message);
+
+  g_slice_free (XmlReaderDecompressor, decompressor);
+
+  return retval;
+}
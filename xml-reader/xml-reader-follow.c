@@ -0,0 +1,344 @@
+/* xml-reader-follow.c: Growing files
+ *
+ * Copyright (C) 2008  Emmanuele Bassi  <ebassi@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Author:
+ *   Emmanuele Bassi  <ebassi@gnome.org>
+ */
+
+/* A followed file is read as it grows, like tail -f does: the bytes
+ * appended since the last read are kept until the reader consumes
+ * them. The file is read a bit at a time, so that the buffer holds
+ * about one record whatever the size of the file. Changes are waited
+ * for through inotify where available, and by checking the file at
+ * every interval otherwise, or in case the notifications do not come,
+ * as on network file systems.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <errno.h>
+#include <string.h>
+
+#ifdef HAVE_UNISTD_H
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#endif
+
+#ifdef HAVE_SYS_INOTIFY_H
+#include <sys/inotify.h>
+#endif
+
+#include <glib.h>
+
+#include "xml-reader-private.h"
+
+/* bytes read from the file in one go, at least */
+#define FOLLOW_READ_SIZE        (64 * 1024)
+
+struct _XmlReaderFollower
+{
+  gchar *filename;
+
+  gint fd;
+
+  /* the inotify instance watching the file, or -1 */
+  gint watch_fd;
+
+  guint interval;
+
+  /* the bytes read from the file */
+  goffset offset;
+
+  /* the bytes read, of which the first @consumed are not needed any
+   * more; they are only moved out once they fill half of the buffer
+   */
+  gchar *data;
+  gsize consumed;
+  gsize len;
+  gsize size;
+};
+
+static void
+follower_set_error (XmlReaderFollower  *follower,
+                    GError            **error,
+                    const gchar        *action,
+                    gint                saved_errno)
+{
+  g_set_error (error, G_FILE_ERROR,
+               g_file_error_from_errno (saved_errno),
+               "Unable to %s file `%s': %s",
+               action,
+               follower->filename,
+               g_strerror (saved_errno));
+}
+
+/* opens @filename for following from @offset, checking for new data
+ * every @interval milliseconds at most
+ */
+XmlReaderFollower *
+_xml_reader_follower_new (const gchar  *filename,
+                          goffset       offset,
+                          guint         interval,
+                          GError      **error)
+{
+#ifdef HAVE_UNISTD_H
+  XmlReaderFollower *follower;
+  struct stat info;
+
+  follower = g_slice_new0 (XmlReaderFollower);
+  follower->filename = g_strdup (filename);
+  follower->interval = interval;
+  follower->watch_fd = -1;
+
+  follower->fd = open (filename, O_RDONLY);
+  if (follower->fd < 0)
+    {
+      follower_set_error (follower, error, "open", errno);
+      _xml_reader_follower_free (follower);
+      return NULL;
+    }
+
+  if (offset > 0)
+    {
+      if (fstat (follower->fd, &info) != 0 || info.st_size < offset ||
+          lseek (follower->fd, offset, SEEK_SET) != offset)
+        {
+          g_set_error (error, XML_READER_ERROR,
+                       XML_READER_ERROR_INVALID,
+                       "The file `%s' is shorter than %" G_GINT64_FORMAT " bytes",
+                       filename,
+                       (gint64) offset);
+          _xml_reader_follower_free (follower);
+          return NULL;
+        }
+
+      follower->offset = offset;
+    }
+
+#ifdef HAVE_SYS_INOTIFY_H
+  /* without notifications the file is checked at every interval */
+  follower->watch_fd = inotify_init1 (IN_NONBLOCK | IN_CLOEXEC);
+  if (follower->watch_fd >= 0 &&
+      inotify_add_watch (follower->watch_fd, filename, IN_MODIFY) < 0)
+    {
+      close (follower->watch_fd);
+      follower->watch_fd = -1;
+    }
+#endif
+
+  return follower;
+#else
+  g_set_error (error, XML_READER_ERROR,
+               XML_READER_ERROR_INVALID,
+               "Following files is not supported on this platform");
+
+  return NULL;
+#endif
+}
+
+void
+_xml_reader_follower_free (XmlReaderFollower *follower)
+{
+#ifdef HAVE_UNISTD_H
+  if (follower->fd >= 0)
+    close (follower->fd);
+
+  if (follower->watch_fd >= 0)
+    close (follower->watch_fd);
+#endif
+
+  g_free (follower->data);
+  g_free (follower->filename);
+
+  g_slice_free (XmlReaderFollower, follower);
+}
+
+/* moves the data not consumed yet to the start of the buffer */
+static void
+follower_compact (XmlReaderFollower *follower)
+{
+  if (follower->consumed == 0)
+    return;
+
+  follower->len -= follower->consumed;
+  memmove (follower->data, follower->data + follower->consumed, follower->len);
+  follower->consumed = 0;
+}
+
+/* reads the next bytes appended to the file: FOLLOW_READ_SIZE of them,
+ * or as many as are pending already, so that a record larger than that
+ * is scanned a logarithmic number of times. Returns the number of bytes
+ * read, 0 at the end of the file, or -1 on errors
+ */
+gssize
+_xml_reader_follower_read (XmlReaderFollower  *follower,
+                           GError            **error)
+{
+#ifdef HAVE_UNISTD_H
+  struct stat info;
+  gsize wanted;
+  gssize n_read = 0;
+
+  /* a log that got rotated in place cannot be followed any more */
+  if (fstat (follower->fd, &info) == 0 && info.st_size < follower->offset)
+    {
+      g_set_error (error, XML_READER_ERROR,
+                   XML_READER_ERROR_INVALID,
+                   "The file `%s' was truncated while being followed",
+                   follower->filename);
+      return -1;
+    }
+
+  wanted = MAX (FOLLOW_READ_SIZE, follower->len - follower->consumed);
+
+  if (follower->size - follower->len < wanted)
+    {
+      follower_compact (follower);
+
+      if (follower->size - follower->len < wanted)
+        {
+          follower->size = MAX (follower->size * 2, follower->len + wanted);
+          follower->data = g_realloc (follower->data, follower->size);
+        }
+    }
+
+  while ((gsize) n_read < wanted)
+    {
+      gssize res;
+
+      res = read (follower->fd,
+                  follower->data + follower->len,
+                  wanted - n_read);
+
+      if (res < 0 && errno == EINTR)
+        continue;
+
+      if (res < 0)
+        {
+          follower_set_error (follower, error, "read", errno);
+          return -1;
+        }
+
+      if (res == 0)
+        break;
+
+      follower->len += res;
+      follower->offset += res;
+      n_read += res;
+    }
+
+  return n_read;
+#else
+  return 0;
+#endif
+}
+
+/* waits until the file changes or @interval milliseconds pass, without
+ * going past @deadline, in monotonic time, unless it is -1. Returns
+ * %FALSE if the deadline has passed
+ */
+gboolean
+_xml_reader_follower_wait (XmlReaderFollower *follower,
+                           gint64             deadline)
+{
+  gint64 timeout = follower->interval;
+
+  if (deadline >= 0)
+    {
+      gint64 remaining = deadline - g_get_monotonic_time ();
+
+      if (remaining <= 0)
+        return FALSE;
+
+      timeout = MIN (timeout, (remaining + 999) / 1000);
+    }
+
+#ifdef HAVE_SYS_INOTIFY_H
+  if (follower->watch_fd >= 0)
+    {
+      GPollFD fd = { follower->watch_fd, G_IO_IN, 0 };
+
+      if (g_poll (&fd, 1, timeout) > 0)
+        {
+          gchar events[4096];
+
+          /* the events only tell that there is something to read */
+          while (read (follower->watch_fd, events, sizeof (events)) > 0)
+            ;
+        }
+
+      return TRUE;
+    }
+#endif
+
+  g_usleep (timeout * 1000);
+
+  return TRUE;
+}
+
+/* the offset in the file of the data not consumed yet */
+goffset
+_xml_reader_follower_get_position (XmlReaderFollower *follower)
+{
+  return follower->offset - (follower->len - follower->consumed);
+}
+
+/* the memory held by the buffer, in bytes */
+gsize
+_xml_reader_follower_get_memory (XmlReaderFollower *follower)
+{
+  return follower->size;
+}
+
+/* the data read and not consumed yet */
+const gchar *
+_xml_reader_follower_peek (XmlReaderFollower *follower,
+                           gsize             *length)
+{
+  *length = follower->len - follower->consumed;
+
+  return follower->data + follower->consumed;
+}
+
+/* drops the first @n_bytes of the data not consumed yet, releasing the
+ * memory held by large records once they are gone
+ */
+void
+_xml_reader_follower_consume (XmlReaderFollower *follower,
+                              gsize              n_bytes)
+{
+  g_assert (n_bytes <= follower->len - follower->consumed);
+
+  if (n_bytes == 0)
+    return;
+
+  follower->consumed += n_bytes;
+
+  if (follower->consumed == follower->len)
+    follower->consumed = follower->len = 0;
+  else if (follower->consumed > follower->size / 2)
+    follower_compact (follower);
+
+  if (follower->size > 4 * FOLLOW_READ_SIZE &&
+      follower->len - follower->consumed < follower->size / 4)
+    {
+      follower_compact (follower);
+      follower->size = MAX (follower->len * 2, FOLLOW_READ_SIZE);
+      follower->data = g_realloc (follower->data, follower->size);
+    }
+}
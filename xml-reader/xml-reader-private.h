@@ -0,0 +1,297 @@
+/* xml-reader-private.h: Private XmlReader data
+ *
+ * Copyright (C) 2008  Emmanuele Bassi  <ebassi@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Author:
+ *   Emmanuele Bassi  <ebassi@gnome.org>
+ */
+
+#ifndef __XML_READER_PRIVATE_H__
+#define __XML_READER_PRIVATE_H__
+
+#include <libxml/tree.h>
+
+#include "xml-reader.h"
+
+G_BEGIN_DECLS
+
+#define XML_TO_CHAR(s)  ((char *) (s))
+
+typedef struct _XmlReaderSuccinct       XmlReaderSuccinct;
+typedef struct _XmlReaderDecompressor   XmlReaderDecompressor;
+typedef struct _XmlReaderFollower       XmlReaderFollower;
+
+typedef enum {
+  XML_READER_COMPRESSION_NONE,
+  XML_READER_COMPRESSION_GZIP,
+  XML_READER_COMPRESSION_ZSTD
+} XmlReaderCompression;
+
+typedef enum {
+  XML_READER_SCAN_INCOMPLETE,
+  XML_READER_SCAN_CHILD,
+  XML_READER_SCAN_PARENT_END
+} XmlReaderScanResult;
+
+struct _XmlReaderPrivate
+{
+  guint is_filename : 1;
+  gchar *filename;
+
+  guint error_state : 1;
+  XmlReaderError last_error;
+
+  gint depth;
+
+  xmlDocPtr current_doc;
+
+  /* the succinct tree replacing @current_doc in succinct mode, and the
+   * source it points into
+   */
+  guint use_succinct : 1;
+  XmlReaderSuccinct *succinct;
+  GBytes *source;
+
+  /* whether the source is kept, and the element offsets recorded, when
+   * loading a libxml2 tree, and whether the offsets can be trusted
+   */
+  guint keep_source : 1;
+  guint has_offsets : 1;
+
+  /* the last serialized subtree */
+  GBytes *xml_copy;
+
+  guint out_of_core : 1;
+  gchar *out_of_core_directory;
+  XmlReaderAccessPattern access_pattern;
+
+  xmlNodePtr parent;
+  xmlNodePtr node_cursor;
+  xmlAttrPtr attr_cursor;
+
+  xmlChar *attr_value;
+
+  GPtrArray *info_blocks;
+  guint info_block_used;
+
+  /* a block of node records kept from the previous document */
+  gpointer spare_info_block;
+
+  guint adaptive_indexing : 1;
+  gsize memory_budget;
+
+  guint dedup : 1;
+  gsize dedup_max_length;
+
+  XmlReaderStatistics stats;
+
+  GPtrArray *index_report;
+  guint n_report_dropped;
+
+  /* the documents iterated by xml_reader_next_document(), and the
+   * parser context they share
+   */
+  GBytes *stream;
+  gsize stream_offset;
+  guint stream_mapped : 1;
+  xmlParserCtxtPtr stream_ctxt;
+
+  /* the file followed by xml_reader_next_record(), its prolog and the
+   * start tag of its root element, and the end tag of the root
+   */
+  XmlReaderFollower *follower;
+  gchar *follow_head;
+  gsize follow_head_len;
+  gchar *follow_tail;
+
+  /* in bounded memory mode, the depth of the subtrees released when
+   * the cursor leaves them, and the memory the document may take;
+   * @window_ctxt parses the document as the cursor moves forward, from
+   * the pieces in @window_sources, then from @window_decompressor
+   * reading @window_input, if any, and the document stays @windowed
+   * until it is discarded, even once it has been parsed whole.
+   * @window_data holds the piece being parsed, up to @window_offset,
+   * and @window_error the failure of the decompressor
+   */
+  gint release_depth;
+  gsize memory_limit;
+  guint windowed : 1;
+  guint memory_exceeded : 1;
+  xmlParserCtxtPtr window_ctxt;
+  GQueue window_sources;
+  GBytes *window_piece;
+  GBytes *window_input;
+  XmlReaderDecompressor *window_decompressor;
+  const gchar *window_data;
+  gsize window_length;
+  gsize window_offset;
+  GError *window_error;
+
+  /* where the elements down to @release_depth end inside the document
+   * in bounded memory mode, until they are released
+   */
+  GHashTable *window_ends;
+
+  /* whether the document was parsed from an uncompressed file, and so
+   * can be checkpointed, after the @checkpoint_head_len bytes of head
+   * it was resumed with and from @checkpoint_offset in the file
+   */
+  guint from_file : 1;
+  gsize checkpoint_head_len;
+  guint64 checkpoint_offset;
+
+  /* the document loaded a step at a time by xml_reader_load_step(),
+   * parsed by @load_ctxt from @load_source, or from the decompressor
+   * reading it; without a parser, the first step loads it at once
+   */
+  GBytes *load_source;
+  guint load_mapped : 1;
+  XmlReaderCompression load_compression;
+  xmlParserCtxtPtr load_ctxt;
+  gsize load_offset;
+  XmlReaderDecompressor *load_decompressor;
+
+  /* the limits on the documents, checked while parsing them when
+   * @has_limits is set: the nodes parsed, the text the entity
+   * references expand to and the length of @limit_text, the text node
+   * being parsed, are counted; the first limit exceeded stops the
+   * parser, and sets @limit_error
+   */
+  XmlReaderLimits limits;
+  guint has_limits : 1;
+  guint limit_exceeded : 1;
+  XmlReaderError limit_error;
+  guint64 limit_nodes;
+  gsize limit_expansion;
+  xmlNodePtr limit_text;
+  gsize limit_text_length;
+
+  /* the function told of the progress of the parser, at most every
+   * @progress_interval microseconds, of the elements parsed so far
+   * and of the size of the document, or -1
+   */
+  XmlReaderProgressFunc progress_func;
+  gpointer progress_data;
+  GDestroyNotify progress_notify;
+  gint64 progress_interval;
+  gint64 progress_next;
+  guint64 progress_elements;
+  goffset progress_total;
+};
+
+const gchar *_xml_reader_peek_attribute_value (xmlAttrPtr   attr,
+                                               xmlChar    **copy);
+gboolean     _xml_reader_window_complete      (XmlReader   *reader,
+                                               xmlNodePtr   node);
+xmlNodePtr   _xml_reader_next_element         (XmlReader   *reader,
+                                               xmlNodePtr   parent,
+                                               xmlNodePtr   prev);
+void         _xml_reader_window_release       (XmlReader   *reader,
+                                               xmlNodePtr   node,
+                                               gint         depth);
+
+XmlReaderSuccinct *_xml_reader_succinct_new      (const gchar        *source,
+                                                 gsize               length,
+                                                 gboolean            source_mapped,
+                                                 const gchar        *directory,
+                                                 const XmlReaderLimits *limits,
+                                                 GError            **error);
+void               _xml_reader_succinct_free     (XmlReaderSuccinct  *tree);
+gsize              _xml_reader_succinct_get_size (XmlReaderSuccinct  *tree);
+void               _xml_reader_succinct_set_access_pattern (XmlReaderSuccinct      *tree,
+                                                            XmlReaderAccessPattern  pattern);
+GBytes *           _xml_reader_succinct_copy_source (const gchar  *buffer,
+                                                     gsize         length,
+                                                     const gchar  *directory,
+                                                     GError      **error);
+
+gboolean     _xml_reader_succinct_read_start_element    (XmlReader   *reader,
+                                                         const gchar *element_name,
+                                                         gboolean     optional);
+gint         _xml_reader_succinct_count_elements        (XmlReader   *reader,
+                                                         const gchar *element_name);
+gboolean     _xml_reader_succinct_read_nth_element      (XmlReader   *reader,
+                                                         const gchar *element_name,
+                                                         gint         index_);
+void         _xml_reader_succinct_read_end_element      (XmlReader   *reader);
+gboolean     _xml_reader_succinct_read_next_in_document (XmlReader   *reader);
+gint         _xml_reader_succinct_get_depth             (XmlReader   *reader);
+const gchar *_xml_reader_succinct_get_element_name      (XmlReader   *reader);
+const gchar *_xml_reader_succinct_get_element_value     (XmlReader   *reader);
+gint         _xml_reader_succinct_count_attributes      (XmlReader   *reader);
+gboolean     _xml_reader_succinct_read_attribute_pos    (XmlReader   *reader,
+                                                         gint         index_);
+gboolean     _xml_reader_succinct_read_attribute_name   (XmlReader   *reader,
+                                                         const gchar *attribute_name);
+const gchar *_xml_reader_succinct_get_attribute_value   (XmlReader   *reader);
+gboolean     _xml_reader_succinct_get_xml_range         (XmlReader   *reader,
+                                                         gboolean     inner,
+                                                         gsize       *start,
+                                                         gsize       *end);
+gboolean     _xml_reader_succinct_get_value_range       (XmlReader   *reader,
+                                                         gboolean     attribute,
+                                                         gsize       *start,
+                                                         gsize       *end);
+
+const gchar *_xml_reader_skip_markup   (const gchar *p,
+                                        const gchar *end,
+                                        gboolean    *is_open);
+gboolean     _xml_reader_find_document (const gchar *data,
+                                        gsize        length,
+                                        gsize       *start,
+                                        gsize       *end);
+gboolean     _xml_reader_find_root     (const gchar *data,
+                                        gsize        length,
+                                        gsize       *start,
+                                        gsize       *end,
+                                        gboolean    *is_open);
+XmlReaderScanResult _xml_reader_find_child (const gchar *data,
+                                            gsize        length,
+                                            gsize       *start,
+                                            gsize       *end);
+
+XmlReaderCompression   _xml_reader_detect_compression (const gchar            *data,
+                                                       gsize                   length);
+XmlReaderDecompressor *_xml_reader_decompressor_new   (XmlReaderCompression    compression,
+                                                       const gchar            *data,
+                                                       gsize                   length,
+                                                       GError                **error);
+const gchar *          _xml_reader_decompressor_read  (XmlReaderDecompressor  *decompressor,
+                                                       gsize                  *size);
+const gchar *          _xml_reader_decompressor_read_until (XmlReaderDecompressor *decompressor,
+                                                            gint64                 deadline,
+                                                            gsize                 *size,
+                                                            gboolean              *pending);
+gboolean               _xml_reader_decompressor_free  (XmlReaderDecompressor  *decompressor,
+                                                       GError                **error);
+void                   _xml_reader_set_decompress_delay (guint                 usec);
+
+XmlReaderFollower *_xml_reader_follower_new     (const gchar        *filename,
+                                                 goffset             offset,
+                                                 guint               interval,
+                                                 GError            **error);
+void               _xml_reader_follower_free    (XmlReaderFollower  *follower);
+gssize             _xml_reader_follower_read    (XmlReaderFollower  *follower,
+                                                 GError            **error);
+gboolean           _xml_reader_follower_wait    (XmlReaderFollower  *follower,
+                                                 gint64              deadline);
+goffset            _xml_reader_follower_get_position (XmlReaderFollower *follower);
+gsize              _xml_reader_follower_get_memory (XmlReaderFollower *follower);
+const gchar *      _xml_reader_follower_peek    (XmlReaderFollower  *follower,
+                                                 gsize              *length);
+void               _xml_reader_follower_consume (XmlReaderFollower  *follower,
+                                                 gsize               n_bytes);
+
+G_END_DECLS
+
+#endif /* __XML_READER_PRIVATE_H__ */
@@ -0,0 +1,308 @@
+/* xml-reader-scan.c: Markup scanning
+ *
+ * Copyright (C) 2008  Emmanuele Bassi  <ebassi@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Author:
+ *   Emmanuele Bassi  <ebassi@gnome.org>
+ */
+
+/* Light scanning of the markup of a document, for finding where
+ * elements and documents end without parsing them.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+
+#include <glib.h>
+
+#include "xml-reader-private.h"
+
+/* skips a document type declaration, internal subset included */
+static const gchar *
+skip_declaration (const gchar *p,
+                  const gchar *end)
+{
+  gint brackets = 0;
+  gchar quote = 0;
+
+  for (p += 2; p < end; p++)
+    {
+      if (quote != 0)
+        {
+          if (*p == quote)
+            quote = 0;
+        }
+      else if (*p == '"' || *p == '\'')
+        quote = *p;
+      else if (*p == '[')
+        brackets += 1;
+      else if (*p == ']')
+        brackets -= 1;
+      else if (*p == '>' && brackets <= 0)
+        return p + 1;
+    }
+
+  return NULL;
+}
+
+/* returns the end of the markup starting at @p, which is not an end tag,
+ * or %NULL if it does not end before @end, and whether it is the start
+ * tag of an element with content
+ */
+const gchar *
+_xml_reader_skip_markup (const gchar *p,
+                         const gchar *end,
+                         gboolean    *is_open)
+{
+  const gchar *found;
+  gchar quote = 0;
+
+  *is_open = FALSE;
+
+  if (end - p >= 4 && memcmp (p, "<!--", 4) == 0)
+    {
+      found = g_strstr_len (p + 4, end - p - 4, "-->");
+      return found != NULL ? found + 3 : NULL;
+    }
+
+  if (end - p >= 9 && memcmp (p, "<![CDATA[", 9) == 0)
+    {
+      found = g_strstr_len (p + 9, end - p - 9, "]]>");
+      return found != NULL ? found + 3 : NULL;
+    }
+
+  if (end - p >= 2 && p[1] == '?')
+    {
+      found = g_strstr_len (p + 2, end - p - 2, "?>");
+      return found != NULL ? found + 2 : NULL;
+    }
+
+  if (end - p >= 2 && p[1] == '!')
+    return skip_declaration (p, end);
+
+  /* attribute values may hold '>' */
+  for (p += 1; p < end; p++)
+    {
+      if (quote != 0)
+        {
+          if (*p == quote)
+            quote = 0;
+        }
+      else if (*p == '"' || *p == '\'')
+        quote = *p;
+      else if (*p == '>')
+        {
+          *is_open = p[-1] != '/';
+          return p + 1;
+        }
+    }
+
+  return NULL;
+}
+
+/* finds the first document in @length bytes of @data, from its prolog
+ * to the end of its root element, skipping the white space and byte
+ * order marks before it. Returns %FALSE if no document ends in @data,
+ * in which case @start tells whether there is a partial one
+ */
+gboolean
+_xml_reader_find_document (const gchar *data,
+                           gsize        length,
+                           gsize       *start,
+                           gsize       *end)
+{
+  const gchar *data_end = data + length;
+  const gchar *p = data;
+  gint depth = 0;
+
+  while (p < data_end)
+    {
+      if (g_ascii_isspace (*p))
+        p += 1;
+      else if (data_end - p >= 3 && memcmp (p, "\xef\xbb\xbf", 3) == 0)
+        p += 3;
+      else
+        break;
+    }
+
+  *start = p - data;
+
+  while (p < data_end)
+    {
+      const gchar *tag;
+      gboolean is_open;
+
+      p = memchr (p, '<', data_end - p);
+      if (p == NULL)
+        break;
+
+      if (p + 1 < data_end && p[1] == '/')
+        {
+          p = memchr (p, '>', data_end - p);
+          if (p == NULL)
+            break;
+
+          p += 1;
+
+          if (--depth <= 0)
+            {
+              *end = p - data;
+              return TRUE;
+            }
+
+          continue;
+        }
+
+      tag = p;
+      p = _xml_reader_skip_markup (p, data_end, &is_open);
+      if (p == NULL)
+        break;
+
+      if (is_open)
+        depth += 1;
+      else if (depth == 0 && tag[1] != '!' && tag[1] != '?')
+        {
+          /* an empty root element */
+          *end = p - data;
+          return TRUE;
+        }
+    }
+
+  *end = length;
+
+  return FALSE;
+}
+
+/* finds the start tag of the root element in @length bytes of @data,
+ * after the prolog. Returns %FALSE if it does not end in @data, and
+ * otherwise sets @start and @end around it, and @is_open to whether
+ * the root element has content
+ */
+gboolean
+_xml_reader_find_root (const gchar *data,
+                       gsize        length,
+                       gsize       *start,
+                       gsize       *end,
+                       gboolean    *is_open)
+{
+  const gchar *data_end = data + length;
+  const gchar *p = data;
+
+  while (p < data_end)
+    {
+      const gchar *tag;
+
+      tag = memchr (p, '<', data_end - p);
+      if (tag == NULL)
+        break;
+
+      p = _xml_reader_skip_markup (tag, data_end, is_open);
+      if (p == NULL)
+        break;
+
+      if (tag[1] != '!' && tag[1] != '?' && tag[1] != '/')
+        {
+          *start = tag - data;
+          *end = p - data;
+          return TRUE;
+        }
+    }
+
+  return FALSE;
+}
+
+/* finds the next child element in @length bytes of @data, which follow
+ * the start tag of its parent or one of its previous children. Returns
+ * %XML_READER_SCAN_CHILD with the child between @start and @end, or
+ * %XML_READER_SCAN_PARENT_END with the end tag of the parent between
+ * @start and @end if there are no more children. Otherwise @start is
+ * set to the first byte still needed to find the child: the text,
+ * comments and processing instructions between the children are
+ * skipped
+ */
+XmlReaderScanResult
+_xml_reader_find_child (const gchar *data,
+                        gsize        length,
+                        gsize       *start,
+                        gsize       *end)
+{
+  const gchar *data_end = data + length;
+  const gchar *p = data;
+  const gchar *child = NULL;
+  gint depth = 0;
+
+  while (p < data_end)
+    {
+      const gchar *tag;
+      gboolean is_open;
+
+      tag = memchr (p, '<', data_end - p);
+      if (tag == NULL)
+        {
+          p = data_end;
+          break;
+        }
+
+      if (depth == 0)
+        child = tag;
+
+      if (tag + 1 < data_end && tag[1] == '/')
+        {
+          p = memchr (tag, '>', data_end - tag);
+          if (p == NULL)
+            break;
+
+          p += 1;
+
+          if (depth == 0)
+            {
+              *start = tag - data;
+              *end = p - data;
+
+              return XML_READER_SCAN_PARENT_END;
+            }
+
+          if (--depth == 0)
+            {
+              *start = child - data;
+              *end = p - data;
+
+              return XML_READER_SCAN_CHILD;
+            }
+
+          continue;
+        }
+
+      p = _xml_reader_skip_markup (tag, data_end, &is_open);
+      if (p == NULL)
+        break;
+
+      if (is_open)
+        depth += 1;
+      else if (depth == 0 && tag[1] != '!' && tag[1] != '?')
+        {
+          /* an empty child */
+          *start = child - data;
+          *end = p - data;
+
+          return XML_READER_SCAN_CHILD;
+        }
+    }
+
+  *start = p == data_end && depth == 0 ? length : (gsize) (child - data);
+
+  return XML_READER_SCAN_INCOMPLETE;
+}
@@ -0,0 +1,685 @@
+/* xml-reader-shard.c: Sharded processing of large files
+ *
+ * Copyright (C) 2008  Emmanuele Bassi  <ebassi@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Author:
+ *   Emmanuele Bassi  <ebassi@gnome.org>
+ */
+
+/**
+ * SECTION:xml-reader-shard
+ * @short_description: Sharded processing of large files
+ *
+ * A file made of many records, like an export of millions of
+ * &lt;item&gt; elements, can be split between processes, or hosts,
+ * that each load a part of it. xml_reader_create_shard_manifest()
+ * scans the file once and cuts it in shards of about the same size,
+ * between two records; each worker then loads its shard with
+ * xml_reader_load_shard(), without parsing the rest of the file and
+ * without talking to the other workers.
+ *
+ * A shard is loaded as a document of its own: the prolog of the file
+ * and the start tags of the ancestors of its records are put before
+ * it, so it keeps the encoding and the namespaces of the file, and
+ * the ancestors still open at its end are closed after it.
+ *
+ * The manifest is a key file, with a group describing the file and a
+ * group for each shard giving its range of bytes in the file, the
+ * number of records in it, and the ranges of the start tags around
+ * it. It only holds offsets into the file, so it stays small, and
+ * workers with a copy of the file can use it too.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+
+#include <glib.h>
+
+#include "xml-reader-shard.h"
+#include "xml-reader-private.h"
+
+#define MANIFEST_GROUP  "Manifest"
+
+typedef struct {
+  guint64 offset;
+  guint64 length;
+} ShardRange;
+
+typedef struct {
+  guint64 offset;
+  guint64 length;
+  guint64 n_records;
+
+  /* the prolog and the start tags of the ancestors of the records */
+  GArray *context;
+
+  /* the start tags of the ancestors still open at the end */
+  GArray *closing;
+} Shard;
+
+typedef struct {
+  const gchar *data;
+  gsize length;
+
+  /* the element names leading to the records, "*" for any */
+  GPtrArray *steps;
+  guint n_shards;
+
+  /* the start tags of the open elements, and how many of them match
+   * the first steps
+   */
+  GArray *stack;
+  guint n_matched;
+
+  ShardRange prolog;
+
+  /* the open elements after the last record */
+  GArray *last_stack;
+  guint64 last_record_end;
+
+  GPtrArray *shards;
+  guint64 next_cut;
+} ShardScanner;
+
+static GArray *
+copy_ranges (GArray *ranges)
+{
+  GArray *retval = g_array_sized_new (FALSE, FALSE, sizeof (ShardRange), ranges->len);
+
+  g_array_append_vals (retval, ranges->data, ranges->len);
+
+  return retval;
+}
+
+static void
+shard_free (gpointer data)
+{
+  Shard *shard = data;
+
+  if (shard->context)
+    g_array_free (shard->context, TRUE);
+
+  if (shard->closing)
+    g_array_free (shard->closing, TRUE);
+
+  g_slice_free (Shard, shard);
+}
+
+/* the name of the element whose start tag is at @tag */
+static gsize
+tag_name_length (const gchar *tag,
+                 const gchar *end)
+{
+  const gchar *p;
+
+  for (p = tag + 1; p < end; p++)
+    if (g_ascii_isspace (*p) || *p == '/' || *p == '>')
+      break;
+
+  return p - tag - 1;
+}
+
+static gboolean
+step_matches (const gchar *step,
+              const gchar *tag,
+              const gchar *end)
+{
+  const gchar *name = tag + 1;
+  gsize name_len = tag_name_length (tag, end);
+  const gchar *colon;
+
+  if (strcmp (step, "*") == 0)
+    return TRUE;
+
+  /* the steps name elements without their prefix */
+  colon = memchr (name, ':', name_len);
+  if (colon != NULL)
+    {
+      name_len -= colon + 1 - name;
+      name = colon + 1;
+    }
+
+  return strlen (step) == name_len && memcmp (step, name, name_len) == 0;
+}
+
+static void
+scanner_start_record (ShardScanner *scanner,
+                      guint64       offset)
+{
+  Shard *shard = NULL;
+
+  if (scanner->shards->len > 0)
+    shard = g_ptr_array_index (scanner->shards, scanner->shards->len - 1);
+
+  if (shard == NULL || offset >= scanner->next_cut)
+    {
+      guint n_left;
+
+      if (shard != NULL)
+        {
+          shard->length = offset - shard->offset;
+          shard->closing = copy_ranges (scanner->stack);
+        }
+
+      shard = g_slice_new0 (Shard);
+      shard->offset = offset;
+      shard->context = g_array_new (FALSE, FALSE, sizeof (ShardRange));
+      g_array_append_val (shard->context, scanner->prolog);
+      g_array_append_vals (shard->context, scanner->stack->data, scanner->stack->len);
+
+      g_ptr_array_add (scanner->shards, shard);
+
+      /* the rest of the file is shared by the shards left */
+      n_left = scanner->n_shards - scanner->shards->len;
+      if (n_left > 0)
+        scanner->next_cut = offset + (scanner->length - offset) / (n_left + 1);
+      else
+        scanner->next_cut = G_MAXUINT64;
+    }
+
+  shard->n_records += 1;
+}
+
+static void
+scanner_end_record (ShardScanner *scanner,
+                    guint64       offset)
+{
+  scanner->last_record_end = offset;
+
+  g_array_set_size (scanner->last_stack, 0);
+  g_array_append_vals (scanner->last_stack,
+                       scanner->stack->data,
+                       scanner->stack->len);
+}
+
+static gboolean
+scanner_run (ShardScanner  *scanner,
+             GError       **error)
+{
+  const gchar *data = scanner->data;
+  const gchar *data_end = data + scanner->length;
+  const gchar *p = data;
+  guint n_steps = scanner->steps->len;
+  gboolean has_root = FALSE;
+
+  while (p < data_end)
+    {
+      const gchar *tag;
+      gboolean is_open, is_record;
+      ShardRange range;
+      guint depth;
+
+      tag = memchr (p, '<', data_end - p);
+      if (tag == NULL)
+        break;
+
+      if (tag + 1 < data_end && tag[1] == '/')
+        {
+          p = memchr (tag, '>', data_end - tag);
+          if (p == NULL || scanner->stack->len == 0)
+            break;
+
+          p += 1;
+
+          depth = scanner->stack->len - 1;
+          g_array_set_size (scanner->stack, depth);
+
+          if (depth == n_steps - 1 && scanner->n_matched == n_steps)
+            scanner_end_record (scanner, p - data);
+
+          scanner->n_matched = MIN (scanner->n_matched, depth);
+
+          /* whatever follows the root element is not needed */
+          if (depth == 0)
+            break;
+
+          continue;
+        }
+
+      p = _xml_reader_skip_markup (tag, data_end, &is_open);
+      if (p == NULL)
+        break;
+
+      if (tag[1] == '!' || tag[1] == '?')
+        continue;
+
+      if (!has_root)
+        {
+          scanner->prolog.offset = 0;
+          scanner->prolog.length = tag - data;
+          has_root = TRUE;
+        }
+      else if (scanner->stack->len == 0)
+        break;
+
+      depth = scanner->stack->len;
+      is_record = FALSE;
+
+      if (depth < n_steps && scanner->n_matched == depth &&
+          step_matches (g_ptr_array_index (scanner->steps, depth), tag, data_end))
+        {
+          is_record = depth == n_steps - 1;
+
+          if (is_open)
+            scanner->n_matched = depth + 1;
+        }
+
+      if (is_record)
+        scanner_start_record (scanner, tag - data);
+
+      if (is_open)
+        {
+          range.offset = tag - data;
+          range.length = p - tag;
+          g_array_append_val (scanner->stack, range);
+        }
+      else if (is_record)
+        scanner_end_record (scanner, p - data);
+    }
+
+  if (!has_root || scanner->stack->len > 0)
+    {
+      g_set_error_literal (error, XML_READER_ERROR,
+                           XML_READER_ERROR_INVALID,
+                           "The document is truncated");
+      return FALSE;
+    }
+
+  if (scanner->shards->len > 0)
+    {
+      Shard *shard = g_ptr_array_index (scanner->shards, scanner->shards->len - 1);
+
+      shard->length = scanner->last_record_end - shard->offset;
+      shard->closing = copy_ranges (scanner->last_stack);
+    }
+
+  return TRUE;
+}
+
+static void
+set_ranges (GKeyFile    *manifest,
+            const gchar *group,
+            const gchar *key,
+            GArray      *ranges)
+{
+  gchar **list = g_new0 (gchar *, ranges->len + 1);
+  guint i;
+
+  for (i = 0; i < ranges->len; i++)
+    {
+      ShardRange *range = &g_array_index (ranges, ShardRange, i);
+
+      list[i] = g_strdup_printf ("%" G_GUINT64_FORMAT ":%" G_GUINT64_FORMAT,
+                                 range->offset,
+                                 range->length);
+    }
+
+  g_key_file_set_string_list (manifest, group, key,
+                              (const gchar * const *) list,
+                              ranges->len);
+
+  g_strfreev (list);
+}
+
+/**
+ * xml_reader_create_shard_manifest:
+ * @filename: the full path to an XML file
+ * @record_path: the path of the records, as a list of element names
+ *   separated by slashes starting with the root element, or %NULL for
+ *   the children of the root element
+ * @n_shards: the number of shards to cut the file in
+ * @error: return location for a #GError, or %NULL
+ *
+ * Scans the file at @filename and cuts it in up to @n_shards shards of
+ * about the same size, each holding whole records, for
+ * xml_reader_load_shard(). The records are the elements matching
+ * @record_path, like for xml_reader_extract_columns(): the name "*"
+ * matches any element, and prefixes are ignored.
+ *
+ * The file is only scanned for its markup, without being parsed, so
+ * this is much faster than loading it; the content of the records is
+ * not checked. Files with fewer records than @n_shards get fewer
+ * shards, and files without records get none.
+ *
+ * Return value: the manifest of the shards, as the contents of a key
+ *   file, or %NULL if the file could not be read. Use g_free() when
+ *   done.
+ */
+gchar *
+xml_reader_create_shard_manifest (const gchar  *filename,
+                                  const gchar  *record_path,
+                                  guint         n_shards,
+                                  GError      **error)
+{
+  ShardScanner scanner;
+  GMappedFile *mapped_file;
+  GKeyFile *manifest;
+  gchar **steps, **step;
+  gchar *retval = NULL;
+  guint i;
+
+  g_return_val_if_fail (filename != NULL, NULL);
+  g_return_val_if_fail (n_shards > 0, NULL);
+
+  mapped_file = g_mapped_file_new (filename, FALSE, error);
+  if (!mapped_file)
+    return NULL;
+
+  memset (&scanner, 0, sizeof (ShardScanner));
+  scanner.data = g_mapped_file_get_contents (mapped_file);
+  scanner.length = g_mapped_file_get_length (mapped_file);
+  scanner.n_shards = n_shards;
+  scanner.stack = g_array_new (FALSE, FALSE, sizeof (ShardRange));
+  scanner.last_stack = g_array_new (FALSE, FALSE, sizeof (ShardRange));
+  scanner.shards = g_ptr_array_new_with_free_func (shard_free);
+  scanner.steps = g_ptr_array_new ();
+  scanner.next_cut = G_MAXUINT64;
+
+  steps = g_strsplit (record_path != NULL ? record_path : "*/*", "/", -1);
+  for (step = steps; *step != NULL; step++)
+    if (**step != '\0' && strcmp (*step, ".") != 0)
+      g_ptr_array_add (scanner.steps, *step);
+
+  if (scanner.steps->len > 0 && scanner_run (&scanner, error))
+    {
+      manifest = g_key_file_new ();
+
+      g_key_file_set_string (manifest, MANIFEST_GROUP, "File", filename);
+      g_key_file_set_uint64 (manifest, MANIFEST_GROUP, "Size", scanner.length);
+      g_key_file_set_string (manifest, MANIFEST_GROUP, "Record",
+                             record_path != NULL ? record_path : "*/*");
+      g_key_file_set_integer (manifest, MANIFEST_GROUP, "Shards", scanner.shards->len);
+
+      for (i = 0; i < scanner.shards->len; i++)
+        {
+          Shard *shard = g_ptr_array_index (scanner.shards, i);
+          gchar *group = g_strdup_printf ("Shard %u", i);
+
+          g_key_file_set_uint64 (manifest, group, "Offset", shard->offset);
+          g_key_file_set_uint64 (manifest, group, "Length", shard->length);
+          g_key_file_set_uint64 (manifest, group, "Records", shard->n_records);
+          set_ranges (manifest, group, "Context", shard->context);
+          set_ranges (manifest, group, "Closing", shard->closing);
+
+          g_free (group);
+        }
+
+      retval = g_key_file_to_data (manifest, NULL, NULL);
+
+      g_key_file_free (manifest);
+    }
+  else if (scanner.steps->len == 0)
+    g_set_error (error, XML_READER_ERROR,
+                 XML_READER_ERROR_INVALID,
+                 "Invalid record path `%s'",
+                 record_path);
+
+  g_strfreev (steps);
+  g_ptr_array_free (scanner.steps, TRUE);
+  g_ptr_array_free (scanner.shards, TRUE);
+  g_array_free (scanner.stack, TRUE);
+  g_array_free (scanner.last_stack, TRUE);
+  g_mapped_file_unref (mapped_file);
+
+  return retval;
+}
+
+static GKeyFile *
+load_manifest (const gchar  *manifest,
+               GError      **error)
+{
+  GKeyFile *retval = g_key_file_new ();
+
+  if (!g_key_file_load_from_data (retval, manifest, strlen (manifest),
+                                  G_KEY_FILE_NONE,
+                                  NULL) ||
+      !g_key_file_has_group (retval, MANIFEST_GROUP))
+    {
+      g_set_error_literal (error, XML_READER_ERROR,
+                           XML_READER_ERROR_INVALID,
+                           "Invalid shard manifest");
+      g_key_file_free (retval);
+      return NULL;
+    }
+
+  return retval;
+}
+
+/**
+ * xml_reader_count_shards:
+ * @manifest: a manifest returned by xml_reader_create_shard_manifest()
+ * @error: return location for a #GError, or %NULL
+ *
+ * Retrieves the number of shards described by @manifest.
+ *
+ * Return value: the number of shards, or 0 if @manifest is invalid, in
+ *   which case @error is set.
+ */
+guint
+xml_reader_count_shards (const gchar  *manifest,
+                         GError      **error)
+{
+  GKeyFile *key_file;
+  gint retval;
+
+  g_return_val_if_fail (manifest != NULL, 0);
+
+  key_file = load_manifest (manifest, error);
+  if (!key_file)
+    return 0;
+
+  retval = g_key_file_get_integer (key_file, MANIFEST_GROUP, "Shards", NULL);
+
+  g_key_file_free (key_file);
+
+  return MAX (retval, 0);
+}
+
+/* appends the ranges listed at @key in @group to @vectors, checking
+ * that they are start tags inside @data
+ */
+static gboolean
+get_ranges (GKeyFile    *manifest,
+            const gchar *group,
+            const gchar *key,
+            const gchar *data,
+            gsize        length,
+            GArray      *vectors)
+{
+  gchar **list;
+  gsize n_ranges, i;
+  gboolean retval = TRUE;
+
+  list = g_key_file_get_string_list (manifest, group, key, &n_ranges, NULL);
+  if (list == NULL)
+    return FALSE;
+
+  for (i = 0; i < n_ranges && retval; i++)
+    {
+      XmlReaderVector vector;
+      guint64 offset, size;
+      gchar *end;
+
+      offset = g_ascii_strtoull (list[i], &end, 10);
+      retval = *end == ':';
+      if (!retval)
+        break;
+
+      size = g_ascii_strtoull (end + 1, &end, 10);
+      retval = *end == '\0' && offset <= length && size <= length - offset;
+      if (!retval)
+        break;
+
+      vector.buffer = data + offset;
+      vector.size = size;
+
+      /* the prolog comes first */
+      if (vectors->len > 0 || strcmp (key, "Context") != 0)
+        retval = size > 1 && data[offset] == '<' && data[offset + size - 1] == '>';
+
+      g_array_append_val (vectors, vector);
+    }
+
+  g_strfreev (list);
+
+  return retval;
+}
+
+/**
+ * xml_reader_load_shard:
+ * @reader: a #XmlReader
+ * @manifest: a manifest returned by xml_reader_create_shard_manifest()
+ * @shard: the index of the shard to load, starting from 0
+ * @filename: the full path to the file on this host, or %NULL for the
+ *   one named in @manifest
+ * @error: return location for a #GError, or %NULL
+ *
+ * Loads the shard @shard of the file described by @manifest into
+ * @reader, like xml_reader_load_from_file() does. The document holds
+ * the records of the shard inside their ancestors, from the root
+ * element down, so it is walked the same way as the whole file.
+ *
+ * Only the shard itself and the start tags of its ancestors are read
+ * from the file, which has to be the one @manifest was created for:
+ * files of another size are reported with the
+ * %XML_READER_ERROR_INVALID error, like invalid manifests and shards
+ * that @manifest does not have.
+ *
+ * Return value: %TRUE if the shard was successfully loaded.
+ */
+gboolean
+xml_reader_load_shard (XmlReader    *reader,
+                       const gchar  *manifest,
+                       guint         shard,
+                       const gchar  *filename,
+                       GError      **error)
+{
+  GKeyFile *key_file;
+  GMappedFile *mapped_file = NULL;
+  GArray *vectors = NULL, *closing = NULL;
+  GString *end_tags = NULL;
+  XmlReaderVector records, tail;
+  gchar *file = NULL, *group;
+  const gchar *data;
+  gsize length;
+  guint64 offset, size;
+  gboolean retval = FALSE;
+  guint i;
+
+  g_return_val_if_fail (XML_IS_READER (reader), FALSE);
+  g_return_val_if_fail (manifest != NULL, FALSE);
+
+  key_file = load_manifest (manifest, error);
+  if (!key_file)
+    return FALSE;
+
+  group = g_strdup_printf ("Shard %u", shard);
+
+  if (!g_key_file_has_group (key_file, group))
+    {
+      g_set_error (error, XML_READER_ERROR,
+                   XML_READER_ERROR_INVALID,
+                   "The manifest has no shard %u",
+                   shard);
+      goto out;
+    }
+
+  if (filename == NULL)
+    filename = file = g_key_file_get_string (key_file, MANIFEST_GROUP, "File", NULL);
+
+  if (filename == NULL)
+    {
+      g_set_error_literal (error, XML_READER_ERROR,
+                           XML_READER_ERROR_INVALID,
+                           "Invalid shard manifest");
+      goto out;
+    }
+
+  mapped_file = g_mapped_file_new (filename, FALSE, error);
+  if (!mapped_file)
+    goto out;
+
+  data = g_mapped_file_get_contents (mapped_file);
+  length = g_mapped_file_get_length (mapped_file);
+
+  if (g_key_file_get_uint64 (key_file, MANIFEST_GROUP, "Size", NULL) != length)
+    {
+      g_set_error (error, XML_READER_ERROR,
+                   XML_READER_ERROR_INVALID,
+                   "The file `%s' does not match the shard manifest",
+                   filename);
+      goto out;
+    }
+
+  vectors = g_array_new (FALSE, FALSE, sizeof (XmlReaderVector));
+  closing = g_array_new (FALSE, FALSE, sizeof (XmlReaderVector));
+
+  offset = g_key_file_get_uint64 (key_file, group, "Offset", NULL);
+  size = g_key_file_get_uint64 (key_file, group, "Length", NULL);
+
+  if (offset > length || size > length - offset ||
+      !get_ranges (key_file, group, "Context", data, length, vectors) ||
+      !get_ranges (key_file, group, "Closing", data, length, closing))
+    {
+      g_set_error_literal (error, XML_READER_ERROR,
+                           XML_READER_ERROR_INVALID,
+                           "Invalid shard manifest");
+      goto out;
+    }
+
+  /* the ancestors open at the end of the shard, closed in order */
+  end_tags = g_string_new (NULL);
+  for (i = closing->len; i > 0; i--)
+    {
+      const gchar *tag = g_array_index (closing, XmlReaderVector, i - 1).buffer;
+
+      g_string_append (end_tags, "</");
+      g_string_append_len (end_tags, tag + 1, tag_name_length (tag, data + length));
+      g_string_append_c (end_tags, '>');
+    }
+
+  records.buffer = data + offset;
+  records.size = size;
+  g_array_append_val (vectors, records);
+
+  tail.buffer = end_tags->str;
+  tail.size = end_tags->len;
+  g_array_append_val (vectors, tail);
+
+  retval = xml_reader_load_from_vectors (reader,
+                                         (XmlReaderVector *) vectors->data,
+                                         vectors->len,
+                                         error);
+
+out:
+  if (end_tags)
+    g_string_free (end_tags, TRUE);
+
+  if (vectors)
+    g_array_free (vectors, TRUE);
+
+  if (closing)
+    g_array_free (closing, TRUE);
+
+  if (mapped_file)
+    g_mapped_file_unref (mapped_file);
+
+  g_free (file);
+  g_free (group);
+  g_key_file_free (key_file);
+
+  return retval;
+}
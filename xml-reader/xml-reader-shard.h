@@ -0,0 +1,40 @@
+/* xml-reader-shard.h: Sharded processing of large files
+ *
+ * Copyright (C) 2008  Emmanuele Bassi  <ebassi@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Author:
+ *   Emmanuele Bassi  <ebassi@gnome.org>
+ */
+
+#ifndef __XML_READER_SHARD_H__
+#define __XML_READER_SHARD_H__
+
+#include <xml-reader/xml-reader.h>
+
+G_BEGIN_DECLS
+
+gchar *  xml_reader_create_shard_manifest (const gchar  *filename,
+                                           const gchar  *record_path,
+                                           guint         n_shards,
+                                           GError      **error);
+guint    xml_reader_count_shards          (const gchar  *manifest,
+                                           GError      **error);
+gboolean xml_reader_load_shard            (XmlReader    *reader,
+                                           const gchar  *manifest,
+                                           guint         shard,
+                                           const gchar  *filename,
+                                           GError      **error);
+
+G_END_DECLS
+
+#endif /* __XML_READER_SHARD_H__ */
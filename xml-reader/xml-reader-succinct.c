@@ -0,0 +1,2046 @@
+/* xml-reader-succinct.c: Succinct document representation
+ *
+ * Copyright (C) 2008  Emmanuele Bassi  <ebassi@gnome.org>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * Author:
+ *   Emmanuele Bassi  <ebassi@gnome.org>
+ */
+
+/* The succinct representation keeps three things per element:
+ *
+ *   - an open and a close parenthesis in a balanced parentheses bit
+ *     vector laid out in document order, so that an element is the
+ *     position of its open parenthesis;
+ *   - the id of its name, interned in a per-document table;
+ *   - the offset of its start tag inside the source buffer, which must
+ *     outlive the tree; attributes and text are decoded from there on
+ *     access.
+ *
+ * The preorder index of an element, used to look up its name id and its
+ * offset, is the rank of its open parenthesis. Next sibling navigation
+ * needs the matching close parenthesis, which is found by skipping
+ * whole words, blocks and chunks of the bit vector whose minimum excess
+ * shows they cannot contain it.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <errno.h>
+#include <string.h>
+
+#if defined(HAVE_SYS_MMAN_H) && defined(HAVE_UNISTD_H)
+#include <sys/mman.h>
+#include <unistd.h>
+#define HAVE_FILE_STORES        1
+#endif
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "xml-reader-private.h"
+
+#define WORD_BITS       64
+#define BLOCK_WORDS     8
+#define BLOCK_BITS      (WORD_BITS * BLOCK_WORDS)
+#define CHUNK_BLOCKS    64
+#define CHUNK_BITS      (BLOCK_BITS * CHUNK_BLOCKS)
+
+/* elements sharing the same 64 bit base offset */
+#define OFFSET_GROUP    64
+
+#define NO_NODE         G_MAXUINT64
+
+/* a growable array, on the heap or, if @directory is set, in an
+ * unlinked temporary file created there, whose pages the kernel can
+ * write back and evict; the mapping moves when the store grows
+ */
+typedef struct {
+  guint8 *data;
+  gsize len;
+  gsize size;
+
+  const gchar *directory;
+  gint fd;
+
+  /* set, with the error code, when the store failed to grow; appends
+   * then land in @scratch
+   */
+  gint *failed;
+  guint64 scratch;
+} SuccinctStore;
+
+typedef struct {
+  const gchar *name;
+  gsize name_len;
+  const gchar *value;
+  gsize value_len;
+} SuccinctAttribute;
+
+struct _XmlReaderSuccinct
+{
+  /* not owned */
+  const gchar *source;
+  gsize source_len;
+  gboolean source_mapped;
+
+  gchar *directory;
+  gint failed;
+
+  guint64 n_bits;
+  guint64 n_elements;
+
+  /* balanced parentheses, least significant bit first */
+  SuccinctStore bits;
+
+  /* per word and block: the minimum excess reached inside it */
+  SuccinctStore word_min;
+  SuccinctStore block_min;
+
+  /* the same over the chunks, as a binary tree in heap order whose
+   * n_leaves leaves are the chunks, so that a run of chunks not
+   * holding a close parenthesis is skipped in logarithmic time
+   */
+  SuccinctStore chunk_min;
+  guint64 n_chunks;
+  guint64 n_leaves;
+
+  /* per block: the number of open parentheses before it */
+  SuccinctStore block_rank;
+
+  /* per element */
+  SuccinctStore name_ids;
+  SuccinctStore offset_deltas;
+
+  /* per group of OFFSET_GROUP elements */
+  SuccinctStore offset_bases;
+
+  /* interned names, and an open addressing table of their ids + 1 */
+  GPtrArray *names;
+  guint32 *name_slots;
+  guint n_name_slots;
+
+  /* the cursor: the open elements from the root down */
+  GArray *path;
+
+  /* the attributes of the element the cursor is on */
+  guint64 attrs_node;
+  GArray *attrs;
+  gint attr_index;
+
+  gchar *value;
+  gchar *attr_value;
+};
+
+static void
+store_init (SuccinctStore *store,
+            const gchar   *directory,
+            gint          *failed)
+{
+  store->data = NULL;
+  store->len = store->size = 0;
+  store->directory = directory;
+  store->fd = -1;
+  store->failed = failed;
+}
+
+#ifdef HAVE_FILE_STORES
+static gboolean
+store_grow_file (SuccinctStore *store,
+                 gsize          size)
+{
+  gpointer data;
+
+  if (store->fd < 0)
+    {
+      gchar *template;
+
+      template = g_build_filename (store->directory, "xml-reader-XXXXXX", NULL);
+      store->fd = g_mkstemp (template);
+      if (store->fd >= 0)
+        g_unlink (template);
+
+      g_free (template);
+
+      if (store->fd < 0)
+        return FALSE;
+    }
+
+  if (ftruncate (store->fd, size) != 0)
+    return FALSE;
+
+  data = mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, store->fd, 0);
+  if (data == MAP_FAILED)
+    return FALSE;
+
+  if (store->data)
+    munmap (store->data, store->size);
+
+  store->data = data;
+
+  return TRUE;
+}
+#endif
+
+static inline gpointer
+store_append (SuccinctStore *store,
+              gsize          n_bytes)
+{
+  gpointer retval;
+
+  if (G_UNLIKELY (store->len + n_bytes > store->size))
+    {
+      gsize size = MAX (store->size * 2, store->len + n_bytes);
+
+      size = MAX (size, 4096);
+
+#ifdef HAVE_FILE_STORES
+      if (store->directory != NULL)
+        {
+          if (*store->failed != 0 || !store_grow_file (store, size))
+            {
+              if (*store->failed == 0)
+                *store->failed = errno != 0 ? errno : ENOSPC;
+
+              return &store->scratch;
+            }
+        }
+      else
+#endif
+        store->data = g_realloc (store->data, size);
+
+      store->size = size;
+    }
+
+  retval = store->data + store->len;
+  store->len += n_bytes;
+
+  return retval;
+}
+
+static void
+store_clear (SuccinctStore *store)
+{
+#ifdef HAVE_FILE_STORES
+  if (store->fd >= 0)
+    {
+      if (store->data)
+        munmap (store->data, store->size);
+
+      close (store->fd);
+      store->fd = -1;
+    }
+  else
+#endif
+    g_free (store->data);
+
+  store->data = NULL;
+  store->len = store->size = 0;
+}
+
+static void
+store_advise (gpointer               data,
+              gsize                  size,
+              XmlReaderAccessPattern pattern)
+{
+#if defined(HAVE_FILE_STORES) && defined(MADV_SEQUENTIAL)
+  gsize page_size = sysconf (_SC_PAGESIZE);
+  guint8 *start = (guint8 *) ((gsize) data & ~(page_size - 1));
+  gint advice;
+
+  switch (pattern)
+    {
+    case XML_READER_ACCESS_SEQUENTIAL:
+      advice = MADV_SEQUENTIAL;
+      break;
+
+    case XML_READER_ACCESS_RANDOM:
+      advice = MADV_RANDOM;
+      break;
+
+    default:
+      advice = MADV_NORMAL;
+      break;
+    }
+
+  if (data != NULL && size > 0)
+    madvise (start, (guint8 *) data + size - start, advice);
+#endif
+}
+
+#define STORE_GET(store,type,i)         (((type *) (store).data)[(i)])
+#define STORE_APPEND(store,type,value)  (*((type *) store_append (&(store), sizeof (type))) = (value))
+
+static inline guint
+popcount64 (guint64 word)
+{
+#if defined(__GNUC__) && (__GNUC__ > 3 || (__GNUC__ == 3 && __GNUC_MINOR__ >= 4))
+  return __builtin_popcountll (word);
+#else
+  guint count = 0;
+
+  while (word != 0)
+    {
+      word &= word - 1;
+      count += 1;
+    }
+
+  return count;
+#endif
+}
+
+static inline gboolean
+tree_bit (XmlReaderSuccinct *tree,
+          guint64            pos)
+{
+  return (STORE_GET (tree->bits, guint64, pos / WORD_BITS) >> (pos % WORD_BITS)) & 1;
+}
+
+/* the number of open parentheses before @pos, that is the preorder
+ * index of the element opening at @pos
+ */
+static inline guint64
+tree_rank (XmlReaderSuccinct *tree,
+           guint64            pos)
+{
+  const guint64 *words = (const guint64 *) tree->bits.data;
+  guint64 retval = STORE_GET (tree->block_rank, guint64, pos / BLOCK_BITS);
+  guint64 w;
+
+  for (w = (pos / BLOCK_BITS) * BLOCK_WORDS; w < pos / WORD_BITS; w++)
+    retval += popcount64 (words[w]);
+
+  if (pos % WORD_BITS != 0)
+    retval += popcount64 (words[w] & ((G_GUINT64_CONSTANT (1) << (pos % WORD_BITS)) - 1));
+
+  return retval;
+}
+
+static inline gint64
+unit_excess (XmlReaderSuccinct *tree,
+             guint64            first_block,
+             guint64            n_blocks)
+{
+  guint64 ones = STORE_GET (tree->block_rank, guint64, first_block + n_blocks)
+               - STORE_GET (tree->block_rank, guint64, first_block);
+
+  return (gint64) (2 * ones) - (gint64) (n_blocks * BLOCK_BITS);
+}
+
+/* the excess over the chunks below @node, @height levels above the
+ * leaves of the chunk tree
+ */
+static inline gint64
+chunk_tree_excess (XmlReaderSuccinct *tree,
+                   guint64            node,
+                   guint              height)
+{
+  guint64 first = (node << height) - tree->n_leaves;
+  guint64 last = first + (G_GUINT64_CONSTANT (1) << height);
+
+  if (first >= tree->n_chunks)
+    return 0;
+
+  last = MIN (last, tree->n_chunks);
+
+  return unit_excess (tree, first * CHUNK_BLOCKS, (last - first) * CHUNK_BLOCKS);
+}
+
+/* the first chunk from @chunk on whose minimum excess, starting from
+ * *@d, reaches -1; *@d is updated to the excess at its start
+ */
+static guint64
+chunk_tree_skip (XmlReaderSuccinct *tree,
+                 guint64            chunk,
+                 gint64            *d)
+{
+  guint64 node = tree->n_leaves + chunk;
+  guint height = 0;
+
+  /* up and right, until a subtree holds the chunk */
+  while (*d + STORE_GET (tree->chunk_min, gint64, node) > -1)
+    {
+      *d += chunk_tree_excess (tree, node, height);
+
+      while (node & 1)
+        {
+          node >>= 1;
+          height += 1;
+        }
+
+      if (node == 0)
+        return tree->n_chunks;
+
+      node += 1;
+    }
+
+  /* then down, to its leftmost leaf */
+  while (height > 0)
+    {
+      node <<= 1;
+      height -= 1;
+
+      if (*d + STORE_GET (tree->chunk_min, gint64, node) > -1)
+        {
+          *d += chunk_tree_excess (tree, node, height);
+          node += 1;
+        }
+    }
+
+  return node - tree->n_leaves;
+}
+
+/* the position of the close parenthesis matching the open one at @pos */
+static guint64
+tree_find_close (XmlReaderSuccinct *tree,
+                 guint64            pos)
+{
+  const guint64 *words = (const guint64 *) tree->bits.data;
+  guint64 i = pos + 1;
+  gint64 d = 0;
+
+  while (i < tree->n_bits)
+    {
+      if (i % CHUNK_BITS == 0 &&
+          d + STORE_GET (tree->chunk_min, gint64, tree->n_leaves + i / CHUNK_BITS) > -1)
+        {
+          i = chunk_tree_skip (tree, i / CHUNK_BITS, &d) * CHUNK_BITS;
+          continue;
+        }
+
+      if (i % BLOCK_BITS == 0 &&
+          d + STORE_GET (tree->block_min, gint16, i / BLOCK_BITS) > -1)
+        {
+          d += unit_excess (tree, i / BLOCK_BITS, 1);
+          i += BLOCK_BITS;
+          continue;
+        }
+
+      if (i % WORD_BITS == 0 &&
+          d + STORE_GET (tree->word_min, gint8, i / WORD_BITS) > -1)
+        {
+          d += 2 * (gint64) popcount64 (words[i / WORD_BITS]) - WORD_BITS;
+          i += WORD_BITS;
+          continue;
+        }
+
+      d += tree_bit (tree, i) ? 1 : -1;
+      if (d == -1)
+        return i;
+
+      i += 1;
+    }
+
+  g_assert_not_reached ();
+
+  return NO_NODE;
+}
+
+static inline guint64
+tree_first_child (XmlReaderSuccinct *tree,
+                  guint64            pos)
+{
+  return tree_bit (tree, pos + 1) ? pos + 1 : NO_NODE;
+}
+
+static inline guint64
+tree_next_sibling (XmlReaderSuccinct *tree,
+                   guint64            pos)
+{
+  guint64 close = tree_find_close (tree, pos);
+
+  if (close + 1 < tree->n_bits && tree_bit (tree, close + 1))
+    return close + 1;
+
+  return NO_NODE;
+}
+
+static inline guint32
+tree_name_id (XmlReaderSuccinct *tree,
+              guint64            pos)
+{
+  return STORE_GET (tree->name_ids, guint32, tree_rank (tree, pos));
+}
+
+/* the start tag of the element opening at @pos */
+static inline const gchar *
+tree_start_tag (XmlReaderSuccinct *tree,
+                guint64            pos)
+{
+  guint64 index_ = tree_rank (tree, pos);
+
+  return tree->source
+       + STORE_GET (tree->offset_bases, guint64, index_ / OFFSET_GROUP)
+       + STORE_GET (tree->offset_deltas, guint32, index_);
+}
+
+static inline guint32
+hash_name (const gchar *name,
+           gsize        len)
+{
+  guint32 h = 5381;
+  gsize i;
+
+  /* djb2 over unsigned bytes, on the length rather than a terminator */
+  for (i = 0; i < len; i++)
+    h = (h << 5) + h + (guchar) name[i];
+
+  return h;
+}
+
+/* returns the slot of @name, which holds 0 if the name is unknown */
+static guint32 *
+tree_name_slot (XmlReaderSuccinct *tree,
+                const gchar       *name,
+                gsize              len)
+{
+  guint mask = tree->n_name_slots - 1;
+  guint i = hash_name (name, len) & mask;
+
+  while (tree->name_slots[i] != 0)
+    {
+      const gchar *candidate = g_ptr_array_index (tree->names, tree->name_slots[i] - 1);
+
+      if (strncmp (candidate, name, len) == 0 && candidate[len] == '\0')
+        break;
+
+      i = (i + 1) & mask;
+    }
+
+  return &tree->name_slots[i];
+}
+
+static guint32
+tree_intern_name (XmlReaderSuccinct *tree,
+                  const gchar       *name,
+                  gsize              len)
+{
+  guint32 *slot = tree_name_slot (tree, name, len);
+
+  if (*slot != 0)
+    return *slot - 1;
+
+  g_ptr_array_add (tree->names, g_strndup (name, len));
+  *slot = tree->names->len;
+
+  /* keep the table at most half full */
+  if (tree->names->len * 2 > tree->n_name_slots)
+    {
+      guint i;
+
+      g_free (tree->name_slots);
+
+      tree->n_name_slots *= 2;
+      tree->name_slots = g_new0 (guint32, tree->n_name_slots);
+
+      for (i = 0; i < tree->names->len; i++)
+        {
+          const gchar *str = g_ptr_array_index (tree->names, i);
+
+          *tree_name_slot (tree, str, strlen (str)) = i + 1;
+        }
+    }
+
+  return tree->names->len - 1;
+}
+
+/* the local part of a qualified name */
+static inline const gchar *
+local_name (const gchar *name,
+            gsize       *len)
+{
+  const gchar *colon = memchr (name, ':', *len);
+
+  if (colon == NULL)
+    return name;
+
+  *len -= colon + 1 - name;
+
+  return colon + 1;
+}
+
+/*
+ * Scanner
+ */
+
+typedef struct {
+  XmlReaderSuccinct *tree;
+
+  const gchar *cursor;
+  const gchar *end;
+
+  guint64 word;
+
+  /* the names of the open elements, for checking the end tags */
+  GArray *open;
+
+  /* the limits on the document, or %NULL */
+  const XmlReaderLimits *limits;
+} Scanner;
+
+typedef struct {
+  const gchar *name;
+  gsize len;
+} OpenTag;
+
+static inline void
+scanner_push_bit (Scanner  *scanner,
+                  gboolean  bit)
+{
+  XmlReaderSuccinct *tree = scanner->tree;
+
+  if (bit)
+    scanner->word |= G_GUINT64_CONSTANT (1) << (tree->n_bits % WORD_BITS);
+
+  tree->n_bits += 1;
+
+  if (tree->n_bits % WORD_BITS == 0)
+    {
+      STORE_APPEND (tree->bits, guint64, scanner->word);
+      scanner->word = 0;
+    }
+}
+
+static inline gboolean
+is_name_end (gchar c)
+{
+  return g_ascii_isspace (c) || c == '/' || c == '>' || c == '=' || c == '\0';
+}
+
+static inline void
+scanner_skip_spaces (Scanner *scanner)
+{
+  while (scanner->cursor < scanner->end && g_ascii_isspace (*scanner->cursor))
+    scanner->cursor += 1;
+}
+
+static gboolean
+scanner_name (Scanner      *scanner,
+              const gchar **name,
+              gsize        *len)
+{
+  const gchar *start = scanner->cursor;
+
+  while (scanner->cursor < scanner->end && !is_name_end (*scanner->cursor))
+    scanner->cursor += 1;
+
+  *name = start;
+  *len = scanner->cursor - start;
+
+  return *len > 0 && scanner->cursor < scanner->end;
+}
+
+/* moves past the next occurrence of @delimiter */
+static gboolean
+scanner_skip_past (Scanner     *scanner,
+                   const gchar *delimiter)
+{
+  gsize len = strlen (delimiter);
+
+  while (scanner->cursor + len <= scanner->end)
+    {
+      const gchar *p = memchr (scanner->cursor, delimiter[0],
+                               scanner->end - scanner->cursor);
+
+      if (p == NULL || p + len > scanner->end)
+        break;
+
+      if (memcmp (p, delimiter, len) == 0)
+        {
+          scanner->cursor = p + len;
+          return TRUE;
+        }
+
+      scanner->cursor = p + 1;
+    }
+
+  return FALSE;
+}
+
+/* skips a document type declaration, internal subset included */
+static gboolean
+scanner_skip_doctype (Scanner *scanner)
+{
+  gint brackets = 0;
+  gchar quote = 0;
+
+  for (; scanner->cursor < scanner->end; scanner->cursor++)
+    {
+      gchar c = *scanner->cursor;
+
+      if (quote != 0)
+        {
+          if (c == quote)
+            quote = 0;
+        }
+      else if (c == '"' || c == '\'')
+        quote = c;
+      else if (c == '[')
+        brackets += 1;
+      else if (c == ']')
+        brackets -= 1;
+      else if (c == '>' && brackets <= 0)
+        {
+          scanner->cursor += 1;
+          return TRUE;
+        }
+    }
+
+  return FALSE;
+}
+
+/* only the encodings the source can be read as without conversion */
+static gboolean
+scanner_check_declaration (Scanner *scanner)
+{
+  const gchar *end = scanner->cursor;
+  const gchar *encoding;
+  gchar *value;
+  gboolean retval;
+
+  while (end + 1 < scanner->end && !(end[0] == '?' && end[1] == '>'))
+    end += 1;
+
+  encoding = g_strstr_len (scanner->cursor, end - scanner->cursor, "encoding");
+  if (encoding == NULL)
+    return TRUE;
+
+  encoding += strlen ("encoding");
+  while (encoding < end && (g_ascii_isspace (*encoding) || *encoding == '='))
+    encoding += 1;
+
+  if (encoding == end || (*encoding != '"' && *encoding != '\''))
+    return FALSE;
+
+  value = g_strndup (encoding + 1, end - encoding - 1);
+  if (strchr (value, *encoding))
+    *strchr (value, *encoding) = '\0';
+
+  retval = g_ascii_strcasecmp (value, "UTF-8") == 0 ||
+           g_ascii_strcasecmp (value, "UTF8") == 0 ||
+           g_ascii_strcasecmp (value, "US-ASCII") == 0 ||
+           g_ascii_strcasecmp (value, "ASCII") == 0;
+
+  g_free (value);
+
+  return retval;
+}
+
+static void
+tree_set_store_error (XmlReaderSuccinct  *tree,
+                      GError            **error)
+{
+  g_set_error (error, XML_READER_ERROR, XML_READER_ERROR_INVALID,
+               "Unable to store the document in `%s': %s",
+               tree->directory,
+               g_strerror (tree->failed));
+}
+
+/* checks @len bytes of text or of an attribute value against the
+ * limits of @scanner
+ */
+static gboolean
+scanner_check_text (Scanner  *scanner,
+                    gsize     len,
+                    GError  **error)
+{
+  const XmlReaderLimits *limits = scanner->limits;
+
+  if (limits != NULL && limits->max_text_length > 0 && len > limits->max_text_length)
+    {
+      g_set_error (error, XML_READER_ERROR, XML_READER_ERROR_TEXT_LIMIT,
+                   "The document has a text longer than %" G_GSIZE_FORMAT " bytes",
+                   limits->max_text_length);
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+/* checks the element starting at the cursor against the limits of
+ * @scanner, before its attributes are looked at
+ */
+static gboolean
+scanner_check_element (Scanner  *scanner,
+                       GError  **error)
+{
+  const XmlReaderLimits *limits = scanner->limits;
+
+  if (limits == NULL)
+    return TRUE;
+
+  if (limits->max_depth > 0 && scanner->open->len >= limits->max_depth)
+    {
+      g_set_error (error, XML_READER_ERROR, XML_READER_ERROR_DEPTH_LIMIT,
+                   "The elements of the document are nested deeper than %u levels",
+                   limits->max_depth);
+      return FALSE;
+    }
+
+  /* only the elements are stored, and so counted */
+  if (limits->max_nodes > 0 && scanner->tree->n_elements >= limits->max_nodes)
+    {
+      g_set_error (error, XML_READER_ERROR, XML_READER_ERROR_NODE_LIMIT,
+                   "The document has more than %" G_GUINT64_FORMAT " nodes",
+                   limits->max_nodes);
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+static gboolean
+scanner_start_tag (Scanner  *scanner,
+                   GError  **error)
+{
+  XmlReaderSuccinct *tree = scanner->tree;
+  const gchar *tag = scanner->cursor;
+  const gchar *name;
+  gsize len;
+  guint64 index_, offset, base;
+  gboolean empty = FALSE;
+  guint n_attributes = 0;
+
+  if (scanner->open->len == 0 && tree->n_elements > 0)
+    {
+      g_set_error_literal (error, XML_READER_ERROR, XML_READER_ERROR_INVALID,
+                           "Extra content at the end of the document");
+      return FALSE;
+    }
+
+  if (!scanner_check_element (scanner, error))
+    return FALSE;
+
+  if (G_UNLIKELY (tree->failed != 0))
+    goto failed;
+
+  scanner->cursor += 1;
+  if (!scanner_name (scanner, &name, &len))
+    goto invalid;
+
+  /* attributes are only checked for well-formedness here */
+  while (TRUE)
+    {
+      const gchar *attr_name, *quote;
+      gsize attr_len;
+
+      scanner_skip_spaces (scanner);
+      if (scanner->cursor >= scanner->end)
+        goto invalid;
+
+      if (*scanner->cursor == '>')
+        break;
+
+      if (*scanner->cursor == '/')
+        {
+          if (scanner->cursor + 1 >= scanner->end || scanner->cursor[1] != '>')
+            goto invalid;
+
+          scanner->cursor += 1;
+          empty = TRUE;
+          break;
+        }
+
+      if (!scanner_name (scanner, &attr_name, &attr_len))
+        goto invalid;
+
+      scanner_skip_spaces (scanner);
+      if (scanner->cursor >= scanner->end || *scanner->cursor != '=')
+        goto invalid;
+
+      scanner->cursor += 1;
+      scanner_skip_spaces (scanner);
+      if (scanner->cursor >= scanner->end ||
+          (*scanner->cursor != '"' && *scanner->cursor != '\''))
+        goto invalid;
+
+      quote = memchr (scanner->cursor + 1, *scanner->cursor,
+                      scanner->end - scanner->cursor - 1);
+      if (quote == NULL)
+        goto invalid;
+
+      if (!scanner_check_text (scanner, quote - scanner->cursor - 1, error))
+        return FALSE;
+
+      n_attributes += 1;
+      if (scanner->limits != NULL && scanner->limits->max_attributes > 0 &&
+          n_attributes > scanner->limits->max_attributes)
+        {
+          g_set_error (error, XML_READER_ERROR, XML_READER_ERROR_ATTRIBUTE_LIMIT,
+                       "An element has more than %u attributes",
+                       scanner->limits->max_attributes);
+          return FALSE;
+        }
+
+      scanner->cursor = quote + 1;
+    }
+
+  scanner->cursor += 1;
+
+  index_ = tree->n_elements++;
+  offset = tag - tree->source;
+
+  if (index_ % OFFSET_GROUP == 0)
+    {
+      STORE_APPEND (tree->offset_bases, guint64, offset);
+
+      if (G_UNLIKELY (tree->failed != 0))
+        goto failed;
+    }
+
+  base = STORE_GET (tree->offset_bases, guint64, index_ / OFFSET_GROUP);
+  if (offset - base > G_MAXUINT32)
+    {
+      g_set_error_literal (error, XML_READER_ERROR, XML_READER_ERROR_INVALID,
+                           "Text content too large for the succinct representation");
+      return FALSE;
+    }
+
+  STORE_APPEND (tree->offset_deltas, guint32, offset - base);
+
+  name = local_name (name, &len);
+  STORE_APPEND (tree->name_ids, guint32, tree_intern_name (tree, name, len));
+
+  scanner_push_bit (scanner, TRUE);
+
+  if (empty)
+    scanner_push_bit (scanner, FALSE);
+  else
+    {
+      OpenTag open_tag = { tag + 1, 0 };
+
+      open_tag.len = (name + len) - open_tag.name;
+      g_array_append_val (scanner->open, open_tag);
+    }
+
+  return TRUE;
+
+invalid:
+  g_set_error_literal (error, XML_READER_ERROR, XML_READER_ERROR_INVALID,
+                       "Malformed start tag");
+  return FALSE;
+
+failed:
+  tree_set_store_error (tree, error);
+  return FALSE;
+}
+
+static gboolean
+scanner_end_tag (Scanner  *scanner,
+                 GError  **error)
+{
+  OpenTag *open_tag;
+  const gchar *name;
+  gsize len;
+
+  scanner->cursor += 2;
+
+  if (!scanner_name (scanner, &name, &len))
+    goto invalid;
+
+  scanner_skip_spaces (scanner);
+  if (scanner->cursor >= scanner->end || *scanner->cursor != '>')
+    goto invalid;
+
+  scanner->cursor += 1;
+
+  if (scanner->open->len == 0)
+    goto invalid;
+
+  open_tag = &g_array_index (scanner->open, OpenTag, scanner->open->len - 1);
+  if (open_tag->len != len || memcmp (open_tag->name, name, len) != 0)
+    {
+      g_set_error (error, XML_READER_ERROR, XML_READER_ERROR_INVALID,
+                   "Opening and ending tag mismatch: %.*s and %.*s",
+                   (int) open_tag->len, open_tag->name,
+                   (int) len, name);
+      return FALSE;
+    }
+
+  g_array_set_size (scanner->open, scanner->open->len - 1);
+  scanner_push_bit (scanner, FALSE);
+
+  return TRUE;
+
+invalid:
+  g_set_error_literal (error, XML_READER_ERROR, XML_READER_ERROR_INVALID,
+                       "Malformed end tag");
+  return FALSE;
+}
+
+static gboolean
+scanner_run (Scanner  *scanner,
+             GError  **error)
+{
+  while (scanner->cursor < scanner->end)
+    {
+      const gchar *p = scanner->cursor;
+      gsize left = scanner->end - p;
+
+      if (*p != '<')
+        {
+          const gchar *next = memchr (p, '<', left);
+
+          if (!scanner_check_text (scanner, (next ? next : scanner->end) - p, error))
+            return FALSE;
+
+          /* text is only looked at on access */
+          if (scanner->open->len == 0)
+            for (; p < (next ? next : scanner->end); p++)
+              if (!g_ascii_isspace (*p))
+                {
+                  g_set_error_literal (error, XML_READER_ERROR,
+                                       XML_READER_ERROR_INVALID,
+                                       "Content outside of the root element");
+                  return FALSE;
+                }
+
+          scanner->cursor = next ? next : scanner->end;
+          continue;
+        }
+
+      if (left >= 2 && p[1] == '?')
+        {
+          if (p == scanner->tree->source && left >= 5 &&
+              strncmp (p, "<?xml", 5) == 0 &&
+              !scanner_check_declaration (scanner))
+            {
+              g_set_error_literal (error, XML_READER_ERROR,
+                                   XML_READER_ERROR_INVALID,
+                                   "Only UTF-8 documents can be loaded "
+                                   "in succinct mode");
+              return FALSE;
+            }
+
+          if (!scanner_skip_past (scanner, "?>"))
+            goto truncated;
+        }
+      else if (left >= 4 && strncmp (p, "<!--", 4) == 0)
+        {
+          if (!scanner_skip_past (scanner, "-->"))
+            goto truncated;
+        }
+      else if (left >= 9 && strncmp (p, "<![CDATA[", 9) == 0)
+        {
+          if (!scanner_skip_past (scanner, "]]>"))
+            goto truncated;
+
+          if (!scanner_check_text (scanner, scanner->cursor - p - 12, error))
+            return FALSE;
+        }
+      else if (left >= 2 && p[1] == '!')
+        {
+          if (!scanner_skip_doctype (scanner))
+            goto truncated;
+        }
+      else if (left >= 2 && p[1] == '/')
+        {
+          if (!scanner_end_tag (scanner, error))
+            return FALSE;
+        }
+      else if (!scanner_start_tag (scanner, error))
+        return FALSE;
+    }
+
+  if (scanner->open->len == 0 && scanner->tree->n_elements > 0)
+    return TRUE;
+
+truncated:
+  g_set_error_literal (error, XML_READER_ERROR, XML_READER_ERROR_INVALID,
+                       "Premature end of data");
+  return FALSE;
+}
+
+/* builds the rank and minimum excess directories; the bit vector is
+ * padded with zeroes to a whole number of chunks, which never hides a
+ * close parenthesis since the padding comes after the last one
+ */
+static void
+tree_build_directories (XmlReaderSuccinct *tree,
+                        guint64            last_word)
+{
+  guint64 n_words, n_blocks, n_chunks, w, b, c, rank, node;
+
+  if (tree->n_bits % WORD_BITS != 0)
+    STORE_APPEND (tree->bits, guint64, last_word);
+
+  while ((tree->bits.len / sizeof (guint64)) % (BLOCK_WORDS * CHUNK_BLOCKS) != 0)
+    {
+      STORE_APPEND (tree->bits, guint64, 0);
+
+      if (tree->failed != 0)
+        return;
+    }
+
+  n_words = tree->bits.len / sizeof (guint64);
+  n_blocks = n_words / BLOCK_WORDS;
+  n_chunks = n_blocks / CHUNK_BLOCKS;
+
+  for (w = 0; w < n_words; w++)
+    {
+      guint64 word = STORE_GET (tree->bits, guint64, w);
+      gint d = 0, min = WORD_BITS;
+      guint i;
+
+      for (i = 0; i < WORD_BITS; i++)
+        {
+          d += ((word >> i) & 1) ? 1 : -1;
+          min = MIN (min, d);
+        }
+
+      STORE_APPEND (tree->word_min, gint8, min);
+    }
+
+  if (tree->failed != 0)
+    return;
+
+  rank = 0;
+  for (b = 0; b < n_blocks; b++)
+    {
+      gint d = 0, min = BLOCK_BITS;
+
+      STORE_APPEND (tree->block_rank, guint64, rank);
+
+      for (w = b * BLOCK_WORDS; w < (b + 1) * BLOCK_WORDS; w++)
+        {
+          guint ones = popcount64 (STORE_GET (tree->bits, guint64, w));
+
+          min = MIN (min, d + STORE_GET (tree->word_min, gint8, w));
+          d += 2 * (gint) ones - WORD_BITS;
+          rank += ones;
+        }
+
+      STORE_APPEND (tree->block_min, gint16, min);
+    }
+
+  STORE_APPEND (tree->block_rank, guint64, rank);
+
+  if (tree->failed != 0)
+    return;
+
+  tree->n_chunks = n_chunks;
+  tree->n_leaves = 1;
+  while (tree->n_leaves < n_chunks)
+    tree->n_leaves *= 2;
+
+  /* the inner nodes are filled in below, and the leaves past the last
+   * chunk never reach -1
+   */
+  for (node = 0; node < 2 * tree->n_leaves; node++)
+    STORE_APPEND (tree->chunk_min, gint64, G_MAXINT32);
+
+  if (tree->failed != 0)
+    return;
+
+  for (c = 0; c < n_chunks; c++)
+    {
+      gint64 d = 0, min = CHUNK_BITS;
+
+      for (b = c * CHUNK_BLOCKS; b < (c + 1) * CHUNK_BLOCKS; b++)
+        {
+          min = MIN (min, d + STORE_GET (tree->block_min, gint16, b));
+          d += unit_excess (tree, b, 1);
+        }
+
+      STORE_GET (tree->chunk_min, gint64, tree->n_leaves + c) = min;
+    }
+
+  for (node = tree->n_leaves - 1; node > 0; node--)
+    {
+      guint height = 0;
+      guint64 n;
+
+      for (n = node; n < tree->n_leaves; n <<= 1)
+        height += 1;
+
+      STORE_GET (tree->chunk_min, gint64, node) =
+        MIN (STORE_GET (tree->chunk_min, gint64, 2 * node),
+             chunk_tree_excess (tree, 2 * node, height - 1) +
+             STORE_GET (tree->chunk_min, gint64, 2 * node + 1));
+    }
+}
+
+/**
+ * _xml_reader_succinct_new:
+ * @source: the document
+ * @length: the length of @source
+ * @limits: the limits on the document, or %NULL
+ * @error: return location for a #GError, or %NULL
+ *
+ * Scans @source into a succinct tree; @source must stay alive and
+ * unchanged for as long as the tree does. The scan stops at the
+ * first of @limits the document exceeds.
+ *
+ * Return value: the tree, or %NULL if @source is not well-formed
+ */
+XmlReaderSuccinct *
+_xml_reader_succinct_new (const gchar  *source,
+                          gsize         length,
+                          gboolean      source_mapped,
+                          const gchar  *directory,
+                          const XmlReaderLimits *limits,
+                          GError      **error)
+{
+  XmlReaderSuccinct *tree;
+  Scanner scanner;
+  gboolean res;
+
+  tree = g_slice_new0 (XmlReaderSuccinct);
+  tree->source = source;
+  tree->source_len = length;
+  tree->source_mapped = source_mapped;
+  tree->directory = g_strdup (directory);
+
+  store_init (&tree->bits, tree->directory, &tree->failed);
+  store_init (&tree->word_min, tree->directory, &tree->failed);
+  store_init (&tree->block_min, tree->directory, &tree->failed);
+  store_init (&tree->chunk_min, tree->directory, &tree->failed);
+  store_init (&tree->block_rank, tree->directory, &tree->failed);
+  store_init (&tree->name_ids, tree->directory, &tree->failed);
+  store_init (&tree->offset_deltas, tree->directory, &tree->failed);
+  store_init (&tree->offset_bases, tree->directory, &tree->failed);
+
+  tree->names = g_ptr_array_new_with_free_func (g_free);
+  tree->n_name_slots = 64;
+  tree->name_slots = g_new0 (guint32, tree->n_name_slots);
+  tree->path = g_array_new (FALSE, FALSE, sizeof (guint64));
+  tree->attrs = g_array_new (FALSE, FALSE, sizeof (SuccinctAttribute));
+  tree->attrs_node = NO_NODE;
+  tree->attr_index = -1;
+
+  scanner.tree = tree;
+  scanner.cursor = source;
+  scanner.end = source + length;
+  scanner.word = 0;
+  scanner.open = g_array_new (FALSE, FALSE, sizeof (OpenTag));
+  scanner.limits = limits;
+
+  /* skip the byte order mark */
+  if (length >= 3 && memcmp (source, "\xef\xbb\xbf", 3) == 0)
+    scanner.cursor += 3;
+
+  if (source_mapped)
+    store_advise ((gpointer) source, length, XML_READER_ACCESS_SEQUENTIAL);
+
+  res = scanner_run (&scanner, error);
+
+  g_array_free (scanner.open, TRUE);
+
+  if (res)
+    tree_build_directories (tree, scanner.word);
+
+  if (res && tree->failed != 0)
+    {
+      tree_set_store_error (tree, error);
+      res = FALSE;
+    }
+
+  if (!res)
+    {
+      _xml_reader_succinct_free (tree);
+      return NULL;
+    }
+
+  _xml_reader_succinct_set_access_pattern (tree, XML_READER_ACCESS_NORMAL);
+
+  return tree;
+}
+
+/* applies @pattern to the mapped parts of @tree */
+void
+_xml_reader_succinct_set_access_pattern (XmlReaderSuccinct      *tree,
+                                         XmlReaderAccessPattern  pattern)
+{
+  SuccinctStore *stores[] = {
+    &tree->bits,
+    &tree->word_min,
+    &tree->block_min,
+    &tree->chunk_min,
+    &tree->block_rank,
+    &tree->name_ids,
+    &tree->offset_deltas,
+    &tree->offset_bases
+  };
+  guint i;
+
+  if (tree->source_mapped)
+    store_advise ((gpointer) tree->source, tree->source_len, pattern);
+
+  for (i = 0; i < G_N_ELEMENTS (stores); i++)
+    if (stores[i]->fd >= 0)
+      store_advise (stores[i]->data, stores[i]->len, pattern);
+}
+
+static void
+free_source_store (gpointer data)
+{
+  SuccinctStore *store = data;
+
+  store_clear (store);
+  g_slice_free (SuccinctStore, store);
+}
+
+/**
+ * _xml_reader_succinct_copy_source:
+ * @buffer: the document
+ * @length: the length of @buffer
+ * @directory: the directory of the temporary file to copy @buffer to
+ * @error: return location for a #GError, or %NULL
+ *
+ * Copies @buffer to an unlinked temporary file, so that the source of
+ * an out-of-core tree can be paged out as well.
+ *
+ * Return value: the mapped copy, or %NULL
+ */
+GBytes *
+_xml_reader_succinct_copy_source (const gchar  *buffer,
+                                  gsize         length,
+                                  const gchar  *directory,
+                                  GError      **error)
+{
+  SuccinctStore *store = g_slice_new (SuccinctStore);
+  gint failed = 0;
+  gpointer data;
+
+  store_init (store, directory, &failed);
+
+  data = store_append (store, MAX (length, 1));
+  if (failed != 0)
+    {
+      g_set_error (error, XML_READER_ERROR, XML_READER_ERROR_INVALID,
+                   "Unable to store the document in `%s': %s",
+                   directory,
+                   g_strerror (failed));
+      free_source_store (store);
+      return NULL;
+    }
+
+  memcpy (data, buffer, length);
+
+  /* the store outlives the local failure flag, but cannot grow again */
+  store->failed = NULL;
+
+  return g_bytes_new_with_free_func (store->data, length,
+                                     free_source_store,
+                                     store);
+}
+
+void
+_xml_reader_succinct_free (XmlReaderSuccinct *tree)
+{
+  if (tree == NULL)
+    return;
+
+  store_clear (&tree->bits);
+  store_clear (&tree->word_min);
+  store_clear (&tree->block_min);
+  store_clear (&tree->chunk_min);
+  store_clear (&tree->block_rank);
+  store_clear (&tree->name_ids);
+  store_clear (&tree->offset_deltas);
+  store_clear (&tree->offset_bases);
+
+  g_free (tree->directory);
+
+  g_ptr_array_free (tree->names, TRUE);
+  g_free (tree->name_slots);
+
+  g_array_free (tree->path, TRUE);
+  g_array_free (tree->attrs, TRUE);
+
+  g_free (tree->value);
+  g_free (tree->attr_value);
+
+  g_slice_free (XmlReaderSuccinct, tree);
+}
+
+/* the memory used by @tree, in bytes, the source excluded */
+gsize
+_xml_reader_succinct_get_size (XmlReaderSuccinct *tree)
+{
+  return tree->bits.len +
+         tree->word_min.len +
+         tree->block_min.len +
+         tree->chunk_min.len +
+         tree->block_rank.len +
+         tree->name_ids.len +
+         tree->offset_deltas.len +
+         tree->offset_bases.len +
+         tree->n_name_slots * sizeof (guint32);
+}
+
+/*
+ * Values
+ */
+
+/* appends the character reference or predefined entity at @p, and
+ * returns the number of bytes it takes, or 0 if it is not one
+ */
+static gsize
+decode_reference (GString     *buffer,
+                  const gchar *p,
+                  const gchar *end)
+{
+  static const struct {
+    const gchar *name;
+    gchar value;
+  } entities[] = {
+    { "amp;", '&' },
+    { "lt;", '<' },
+    { "gt;", '>' },
+    { "quot;", '"' },
+    { "apos;", '\'' }
+  };
+  const gchar *semicolon = memchr (p, ';', end - p);
+  guint i;
+
+  if (semicolon == NULL)
+    return 0;
+
+  if (p[1] == '#')
+    {
+      gchar *num_end;
+      gunichar c;
+
+      if (p + 2 < semicolon && (p[2] == 'x' || p[2] == 'X'))
+        c = g_ascii_strtoull (p + 3, &num_end, 16);
+      else
+        c = g_ascii_strtoull (p + 2, &num_end, 10);
+
+      if (num_end != semicolon || !g_unichar_validate (c))
+        return 0;
+
+      g_string_append_unichar (buffer, c);
+
+      return semicolon + 1 - p;
+    }
+
+  for (i = 0; i < G_N_ELEMENTS (entities); i++)
+    {
+      gsize len = strlen (entities[i].name);
+
+      if (semicolon + 1 - (p + 1) == (gssize) len &&
+          memcmp (p + 1, entities[i].name, len) == 0)
+        {
+          g_string_append_c (buffer, entities[i].value);
+          return len + 1;
+        }
+    }
+
+  return 0;
+}
+
+/* unescapes @len bytes of text or, if @attribute is set, of an
+ * attribute value, normalizing its white space like the parser does
+ */
+static gchar *
+decode_text (const gchar *text,
+             gsize        len,
+             gboolean     attribute)
+{
+  const gchar *end = text + len;
+  GString *buffer = g_string_sized_new (len);
+
+  while (text < end)
+    {
+      gsize n;
+
+      if (*text == '&' && (n = decode_reference (buffer, text, end)) > 0)
+        {
+          text += n;
+          continue;
+        }
+
+      if (*text == '\r')
+        {
+          g_string_append_c (buffer, attribute ? ' ' : '\n');
+          text += (text + 1 < end && text[1] == '\n') ? 2 : 1;
+          continue;
+        }
+
+      if (attribute && (*text == '\t' || *text == '\n'))
+        g_string_append_c (buffer, ' ');
+      else
+        g_string_append_c (buffer, *text);
+
+      text += 1;
+    }
+
+  return g_string_free (buffer, FALSE);
+}
+
+/* parses the attributes of the element opening at @pos, namespace
+ * declarations excluded, and returns the end of its start tag
+ */
+static const gchar *
+tree_parse_start_tag (XmlReaderSuccinct *tree,
+                      guint64            pos,
+                      GArray            *attrs)
+{
+  const gchar *end = tree->source + tree->source_len;
+  const gchar *p = tree_start_tag (tree, pos) + 1;
+
+  if (attrs)
+    g_array_set_size (attrs, 0);
+
+  while (!is_name_end (*p))
+    p += 1;
+
+  /* the scanner made sure the tag is well-formed */
+  while (TRUE)
+    {
+      SuccinctAttribute attr;
+      const gchar *quote;
+
+      while (g_ascii_isspace (*p))
+        p += 1;
+
+      if (*p == '>' || *p == '/')
+        break;
+
+      attr.name = p;
+      while (!is_name_end (*p))
+        p += 1;
+      attr.name_len = p - attr.name;
+
+      while (*p != '"' && *p != '\'')
+        p += 1;
+
+      quote = memchr (p + 1, *p, end - p - 1);
+      attr.value = p + 1;
+      attr.value_len = quote - attr.value;
+      p = quote + 1;
+
+      if (attrs == NULL)
+        continue;
+
+      if ((attr.name_len == 5 && memcmp (attr.name, "xmlns", 5) == 0) ||
+          (attr.name_len > 6 && memcmp (attr.name, "xmlns:", 6) == 0))
+        continue;
+
+      g_array_append_val (attrs, attr);
+    }
+
+  return p;
+}
+
+static GArray *
+tree_get_attributes (XmlReaderSuccinct *tree,
+                     guint64            pos)
+{
+  if (tree->attrs_node != pos)
+    {
+      tree_parse_start_tag (tree, pos, tree->attrs);
+      tree->attrs_node = pos;
+    }
+
+  return tree->attrs;
+}
+
+/*
+ * Cursor
+ */
+
+#define TREE_CURSOR(tree) \
+  ((tree)->path->len > 0 ? g_array_index ((tree)->path, guint64, (tree)->path->len - 1) : NO_NODE)
+
+static void
+tree_move_cursor (XmlReaderSuccinct *tree)
+{
+  tree->attr_index = -1;
+
+  g_free (tree->value);
+  tree->value = NULL;
+
+  g_free (tree->attr_value);
+  tree->attr_value = NULL;
+}
+
+static inline void
+tree_enter (XmlReaderSuccinct *tree,
+            guint64            pos)
+{
+  g_array_append_val (tree->path, pos);
+  tree_move_cursor (tree);
+}
+
+static gint64
+tree_lookup_name (XmlReaderSuccinct *tree,
+                  const gchar       *name)
+{
+  guint32 slot = *tree_name_slot (tree, name, strlen (name));
+
+  return slot != 0 ? (gint64) slot - 1 : -1;
+}
+
+/* the children of the cursor, or the root element if the cursor is not
+ * set; @name_id is -1 for any name
+ */
+static guint64
+tree_find_nth (XmlReaderSuccinct *tree,
+               gint64             name_id,
+               guint              n,
+               guint             *n_elements)
+{
+  guint64 parent = TREE_CURSOR (tree);
+  guint64 child, retval = NO_NODE;
+  guint count = 0;
+
+  /* the root element has no siblings */
+  if (parent == NO_NODE)
+    {
+      if (name_id < 0 || tree_name_id (tree, 0) == name_id)
+        {
+          count = 1;
+          retval = n == 0 ? 0 : NO_NODE;
+        }
+
+      if (n_elements)
+        *n_elements = count;
+
+      return retval;
+    }
+
+  for (child = tree_first_child (tree, parent);
+       child != NO_NODE;
+       child = tree_next_sibling (tree, child))
+    {
+      if (name_id >= 0 && tree_name_id (tree, child) != name_id)
+        continue;
+
+      if (count == n)
+        {
+          retval = child;
+
+          if (n_elements == NULL)
+            break;
+        }
+
+      count += 1;
+    }
+
+  if (n_elements)
+    *n_elements = count;
+
+  return retval;
+}
+
+gboolean
+_xml_reader_succinct_read_start_element (XmlReader   *reader,
+                                         const gchar *element_name,
+                                         gboolean     optional)
+{
+  XmlReaderSuccinct *tree = reader->priv->succinct;
+  gint64 name_id = tree_lookup_name (tree, element_name);
+  guint64 node = NO_NODE;
+
+  if (name_id >= 0)
+    node = tree_find_nth (tree, name_id, 0, NULL);
+
+  if (node != NO_NODE)
+    {
+      tree_enter (tree, node);
+      return TRUE;
+    }
+
+  if (!optional)
+    {
+      reader->priv->error_state = TRUE;
+      reader->priv->last_error = XML_READER_ERROR_UNKNOWN_NODE;
+    }
+
+  return FALSE;
+}
+
+gint
+_xml_reader_succinct_count_elements (XmlReader   *reader,
+                                     const gchar *element_name)
+{
+  XmlReaderSuccinct *tree = reader->priv->succinct;
+  gint64 name_id = -1;
+  guint n_elements;
+
+  if (element_name != NULL)
+    {
+      name_id = tree_lookup_name (tree, element_name);
+      if (name_id < 0)
+        return 0;
+    }
+
+  tree_find_nth (tree, name_id, 0, &n_elements);
+
+  return n_elements;
+}
+
+gboolean
+_xml_reader_succinct_read_nth_element (XmlReader   *reader,
+                                       const gchar *element_name,
+                                       gint         index_)
+{
+  XmlReaderSuccinct *tree = reader->priv->succinct;
+  gint64 name_id = -1;
+  guint64 node = NO_NODE;
+
+  if (element_name != NULL)
+    name_id = tree_lookup_name (tree, element_name);
+
+  if (index_ >= 0 && (element_name == NULL || name_id >= 0))
+    node = tree_find_nth (tree, name_id, index_, NULL);
+
+  if (node != NO_NODE)
+    {
+      tree_enter (tree, node);
+      return TRUE;
+    }
+
+  reader->priv->error_state = TRUE;
+  reader->priv->last_error = XML_READER_ERROR_UNKNOWN_NODE;
+
+  return FALSE;
+}
+
+void
+_xml_reader_succinct_read_end_element (XmlReader *reader)
+{
+  XmlReaderSuccinct *tree = reader->priv->succinct;
+
+  /* a failed movement left the cursor where it was */
+  if (reader->priv->error_state)
+    {
+      reader->priv->error_state = FALSE;
+      return;
+    }
+
+  if (tree->path->len == 0)
+    {
+      g_warning ("No cursor set");
+      return;
+    }
+
+  g_array_set_size (tree->path, tree->path->len - 1);
+  tree_move_cursor (tree);
+}
+
+gboolean
+_xml_reader_succinct_read_next_in_document (XmlReader *reader)
+{
+  XmlReaderSuccinct *tree = reader->priv->succinct;
+  guint64 pos = TREE_CURSOR (tree);
+  guint64 close;
+
+  if (pos == NO_NODE)
+    {
+      tree_enter (tree, 0);
+      return TRUE;
+    }
+
+  tree_move_cursor (tree);
+
+  if (tree_bit (tree, pos + 1))
+    {
+      pos += 1;
+      g_array_append_val (tree->path, pos);
+      return TRUE;
+    }
+
+  /* climb until an ancestor has a next sibling; the close parenthesis
+   * of a parent follows the one of its last child
+   */
+  close = pos + 1;
+  while (TRUE)
+    {
+      g_array_set_size (tree->path, tree->path->len - 1);
+
+      if (close + 1 < tree->n_bits && tree_bit (tree, close + 1))
+        {
+          pos = close + 1;
+          g_array_append_val (tree->path, pos);
+          return TRUE;
+        }
+
+      if (tree->path->len == 0)
+        return FALSE;
+
+      close += 1;
+    }
+}
+
+gint
+_xml_reader_succinct_get_depth (XmlReader *reader)
+{
+  return reader->priv->succinct->path->len;
+}
+
+const gchar *
+_xml_reader_succinct_get_element_name (XmlReader *reader)
+{
+  XmlReaderSuccinct *tree = reader->priv->succinct;
+  guint64 pos = TREE_CURSOR (tree);
+
+  if (pos == NO_NODE)
+    return NULL;
+
+  return g_ptr_array_index (tree->names, tree_name_id (tree, pos));
+}
+
+/* the text between the start tag and the first markup, unless it is
+ * only made of white space
+ */
+const gchar *
+_xml_reader_succinct_get_element_value (XmlReader *reader)
+{
+  XmlReaderSuccinct *tree = reader->priv->succinct;
+  guint64 pos = TREE_CURSOR (tree);
+  const gchar *text, *text_end, *end;
+
+  if (pos == NO_NODE)
+    return NULL;
+
+  if (tree->value)
+    return tree->value;
+
+  text = tree_parse_start_tag (tree, pos, NULL);
+  if (*text == '/')
+    return NULL;
+
+  text += 1;
+  end = tree->source + tree->source_len;
+  text_end = memchr (text, '<', end - text);
+  if (text_end == NULL)
+    text_end = end;
+
+  for (end = text; end < text_end; end++)
+    if (!g_ascii_isspace (*end))
+      break;
+
+  if (end == text_end)
+    return NULL;
+
+  tree->value = decode_text (text, text_end - text, FALSE);
+
+  return tree->value;
+}
+
+gint
+_xml_reader_succinct_count_attributes (XmlReader *reader)
+{
+  XmlReaderSuccinct *tree = reader->priv->succinct;
+  guint64 pos = TREE_CURSOR (tree);
+
+  if (pos == NO_NODE)
+    return -1;
+
+  return tree_get_attributes (tree, pos)->len;
+}
+
+static gboolean
+tree_read_attribute (XmlReaderSuccinct *tree,
+                     GArray            *attrs,
+                     gint               index_)
+{
+  SuccinctAttribute *attr = &g_array_index (attrs, SuccinctAttribute, index_);
+
+  g_free (tree->attr_value);
+
+  tree->attr_index = index_;
+  tree->attr_value = decode_text (attr->value, attr->value_len, TRUE);
+
+  return TRUE;
+}
+
+gboolean
+_xml_reader_succinct_read_attribute_pos (XmlReader *reader,
+                                         gint       index_)
+{
+  XmlReaderSuccinct *tree = reader->priv->succinct;
+  guint64 pos = TREE_CURSOR (tree);
+  GArray *attrs;
+
+  if (pos == NO_NODE)
+    return FALSE;
+
+  attrs = tree_get_attributes (tree, pos);
+  if (index_ < 0 || (guint) index_ >= attrs->len)
+    return FALSE;
+
+  return tree_read_attribute (tree, attrs, index_);
+}
+
+gboolean
+_xml_reader_succinct_read_attribute_name (XmlReader   *reader,
+                                          const gchar *attribute_name)
+{
+  XmlReaderSuccinct *tree = reader->priv->succinct;
+  guint64 pos = TREE_CURSOR (tree);
+  gsize len = strlen (attribute_name);
+  GArray *attrs;
+  guint i;
+
+  if (pos == NO_NODE)
+    return FALSE;
+
+  attrs = tree_get_attributes (tree, pos);
+  for (i = 0; i < attrs->len; i++)
+    {
+      SuccinctAttribute *attr = &g_array_index (attrs, SuccinctAttribute, i);
+      gsize name_len = attr->name_len;
+      const gchar *name = local_name (attr->name, &name_len);
+
+      if (name_len == len && memcmp (name, attribute_name, len) == 0)
+        return tree_read_attribute (tree, attrs, i);
+    }
+
+  return FALSE;
+}
+
+const gchar *
+_xml_reader_succinct_get_attribute_value (XmlReader *reader)
+{
+  return reader->priv->succinct->attr_value;
+}
+
+/* the outer or inner XML of the current element, found by scanning its
+ * content for the matching end tag
+ */
+gboolean
+_xml_reader_succinct_get_xml_range (XmlReader *reader,
+                                    gboolean   inner,
+                                    gsize     *start,
+                                    gsize     *end)
+{
+  XmlReaderSuccinct *tree = reader->priv->succinct;
+  guint64 pos = TREE_CURSOR (tree);
+  const gchar *source_end, *p;
+  gint depth;
+
+  if (pos == NO_NODE)
+    return FALSE;
+
+  source_end = tree->source + tree->source_len;
+
+  p = tree_parse_start_tag (tree, pos, NULL);
+  if (*p == '/')
+    {
+      /* an empty element has no content */
+      *start = inner ? p + 2 - tree->source : tree_start_tag (tree, pos) - tree->source;
+      *end = p + 2 - tree->source;
+
+      return TRUE;
+    }
+
+  p += 1;
+  *start = inner ? p - tree->source : tree_start_tag (tree, pos) - tree->source;
+
+  for (depth = 1; p < source_end; )
+    {
+      gboolean is_open;
+
+      p = memchr (p, '<', source_end - p);
+      if (p == NULL)
+        break;
+
+      if (p + 1 < source_end && p[1] == '/')
+        {
+          const gchar *close = memchr (p, '>', source_end - p);
+
+          if (close == NULL)
+            break;
+
+          if (--depth == 0)
+            {
+              *end = (inner ? p : close + 1) - tree->source;
+              return TRUE;
+            }
+
+          p = close + 1;
+          continue;
+        }
+
+      p = _xml_reader_skip_markup (p, source_end, &is_open);
+      if (p == NULL)
+        break;
+
+      if (is_open)
+        depth += 1;
+    }
+
+  /* the scanner made sure the element is closed */
+  g_assert_not_reached ();
+
+  return FALSE;
+}
+
+/* the value of the current element or attribute inside the source, if
+ * it needs no decoding
+ */
+gboolean
+_xml_reader_succinct_get_value_range (XmlReader *reader,
+                                      gboolean   attribute,
+                                      gsize     *start,
+                                      gsize     *end)
+{
+  XmlReaderSuccinct *tree = reader->priv->succinct;
+  guint64 pos = TREE_CURSOR (tree);
+  const gchar *value, *p;
+  gsize len;
+
+  if (pos == NO_NODE)
+    return FALSE;
+
+  if (attribute)
+    {
+      GArray *attrs;
+      SuccinctAttribute *attr;
+
+      if (tree->attr_index < 0)
+        return FALSE;
+
+      attrs = tree_get_attributes (tree, pos);
+      attr = &g_array_index (attrs, SuccinctAttribute, tree->attr_index);
+      value = attr->value;
+      len = attr->value_len;
+    }
+  else
+    {
+      const gchar *text_end, *source_end = tree->source + tree->source_len;
+
+      value = tree_parse_start_tag (tree, pos, NULL);
+      if (*value == '/')
+        return FALSE;
+
+      value += 1;
+      text_end = memchr (value, '<', source_end - value);
+      if (text_end == NULL)
+        text_end = source_end;
+
+      /* same as _xml_reader_succinct_get_element_value() */
+      for (p = value; p < text_end; p++)
+        if (!g_ascii_isspace (*p))
+          break;
+
+      if (p == text_end)
+        return FALSE;
+
+      len = text_end - value;
+    }
+
+  for (p = value; p < value + len; p++)
+    if (*p == '&' || *p == '\r' || (attribute && (*p == '\t' || *p == '\n')))
+      return FALSE;
+
+  *start = value - tree->source;
+  *end = *start + len;
+
+  return TRUE;
+}
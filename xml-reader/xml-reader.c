@@ -35,58 +35,305 @@
 #include <libxml/globals.h>
 #include <libxml/tree.h>
 #include <libxml/parser.h>
+#include <libxml/parserInternals.h>
+#include <libxml/SAX2.h>
 
 #include <glib.h>
 
 #include "xml-reader.h"
+#include "xml-reader-private.h"
 
 #define G_UNIMPLEMENTED                         G_STMT_START {  \
         g_warning ("%s: Function not implemented", G_STRLOC);   \
                                                 } G_STMT_END
 
-#define XML_TO_CHAR(s)  ((char *) (s))
+/* number of per-element records allocated in one go */
+#define NODE_INFO_BLOCK_SIZE    256
+
+/* lookups below an element before its children get packed */
+#define CHILD_INDEX_MIN_LOOKUPS 2
+
+/* adaptive indexing thresholds: children compared below an element
+ * before they get packed, misses below an element before its
+ * descendant names filter is built, and the lookups and children an
+ * element needs before its children get indexed by name
+ */
+#define ADAPTIVE_MIN_SCANNED            32
+#define ADAPTIVE_MIN_MISSES             2
+#define ADAPTIVE_NAME_MAP_MIN_LOOKUPS   4
+#define ADAPTIVE_NAME_MAP_MIN_CHILDREN  64
+
+/* rough cost of one name in a by-name index */
+#define NAME_MAP_ENTRY_SIZE     64
+
+/* values interned by default when deduplicating */
+#define DEDUP_DEFAULT_MAX_LENGTH 64
+
+/* decisions kept for xml_reader_get_index_report() */
+#define INDEX_REPORT_MAX_ENTRIES 128
+
+#define PARSE_OPTIONS   (XML_PARSE_RECOVER | XML_PARSE_NOBLANKS | XML_PARSE_COMPACT)
+
+/* strings interned by the parser context shared by a stream of
+ * documents before it gets replaced
+ */
+#define STREAM_DICT_MAX_SIZE    65536
+
+/* bytes of the source parsed at a time by xml_reader_load_step() */
+#define LOAD_STEP_CHUNK_SIZE    (64 * 1024)
+
+/* bytes of the source parsed at a time in bounded memory mode */
+#define WINDOW_CHUNK_SIZE       (4 * 1024)
+
+/* elements parsed between two looks at the clock, when reporting the
+ * progress of the parser
+ */
+#define PROGRESS_CHECK_ELEMENTS 64
+
+/* the format of the checkpoints of followed files, and its tag */
+#define CHECKPOINT_TYPE         "(stay)"
+#define CHECKPOINT_TAG          "xml-reader-checkpoint-1"
 
 G_DEFINE_TYPE (XmlReader, xml_reader, G_TYPE_OBJECT);
 
-struct _XmlReaderPrivate
+typedef struct _XmlReaderNodeInfo       XmlReaderNodeInfo;
+
+/* lookup data attached to an element through xmlNode::_private; it is
+ * created on demand and lives as long as the document does
+ */
+struct _XmlReaderNodeInfo
 {
-  guint is_filename : 1;
-  gchar *filename;
+  /* g_str_hash() of the element name */
+  guint32 name_hash;
 
-  guint error_state : 1;
-  XmlReaderError last_error;
+  /* Bloom filter of the names of every descendant element */
+  guint64 names_bloom;
 
-  gint depth;
+  /* the element children and their name hashes, packed contiguously so
+   * that sibling scans compare hashes instead of walking the list
+   */
+  guint n_children;
+  guint32 *child_hashes;
+  xmlNodePtr *children;
 
-  xmlDocPtr current_doc;
+  /* positions inside @children, grouped by element name */
+  GHashTable *positions_by_name;
 
-  xmlNodePtr parent;
-  xmlNodePtr node_cursor;
-  xmlAttrPtr attr_cursor;
+  /* lookup costs, used by the adaptive indexing */
+  guint n_lookups;
+  guint n_scanned;
+  guint n_misses;
 
-  xmlChar *cursor_value;
-  xmlChar *attr_value;
+  /* where the element starts and ends inside the kept source, and the
+   * lengths of its start and end tags
+   */
+  guint64 outer_start;
+  guint64 outer_end;
+  guint32 start_tag_len;
+  guint32 end_tag_len;
+
+  guint has_offsets : 1;
+  guint has_bloom : 1;
+  guint has_children : 1;
+  guint bloom_declined : 1;
+  guint children_declined : 1;
+  guint positions_declined : 1;
 };
 
-static inline void
-xml_reader_clear (XmlReader *reader)
+/* releases what is left to parse of a document in bounded memory mode;
+ * a failure of the decompressor is kept in @window_error
+ */
+static void
+xml_reader_window_close_sources (XmlReader *reader)
 {
   XmlReaderPrivate *priv = reader->priv;
+  GBytes *piece;
+
+  while ((piece = g_queue_pop_head (&priv->window_sources)) != NULL)
+    g_bytes_unref (piece);
+
+  if (priv->window_piece)
+    {
+      g_bytes_unref (priv->window_piece);
+      priv->window_piece = NULL;
+    }
+
+  if (priv->window_decompressor)
+    {
+      GError *internal_error = NULL;
+
+      if (!_xml_reader_decompressor_free (priv->window_decompressor,
+                                          &internal_error))
+        {
+          g_set_error (&priv->window_error, XML_READER_ERROR,
+                       XML_READER_ERROR_INVALID,
+                       "Unable to decompress file `%s': %s",
+                       priv->filename,
+                       internal_error->message);
+          g_error_free (internal_error);
+        }
+
+      priv->window_decompressor = NULL;
+    }
 
-  if (priv->cursor_value)
+  /* the decompressor reads from the input */
+  if (priv->window_input)
     {
-      xmlFree (priv->cursor_value);
-      priv->cursor_value = NULL;
+      g_bytes_unref (priv->window_input);
+      priv->window_input = NULL;
     }
 
+  priv->window_data = NULL;
+  priv->window_length = 0;
+  priv->window_offset = 0;
+}
+
+static inline void
+xml_reader_clear (XmlReader *reader)
+{
+  XmlReaderPrivate *priv = reader->priv;
+
   if (priv->attr_value)
     {
       xmlFree (priv->attr_value);
       priv->attr_value = NULL;
     }
 
+  /* a pending incremental load is abandoned; the decompressor reads
+   * from the source, which is released last
+   */
+  if (priv->load_ctxt)
+    {
+      if (priv->load_ctxt->myDoc)
+        xmlFreeDoc (priv->load_ctxt->myDoc);
+
+      xmlFreeParserCtxt (priv->load_ctxt);
+      priv->load_ctxt = NULL;
+    }
+
+  if (priv->load_decompressor)
+    {
+      _xml_reader_decompressor_free (priv->load_decompressor, NULL);
+      priv->load_decompressor = NULL;
+    }
+
+  if (priv->load_source)
+    {
+      g_bytes_unref (priv->load_source);
+      priv->load_source = NULL;
+    }
+
+  /* the document being parsed belongs to @current_doc */
+  if (priv->window_ctxt)
+    {
+      priv->window_ctxt->myDoc = NULL;
+      xmlFreeParserCtxt (priv->window_ctxt);
+      priv->window_ctxt = NULL;
+    }
+
+  xml_reader_window_close_sources (reader);
+
+  /* the error state of a windowed document only comes from its parser */
+  if (priv->windowed &&
+      (priv->memory_exceeded || priv->limit_exceeded || priv->window_error))
+    priv->error_state = FALSE;
+
+  g_clear_error (&priv->window_error);
+  g_hash_table_remove_all (priv->window_ends);
+
+  priv->windowed = FALSE;
+  priv->memory_exceeded = FALSE;
+
   if (priv->current_doc)
-    xmlFreeDoc (priv->current_doc);
+    {
+      xmlFreeDoc (priv->current_doc);
+      priv->current_doc = NULL;
+    }
+
+  if (priv->succinct)
+    {
+      _xml_reader_succinct_free (priv->succinct);
+      priv->succinct = NULL;
+    }
+
+  if (priv->source)
+    {
+      g_bytes_unref (priv->source);
+      priv->source = NULL;
+    }
+
+  if (priv->xml_copy)
+    {
+      g_bytes_unref (priv->xml_copy);
+      priv->xml_copy = NULL;
+    }
+
+  priv->has_offsets = FALSE;
+
+  /* the node records are only referenced by the document nodes */
+  if (priv->info_blocks)
+    {
+      guint i, j;
+
+      for (i = 0; i < priv->info_blocks->len; i++)
+        {
+          XmlReaderNodeInfo *block = g_ptr_array_index (priv->info_blocks, i);
+          guint n_used = NODE_INFO_BLOCK_SIZE;
+
+          if (i == priv->info_blocks->len - 1)
+            n_used = priv->info_block_used;
+
+          for (j = 0; j < n_used; j++)
+            {
+              g_free (block[j].child_hashes);
+              g_free (block[j].children);
+
+              if (block[j].positions_by_name)
+                g_hash_table_destroy (block[j].positions_by_name);
+            }
+
+          /* one block is kept for the next document, which saves the
+           * allocations when iterating over small ones
+           */
+          if (priv->spare_info_block == NULL)
+            {
+              memset (block, 0, n_used * sizeof (XmlReaderNodeInfo));
+              priv->spare_info_block = block;
+            }
+          else
+            g_free (block);
+        }
+
+      g_ptr_array_set_size (priv->info_blocks, 0);
+    }
+
+  priv->info_block_used = NODE_INFO_BLOCK_SIZE;
+
+  memset (&priv->stats, 0, sizeof (XmlReaderStatistics));
+
+  if (priv->index_report)
+    g_ptr_array_set_size (priv->index_report, 0);
+
+  priv->n_report_dropped = 0;
+}
+
+static void
+xml_reader_stop_following (XmlReader *reader)
+{
+  XmlReaderPrivate *priv = reader->priv;
+
+  if (priv->follower)
+    {
+      _xml_reader_follower_free (priv->follower);
+      priv->follower = NULL;
+    }
+
+  g_free (priv->follow_head);
+  priv->follow_head = NULL;
+  priv->follow_head_len = 0;
+
+  g_free (priv->follow_tail);
+  priv->follow_tail = NULL;
 }
 
 static void
@@ -95,9 +342,26 @@ xml_reader_finalize (GObject *gobject)
   XmlReaderPrivate *priv = XML_READER (gobject)->priv;
 
   g_free (priv->filename);
+  g_free (priv->out_of_core_directory);
 
   xml_reader_clear (XML_READER (gobject));
 
+  if (priv->stream)
+    g_bytes_unref (priv->stream);
+
+  if (priv->stream_ctxt)
+    xmlFreeParserCtxt (priv->stream_ctxt);
+
+  xml_reader_stop_following (XML_READER (gobject));
+
+  if (priv->progress_notify)
+    priv->progress_notify (priv->progress_data);
+
+  g_free (priv->spare_info_block);
+  g_ptr_array_free (priv->info_blocks, TRUE);
+  g_ptr_array_free (priv->index_report, TRUE);
+  g_hash_table_destroy (priv->window_ends);
+
   G_OBJECT_CLASS (xml_reader_parent_class)->finalize (gobject);
 }
 
@@ -126,150 +390,3810 @@ xml_reader_init (XmlReader *reader)
 
   priv->node_cursor = NULL;
   priv->attr_cursor = NULL;
-  priv->cursor_value = NULL;
   priv->attr_value = NULL;
+
+  priv->info_blocks = g_ptr_array_new ();
+  priv->info_block_used = NODE_INFO_BLOCK_SIZE;
+
+  priv->adaptive_indexing = FALSE;
+  priv->memory_budget = 0;
+
+  priv->dedup = FALSE;
+  priv->dedup_max_length = DEDUP_DEFAULT_MAX_LENGTH;
+
+  priv->keep_source = FALSE;
+
+  priv->release_depth = 0;
+  priv->memory_limit = 0;
+  priv->window_ends = g_hash_table_new (NULL, NULL);
+
+  priv->progress_func = NULL;
+  priv->progress_total = -1;
+
+  priv->has_limits = FALSE;
+
+  priv->out_of_core = FALSE;
+  priv->out_of_core_directory = NULL;
+  priv->access_pattern = XML_READER_ACCESS_NORMAL;
+
+  priv->index_report = g_ptr_array_new_with_free_func (g_free);
 }
 
-/*
- * Public API
- */
+/* the number of node records handed out so far */
+static inline gsize
+xml_reader_n_node_infos (XmlReader *reader)
+{
+  XmlReaderPrivate *priv = reader->priv;
 
-/**
- * xml_reader_new:
- *
- * Creates a new #XmlReader instance. You can use the #XmlReader
- * instance to load an XML data stream from a file or a memory
- * buffer and then iterate over it to extract the data contained
- * inside it.
- *
- * Return value: the newly created #XmlReader instance. Use
- *   g_object_unref() when done using it.
- */
-XmlReader *
-xml_reader_new (void)
+  if (priv->info_blocks->len == 0)
+    return 0;
+
+  return (gsize) (priv->info_blocks->len - 1) * NODE_INFO_BLOCK_SIZE
+       + priv->info_block_used;
+}
+
+/* whether an index of @size bytes fits in the adaptive memory budget */
+static inline gboolean
+xml_reader_index_fits (XmlReader *reader,
+                       gsize      size)
 {
-  return g_object_new (XML_TYPE_READER, NULL);
+  XmlReaderPrivate *priv = reader->priv;
+
+  if (priv->memory_budget == 0)
+    return TRUE;
+
+  return priv->stats.index_memory + size <= priv->memory_budget;
 }
 
-/**
- * xml_reader_load_from_data:
- * @reader: a #XmlReader
- * @buffer: a %NULL terminated string containing an XML stream
- * @error: return location for a #GError, or %NULL
- *
- * Loads the XML into the @reader and sets the initial status of the
- * DOM to be ready to be walked using the #XmlReader methods.
- *
- * If @reader was already being used, the previous state is discarded;
- * this is also true for an #XmlReader instance in an error state.
- *
- * In case of error, %FALSE is returned and @error is set.
- *
- * Return value: %TRUE if the XML data was successfully loaded.
- */
-gboolean
-xml_reader_load_from_data (XmlReader    *reader,
-                           const gchar  *buffer,
-                           GError      **error)
+/* records why an index was built, or not, below @node */
+static void
+xml_reader_report_index (XmlReader   *reader,
+                         xmlNodePtr   node,
+                         const gchar *format,
+                         ...)
 {
-  XmlReaderPrivate *priv;
+  XmlReaderPrivate *priv = reader->priv;
+  xmlChar *path;
+  gchar *reason;
+  va_list args;
 
-  g_return_val_if_fail (XML_IS_READER (reader), FALSE);
-  g_return_val_if_fail (buffer != NULL, FALSE);
+  if (priv->index_report->len >= INDEX_REPORT_MAX_ENTRIES)
+    {
+      priv->n_report_dropped += 1;
+      return;
+    }
 
-  priv = reader->priv;
+  va_start (args, format);
+  reason = g_strdup_vprintf (format, args);
+  va_end (args);
 
-  xml_reader_clear (reader);
+  path = xmlGetNodePath (node);
+  g_ptr_array_add (priv->index_report,
+                   g_strdup_printf ("%s: %s", XML_TO_CHAR (path), reason));
 
-  LIBXML_TEST_VERSION;
+  xmlFree (path);
+  g_free (reason);
+}
 
-  priv->current_doc = xmlReadMemory (buffer, strlen (buffer),
-                                     NULL, NULL,
-                                     XML_PARSE_RECOVER | XML_PARSE_NOBLANKS | XML_PARSE_COMPACT);
-  if (!priv->current_doc)
-    {
-      gchar *error_message;
+static XmlReaderNodeInfo *
+xml_reader_get_node_info (XmlReader  *reader,
+                          xmlNodePtr  node)
+{
+  XmlReaderPrivate *priv = reader->priv;
+  XmlReaderNodeInfo *block;
 
-      if (!priv->is_filename)
-        error_message = g_strdup ("Unable to parse XML buffer");
+  if (G_LIKELY (node->_private != NULL))
+    return node->_private;
+
+  if (priv->info_block_used == NODE_INFO_BLOCK_SIZE)
+    {
+      if (priv->spare_info_block != NULL)
+        {
+          block = priv->spare_info_block;
+          priv->spare_info_block = NULL;
+        }
       else
-        error_message = g_strdup_printf ("Unable to parse file `%s'",
-                                         priv->filename);
+        block = g_new0 (XmlReaderNodeInfo, NODE_INFO_BLOCK_SIZE);
 
-      g_set_error (error, XML_READER_ERROR,
-                   XML_READER_ERROR_INVALID,
-                   error_message);
+      g_ptr_array_add (priv->info_blocks, block);
+      priv->info_block_used = 0;
+    }
+  else
+    block = g_ptr_array_index (priv->info_blocks, priv->info_blocks->len - 1);
 
-      g_free (error_message);
+  node->_private = &block[priv->info_block_used++];
 
-      return FALSE;
-    }
+  if (node->name != NULL)
+    ((XmlReaderNodeInfo *) node->_private)->name_hash = g_str_hash (node->name);
 
-  priv->parent = priv->current_doc->xmlRootNode;
-  priv->node_cursor = NULL;
-  priv->attr_cursor = NULL;
-  priv->depth = 0;
+  return node->_private;
+}
 
-  return TRUE;
+/* two bits out of 64, both taken from the same string hash */
+static inline guint64
+xml_reader_name_bits (guint32 hash)
+{
+  return (G_GUINT64_CONSTANT (1) << (hash & 63)) |
+         (G_GUINT64_CONSTANT (1) << ((hash >> 6) & 63));
 }
 
-/**
- * xml_reader_load_from_file:
- * @reader: a #XmlReader
- * @filename: the full path to an XML file
- * @error: return location for a #GError, or %NULL
- *
- * Loads an XML file at @filename into @reader and sets the #XmlReader
- * to be ready to walk the XML document object model.
- *
- * See also xml_reader_load_from_file().
+/* folds a finished element into the filter of its parent */
+static inline void
+xml_reader_bloom_finish (XmlReader  *reader,
+                         xmlNodePtr  node)
+{
+  XmlReaderNodeInfo *info = xml_reader_get_node_info (reader, node);
+  XmlReaderNodeInfo *parent_info;
+
+  info->has_bloom = TRUE;
+
+  parent_info = xml_reader_get_node_info (reader, node->parent);
+  parent_info->names_bloom |= info->names_bloom
+                            | xml_reader_name_bits (info->name_hash);
+}
+
+/* builds the descendant names filter of @root and, on the way, of every
+ * element below it; the walk is iterative so that deep documents cannot
+ * exhaust the stack, and subtrees that already have a filter are folded
+ * in without being visited again
  *
- * Return value: %TRUE if the file was successfully loaded.
+ * if @limit is not 0 the walk gives up once the records it allocated
+ * take more than @limit bytes; the filters of the subtrees finished by
+ * then are kept, since they are complete
  */
-gboolean
-xml_reader_load_from_file (XmlReader    *reader,
-                           const gchar  *filename,
-                           GError      **error)
+static gboolean
+xml_reader_build_bloom (XmlReader  *reader,
+                        xmlNodePtr  root,
+                        gsize       limit)
 {
-  XmlReaderPrivate *priv;
-  GError *internal_error;
-  gchar *buffer;
-  gboolean retval;
+  XmlReaderPrivate *priv = reader->priv;
+  XmlReaderNodeInfo *info;
+  xmlNodePtr node;
+  gsize n_infos, max_infos;
+  gboolean retval = TRUE;
 
-  g_return_val_if_fail (XML_IS_READER (reader), FALSE);
-  g_return_val_if_fail (filename != NULL, FALSE);
+  info = xml_reader_get_node_info (reader, root);
+  if (info->has_bloom)
+    return TRUE;
 
-  priv = reader->priv;
+  info->names_bloom = 0;
 
-  internal_error = NULL;
-  if (!g_file_get_contents (filename, &buffer, NULL, &internal_error))
+  n_infos = xml_reader_n_node_infos (reader);
+  max_infos = limit != 0 ? n_infos + limit / sizeof (XmlReaderNodeInfo) : 0;
+
+  node = root->xmlChildrenNode;
+  while (node != NULL)
     {
-      g_propagate_error (error, internal_error);
-      return FALSE;
-    }
+      if (node->type == XML_ELEMENT_NODE)
+        {
+          info = xml_reader_get_node_info (reader, node);
 
-  g_free (priv->filename);
+          if (max_infos != 0 && xml_reader_n_node_infos (reader) > max_infos)
+            {
+              retval = FALSE;
+              break;
+            }
 
-  priv->is_filename = TRUE;
-  priv->filename = g_strdup (filename);
+          if (!info->has_bloom)
+            {
+              info->names_bloom = 0;
+
+              if (node->xmlChildrenNode != NULL)
+                {
+                  node = node->xmlChildrenNode;
+                  continue;
+                }
+            }
+
+          xml_reader_bloom_finish (reader, node);
+        }
+
+      /* climb back up, finishing the elements we are leaving */
+      while (node->next == NULL && node->parent != root)
+        {
+          node = node->parent;
+          xml_reader_bloom_finish (reader, node);
+        }
 
-  retval = xml_reader_load_from_data (reader, buffer, &internal_error);
-  if (!retval)
-    g_propagate_error (error, internal_error);
+      node = node->next;
+    }
+
+  priv->stats.index_memory += (xml_reader_n_node_infos (reader) - n_infos)
+                            * sizeof (XmlReaderNodeInfo);
 
-  g_free (buffer);
+  if (retval)
+    {
+      xml_reader_get_node_info (reader, root)->has_bloom = TRUE;
+      priv->stats.n_filters += 1;
+    }
 
   return retval;
 }
 
-/**
- * xml_reader_get_error:
- * @reader: a #XmlReader
- * @error: return location for a #GError, or %NULL
- *
- * Checks the state of @reader and returns whether the #XmlReader instance
- * is in an error state and cannot be used to walk the DOM tree or not.
- *
+static guint
+xml_reader_count_children (xmlNodePtr parent)
+{
+  xmlNodePtr node;
+  guint n_children = 0;
+
+  for (node = parent->xmlChildrenNode; node != NULL; node = node->next)
+    if (node->type == XML_ELEMENT_NODE)
+      n_children += 1;
+
+  return n_children;
+}
+
+static inline gsize
+xml_reader_children_size (guint n_children)
+{
+  return n_children * (sizeof (guint32) + sizeof (xmlNodePtr));
+}
+
+/* packs the element children of @parent and their name hashes */
+static void
+xml_reader_build_children (XmlReader  *reader,
+                           xmlNodePtr  parent)
+{
+  XmlReaderNodeInfo *info = xml_reader_get_node_info (reader, parent);
+  xmlNodePtr node;
+  guint n_children, i;
+
+  n_children = xml_reader_count_children (parent);
+
+  info->n_children = n_children;
+  info->child_hashes = g_new (guint32, n_children);
+  info->children = g_new (xmlNodePtr, n_children);
+
+  for (node = parent->xmlChildrenNode, i = 0; node != NULL; node = node->next)
+    {
+      if (node->type != XML_ELEMENT_NODE)
+        continue;
+
+      info->child_hashes[i] = xml_reader_get_node_info (reader, node)->name_hash;
+      info->children[i] = node;
+      i += 1;
+    }
+
+  info->has_children = TRUE;
+
+  reader->priv->stats.n_child_arrays += 1;
+  reader->priv->stats.index_memory += xml_reader_children_size (n_children);
+}
+
+static void
+free_positions (gpointer data)
+{
+  g_array_free (data, TRUE);
+}
+
+/* groups the positions of the element children of @parent by name, so
+ * that counting them and picking one by position are both O(1)
+ */
+static GHashTable *
+xml_reader_get_positions_by_name (XmlReader  *reader,
+                                  xmlNodePtr  parent)
+{
+  XmlReaderNodeInfo *info = xml_reader_get_node_info (reader, parent);
+  guint i;
+
+  if (info->positions_by_name)
+    return info->positions_by_name;
+
+  if (!info->has_children)
+    xml_reader_build_children (reader, parent);
+
+  info->positions_by_name = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                   NULL,
+                                                   free_positions);
+
+  for (i = 0; i < info->n_children; i++)
+    {
+      gchar *name = XML_TO_CHAR (info->children[i]->name);
+      GArray *positions;
+
+      positions = g_hash_table_lookup (info->positions_by_name, name);
+      if (!positions)
+        {
+          positions = g_array_new (FALSE, FALSE, sizeof (guint));
+          g_hash_table_insert (info->positions_by_name, name, positions);
+        }
+
+      g_array_append_val (positions, i);
+    }
+
+  reader->priv->stats.n_name_maps += 1;
+  reader->priv->stats.index_memory +=
+    info->n_children * sizeof (guint) +
+    g_hash_table_size (info->positions_by_name) * NAME_MAP_ENTRY_SIZE;
+
+  return info->positions_by_name;
+}
+
+/* whether @ctxt gave up or was stopped; libxml2 marks this with
+ * disableSAX set to 2 from 2.13 on, and only with the end of file
+ * state before that
+ */
+static inline gboolean
+xml_reader_parser_stopped (xmlParserCtxtPtr ctxt)
+{
+  return ctxt->disableSAX > 1 || ctxt->instate == XML_PARSER_EOF;
+}
+
+static void
+xml_reader_report_progress (XmlReader *reader,
+                            goffset    bytes_read)
+{
+  XmlReaderPrivate *priv = reader->priv;
+
+  priv->progress_func (reader,
+                       bytes_read,
+                       priv->progress_total,
+                       priv->progress_elements,
+                       priv->progress_data);
+}
+
+/* counts the element just parsed, and reports the progress of the
+ * parser once the interval has passed
+ */
+static void
+xml_reader_progress_element (XmlReader        *reader,
+                             xmlParserCtxtPtr  ctxt)
+{
+  XmlReaderPrivate *priv = reader->priv;
+  gint64 now;
+
+  priv->progress_elements += 1;
+
+  if (priv->progress_elements % PROGRESS_CHECK_ELEMENTS != 0)
+    return;
+
+  now = g_get_monotonic_time ();
+  if (now < priv->progress_next)
+    return;
+
+  priv->progress_next = now + priv->progress_interval;
+
+  xml_reader_report_progress (reader, xmlByteConsumed (ctxt));
+}
+
+/* reports the progress of @ctxt once it is done parsing */
+static void
+xml_reader_progress_done (XmlReader        *reader,
+                          xmlParserCtxtPtr  ctxt)
+{
+  glong consumed = xmlByteConsumed (ctxt);
+
+  /* the inputs are gone once a document has been read whole */
+  xml_reader_report_progress (reader,
+                              consumed >= 0 ? consumed : reader->priv->progress_total);
+}
+
+/* an estimate of the memory taken by @element, its attributes and its
+ * text, leaving out its child elements
+ */
+static gsize
+xml_reader_element_memory (xmlNodePtr element)
+{
+  xmlAttrPtr attr;
+  xmlNsPtr ns;
+  xmlNodePtr child;
+  gsize size = sizeof (xmlNode);
+
+  for (attr = element->properties; attr != NULL; attr = attr->next)
+    {
+      size += sizeof (xmlAttr);
+
+      for (child = attr->children; child != NULL; child = child->next)
+        size += sizeof (xmlNode) + xmlStrlen (child->content);
+    }
+
+  for (ns = element->nsDef; ns != NULL; ns = ns->next)
+    size += sizeof (xmlNs);
+
+  for (child = element->children; child != NULL; child = child->next)
+    if (child->type != XML_ELEMENT_NODE)
+      size += sizeof (xmlNode) + xmlStrlen (child->content);
+
+  return size;
+}
+
+/* the estimate of the memory taken by the elements of the subtree of
+ * @root, as they were accounted for while parsing them
+ */
+static gsize
+xml_reader_subtree_memory (xmlNodePtr root)
+{
+  xmlNodePtr node = root;
+  gsize size = 0;
+
+  while (node != NULL)
+    {
+      if (node->type == XML_ELEMENT_NODE)
+        {
+          size += xml_reader_element_memory (node);
+
+          if (node->children != NULL)
+            {
+              node = node->children;
+              continue;
+            }
+        }
+
+      while (node != root && node->next == NULL)
+        node = node->parent;
+
+      node = node != root ? node->next : NULL;
+    }
+
+  return size;
+}
+
+/* accounts for @element, just parsed whole in bounded memory mode, and
+ * stops the parser once the document takes more memory than allowed
+ */
+static void
+xml_reader_window_account (XmlReader        *reader,
+                           xmlParserCtxtPtr  ctxt,
+                           xmlNodePtr        element)
+{
+  XmlReaderPrivate *priv = reader->priv;
+
+  priv->stats.tree_memory += xml_reader_element_memory (element);
+  priv->stats.tree_memory_peak = MAX (priv->stats.tree_memory_peak,
+                                      priv->stats.tree_memory);
+
+  if (priv->memory_limit > 0 && priv->stats.tree_memory > priv->memory_limit)
+    {
+      priv->memory_exceeded = TRUE;
+      xmlStopParser (ctxt);
+    }
+}
+
+/* points @data to the next chunk of the document in bounded memory
+ * mode, of @size bytes, and returns %FALSE at the end of the document
+ */
+static gboolean
+xml_reader_window_read (XmlReader    *reader,
+                        const gchar **data,
+                        gsize        *size)
+{
+  XmlReaderPrivate *priv = reader->priv;
+
+  while (priv->window_offset == priv->window_length)
+    {
+      if (priv->window_piece)
+        {
+          g_bytes_unref (priv->window_piece);
+          priv->window_piece = NULL;
+        }
+
+      priv->window_offset = 0;
+      priv->window_length = 0;
+
+      if (!g_queue_is_empty (&priv->window_sources))
+        {
+          priv->window_piece = g_queue_pop_head (&priv->window_sources);
+          priv->window_data = g_bytes_get_data (priv->window_piece,
+                                                &priv->window_length);
+        }
+      else if (priv->window_decompressor)
+        {
+          priv->window_data = _xml_reader_decompressor_read (priv->window_decompressor,
+                                                             &priv->window_length);
+          if (priv->window_data == NULL)
+            return FALSE;
+        }
+      else
+        return FALSE;
+    }
+
+  *data = priv->window_data + priv->window_offset;
+  *size = MIN (priv->window_length - priv->window_offset, WINDOW_CHUNK_SIZE);
+
+  priv->window_offset += *size;
+
+  return TRUE;
+}
+
+/* parses the next chunk of the document in bounded memory mode, and
+ * returns %FALSE once the document has been parsed whole, or once it
+ * took more memory than allowed or failed to decompress, which puts
+ * @reader in error state
+ */
+static gboolean
+xml_reader_window_feed (XmlReader *reader)
+{
+  XmlReaderPrivate *priv = reader->priv;
+  xmlParserCtxtPtr ctxt = priv->window_ctxt;
+  gboolean finished = FALSE;
+  const gchar *data;
+  gsize chunk;
+
+  if (ctxt == NULL)
+    return FALSE;
+
+  if (!priv->memory_exceeded && !priv->limit_exceeded)
+    {
+      if (xml_reader_window_read (reader, &data, &chunk))
+        xmlParseChunk (ctxt, data, chunk, FALSE);
+      else
+        {
+          xmlParseChunk (ctxt, NULL, 0, TRUE);
+          finished = TRUE;
+        }
+
+      priv->current_doc = ctxt->myDoc;
+    }
+
+  /* the stopped parser is kept, so that the cursor cannot move past
+   * what was parsed before the limit was hit
+   */
+  if (priv->memory_exceeded || priv->limit_exceeded)
+    {
+      priv->error_state = TRUE;
+      priv->last_error = priv->memory_exceeded
+                       ? XML_READER_ERROR_MEMORY_LIMIT
+                       : priv->limit_error;
+
+      return FALSE;
+    }
+
+  if (finished || xml_reader_parser_stopped (ctxt))
+    {
+      if (priv->progress_func)
+        xml_reader_progress_done (reader, ctxt);
+
+      ctxt->myDoc = NULL;
+      xmlFreeParserCtxt (ctxt);
+      priv->window_ctxt = NULL;
+
+      xml_reader_window_close_sources (reader);
+    }
+
+  if (priv->window_error)
+    {
+      priv->error_state = TRUE;
+      priv->last_error = XML_READER_ERROR_INVALID;
+
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+/* whether @node is still being parsed, in bounded memory mode */
+static inline gboolean
+xml_reader_window_is_open (XmlReader  *reader,
+                           xmlNodePtr  node)
+{
+  xmlParserCtxtPtr ctxt = reader->priv->window_ctxt;
+  gint i;
+
+  if (G_LIKELY (ctxt == NULL))
+    return FALSE;
+
+  for (i = ctxt->nodeNr - 1; i >= 0; i--)
+    if (ctxt->nodeTab[i] == node)
+      return TRUE;
+
+  return FALSE;
+}
+
+/* parses the document until @node is complete, and returns %FALSE if
+ * the memory limit was hit before
+ */
+static gboolean
+xml_reader_window_complete (XmlReader  *reader,
+                            xmlNodePtr  node)
+{
+  while (xml_reader_window_is_open (reader, node))
+    if (!xml_reader_window_feed (reader))
+      return FALSE;
+
+  return TRUE;
+}
+
+/* for the modules reading the tree on their own */
+gboolean
+_xml_reader_window_complete (XmlReader  *reader,
+                             xmlNodePtr  node)
+{
+  return xml_reader_window_complete (reader, node);
+}
+
+/* returns the first element child of @parent following @prev, or the
+ * first one if @prev is %NULL, parsing more of the document if needed
+ * in bounded memory mode
+ */
+static xmlNodePtr
+xml_reader_next_element (XmlReader  *reader,
+                         xmlNodePtr  parent,
+                         xmlNodePtr  prev)
+{
+  xmlNodePtr node;
+
+  while (TRUE)
+    {
+      for (node = prev != NULL ? prev->next : parent->xmlChildrenNode;
+           node != NULL;
+           node = node->next)
+        {
+          if (node->type == XML_ELEMENT_NODE)
+            return node;
+
+          prev = node;
+        }
+
+      if (!xml_reader_window_is_open (reader, parent) ||
+          !xml_reader_window_feed (reader))
+        return NULL;
+    }
+}
+
+/* frees the subtree of @node, which the cursor just left at @depth, if
+ * that is the depth where subtrees are released in bounded memory mode,
+ * together with the text before it, which is behind the cursor too
+ */
+static void
+xml_reader_window_release (XmlReader  *reader,
+                           xmlNodePtr  node,
+                           gint        depth)
+{
+  XmlReaderPrivate *priv = reader->priv;
+  xmlParserCtxtPtr ctxt;
+  xmlNodePtr prev;
+  gsize size;
+
+  if (!priv->windowed || depth != priv->release_depth)
+    return;
+
+  /* the parser holds on to the elements it did not finish */
+  if (!xml_reader_window_complete (reader, node))
+    return;
+
+  /* the parser appends text to the last child of the element it is in
+   * using the lengths it kept for it, which are wrong for the text node
+   * that becomes the last child; with no lengths it appends by copy
+   */
+  ctxt = priv->window_ctxt;
+  if (ctxt != NULL && node->parent == ctxt->node)
+    ctxt->nodemem = 0;
+
+  size = xml_reader_subtree_memory (node);
+
+  priv->stats.tree_memory -= MIN (size, priv->stats.tree_memory);
+  priv->stats.n_released += 1;
+
+  /* the text inside an element still being parsed is not accounted
+   * for yet
+   */
+  while ((prev = node->prev) != NULL && prev->type != XML_ELEMENT_NODE)
+    {
+      if (!xml_reader_window_is_open (reader, node->parent))
+        priv->stats.tree_memory -= MIN (sizeof (xmlNode) + xmlStrlen (prev->content),
+                                        priv->stats.tree_memory);
+
+      xmlUnlinkNode (prev);
+      xmlFreeNode (prev);
+    }
+
+  g_hash_table_remove (priv->window_ends, node);
+
+  xmlUnlinkNode (node);
+  xmlFreeNode (node);
+}
+
+/* for the modules walking the tree of a windowed document on their own */
+xmlNodePtr
+_xml_reader_next_element (XmlReader  *reader,
+                          xmlNodePtr  parent,
+                          xmlNodePtr  prev)
+{
+  return xml_reader_next_element (reader, parent, prev);
+}
+
+void
+_xml_reader_window_release (XmlReader  *reader,
+                            xmlNodePtr  node,
+                            gint        depth)
+{
+  xml_reader_window_release (reader, node, depth);
+}
+
+/* returns the @n-th element child of the cursor named @element_name,
+ * or of any name if @element_name is %NULL; the root element level
+ * holds a single element, so it is simply scanned, and so are the
+ * children in bounded memory mode, which are gone once left
+ */
+static xmlNodePtr
+xml_reader_find_nth_element (XmlReader   *reader,
+                             const gchar *element_name,
+                             guint        n,
+                             guint       *n_elements)
+{
+  XmlReaderPrivate *priv = reader->priv;
+  XmlReaderNodeInfo *info;
+  GArray *positions;
+  xmlNodePtr node, retval = NULL;
+  guint count;
+
+  if (!priv->node_cursor || priv->windowed)
+    {
+      if (!priv->node_cursor)
+        node = priv->current_doc->xmlRootNode;
+      else
+        {
+          /* counting needs every child */
+          if (!xml_reader_window_complete (reader, priv->node_cursor))
+            {
+              *n_elements = 0;
+              return NULL;
+            }
+
+          node = priv->node_cursor->xmlChildrenNode;
+        }
+
+      count = 0;
+      for (; node != NULL; node = node->next)
+        {
+          if (node->type != XML_ELEMENT_NODE)
+            continue;
+
+          if (element_name &&
+              strcmp (XML_TO_CHAR (node->name), element_name) != 0)
+            continue;
+
+          if (count == n)
+            retval = node;
+
+          count += 1;
+        }
+
+      *n_elements = count;
+
+      return retval;
+    }
+
+  info = xml_reader_get_node_info (reader, priv->node_cursor);
+
+  if (!element_name)
+    {
+      if (!info->has_children)
+        xml_reader_build_children (reader, priv->node_cursor);
+
+      *n_elements = info->n_children;
+
+      return n < info->n_children ? info->children[n] : NULL;
+    }
+
+  positions = g_hash_table_lookup (xml_reader_get_positions_by_name (reader,
+                                                                     priv->node_cursor),
+                                   element_name);
+  if (!positions)
+    {
+      *n_elements = 0;
+      return NULL;
+    }
+
+  *n_elements = positions->len;
+
+  if (n >= positions->len)
+    return NULL;
+
+  return info->children[g_array_index (positions, guint, n)];
+}
+
+/* returns the position of the first of @hashes starting at @start
+ * that is equal to @hash, or -1; the hashes are compared eight at a
+ * time into a match mask, a form compilers turn into vector compares
+ */
+static inline gint
+xml_reader_scan_hashes (const guint32 *hashes,
+                        guint          n_hashes,
+                        guint          start,
+                        guint32        hash)
+{
+  guint i = start;
+
+  for (; i + 8 <= n_hashes; i += 8)
+    {
+      gulong mask = 0;
+      guint j;
+
+      for (j = 0; j < 8; j++)
+        mask |= (gulong) (hashes[i + j] == hash) << j;
+
+      if (mask != 0)
+        return i + g_bit_nth_lsf (mask, -1);
+    }
+
+  for (; i < n_hashes; i++)
+    if (hashes[i] == hash)
+      return i;
+
+  return -1;
+}
+
+/* adaptive indexing: builds the indexes that the lookup costs observed
+ * below @parent call for, as long as they fit in the memory budget
+ */
+static void
+xml_reader_adapt_indexes (XmlReader         *reader,
+                          xmlNodePtr         parent,
+                          XmlReaderNodeInfo *info)
+{
+  XmlReaderPrivate *priv = reader->priv;
+
+  if (!info->has_children &&
+      !info->children_declined &&
+      info->n_lookups >= CHILD_INDEX_MIN_LOOKUPS &&
+      info->n_scanned >= ADAPTIVE_MIN_SCANNED)
+    {
+      guint n_children = xml_reader_count_children (parent);
+
+      if (xml_reader_index_fits (reader, xml_reader_children_size (n_children)))
+        {
+          xml_reader_build_children (reader, parent);
+          xml_reader_report_index (reader, parent,
+                                   "packed %u children, %u lookups "
+                                   "compared %u siblings",
+                                   n_children,
+                                   info->n_lookups,
+                                   info->n_scanned);
+        }
+      else
+        {
+          info->children_declined = TRUE;
+          priv->stats.n_declined += 1;
+          xml_reader_report_index (reader, parent,
+                                   "did not pack %u children, over the "
+                                   "memory budget",
+                                   n_children);
+        }
+    }
+
+  if (info->has_children &&
+      info->positions_by_name == NULL &&
+      !info->positions_declined &&
+      info->n_children >= ADAPTIVE_NAME_MAP_MIN_CHILDREN &&
+      info->n_lookups >= ADAPTIVE_NAME_MAP_MIN_LOOKUPS)
+    {
+      /* at most one name per child */
+      gsize size = info->n_children * (sizeof (guint) + NAME_MAP_ENTRY_SIZE);
+
+      if (xml_reader_index_fits (reader, size))
+        {
+          xml_reader_get_positions_by_name (reader, parent);
+          xml_reader_report_index (reader, parent,
+                                   "indexed %u children by name, %u lookups "
+                                   "compared %u siblings",
+                                   info->n_children,
+                                   info->n_lookups,
+                                   info->n_scanned);
+        }
+      else
+        {
+          info->positions_declined = TRUE;
+          priv->stats.n_declined += 1;
+          xml_reader_report_index (reader, parent,
+                                   "did not index %u children by name, "
+                                   "over the memory budget",
+                                   info->n_children);
+        }
+    }
+}
+
+/* adaptive indexing: builds the descendant names filter of @parent
+ * once misses below it keep happening
+ */
+static void
+xml_reader_adapt_filter (XmlReader         *reader,
+                         xmlNodePtr         parent,
+                         XmlReaderNodeInfo *info)
+{
+  XmlReaderPrivate *priv = reader->priv;
+  gsize limit = 0;
+
+  if (info->has_bloom ||
+      info->bloom_declined ||
+      info->n_misses < ADAPTIVE_MIN_MISSES)
+    return;
+
+  if (priv->memory_budget != 0 && xml_reader_index_fits (reader, 1))
+    limit = priv->memory_budget - priv->stats.index_memory;
+
+  if ((priv->memory_budget == 0 || limit != 0) &&
+      xml_reader_build_bloom (reader, parent, limit))
+    xml_reader_report_index (reader, parent,
+                             "built the descendant names filter after "
+                             "%u misses",
+                             info->n_misses);
+  else
+    {
+      info->bloom_declined = TRUE;
+      priv->stats.n_declined += 1;
+      xml_reader_report_index (reader, parent,
+                               "did not build the descendant names "
+                               "filter, over the memory budget");
+    }
+}
+
+/* returns the first element named @element_name below the cursor, or
+ * %NULL; misses below an element are answered by its descendant names
+ * filter once a first miss has built it, and repeated lookups below the
+ * same element scan its packed child name hashes
+ *
+ * with adaptive indexing the indexes are instead built once the lookup
+ * costs observed below the element justify them
+ */
+static xmlNodePtr
+xml_reader_find_element (XmlReader   *reader,
+                         const gchar *element_name)
+{
+  XmlReaderPrivate *priv = reader->priv;
+  XmlReaderNodeInfo *info;
+  xmlNodePtr node;
+  guint32 hash;
+  guint64 name_bits;
+  guint n_scanned;
+  gint pos;
+
+  if (!priv->node_cursor)
+    {
+      for (node = priv->current_doc->xmlRootNode;
+           node != NULL;
+           node = node->next)
+        {
+          if (node->type == XML_ELEMENT_NODE &&
+              node->name != NULL &&
+              strcmp (XML_TO_CHAR (node->name), element_name) == 0)
+            return node;
+        }
+
+      return NULL;
+    }
+
+  /* the children are scanned as they get parsed, without indexes,
+   * which would point to the subtrees released later
+   */
+  if (priv->windowed)
+    {
+      node = NULL;
+      while ((node = xml_reader_next_element (reader, priv->node_cursor, node)) != NULL)
+        if (strcmp (XML_TO_CHAR (node->name), element_name) == 0)
+          return node;
+
+      return NULL;
+    }
+
+  hash = g_str_hash (element_name);
+  name_bits = xml_reader_name_bits (hash);
+
+  priv->stats.n_lookups += 1;
+
+  info = xml_reader_get_node_info (reader, priv->node_cursor);
+  if (info->has_bloom && (info->names_bloom & name_bits) != name_bits)
+    {
+      priv->stats.n_misses += 1;
+      priv->stats.n_filter_rejections += 1;
+      return NULL;
+    }
+
+  info->n_lookups += 1;
+
+  if (priv->adaptive_indexing)
+    xml_reader_adapt_indexes (reader, priv->node_cursor, info);
+  else if (!info->has_children && info->n_lookups >= CHILD_INDEX_MIN_LOOKUPS)
+    xml_reader_build_children (reader, priv->node_cursor);
+
+  n_scanned = 0;
+  node = NULL;
+
+  if (info->positions_by_name)
+    {
+      GArray *positions;
+
+      positions = g_hash_table_lookup (info->positions_by_name, element_name);
+      if (positions)
+        node = info->children[g_array_index (positions, guint, 0)];
+
+      n_scanned = 1;
+    }
+  else if (info->has_children)
+    {
+      pos = xml_reader_scan_hashes (info->child_hashes, info->n_children, 0, hash);
+      while (pos >= 0)
+        {
+          if (strcmp (XML_TO_CHAR (info->children[pos]->name), element_name) == 0)
+            {
+              node = info->children[pos];
+              break;
+            }
+
+          pos = xml_reader_scan_hashes (info->child_hashes, info->n_children,
+                                        pos + 1,
+                                        hash);
+        }
+
+      n_scanned = pos >= 0 ? pos + 1 : info->n_children;
+    }
+  else
+    {
+      for (node = priv->node_cursor->xmlChildrenNode;
+           node != NULL;
+           node = node->next)
+        {
+          if (node->type != XML_ELEMENT_NODE)
+            continue;
+
+          n_scanned += 1;
+
+          if (node->name != NULL &&
+              strcmp (XML_TO_CHAR (node->name), element_name) == 0)
+            break;
+        }
+    }
+
+  info->n_scanned += n_scanned;
+  priv->stats.n_siblings_scanned += n_scanned;
+
+  if (node)
+    return node;
+
+  info->n_misses += 1;
+  priv->stats.n_misses += 1;
+
+  if (priv->adaptive_indexing)
+    xml_reader_adapt_filter (reader, priv->node_cursor, info);
+  else
+    xml_reader_build_bloom (reader, priv->node_cursor, 0);
+
+  return NULL;
+}
+
+/* puts the cursor on @node, found at @depth */
+static inline void
+xml_reader_set_cursor (XmlReader  *reader,
+                       xmlNodePtr  node,
+                       gint        depth)
+{
+  XmlReaderPrivate *priv = reader->priv;
+
+  priv->node_cursor = node;
+  priv->parent = node->parent;
+  if (priv->parent && priv->parent->type != XML_ELEMENT_NODE)
+    priv->parent = NULL;
+
+  priv->depth = depth;
+
+  /* unset the attributes cache */
+  priv->attr_cursor = node->properties;
+  if (priv->attr_value)
+    {
+      xmlFree (priv->attr_value);
+      priv->attr_value = NULL;
+    }
+}
+
+/* puts the reader in error state after a failed cursor movement */
+static void
+xml_reader_set_unknown_node (XmlReader *reader)
+{
+  XmlReaderPrivate *priv = reader->priv;
+
+  /* the movement may have failed on the memory limit */
+  if (!priv->error_state)
+    priv->last_error = XML_READER_ERROR_UNKNOWN_NODE;
+
+  priv->error_state = TRUE;
+  priv->parent = priv->node_cursor;
+  if (!priv->parent)
+    priv->parent = priv->current_doc->xmlRootNode;
+  priv->node_cursor = NULL;
+  priv->attr_cursor = NULL;
+}
+
+/* moves the cursor on @node, one level deeper */
+static void
+xml_reader_enter_element (XmlReader  *reader,
+                          xmlNodePtr  node)
+{
+  XmlReaderPrivate *priv = reader->priv;
+
+  xml_reader_set_cursor (reader, node, priv->depth + 1);
+}
+
+/* scans @source into a succinct tree, which keeps a reference on it */
+static gboolean
+xml_reader_load_succinct (XmlReader  *reader,
+                          GBytes     *source,
+                          gboolean    source_mapped,
+                          GError    **error)
+{
+  XmlReaderPrivate *priv = reader->priv;
+  GError *internal_error = NULL;
+  gsize length;
+  const gchar *buffer = g_bytes_get_data (source, &length);
+
+  priv->succinct = _xml_reader_succinct_new (buffer, length,
+                                             source_mapped,
+                                             priv->out_of_core
+                                               ? priv->out_of_core_directory
+                                               : NULL,
+                                             priv->has_limits
+                                               ? &priv->limits
+                                               : NULL,
+                                             &internal_error);
+  /* the limits exceeded by the document keep their error code */
+  if (!priv->succinct)
+    {
+      if (!priv->is_filename)
+        g_set_error (error, XML_READER_ERROR,
+                     internal_error->code,
+                     "Unable to parse XML buffer: %s",
+                     internal_error->message);
+      else
+        g_set_error (error, XML_READER_ERROR,
+                     internal_error->code,
+                     "Unable to parse file `%s': %s",
+                     priv->filename,
+                     internal_error->message);
+
+      g_error_free (internal_error);
+
+      return FALSE;
+    }
+
+  priv->source = g_bytes_ref (source);
+
+  if (priv->access_pattern != XML_READER_ACCESS_NORMAL)
+    _xml_reader_succinct_set_access_pattern (priv->succinct,
+                                             priv->access_pattern);
+
+  return TRUE;
+}
+
+/* replaces the text of @node with a copy interned in @dict, which
+ * xmlFreeNode() knows not to free
+ */
+static void
+xml_reader_dedup_text (XmlReader  *reader,
+                       xmlDictPtr  dict,
+                       xmlNodePtr  node)
+{
+  XmlReaderPrivate *priv = reader->priv;
+  const xmlChar *shared;
+  xmlChar *content = node->content;
+  gint len, dict_size;
+
+  /* the parser already interns some short strings, and stores others
+   * inside the node itself
+   */
+  if (content == NULL ||
+      content == (xmlChar *) &node->properties ||
+      xmlDictOwns (dict, content))
+    return;
+
+  len = xmlStrlen (content);
+  if ((gsize) len > priv->dedup_max_length)
+    return;
+
+  dict_size = xmlDictSize (dict);
+
+  shared = xmlDictLookup (dict, content, len);
+  if (!shared)
+    return;
+
+  priv->stats.n_dedup_values += 1;
+
+  if (xmlDictSize (dict) == dict_size)
+    priv->stats.dedup_bytes_saved += len + 1;
+  else
+    priv->stats.n_dedup_unique += 1;
+
+  xmlFree (content);
+  node->content = (xmlChar *) shared;
+}
+
+/* deduplicates the text children and the attribute values of @node */
+static void
+xml_reader_dedup_element (XmlReader  *reader,
+                          xmlDictPtr  dict,
+                          xmlNodePtr  node)
+{
+  xmlNodePtr child;
+  xmlAttrPtr attr;
+
+  for (child = node->xmlChildrenNode; child != NULL; child = child->next)
+    if (child->type == XML_TEXT_NODE)
+      xml_reader_dedup_text (reader, dict, child);
+
+  for (attr = node->properties; attr != NULL; attr = attr->next)
+    for (child = attr->children; child != NULL; child = child->next)
+      if (child->type == XML_TEXT_NODE)
+        xml_reader_dedup_text (reader, dict, child);
+}
+
+/* the offset of the parser inside the kept source; entities and
+ * sources converted to UTF-8 are parsed from other buffers
+ */
+static gboolean
+xml_reader_source_offset (xmlParserCtxtPtr  ctxt,
+                          gsize             source_len,
+                          gsize            *offset)
+{
+  xmlParserInputPtr input = ctxt->input;
+
+  if (ctxt->inputNr != 1 || input->buf == NULL || input->buf->encoder != NULL)
+    return FALSE;
+
+  *offset = input->consumed + (input->cur - input->base);
+
+  return *offset <= source_len;
+}
+
+/* the start tag of an element has been parsed up to its closing '>'
+ * or "/>" when the element gets created
+ */
+static void
+xml_reader_record_start (XmlReader        *reader,
+                         xmlParserCtxtPtr  ctxt,
+                         xmlNodePtr        node)
+{
+  XmlReaderNodeInfo *info;
+  const gchar *source;
+  gsize source_len, offset, tag_end, start;
+
+  source = g_bytes_get_data (reader->priv->source, &source_len);
+
+  if (!xml_reader_source_offset (ctxt, source_len, &offset) ||
+      offset >= source_len)
+    return;
+
+  if (source[offset] == '>')
+    tag_end = offset + 1;
+  else if (source[offset] == '/' && offset + 1 < source_len && source[offset + 1] == '>')
+    tag_end = offset + 2;
+  else
+    return;
+
+  /* attribute values cannot hold a '<' */
+  for (start = offset; start > 0 && source[start] != '<'; start--)
+    ;
+
+  if (source[start] != '<')
+    return;
+
+  info = xml_reader_get_node_info (reader, node);
+  info->outer_start = start;
+  info->start_tag_len = tag_end - start;
+}
+
+/* the end tag, if any, has been parsed when the element ends */
+static void
+xml_reader_record_end (XmlReader        *reader,
+                       xmlParserCtxtPtr  ctxt,
+                       xmlNodePtr        node)
+{
+  XmlReaderNodeInfo *info = node->_private;
+  const gchar *source;
+  gsize source_len, offset, tag_start;
+
+  if (info == NULL || info->start_tag_len == 0)
+    return;
+
+  source = g_bytes_get_data (reader->priv->source, &source_len);
+
+  if (!xml_reader_source_offset (ctxt, source_len, &offset) ||
+      offset == 0 || source[offset - 1] != '>')
+    return;
+
+  if (offset == info->outer_start + info->start_tag_len)
+    tag_start = offset;
+  else
+    {
+      for (tag_start = offset - 1; tag_start > 0 && source[tag_start] != '<'; tag_start--)
+        ;
+
+      if (source[tag_start] != '<' || source[tag_start + 1] != '/' ||
+          tag_start < info->outer_start + info->start_tag_len)
+        return;
+    }
+
+  info->outer_end = offset;
+  info->end_tag_len = offset - tag_start;
+  info->has_offsets = TRUE;
+}
+
+/* the elements the checkpoints can be taken after in bounded memory
+ * mode are those which are not released with their parent; the end
+ * of their end tag is kept until they are released
+ */
+static void
+xml_reader_window_record_end (XmlReader        *reader,
+                              xmlParserCtxtPtr  ctxt,
+                              xmlNodePtr        node)
+{
+  gsize offset;
+
+  if (xml_reader_source_offset (ctxt, G_MAXSIZE, &offset) && offset > 0)
+    g_hash_table_insert (reader->priv->window_ends, node, GSIZE_TO_POINTER (offset));
+}
+
+/* stops @ctxt, the document of @reader exceeding one of its limits */
+static void
+xml_reader_limit_exceeded (XmlReader        *reader,
+                           xmlParserCtxtPtr  ctxt,
+                           XmlReaderError    code)
+{
+  XmlReaderPrivate *priv = reader->priv;
+
+  priv->limit_exceeded = TRUE;
+  priv->limit_error = code;
+
+  xmlStopParser (ctxt);
+}
+
+/* counts one more node of the document, and returns %FALSE once there
+ * are too many of them
+ */
+static inline gboolean
+xml_reader_limit_node (XmlReader        *reader,
+                       xmlParserCtxtPtr  ctxt)
+{
+  XmlReaderPrivate *priv = reader->priv;
+
+  priv->limit_nodes += 1;
+
+  if (priv->limits.max_nodes > 0 && priv->limit_nodes > priv->limits.max_nodes)
+    {
+      xml_reader_limit_exceeded (reader, ctxt, XML_READER_ERROR_NODE_LIMIT);
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+/* checks the element about to be created by @ctxt against the limits
+ * of @reader; the parser of the text of an entity is a different one,
+ * and gets stopped too once a limit has been exceeded
+ */
+static gboolean
+xml_reader_limit_start_element (XmlReader         *reader,
+                                xmlParserCtxtPtr   ctxt,
+                                gint               nb_attributes,
+                                const xmlChar    **attributes)
+{
+  XmlReaderPrivate *priv = reader->priv;
+  gint i;
+
+  if (priv->limit_exceeded)
+    {
+      xmlStopParser (ctxt);
+      return FALSE;
+    }
+
+  if (priv->limits.max_depth > 0 && ctxt->nodeNr >= priv->limits.max_depth)
+    {
+      xml_reader_limit_exceeded (reader, ctxt, XML_READER_ERROR_DEPTH_LIMIT);
+      return FALSE;
+    }
+
+  if (priv->limits.max_attributes > 0 && nb_attributes > priv->limits.max_attributes)
+    {
+      xml_reader_limit_exceeded (reader, ctxt, XML_READER_ERROR_ATTRIBUTE_LIMIT);
+      return FALSE;
+    }
+
+  /* each attribute is its name, prefix, namespace, value and value end */
+  if (priv->limits.max_text_length > 0)
+    for (i = 0; i < nb_attributes; i++)
+      if (attributes[i * 5 + 4] - attributes[i * 5 + 3] > priv->limits.max_text_length)
+        {
+          xml_reader_limit_exceeded (reader, ctxt, XML_READER_ERROR_TEXT_LIMIT);
+          return FALSE;
+        }
+
+  return xml_reader_limit_node (reader, ctxt);
+}
+
+/* checks @len more bytes of text of @type against the limits of
+ * @reader; the text is appended to the last one parsed, if it is
+ * still the last child of the current element, or starts a new node
+ */
+static gboolean
+xml_reader_limit_text (XmlReader        *reader,
+                       xmlParserCtxtPtr  ctxt,
+                       xmlElementType    type,
+                       gsize             len)
+{
+  XmlReaderPrivate *priv = reader->priv;
+  xmlNodePtr last = ctxt->node != NULL ? ctxt->node->last : NULL;
+
+  if (priv->limit_exceeded)
+    {
+      xmlStopParser (ctxt);
+      return FALSE;
+    }
+
+  if (last != NULL && last == priv->limit_text && last->type == type)
+    priv->limit_text_length += len;
+  else
+    {
+      priv->limit_text_length = len;
+
+      if (!xml_reader_limit_node (reader, ctxt))
+        return FALSE;
+    }
+
+  if (priv->limits.max_text_length > 0 &&
+      priv->limit_text_length > priv->limits.max_text_length)
+    {
+      xml_reader_limit_exceeded (reader, ctxt, XML_READER_ERROR_TEXT_LIMIT);
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+/* the length of the text @entity expands to, counted up to @budget
+ * bytes; the references nested deeper than libxml2 allows, which can
+ * only be loops, count as exceeding @budget
+ */
+static gsize
+xml_reader_entity_size (xmlEntityPtr entity,
+                        gsize        budget,
+                        guint        level)
+{
+  const xmlChar *p;
+  gsize size = 0;
+
+  if (entity == NULL)
+    return 0;
+
+  if (entity->etype == XML_INTERNAL_PREDEFINED_ENTITY)
+    return 1;
+
+  if (entity->etype != XML_INTERNAL_GENERAL_ENTITY || entity->content == NULL)
+    return 0;
+
+  if (level > 40)
+    return budget + 1;
+
+  for (p = entity->content; *p != '\0' && size <= budget; p++)
+    {
+      const xmlChar *semicolon;
+      xmlChar *name;
+
+      if (p[0] != '&' || p[1] == '#' ||
+          (semicolon = xmlStrchr (p, ';')) == NULL)
+        {
+          size += 1;
+          continue;
+        }
+
+      name = xmlStrndup (p + 1, semicolon - p - 1);
+      size += xml_reader_entity_size (xmlGetDocEntity (entity->doc, name),
+                                      budget - size,
+                                      level + 1);
+      xmlFree (name);
+
+      p = semicolon;
+    }
+
+  return size;
+}
+
+static void
+xml_reader_sax_characters (void          *ctx,
+                           const xmlChar *ch,
+                           int            len)
+{
+  xmlParserCtxtPtr ctxt = ctx;
+  XmlReader *reader = ctxt->_private;
+
+  if (!xml_reader_limit_text (reader, ctxt, XML_TEXT_NODE, len))
+    return;
+
+  xmlSAX2Characters (ctx, ch, len);
+
+  reader->priv->limit_text = ctxt->node != NULL ? ctxt->node->last : NULL;
+}
+
+static void
+xml_reader_sax_cdata_block (void          *ctx,
+                            const xmlChar *value,
+                            int            len)
+{
+  xmlParserCtxtPtr ctxt = ctx;
+  XmlReader *reader = ctxt->_private;
+
+  if (!xml_reader_limit_text (reader, ctxt, XML_CDATA_SECTION_NODE, len))
+    return;
+
+  xmlSAX2CDataBlock (ctx, value, len);
+
+  reader->priv->limit_text = ctxt->node != NULL ? ctxt->node->last : NULL;
+}
+
+static void
+xml_reader_sax_comment (void          *ctx,
+                        const xmlChar *value)
+{
+  xmlParserCtxtPtr ctxt = ctx;
+  XmlReader *reader = ctxt->_private;
+
+  /* a comment is never appended to */
+  reader->priv->limit_text = NULL;
+
+  if (!xml_reader_limit_text (reader, ctxt, XML_COMMENT_NODE, xmlStrlen (value)))
+    return;
+
+  xmlSAX2Comment (ctx, value);
+}
+
+static void
+xml_reader_sax_processing_instruction (void          *ctx,
+                                       const xmlChar *target,
+                                       const xmlChar *data)
+{
+  xmlParserCtxtPtr ctxt = ctx;
+  XmlReader *reader = ctxt->_private;
+
+  reader->priv->limit_text = NULL;
+
+  if (!xml_reader_limit_text (reader, ctxt, XML_PI_NODE, xmlStrlen (data)))
+    return;
+
+  xmlSAX2ProcessingInstruction (ctx, target, data);
+}
+
+/* the entity references are kept in the tree, and expanded when the
+ * text of their element is read; those in the text of an entity, which
+ * libxml2 parses in a nested context, are counted where the entity is
+ * referenced
+ */
+static void
+xml_reader_sax_reference (void          *ctx,
+                          const xmlChar *name)
+{
+  xmlParserCtxtPtr ctxt = ctx;
+  XmlReader *reader = ctxt->_private;
+  XmlReaderPrivate *priv = reader->priv;
+
+  priv->limit_text = NULL;
+
+  if (priv->limit_exceeded)
+    {
+      xmlStopParser (ctxt);
+      return;
+    }
+
+  if (!xml_reader_limit_node (reader, ctxt))
+    return;
+
+  if (priv->limits.max_entity_expansion > 0 && ctxt->depth == 0)
+    {
+      gsize budget = priv->limits.max_entity_expansion - priv->limit_expansion;
+
+      priv->limit_expansion +=
+        xml_reader_entity_size (xmlGetDocEntity (ctxt->myDoc, name), budget, 0);
+
+      if (priv->limit_expansion > priv->limits.max_entity_expansion)
+        {
+          xml_reader_limit_exceeded (reader, ctxt, XML_READER_ERROR_ENTITY_LIMIT);
+          return;
+        }
+    }
+
+  xmlSAX2Reference (ctx, name);
+}
+
+static void
+xml_reader_sax_start_element (void           *ctx,
+                              const xmlChar  *localname,
+                              const xmlChar  *prefix,
+                              const xmlChar  *URI,
+                              int             nb_namespaces,
+                              const xmlChar **namespaces,
+                              int             nb_attributes,
+                              int             nb_defaulted,
+                              const xmlChar **attributes)
+{
+  xmlParserCtxtPtr ctxt = ctx;
+  XmlReader *reader = ctxt->_private;
+  xmlNodePtr parent = ctxt->node;
+
+  if (reader->priv->has_limits &&
+      !xml_reader_limit_start_element (reader, ctxt, nb_attributes, attributes))
+    return;
+
+  xmlSAX2StartElementNs (ctx, localname, prefix, URI,
+                         nb_namespaces, namespaces,
+                         nb_attributes, nb_defaulted,
+                         attributes);
+
+  if (ctxt->node == NULL || ctxt->node == parent)
+    return;
+
+  if (reader->priv->source != NULL)
+    xml_reader_record_start (reader, ctxt, ctxt->node);
+
+  if (reader->priv->progress_func != NULL)
+    xml_reader_progress_element (reader, ctxt);
+}
+
+/* the text of an element is complete once the element ends, and text
+ * nodes coalesced later copy interned contents before appending to them
+ */
+static void
+xml_reader_sax_end_element (void          *ctx,
+                            const xmlChar *localname,
+                            const xmlChar *prefix,
+                            const xmlChar *URI)
+{
+  xmlParserCtxtPtr ctxt = ctx;
+  XmlReader *reader = ctxt->_private;
+  xmlNodePtr node = ctxt->node;
+
+  if (node != NULL && reader->priv->source != NULL)
+    xml_reader_record_end (reader, ctxt, node);
+
+  if (node != NULL && ctxt == reader->priv->window_ctxt &&
+      ctxt->nodeNr <= reader->priv->release_depth)
+    xml_reader_window_record_end (reader, ctxt, node);
+
+  xmlSAX2EndElementNs (ctx, localname, prefix, URI);
+
+  if (node != NULL && ctxt->dict != NULL && reader->priv->dedup)
+    xml_reader_dedup_element (reader, ctxt->dict, node);
+
+  if (node != NULL && ctxt == reader->priv->window_ctxt)
+    xml_reader_window_account (reader, ctxt, node);
+}
+
+/* installs the SAX handlers of the enabled features in place of the
+ * default ones
+ */
+static void
+xml_reader_setup_parser (XmlReader        *reader,
+                         xmlParserCtxtPtr  ctxt)
+{
+  XmlReaderPrivate *priv = reader->priv;
+
+  xmlCtxtUseOptions (ctxt, PARSE_OPTIONS);
+
+  ctxt->_private = reader;
+
+  /* the offsets of the elements are recorded when keeping the source,
+   * the elements counted when reporting the progress, and the nodes
+   * checked against the limits; the context may be reused, so the
+   * defaults are set back otherwise
+   */
+  if (priv->source || priv->progress_func || priv->has_limits)
+    ctxt->sax->startElementNs = xml_reader_sax_start_element;
+  else
+    ctxt->sax->startElementNs = xmlSAX2StartElementNs;
+
+  if (priv->dedup || priv->source || priv->release_depth > 0)
+    ctxt->sax->endElementNs = xml_reader_sax_end_element;
+  else
+    ctxt->sax->endElementNs = xmlSAX2EndElementNs;
+
+  if (priv->has_limits)
+    {
+      ctxt->sax->characters = xml_reader_sax_characters;
+      ctxt->sax->cdataBlock = xml_reader_sax_cdata_block;
+      ctxt->sax->comment = xml_reader_sax_comment;
+      ctxt->sax->processingInstruction = xml_reader_sax_processing_instruction;
+      ctxt->sax->reference = xml_reader_sax_reference;
+    }
+  else
+    {
+      ctxt->sax->characters = xmlSAX2Characters;
+      ctxt->sax->cdataBlock = xmlSAX2CDataBlock;
+      ctxt->sax->comment = xmlSAX2Comment;
+      ctxt->sax->processingInstruction = xmlSAX2ProcessingInstruction;
+      ctxt->sax->reference = xmlSAX2Reference;
+    }
+}
+
+/* takes the document out of @ctxt, and frees it */
+static xmlDocPtr
+xml_reader_finish_parse (XmlReader        *reader,
+                         xmlParserCtxtPtr  ctxt)
+{
+  XmlReaderPrivate *priv = reader->priv;
+  xmlDocPtr doc;
+
+  /* the offsets are only right if the tree matches the source */
+  priv->has_offsets = priv->source != NULL && ctxt->wellFormed;
+
+  if (priv->progress_func)
+    xml_reader_progress_done (reader, ctxt);
+
+  /* same as xmlReadMemory() in recovery mode */
+  doc = ctxt->myDoc;
+  ctxt->myDoc = NULL;
+
+  xmlFreeParserCtxt (ctxt);
+
+  return doc;
+}
+
+/* parses @length bytes of @buffer into a document */
+static xmlDocPtr
+xml_reader_parse (XmlReader   *reader,
+                  const gchar *buffer,
+                  gsize        length)
+{
+  XmlReaderPrivate *priv = reader->priv;
+  xmlParserCtxtPtr ctxt;
+
+  if (length > G_MAXINT)
+    return NULL;
+
+  /* the documents of a stream share a context, and its dictionary */
+  if (priv->stream_ctxt)
+    {
+      xmlDocPtr doc;
+
+      ctxt = priv->stream_ctxt;
+      xml_reader_setup_parser (reader, ctxt);
+
+      priv->progress_total = length;
+
+      doc = xmlCtxtReadMemory (ctxt, buffer, length, NULL, NULL, PARSE_OPTIONS);
+
+      priv->has_offsets = priv->source != NULL && ctxt->wellFormed;
+
+      if (priv->progress_func)
+        xml_reader_progress_done (reader, ctxt);
+
+      return doc;
+    }
+
+  ctxt = xmlCreateMemoryParserCtxt (buffer, length);
+  if (!ctxt)
+    return NULL;
+
+  priv->progress_total = length;
+
+  xml_reader_setup_parser (reader, ctxt);
+
+  xmlParseDocument (ctxt);
+
+  return xml_reader_finish_parse (reader, ctxt);
+}
+
+static xmlParserCtxtPtr
+xml_reader_new_push_parser (XmlReader *reader)
+{
+  xmlParserCtxtPtr ctxt;
+
+  ctxt = xmlCreatePushParserCtxt (NULL, NULL, NULL, 0, NULL);
+  if (ctxt)
+    xml_reader_setup_parser (reader, ctxt);
+
+  return ctxt;
+}
+
+/* feeds @size bytes of @buffer to @ctxt, and returns %FALSE once the
+ * parser gave up, or was stopped by a limit
+ */
+static gboolean
+xml_reader_push (xmlParserCtxtPtr  ctxt,
+                 const gchar      *buffer,
+                 gsize             size)
+{
+  XmlReader *reader = ctxt->_private;
+
+  while (size > 0)
+    {
+      gsize chunk = MIN (size, G_MAXINT);
+
+      if (xmlParseChunk (ctxt, buffer, chunk, FALSE) != XML_ERR_OK &&
+          (xml_reader_parser_stopped (ctxt) || reader->priv->limit_exceeded))
+        return FALSE;
+
+      buffer += chunk;
+      size -= chunk;
+    }
+
+  return TRUE;
+}
+
+/* parses the @n_vectors buffers of @vectors, one after the other, into
+ * a document, without joining them
+ */
+static xmlDocPtr
+xml_reader_parse_vectors (XmlReader             *reader,
+                          const XmlReaderVector *vectors,
+                          guint                  n_vectors)
+{
+  xmlParserCtxtPtr ctxt;
+  guint i;
+
+  ctxt = xml_reader_new_push_parser (reader);
+  if (!ctxt)
+    return NULL;
+
+  reader->priv->progress_total = 0;
+  for (i = 0; i < n_vectors; i++)
+    reader->priv->progress_total += vectors[i].size;
+
+  for (i = 0; i < n_vectors; i++)
+    if (!xml_reader_push (ctxt, vectors[i].buffer, vectors[i].size))
+      break;
+
+  if (i == n_vectors)
+    xmlParseChunk (ctxt, NULL, 0, TRUE);
+
+  return xml_reader_finish_parse (reader, ctxt);
+}
+
+/* discards the document loaded by @reader, and its cursor */
+static void
+xml_reader_reset (XmlReader *reader)
+{
+  XmlReaderPrivate *priv = reader->priv;
+
+  xml_reader_clear (reader);
+
+  priv->parent = NULL;
+  priv->node_cursor = NULL;
+  priv->attr_cursor = NULL;
+  priv->depth = 0;
+
+  priv->from_file = FALSE;
+  priv->checkpoint_head_len = 0;
+  priv->checkpoint_offset = 0;
+
+  priv->progress_elements = 0;
+  priv->progress_total = -1;
+
+  priv->limit_exceeded = FALSE;
+  priv->limit_nodes = 0;
+  priv->limit_expansion = 0;
+  priv->limit_text = NULL;
+
+  if (priv->progress_func)
+    priv->progress_next = g_get_monotonic_time () + priv->progress_interval;
+}
+
+/* sets @error to the limit exceeded by the document of @reader */
+static void
+xml_reader_set_limit_error (XmlReader  *reader,
+                            GError    **error)
+{
+  XmlReaderPrivate *priv = reader->priv;
+
+  switch (priv->limit_error)
+    {
+    case XML_READER_ERROR_DEPTH_LIMIT:
+      g_set_error (error, XML_READER_ERROR, priv->limit_error,
+                   "The elements of the document are nested deeper than %u levels",
+                   priv->limits.max_depth);
+      break;
+
+    case XML_READER_ERROR_NODE_LIMIT:
+      g_set_error (error, XML_READER_ERROR, priv->limit_error,
+                   "The document has more than %" G_GUINT64_FORMAT " nodes",
+                   priv->limits.max_nodes);
+      break;
+
+    case XML_READER_ERROR_ATTRIBUTE_LIMIT:
+      g_set_error (error, XML_READER_ERROR, priv->limit_error,
+                   "An element has more than %u attributes",
+                   priv->limits.max_attributes);
+      break;
+
+    case XML_READER_ERROR_TEXT_LIMIT:
+      g_set_error (error, XML_READER_ERROR, priv->limit_error,
+                   "The document has a text longer than %" G_GSIZE_FORMAT " bytes",
+                   priv->limits.max_text_length);
+      break;
+
+    case XML_READER_ERROR_ENTITY_LIMIT:
+      g_set_error (error, XML_READER_ERROR, priv->limit_error,
+                   "The entity references of the document expand to more "
+                   "than %" G_GSIZE_FORMAT " bytes",
+                   priv->limits.max_entity_expansion);
+      break;
+
+    default:
+      g_assert_not_reached ();
+    }
+}
+
+/* makes @doc the document of @reader, unless it exceeded a limit */
+static gboolean
+xml_reader_set_document (XmlReader  *reader,
+                         xmlDocPtr   doc,
+                         GError    **error)
+{
+  XmlReaderPrivate *priv = reader->priv;
+
+  if (priv->limit_exceeded)
+    {
+      if (doc)
+        xmlFreeDoc (doc);
+
+      xml_reader_set_limit_error (reader, error);
+
+      return FALSE;
+    }
+
+  priv->current_doc = doc;
+  if (!priv->current_doc)
+    {
+      gchar *error_message;
+
+      if (!priv->is_filename)
+        error_message = g_strdup ("Unable to parse XML buffer");
+      else
+        error_message = g_strdup_printf ("Unable to parse file `%s'",
+                                         priv->filename);
+
+      g_set_error_literal (error, XML_READER_ERROR,
+                           XML_READER_ERROR_INVALID,
+                           error_message);
+
+      g_free (error_message);
+
+      return FALSE;
+    }
+
+  priv->parent = priv->current_doc->xmlRootNode;
+
+  return TRUE;
+}
+
+/* the bounded memory mode builds a tree, which the succinct and the
+ * out-of-core modes do without
+ */
+static gboolean
+xml_reader_check_modes (XmlReader  *reader,
+                        GError    **error)
+{
+  XmlReaderPrivate *priv = reader->priv;
+
+  if (priv->release_depth > 0 && (priv->use_succinct || priv->out_of_core))
+    {
+      g_set_error_literal (error, XML_READER_ERROR,
+                           XML_READER_ERROR_INVALID,
+                           "The bounded memory mode cannot be combined with "
+                           "the succinct or the out-of-core mode");
+      return FALSE;
+    }
+
+  return TRUE;
+}
+
+/* starts parsing the document queued in the window sources of @reader,
+ * or read by its window decompressor, in bounded memory mode, up to the
+ * start of the root element
+ */
+static gboolean
+xml_reader_load_window (XmlReader  *reader,
+                        GError    **error)
+{
+  XmlReaderPrivate *priv = reader->priv;
+
+  LIBXML_TEST_VERSION;
+
+  priv->window_ctxt = xml_reader_new_push_parser (reader);
+  if (!priv->window_ctxt)
+    {
+      xml_reader_window_close_sources (reader);
+      return xml_reader_set_document (reader, NULL, error);
+    }
+
+  priv->windowed = TRUE;
+
+  while (priv->window_ctxt != NULL && priv->window_ctxt->nodeNr == 0)
+    if (!xml_reader_window_feed (reader))
+      break;
+
+  if (priv->window_error)
+    {
+      g_propagate_error (error, g_error_copy (priv->window_error));
+      return FALSE;
+    }
+
+  if (priv->memory_exceeded)
+    {
+      g_set_error (error, XML_READER_ERROR,
+                   XML_READER_ERROR_MEMORY_LIMIT,
+                   "The document takes more than %" G_GSIZE_FORMAT " bytes",
+                   priv->memory_limit);
+      return FALSE;
+    }
+
+  if (priv->limit_exceeded)
+    {
+      xml_reader_set_limit_error (reader, error);
+      return FALSE;
+    }
+
+  return xml_reader_set_document (reader, priv->current_doc, error);
+}
+
+/* parses @length bytes of @buffer, which needs no terminator; @source
+ * holds @buffer, if available, and is only needed by the succinct mode,
+ * the bounded memory mode and when keeping the source, which copy
+ * @buffer otherwise. A source that is not a file mapping is always
+ * kept, as it costs nothing
+ */
+static gboolean
+xml_reader_load_buffer (XmlReader    *reader,
+                        const gchar  *buffer,
+                        gsize         length,
+                        GBytes       *source,
+                        gboolean      source_mapped,
+                        GError      **error)
+{
+  XmlReaderPrivate *priv = reader->priv;
+
+  if (!xml_reader_check_modes (reader, error))
+    return FALSE;
+
+  xml_reader_reset (reader);
+
+  if (priv->use_succinct || priv->out_of_core)
+    {
+      gboolean retval;
+
+      if (source)
+        return xml_reader_load_succinct (reader, source, source_mapped, error);
+
+      if (!priv->out_of_core)
+        source = g_bytes_new (buffer, length);
+      else
+        {
+          source = _xml_reader_succinct_copy_source (buffer, length,
+                                                     priv->out_of_core_directory,
+                                                     error);
+          if (!source)
+            return FALSE;
+        }
+
+      retval = xml_reader_load_succinct (reader, source, priv->out_of_core, error);
+      g_bytes_unref (source);
+
+      return retval;
+    }
+
+  if (priv->release_depth > 0)
+    {
+      g_queue_push_tail (&priv->window_sources,
+                         source != NULL ? g_bytes_ref (source)
+                                        : g_bytes_new (buffer, length));
+      priv->progress_total = length;
+
+      return xml_reader_load_window (reader, error);
+    }
+
+  LIBXML_TEST_VERSION;
+
+  if (priv->keep_source || (source != NULL && !source_mapped))
+    {
+      priv->source = source != NULL ? g_bytes_ref (source) : g_bytes_new (buffer, length);
+      buffer = g_bytes_get_data (priv->source, NULL);
+    }
+
+  return xml_reader_set_document (reader,
+                                  xml_reader_parse (reader, buffer, length),
+                                  error);
+}
+
+/* loads the XML split across @vectors, see xml_reader_load_from_vectors() */
+static gboolean
+xml_reader_load_vectors (XmlReader              *reader,
+                         const XmlReaderVector  *vectors,
+                         guint                   n_vectors,
+                         GError                **error)
+{
+  XmlReaderPrivate *priv = reader->priv;
+
+  if (!xml_reader_check_modes (reader, error))
+    return FALSE;
+
+  /* each vector gets copied, as they are parsed after this returns */
+  if (priv->release_depth > 0)
+    {
+      guint i;
+
+      xml_reader_reset (reader);
+
+      priv->progress_total = 0;
+      for (i = 0; i < n_vectors; i++)
+        {
+          g_queue_push_tail (&priv->window_sources,
+                             g_bytes_new (vectors[i].buffer, vectors[i].size));
+          priv->progress_total += vectors[i].size;
+        }
+
+      return xml_reader_load_window (reader, error);
+    }
+
+  if (priv->use_succinct || priv->out_of_core || priv->keep_source)
+    {
+      GBytes *source;
+      gchar *buffer;
+      gsize length = 0;
+      gboolean retval;
+      guint i;
+
+      for (i = 0; i < n_vectors; i++)
+        length += vectors[i].size;
+
+      buffer = g_malloc (MAX (length, 1));
+
+      for (i = 0, length = 0; i < n_vectors; i++)
+        {
+          memcpy (buffer + length, vectors[i].buffer, vectors[i].size);
+          length += vectors[i].size;
+        }
+
+      source = g_bytes_new_take (buffer, length);
+
+      /* out of core, the source is moved to a file */
+      retval = xml_reader_load_buffer (reader, buffer, length,
+                                       priv->out_of_core ? NULL : source,
+                                       FALSE,
+                                       error);
+
+      g_bytes_unref (source);
+
+      return retval;
+    }
+
+  xml_reader_reset (reader);
+
+  LIBXML_TEST_VERSION;
+
+  return xml_reader_set_document (reader,
+                                  xml_reader_parse_vectors (reader, vectors, n_vectors),
+                                  error);
+}
+
+/* creates the parser context shared by the documents of a stream, or
+ * replaces it once its dictionary grew with the values it interned
+ */
+static void
+xml_reader_prepare_stream_context (XmlReader *reader)
+{
+  XmlReaderPrivate *priv = reader->priv;
+
+  if (priv->stream_ctxt &&
+      xmlDictSize (priv->stream_ctxt->dict) > STREAM_DICT_MAX_SIZE)
+    {
+      xmlFreeParserCtxt (priv->stream_ctxt);
+      priv->stream_ctxt = NULL;
+    }
+
+  if (priv->stream_ctxt == NULL)
+    {
+      LIBXML_TEST_VERSION;
+
+      priv->stream_ctxt = xmlNewParserCtxt ();
+    }
+}
+
+/* loads the child of the root of the followed file found in @length
+ * bytes of @child, inside a copy of the root element, and drops the
+ * data read up to @consumed
+ */
+static gboolean
+xml_reader_load_record (XmlReader    *reader,
+                        const gchar  *child,
+                        gsize         length,
+                        gsize         consumed,
+                        GError      **error)
+{
+  XmlReaderPrivate *priv = reader->priv;
+  gsize tail_len = strlen (priv->follow_tail);
+  gsize document_len = priv->follow_head_len + length + tail_len;
+  gchar *document;
+  GBytes *source;
+  gboolean retval;
+
+  document = g_malloc (document_len);
+  memcpy (document, priv->follow_head, priv->follow_head_len);
+  memcpy (document + priv->follow_head_len, child, length);
+  memcpy (document + priv->follow_head_len + length, priv->follow_tail, tail_len);
+
+  _xml_reader_follower_consume (priv->follower, consumed);
+
+  source = g_bytes_new_take (document, document_len);
+
+  priv->is_filename = FALSE;
+
+  xml_reader_prepare_stream_context (reader);
+
+  retval = xml_reader_load_buffer (reader, document, document_len,
+                                   source, FALSE,
+                                   error);
+
+  g_bytes_unref (source);
+
+  return retval;
+}
+
+/* keeps the prolog and the start tag of the root element of the
+ * followed file, found between @start and @end in @data, which every
+ * record gets loaded inside of
+ */
+static void
+xml_reader_set_follow_root (XmlReader   *reader,
+                            const gchar *data,
+                            gsize        start,
+                            gsize        end)
+{
+  XmlReaderPrivate *priv = reader->priv;
+  gsize name_len;
+
+  priv->follow_head = g_strndup (data, end);
+  priv->follow_head_len = end;
+
+  for (name_len = 0; start + 1 + name_len < end; name_len++)
+    {
+      gchar c = data[start + 1 + name_len];
+
+      if (g_ascii_isspace (c) || c == '/' || c == '>')
+        break;
+    }
+
+  priv->follow_tail = g_strdup_printf ("</%.*s>",
+                                       (gint) name_len,
+                                       data + start + 1);
+}
+
+/* appends @value to @head, escaped as the value of an attribute; the
+ * white space is escaped too, which the parser would normalize
+ */
+static void
+xml_reader_append_escaped (GString     *head,
+                           const gchar *value)
+{
+  const gchar *p;
+
+  for (p = value; *p != '\0'; p++)
+    {
+      switch (*p)
+        {
+        case '&':
+          g_string_append (head, "&amp;");
+          break;
+
+        case '<':
+          g_string_append (head, "&lt;");
+          break;
+
+        case '>':
+          g_string_append (head, "&gt;");
+          break;
+
+        case '"':
+          g_string_append (head, "&quot;");
+          break;
+
+        case '\t':
+          g_string_append (head, "&#9;");
+          break;
+
+        case '\n':
+          g_string_append (head, "&#10;");
+          break;
+
+        case '\r':
+          g_string_append (head, "&#13;");
+          break;
+
+        default:
+          g_string_append_c (head, *p);
+          break;
+        }
+    }
+}
+
+/* appends the start tag of @element to @head, with the namespaces it
+ * declares and its attributes
+ */
+static void
+xml_reader_append_start_tag (GString    *head,
+                             xmlNodePtr  element)
+{
+  xmlAttrPtr attr;
+  xmlNsPtr ns;
+
+  g_string_append_c (head, '<');
+
+  if (element->ns != NULL && element->ns->prefix != NULL)
+    g_string_append_printf (head, "%s:", XML_TO_CHAR (element->ns->prefix));
+
+  g_string_append (head, XML_TO_CHAR (element->name));
+
+  for (ns = element->nsDef; ns != NULL; ns = ns->next)
+    {
+      if (ns->prefix != NULL)
+        g_string_append_printf (head, " xmlns:%s=\"", XML_TO_CHAR (ns->prefix));
+      else
+        g_string_append (head, " xmlns=\"");
+
+      xml_reader_append_escaped (head, XML_TO_CHAR (ns->href));
+      g_string_append_c (head, '"');
+    }
+
+  for (attr = element->properties; attr != NULL; attr = attr->next)
+    {
+      xmlChar *copy;
+
+      g_string_append_c (head, ' ');
+
+      if (attr->ns != NULL && attr->ns->prefix != NULL)
+        g_string_append_printf (head, "%s:", XML_TO_CHAR (attr->ns->prefix));
+
+      g_string_append_printf (head, "%s=\"", XML_TO_CHAR (attr->name));
+      xml_reader_append_escaped (head, _xml_reader_peek_attribute_value (attr, &copy));
+      g_string_append_c (head, '"');
+
+      if (copy)
+        xmlFree (copy);
+    }
+
+  g_string_append_c (head, '>');
+}
+
+/* builds the head of a checkpoint taken after @node: the declaration
+ * and the document type of its document, in UTF-8 like the document
+ * itself, and the start tags of the elements enclosing @node, which
+ * declare every namespace in scope
+ */
+static gchar *
+xml_reader_checkpoint_head (XmlReader  *reader,
+                            xmlNodePtr  node)
+{
+  xmlDocPtr doc = reader->priv->current_doc;
+  GPtrArray *ancestors;
+  xmlNodePtr parent;
+  GString *head;
+  gint i;
+
+  head = g_string_new (NULL);
+
+  g_string_append_printf (head, "<?xml version=\"%s\"?>\n",
+                          doc->version != NULL ? XML_TO_CHAR (doc->version) : "1.0");
+
+  if (doc->intSubset != NULL)
+    {
+      xmlBufferPtr buffer = xmlBufferCreate ();
+
+      xmlNodeDump (buffer, doc, (xmlNodePtr) doc->intSubset, 0, 0);
+      g_string_append_len (head,
+                           XML_TO_CHAR (xmlBufferContent (buffer)),
+                           xmlBufferLength (buffer));
+      g_string_append_c (head, '\n');
+
+      xmlBufferFree (buffer);
+    }
+
+  ancestors = g_ptr_array_new ();
+
+  for (parent = node->parent;
+       parent != NULL && parent->type == XML_ELEMENT_NODE;
+       parent = parent->parent)
+    g_ptr_array_add (ancestors, parent);
+
+  for (i = ancestors->len - 1; i >= 0; i--)
+    xml_reader_append_start_tag (head, g_ptr_array_index (ancestors, i));
+
+  g_ptr_array_free (ancestors, TRUE);
+
+  return g_string_free (head, FALSE);
+}
+
+/* serializes a checkpoint at @offset in the file, with @head */
+static GBytes *
+xml_reader_new_checkpoint (guint64      offset,
+                           const gchar *head)
+{
+  GVariant *checkpoint;
+  GBytes *retval;
+
+  checkpoint = g_variant_new ("(st^ay)", CHECKPOINT_TAG, offset, head);
+  g_variant_ref_sink (checkpoint);
+
+  retval = g_bytes_new (g_variant_get_data (checkpoint),
+                        g_variant_get_size (checkpoint));
+
+  g_variant_unref (checkpoint);
+
+  return retval;
+}
+
+/* reads the @offset and the @head of @checkpoint, which point into the
+ * returned variant
+ */
+static GVariant *
+xml_reader_open_checkpoint (GBytes       *checkpoint,
+                            guint64      *offset,
+                            const gchar **head,
+                            GError      **error)
+{
+  GVariant *variant;
+  const gchar *tag;
+  gpointer data;
+  gsize size;
+
+  /* the copy is suitably aligned, whatever holds @checkpoint */
+  size = g_bytes_get_size (checkpoint);
+  data = g_malloc (MAX (size, 1));
+  if (size > 0)
+    memcpy (data, g_bytes_get_data (checkpoint, NULL), size);
+
+  variant = g_variant_new_from_data (G_VARIANT_TYPE (CHECKPOINT_TYPE),
+                                     data, size,
+                                     FALSE,
+                                     g_free, data);
+  g_variant_ref_sink (variant);
+
+  g_variant_get (variant, "(&st^&ay)", &tag, offset, head);
+
+  if (strcmp (tag, CHECKPOINT_TAG) != 0 || *offset > G_MAXINT64)
+    {
+      g_set_error_literal (error, XML_READER_ERROR,
+                           XML_READER_ERROR_INVALID,
+                           "Invalid checkpoint");
+      g_variant_unref (variant);
+      return NULL;
+    }
+
+  return variant;
+}
+
+/* parses the file in @compressed while it gets decompressed */
+static gboolean
+xml_reader_load_compressed (XmlReader             *reader,
+                            XmlReaderCompression   compression,
+                            GBytes                *compressed,
+                            GError               **error)
+{
+  XmlReaderPrivate *priv = reader->priv;
+  XmlReaderDecompressor *decompressor;
+  GError *internal_error = NULL;
+  gchar *contents = NULL;
+  gsize contents_len = 0, contents_size = 0;
+  xmlDocPtr doc = NULL;
+  const gchar *data;
+  gsize size;
+
+  if (!xml_reader_check_modes (reader, error))
+    return FALSE;
+
+  data = g_bytes_get_data (compressed, &size);
+
+  decompressor = _xml_reader_decompressor_new (compression, data, size,
+                                               &internal_error);
+  if (decompressor)
+    {
+      xml_reader_reset (reader);
+
+      /* the decompressor is left running, to be read as the cursor
+       * moves forward
+       */
+      if (priv->release_depth > 0)
+        {
+          priv->window_decompressor = decompressor;
+          priv->window_input = g_bytes_ref (compressed);
+
+          return xml_reader_load_window (reader, error);
+        }
+
+      LIBXML_TEST_VERSION;
+
+      /* the succinct mode and the kept source need the whole document */
+      if (priv->use_succinct || priv->out_of_core || priv->keep_source)
+        {
+          contents = g_malloc (1);
+
+          while ((data = _xml_reader_decompressor_read (decompressor, &size)) != NULL)
+            {
+              if (contents_len + size > contents_size)
+                {
+                  contents_size = MAX (contents_size * 2, contents_len + size);
+                  contents = g_realloc (contents, contents_size);
+                }
+
+              memcpy (contents + contents_len, data, size);
+              contents_len += size;
+            }
+        }
+      else
+        {
+          xmlParserCtxtPtr ctxt = xml_reader_new_push_parser (reader);
+
+          if (ctxt)
+            {
+              gboolean stopped = FALSE;
+
+              while (!stopped &&
+                     (data = _xml_reader_decompressor_read (decompressor, &size)) != NULL)
+                stopped = !xml_reader_push (ctxt, data, size);
+
+              if (!stopped)
+                xmlParseChunk (ctxt, NULL, 0, TRUE);
+
+              doc = xml_reader_finish_parse (reader, ctxt);
+            }
+        }
+
+      _xml_reader_decompressor_free (decompressor, &internal_error);
+    }
+
+  if (internal_error)
+    {
+      g_set_error (error, XML_READER_ERROR,
+                   XML_READER_ERROR_INVALID,
+                   "Unable to decompress file `%s': %s",
+                   priv->filename,
+                   internal_error->message);
+
+      g_error_free (internal_error);
+
+      if (doc)
+        xmlFreeDoc (doc);
+
+      g_free (contents);
+
+      return FALSE;
+    }
+
+  if (contents)
+    {
+      GBytes *source;
+      gboolean retval;
+
+      source = g_bytes_new_take (contents, contents_len);
+
+      /* out of core, the source is moved to a file */
+      retval = xml_reader_load_buffer (reader, contents, contents_len,
+                                       priv->out_of_core ? NULL : source,
+                                       FALSE,
+                                       error);
+
+      g_bytes_unref (source);
+
+      return retval;
+    }
+
+  return xml_reader_set_document (reader, doc, error);
+}
+
+/* maps @filename, which becomes the file of @reader, into a #GBytes;
+ * the file is parsed straight from its mapping, saving a copy, and the
+ * succinct mode and the kept source point into it
+ */
+static GBytes *
+xml_reader_map_file (XmlReader    *reader,
+                     const gchar  *filename,
+                     GError      **error)
+{
+  XmlReaderPrivate *priv = reader->priv;
+  GMappedFile *mapped_file;
+  GError *internal_error = NULL;
+
+  mapped_file = g_mapped_file_new (filename, FALSE, &internal_error);
+  if (!mapped_file)
+    {
+      g_propagate_error (error, internal_error);
+      return NULL;
+    }
+
+  g_free (priv->filename);
+
+  priv->is_filename = TRUE;
+  priv->filename = g_strdup (filename);
+
+  if (g_mapped_file_get_length (mapped_file) == 0)
+    {
+      g_set_error (error, XML_READER_ERROR,
+                   XML_READER_ERROR_EMPTY_FILE,
+                   "The file `%s' is empty",
+                   filename);
+      g_mapped_file_unref (mapped_file);
+      return NULL;
+    }
+
+  return g_bytes_new_with_free_func (g_mapped_file_get_contents (mapped_file),
+                                     g_mapped_file_get_length (mapped_file),
+                                     (GDestroyNotify) g_mapped_file_unref,
+                                     mapped_file);
+}
+
+/* prepares the load of @source by xml_reader_load_step(); the files
+ * may be compressed, unlike the buffers
+ */
+static gboolean
+xml_reader_begin_load (XmlReader  *reader,
+                       GBytes     *source,
+                       gboolean    is_file,
+                       GError    **error)
+{
+  XmlReaderPrivate *priv = reader->priv;
+  GError *internal_error = NULL;
+  const gchar *data;
+  gsize length;
+
+  if (!xml_reader_check_modes (reader, error))
+    return FALSE;
+
+  xml_reader_reset (reader);
+
+  data = g_bytes_get_data (source, &length);
+
+  priv->load_source = g_bytes_ref (source);
+  priv->load_mapped = is_file;
+  priv->load_offset = 0;
+  priv->load_compression = is_file
+                         ? _xml_reader_detect_compression (data, length)
+                         : XML_READER_COMPRESSION_NONE;
+
+  if (priv->load_compression == XML_READER_COMPRESSION_NONE)
+    priv->progress_total = length;
+
+  /* the succinct mode and the kept source need the whole document, and
+   * the bounded memory mode parses it as the cursor moves
+   */
+  if (priv->use_succinct || priv->out_of_core || priv->keep_source ||
+      priv->release_depth > 0)
+    return TRUE;
+
+  LIBXML_TEST_VERSION;
+
+  if (priv->load_compression != XML_READER_COMPRESSION_NONE)
+    {
+      priv->load_decompressor = _xml_reader_decompressor_new (priv->load_compression,
+                                                              data, length,
+                                                              &internal_error);
+      if (!priv->load_decompressor)
+        {
+          g_set_error (error, XML_READER_ERROR,
+                       XML_READER_ERROR_INVALID,
+                       "Unable to decompress file `%s': %s",
+                       priv->filename,
+                       internal_error->message);
+          g_error_free (internal_error);
+
+          xml_reader_reset (reader);
+
+          return FALSE;
+        }
+    }
+
+  priv->load_ctxt = xml_reader_new_push_parser (reader);
+
+  return TRUE;
+}
+
+/* loads the document of the pending load in one go, in the modes that
+ * need it whole
+ */
+static gboolean
+xml_reader_load_at_once (XmlReader  *reader,
+                         GError    **error)
+{
+  XmlReaderPrivate *priv = reader->priv;
+  GBytes *source = priv->load_source;
+  const gchar *data;
+  gsize length;
+  gboolean retval;
+
+  /* loading discards the pending load */
+  priv->load_source = NULL;
+
+  data = g_bytes_get_data (source, &length);
+
+  if (priv->load_compression != XML_READER_COMPRESSION_NONE)
+    retval = xml_reader_load_compressed (reader, priv->load_compression,
+                                         source,
+                                         error);
+  else
+    {
+      retval = xml_reader_load_buffer (reader, data, length,
+                                       source, priv->load_mapped,
+                                       error);
+      priv->from_file = retval && priv->load_mapped;
+    }
+
+  g_bytes_unref (source);
+
+  return retval;
+}
+
+/* ends the pending load once its parser is done, after feeding it the
+ * whole document unless it gave up
+ */
+static gboolean
+xml_reader_finish_load (XmlReader  *reader,
+                        gboolean    stopped,
+                        GError    **error)
+{
+  XmlReaderPrivate *priv = reader->priv;
+  GError *internal_error = NULL;
+  xmlDocPtr doc;
+
+  if (!stopped)
+    xmlParseChunk (priv->load_ctxt, NULL, 0, TRUE);
+
+  doc = xml_reader_finish_parse (reader, priv->load_ctxt);
+  priv->load_ctxt = NULL;
+
+  if (priv->load_decompressor)
+    {
+      _xml_reader_decompressor_free (priv->load_decompressor, &internal_error);
+      priv->load_decompressor = NULL;
+    }
+
+  g_bytes_unref (priv->load_source);
+  priv->load_source = NULL;
+
+  if (internal_error)
+    {
+      g_set_error (error, XML_READER_ERROR,
+                   XML_READER_ERROR_INVALID,
+                   "Unable to decompress file `%s': %s",
+                   priv->filename,
+                   internal_error->message);
+      g_error_free (internal_error);
+
+      if (doc)
+        xmlFreeDoc (doc);
+
+      return FALSE;
+    }
+
+  return xml_reader_set_document (reader, doc, error);
+}
+
+typedef struct {
+  XmlReader *reader;
+  gint64 budget;
+  XmlReaderLoadFunc callback;
+  gpointer user_data;
+  GDestroyNotify notify;
+} LoadClosure;
+
+static gboolean
+xml_reader_load_idle (gpointer data)
+{
+  LoadClosure *closure = data;
+  GError *error = NULL;
+
+  if (xml_reader_load_step (closure->reader, closure->budget, &error))
+    return TRUE;
+
+  if (closure->callback)
+    closure->callback (closure->reader, error, closure->user_data);
+
+  if (error)
+    g_error_free (error);
+
+  return FALSE;
+}
+
+static void
+load_closure_free (gpointer data)
+{
+  LoadClosure *closure = data;
+
+  if (closure->notify)
+    closure->notify (closure->user_data);
+
+  g_object_unref (closure->reader);
+
+  g_slice_free (LoadClosure, closure);
+}
+
+/*
+ * Public API
+ */
+
+/**
+ * xml_reader_new:
+ *
+ * Creates a new #XmlReader instance. You can use the #XmlReader
+ * instance to load an XML data stream from a file or a memory
+ * buffer and then iterate over it to extract the data contained
+ * inside it.
+ *
+ * Return value: the newly created #XmlReader instance. Use
+ *   g_object_unref() when done using it.
+ */
+XmlReader *
+xml_reader_new (void)
+{
+  return g_object_new (XML_TYPE_READER, NULL);
+}
+
+/**
+ * xml_reader_load_from_data:
+ * @reader: a #XmlReader
+ * @buffer: a %NULL terminated string containing an XML stream
+ * @error: return location for a #GError, or %NULL
+ *
+ * Loads the XML into the @reader and sets the initial status of the
+ * DOM to be ready to be walked using the #XmlReader methods.
+ *
+ * If @reader was already being used, the previous state is discarded;
+ * this is also true for an #XmlReader instance in an error state.
+ *
+ * In case of error, %FALSE is returned and @error is set.
+ *
+ * Return value: %TRUE if the XML data was successfully loaded.
+ */
+gboolean
+xml_reader_load_from_data (XmlReader    *reader,
+                           const gchar  *buffer,
+                           GError      **error)
+{
+  g_return_val_if_fail (XML_IS_READER (reader), FALSE);
+  g_return_val_if_fail (buffer != NULL, FALSE);
+
+  reader->priv->is_filename = FALSE;
+
+  return xml_reader_load_buffer (reader, buffer, strlen (buffer), NULL, FALSE, error);
+}
+
+/**
+ * xml_reader_load_from_bytes:
+ * @reader: a #XmlReader
+ * @bytes: a #GBytes containing an XML stream
+ * @error: return location for a #GError, or %NULL
+ *
+ * Loads the XML in @bytes into the @reader, like
+ * xml_reader_load_from_data() does, without requiring a terminator.
+ *
+ * The @reader keeps a reference on @bytes instead of copying it, like
+ * it does with the source of the documents when keeping it, see
+ * xml_reader_set_keep_source(). The XML of the elements and the values
+ * that needed no unescaping are then handed out as slices of @bytes by
+ * xml_reader_get_outer_xml_bytes(), xml_reader_get_element_value_bytes()
+ * and the like.
+ *
+ * Return value: %TRUE if the XML data was successfully loaded.
+ */
+gboolean
+xml_reader_load_from_bytes (XmlReader  *reader,
+                            GBytes     *bytes,
+                            GError    **error)
+{
+  gconstpointer data;
+  gsize length;
+
+  g_return_val_if_fail (XML_IS_READER (reader), FALSE);
+  g_return_val_if_fail (bytes != NULL, FALSE);
+
+  reader->priv->is_filename = FALSE;
+
+  data = g_bytes_get_data (bytes, &length);
+
+  return xml_reader_load_buffer (reader, data, length, bytes, FALSE, error);
+}
+
+/**
+ * xml_reader_load_from_vectors:
+ * @reader: a #XmlReader
+ * @vectors: the buffers holding the XML stream, in order
+ * @n_vectors: the number of @vectors
+ * @error: return location for a #GError, or %NULL
+ *
+ * Loads the XML split across the buffers of @vectors into the @reader,
+ * like xml_reader_load_from_data() does. The buffers are fed to the
+ * parser one after the other, so a document received in pieces can be
+ * loaded without joining them first; the buffers need no terminator,
+ * and can be released once this function returns.
+ *
+ * The source of the document has to be contiguous to be kept, in
+ * succinct mode or when keeping it, see xml_reader_set_keep_source(),
+ * so the buffers are joined in those cases. In bounded memory mode
+ * they are copied one by one, and parsed as the cursor moves.
+ *
+ * Return value: %TRUE if the XML data was successfully loaded.
+ */
+gboolean
+xml_reader_load_from_vectors (XmlReader              *reader,
+                              const XmlReaderVector  *vectors,
+                              guint                   n_vectors,
+                              GError                **error)
+{
+  g_return_val_if_fail (XML_IS_READER (reader), FALSE);
+  g_return_val_if_fail (vectors != NULL || n_vectors == 0, FALSE);
+
+  reader->priv->is_filename = FALSE;
+
+  return xml_reader_load_vectors (reader, vectors, n_vectors, error);
+}
+
+/**
+ * xml_reader_load_from_file:
+ * @reader: a #XmlReader
+ * @filename: the full path to an XML file
+ * @error: return location for a #GError, or %NULL
+ *
+ * Loads an XML file at @filename into @reader and sets the #XmlReader
+ * to be ready to walk the XML document object model.
+ *
+ * The file is mapped in memory and parsed in place, without reading
+ * it into a buffer first. An empty file is reported with the
+ * %XML_READER_ERROR_EMPTY_FILE error.
+ *
+ * Files compressed with gzip or, if xml-reader was built with libzstd,
+ * with zstd are recognized and decompressed by a separate thread while
+ * they are parsed, a few buffers at a time, or as the cursor moves in
+ * bounded memory mode. The succinct mode and the kept source, see
+ * xml_reader_set_keep_source(), need the whole document, which is then
+ * decompressed in memory.
+ *
+ * See also xml_reader_load_from_data().
+ *
+ * Return value: %TRUE if the file was successfully loaded.
+ */
+gboolean
+xml_reader_load_from_file (XmlReader    *reader,
+                           const gchar  *filename,
+                           GError      **error)
+{
+  XmlReaderCompression compression;
+  GBytes *source;
+  const gchar *data;
+  gsize length;
+  gboolean retval;
+
+  g_return_val_if_fail (XML_IS_READER (reader), FALSE);
+  g_return_val_if_fail (filename != NULL, FALSE);
+
+  source = xml_reader_map_file (reader, filename, error);
+  if (!source)
+    return FALSE;
+
+  data = g_bytes_get_data (source, &length);
+  compression = _xml_reader_detect_compression (data, length);
+
+  if (compression != XML_READER_COMPRESSION_NONE)
+    retval = xml_reader_load_compressed (reader, compression, source, error);
+  else
+    {
+      retval = xml_reader_load_buffer (reader, data, length, source, TRUE, error);
+      reader->priv->from_file = retval;
+    }
+
+  g_bytes_unref (source);
+
+  return retval;
+}
+
+/**
+ * xml_reader_begin_load_from_file:
+ * @reader: a #XmlReader
+ * @filename: the full path to an XML file
+ * @error: return location for a #GError, or %NULL
+ *
+ * Starts loading the XML file at @filename into @reader a step at a
+ * time, like xml_reader_load_from_file() does at once; the document is
+ * then parsed by xml_reader_load_step(), or by xml_reader_load_in_idle().
+ *
+ * The previous document of @reader is discarded, and the new one can
+ * only be read once xml_reader_is_loading() returns %FALSE.
+ *
+ * Return value: %TRUE if the file could be opened
+ */
+gboolean
+xml_reader_begin_load_from_file (XmlReader    *reader,
+                                 const gchar  *filename,
+                                 GError      **error)
+{
+  GBytes *source;
+  gboolean retval;
+
+  g_return_val_if_fail (XML_IS_READER (reader), FALSE);
+  g_return_val_if_fail (filename != NULL, FALSE);
+
+  source = xml_reader_map_file (reader, filename, error);
+  if (!source)
+    return FALSE;
+
+  retval = xml_reader_begin_load (reader, source, TRUE, error);
+
+  g_bytes_unref (source);
+
+  return retval;
+}
+
+/**
+ * xml_reader_begin_load_from_bytes:
+ * @reader: a #XmlReader
+ * @bytes: a #GBytes containing an XML stream
+ *
+ * Starts loading the XML in @bytes into @reader a step at a time, like
+ * xml_reader_load_from_bytes() does at once. See
+ * xml_reader_begin_load_from_file().
+ */
+void
+xml_reader_begin_load_from_bytes (XmlReader *reader,
+                                  GBytes    *bytes)
+{
+  g_return_if_fail (XML_IS_READER (reader));
+  g_return_if_fail (bytes != NULL);
+
+  reader->priv->is_filename = FALSE;
+
+  xml_reader_begin_load (reader, bytes, FALSE, NULL);
+}
+
+/**
+ * xml_reader_load_step:
+ * @reader: a #XmlReader
+ * @budget: the time the step may take, in microseconds
+ * @error: return location for a #GError, or %NULL
+ *
+ * Parses the document whose loading was started by
+ * xml_reader_begin_load_from_file() or xml_reader_begin_load_from_bytes()
+ * for about @budget microseconds, so that a large document can be
+ * loaded by the thread running a user interface or an event loop
+ * between two frames or two events, without handing it over from
+ * another thread:
+ *
+ * |[
+ *   xml_reader_begin_load_from_file (reader, "catalog.xml", &amp;error);
+ *
+ *   while (xml_reader_load_step (reader, 4000, &amp;error))
+ *     update_progress_bar ();
+ *
+ *   if (error != NULL)
+ *     show_error (error);
+ * ]|
+ *
+ * The document is parsed 64 kilobytes at a time, as many times as fit
+ * in @budget, and at least once. Compressed files are decompressed
+ * along on another thread, see xml_reader_load_from_file(); a step
+ * waits for it no longer than @budget, and may then parse nothing.
+ * In succinct and out-of-core mode, when keeping the source and in
+ * bounded memory mode, the first step loads the document as
+ * xml_reader_load_from_file() does.
+ *
+ * Return value: %TRUE if the document is still loading, and %FALSE
+ *   once it is loaded, or if loading it failed, in which case @error
+ *   is set
+ */
+gboolean
+xml_reader_load_step (XmlReader  *reader,
+                      gint64      budget,
+                      GError    **error)
+{
+  XmlReaderPrivate *priv;
+  gboolean finished = FALSE, stopped = FALSE;
+  gint64 deadline;
+
+  g_return_val_if_fail (XML_IS_READER (reader), FALSE);
+
+  priv = reader->priv;
+
+  if (!priv->load_source)
+    return FALSE;
+
+  if (!priv->load_ctxt)
+    {
+      xml_reader_load_at_once (reader, error);
+      return FALSE;
+    }
+
+  deadline = g_get_monotonic_time () + budget;
+
+  do
+    {
+      const gchar *data;
+      gsize size;
+
+      if (priv->load_decompressor)
+        {
+          gboolean pending;
+
+          /* the decompressing thread may lag behind the parser */
+          data = _xml_reader_decompressor_read_until (priv->load_decompressor,
+                                                      deadline,
+                                                      &size, &pending);
+          if (pending)
+            return TRUE;
+
+          finished = data == NULL;
+        }
+      else
+        {
+          gsize length;
+
+          data = g_bytes_get_data (priv->load_source, &length);
+          data += priv->load_offset;
+          size = MIN (length - priv->load_offset, LOAD_STEP_CHUNK_SIZE);
+
+          priv->load_offset += size;
+          finished = priv->load_offset == length;
+        }
+
+      if (data != NULL)
+        stopped = !xml_reader_push (priv->load_ctxt, data, size);
+    }
+  while (!finished && !stopped && g_get_monotonic_time () < deadline);
+
+  if (!finished && !stopped)
+    return TRUE;
+
+  xml_reader_finish_load (reader, stopped, error);
+
+  return FALSE;
+}
+
+/**
+ * xml_reader_is_loading:
+ * @reader: a #XmlReader
+ *
+ * Checks whether the document of @reader is being loaded a step at a
+ * time, see xml_reader_load_step().
+ *
+ * Return value: %TRUE if the document is still loading
+ */
+gboolean
+xml_reader_is_loading (XmlReader *reader)
+{
+  g_return_val_if_fail (XML_IS_READER (reader), FALSE);
+
+  return reader->priv->load_source != NULL;
+}
+
+/**
+ * xml_reader_load_in_idle:
+ * @reader: a #XmlReader
+ * @context: the #GMainContext to load the document in, or %NULL for
+ *   the default one
+ * @budget: the time each step may take, in microseconds
+ * @callback: the function to call once the document is loaded, or %NULL
+ * @user_data: the data to pass to @callback
+ * @notify: the function to call on @user_data once the load is over,
+ *   or %NULL
+ *
+ * Loads the document whose loading was started by
+ * xml_reader_begin_load_from_file() or xml_reader_begin_load_from_bytes()
+ * from an idle source attached to @context, which calls
+ * xml_reader_load_step() with @budget whenever @context has nothing
+ * more urgent to dispatch, and then @callback, with the error if the
+ * document failed to load.
+ *
+ * The source keeps a reference on @reader until the document is
+ * loaded. Destroying the source stops the loading, which can be
+ * resumed by calling xml_reader_load_step().
+ *
+ * Return value: the ID of the source
+ */
+guint
+xml_reader_load_in_idle (XmlReader         *reader,
+                         GMainContext      *context,
+                         gint64             budget,
+                         XmlReaderLoadFunc  callback,
+                         gpointer           user_data,
+                         GDestroyNotify     notify)
+{
+  LoadClosure *closure;
+  GSource *source;
+  guint source_id;
+
+  g_return_val_if_fail (XML_IS_READER (reader), 0);
+
+  closure = g_slice_new (LoadClosure);
+  closure->reader = g_object_ref (reader);
+  closure->budget = budget;
+  closure->callback = callback;
+  closure->user_data = user_data;
+  closure->notify = notify;
+
+  source = g_idle_source_new ();
+  g_source_set_callback (source, xml_reader_load_idle, closure, load_closure_free);
+
+  source_id = g_source_attach (source, context);
+  g_source_unref (source);
+
+  return source_id;
+}
+
+/**
+ * xml_reader_open_documents:
+ * @reader: a #XmlReader
+ * @stream: a #GBytes containing a stream of XML documents
+ *
+ * Sets @stream as the stream of documents of @reader, which
+ * xml_reader_next_document() loads one at a time. The documents may
+ * follow each other directly, or be separated by white space, for
+ * instance one per line.
+ *
+ * The documents are found by a light scan of the markup, without
+ * parsing them twice, and are parsed straight from @stream, which
+ * @reader keeps a reference on. They share one parser context and the
+ * names it interns, so loading many small documents costs little more
+ * than loading one large one.
+ */
+void
+xml_reader_open_documents (XmlReader *reader,
+                           GBytes    *stream)
+{
+  XmlReaderPrivate *priv;
+
+  g_return_if_fail (XML_IS_READER (reader));
+  g_return_if_fail (stream != NULL);
+
+  priv = reader->priv;
+
+  g_bytes_ref (stream);
+
+  if (priv->stream)
+    g_bytes_unref (priv->stream);
+
+  priv->stream = stream;
+  priv->stream_offset = 0;
+  priv->stream_mapped = FALSE;
+}
+
+/**
+ * xml_reader_open_documents_from_file:
+ * @reader: a #XmlReader
+ * @filename: the full path to a file containing a stream of XML
+ *   documents
+ * @error: return location for a #GError, or %NULL
+ *
+ * Maps the file at @filename in memory and sets it as the stream of
+ * documents of @reader, like xml_reader_open_documents() does.
+ *
+ * Return value: %TRUE if the file was successfully opened.
+ */
+gboolean
+xml_reader_open_documents_from_file (XmlReader    *reader,
+                                     const gchar  *filename,
+                                     GError      **error)
+{
+  GMappedFile *mapped_file;
+  GBytes *stream;
+
+  g_return_val_if_fail (XML_IS_READER (reader), FALSE);
+  g_return_val_if_fail (filename != NULL, FALSE);
+
+  mapped_file = g_mapped_file_new (filename, FALSE, error);
+  if (!mapped_file)
+    return FALSE;
+
+  stream = g_bytes_new_with_free_func (g_mapped_file_get_contents (mapped_file),
+                                       g_mapped_file_get_length (mapped_file),
+                                       (GDestroyNotify) g_mapped_file_unref,
+                                       mapped_file);
+
+  xml_reader_open_documents (reader, stream);
+  reader->priv->stream_mapped = TRUE;
+
+  g_bytes_unref (stream);
+
+  return TRUE;
+}
+
+/**
+ * xml_reader_next_document:
+ * @reader: a #XmlReader
+ * @error: return location for a #GError, or %NULL
+ *
+ * Loads the next document of the stream set with
+ * xml_reader_open_documents(), and sets the #XmlReader to be ready to
+ * walk it, like xml_reader_load_from_data() does.
+ *
+ * At the end of the stream %FALSE is returned and @error is not set. A
+ * document that cannot be parsed is reported with the
+ * %XML_READER_ERROR_INVALID error; the following call moves on to the
+ * next document, unless the stream ended in the middle of this one.
+ *
+ * Return value: %TRUE if a document was loaded.
+ */
+gboolean
+xml_reader_next_document (XmlReader  *reader,
+                          GError    **error)
+{
+  XmlReaderPrivate *priv;
+  const gchar *data;
+  gsize length, start, end;
+  GBytes *document;
+  gboolean retval;
+
+  g_return_val_if_fail (XML_IS_READER (reader), FALSE);
+
+  priv = reader->priv;
+
+  if (priv->stream == NULL)
+    return FALSE;
+
+  data = g_bytes_get_data (priv->stream, &length);
+  data += priv->stream_offset;
+  length -= priv->stream_offset;
+
+  if (!_xml_reader_find_document (data, length, &start, &end))
+    {
+      xml_reader_reset (reader);
+
+      priv->stream_offset += length;
+
+      if (start == length)
+        return FALSE;
+
+      g_set_error (error, XML_READER_ERROR,
+                   XML_READER_ERROR_INVALID,
+                   "The last document of the stream is truncated");
+
+      return FALSE;
+    }
+
+  /* a slice of the stream, not a copy */
+  document = g_bytes_new_from_bytes (priv->stream,
+                                     priv->stream_offset + start,
+                                     end - start);
+
+  priv->stream_offset += end;
+  priv->is_filename = FALSE;
+
+  xml_reader_prepare_stream_context (reader);
+
+  retval = xml_reader_load_buffer (reader, data + start, end - start,
+                                   document, priv->stream_mapped,
+                                   error);
+
+  g_bytes_unref (document);
+
+  return retval;
+}
+
+/**
+ * xml_reader_follow_file:
+ * @reader: a #XmlReader
+ * @filename: the full path to an XML file being written
+ * @interval: the longest time between two checks of the file, in
+ *   milliseconds
+ * @error: return location for a #GError, or %NULL
+ *
+ * Follows the file at @filename as it grows, like <command>tail
+ * -f</command> does, for logs made of one root element that stays
+ * open and gets new children appended to it. Each of those records is
+ * loaded by xml_reader_next_record() once it is complete.
+ *
+ * The file is watched for changes where the platform allows it, so
+ * records are available as soon as they are written. It is also
+ * checked every @interval milliseconds, which bounds the delay when
+ * changes cannot be watched, as on some network file systems.
+ *
+ * Files that are complete can be read a record at a time the same
+ * way. The file is read a bit at a time, as records are needed, so
+ * this takes memory for about one record whatever the size of the
+ * file; see also xml_reader_get_checkpoint() for resuming long reads.
+ *
+ * Return value: %TRUE if the file was successfully opened.
+ */
+gboolean
+xml_reader_follow_file (XmlReader    *reader,
+                        const gchar  *filename,
+                        guint         interval,
+                        GError      **error)
+{
+  XmlReaderFollower *follower;
+
+  g_return_val_if_fail (XML_IS_READER (reader), FALSE);
+  g_return_val_if_fail (filename != NULL, FALSE);
+  g_return_val_if_fail (interval > 0, FALSE);
+
+  follower = _xml_reader_follower_new (filename, 0, interval, error);
+  if (!follower)
+    return FALSE;
+
+  xml_reader_stop_following (reader);
+  xml_reader_reset (reader);
+
+  reader->priv->follower = follower;
+
+  return TRUE;
+}
+
+/**
+ * xml_reader_next_record:
+ * @reader: a #XmlReader
+ * @timeout: the longest time to wait for a record, in milliseconds,
+ *   0 for not waiting or -1 for waiting until one comes
+ * @error: return location for a #GError, or %NULL
+ *
+ * Loads the next child of the root element of the file followed with
+ * xml_reader_follow_file(), and sets the #XmlReader to be ready to
+ * walk it, like xml_reader_load_from_data() does. The record is loaded
+ * inside its root element, which holds no other child; the declaration
+ * and the document type of the file also apply to it.
+ *
+ * The previous record and the data read for it are released, so the
+ * memory used does not grow with the file. Text, comments and
+ * processing instructions between the records are skipped.
+ *
+ * If no record is complete after @timeout milliseconds, %FALSE is
+ * returned and @error is not set. Once the root element is closed
+ * the file is not followed any more: %FALSE is returned, and
+ * xml_reader_is_following() returns %FALSE.
+ *
+ * Return value: %TRUE if a record was loaded.
+ */
+gboolean
+xml_reader_next_record (XmlReader  *reader,
+                        gint        timeout,
+                        GError    **error)
+{
+  XmlReaderPrivate *priv;
+  gint64 deadline;
+
+  g_return_val_if_fail (XML_IS_READER (reader), FALSE);
+
+  priv = reader->priv;
+
+  xml_reader_reset (reader);
+
+  if (priv->follower == NULL)
+    return FALSE;
+
+  deadline = timeout >= 0 ? g_get_monotonic_time () + (gint64) timeout * 1000 : -1;
+
+  while (TRUE)
+    {
+      const gchar *data;
+      gsize length, start, end;
+      gboolean is_open;
+      gssize n_read;
+
+      data = _xml_reader_follower_peek (priv->follower, &length);
+
+      if (priv->follow_head == NULL)
+        {
+          if (_xml_reader_find_root (data, length, &start, &end, &is_open))
+            {
+              /* an empty root has no records */
+              if (!is_open)
+                {
+                  xml_reader_stop_following (reader);
+                  return FALSE;
+                }
+
+              xml_reader_set_follow_root (reader, data, start, end);
+              _xml_reader_follower_consume (priv->follower, end);
+              continue;
+            }
+        }
+      else
+        {
+          switch (_xml_reader_find_child (data, length, &start, &end))
+            {
+            case XML_READER_SCAN_CHILD:
+              return xml_reader_load_record (reader, data + start, end - start,
+                                             end,
+                                             error);
+
+            case XML_READER_SCAN_PARENT_END:
+              xml_reader_stop_following (reader);
+              return FALSE;
+
+            case XML_READER_SCAN_INCOMPLETE:
+              _xml_reader_follower_consume (priv->follower, start);
+              break;
+            }
+        }
+
+      n_read = _xml_reader_follower_read (priv->follower, error);
+      if (n_read < 0)
+        {
+          xml_reader_stop_following (reader);
+          return FALSE;
+        }
+
+      if (n_read == 0 && !_xml_reader_follower_wait (priv->follower, deadline))
+        return FALSE;
+    }
+}
+
+/**
+ * xml_reader_is_following:
+ * @reader: a #XmlReader
+ *
+ * Checks whether @reader follows a file, see xml_reader_follow_file().
+ * A file is not followed any more once its root element is closed, or
+ * after an error reading it.
+ *
+ * Return value: %TRUE if @reader follows a file.
+ */
+gboolean
+xml_reader_is_following (XmlReader *reader)
+{
+  g_return_val_if_fail (XML_IS_READER (reader), FALSE);
+
+  return reader->priv->follower != NULL;
+}
+
+/**
+ * xml_reader_get_checkpoint:
+ * @reader: a #XmlReader
+ *
+ * Saves the position of @reader in the file it reads, so that a new
+ * #XmlReader, in this process or in another one, can go on from there
+ * instead of reading the file from the beginning again: with
+ * xml_reader_resume_from_checkpoint() in a file followed with
+ * xml_reader_follow_file(), and with xml_reader_load_from_checkpoint()
+ * otherwise.
+ *
+ * The checkpoint is taken after the current record of a followed file,
+ * or else after the element the cursor is on, which cannot be the root
+ * element. It holds the offset of the end of that element in the file,
+ * and the prolog of the file with the start tags of the elements
+ * enclosing it, which the rest of the file is parsed inside of: the
+ * document type, the namespaces in scope and the attributes of those
+ * elements thus carry over. It is a small binary blob, meant to be
+ * stored along with the results of the records read so far.
+ *
+ * Besides followed files, checkpoints can be taken in the files loaded
+ * by xml_reader_load_from_file(), xml_reader_begin_load_from_file() or
+ * xml_reader_load_from_checkpoint() that are neither compressed nor
+ * encoded otherwise than in UTF-8, and parsed into a tree: in bounded
+ * memory mode after the elements down to the release depth, see
+ * xml_reader_set_bounded_memory(), which are parsed whole first, and
+ * otherwise after any element when keeping the source, see
+ * xml_reader_set_keep_source().
+ *
+ * Return value: the checkpoint, or %NULL if none can be taken where
+ *   @reader is. Use g_bytes_unref() when done.
+ */
+GBytes *
+xml_reader_get_checkpoint (XmlReader *reader)
+{
+  XmlReaderPrivate *priv;
+  xmlNodePtr node;
+  GBytes *retval;
+  gchar *head;
+  gsize end = 0;
+
+  g_return_val_if_fail (XML_IS_READER (reader), NULL);
+
+  priv = reader->priv;
+
+  if (priv->follower != NULL)
+    {
+      if (priv->follow_head == NULL)
+        return NULL;
+
+      return xml_reader_new_checkpoint (_xml_reader_follower_get_position (priv->follower),
+                                        priv->follow_head);
+    }
+
+  node = priv->node_cursor;
+
+  if (!priv->from_file || priv->succinct != NULL || priv->error_state ||
+      node == NULL || node->type != XML_ELEMENT_NODE ||
+      node->parent == NULL || node->parent->type != XML_ELEMENT_NODE)
+    return NULL;
+
+  if (priv->windowed)
+    {
+      if (xml_reader_window_complete (reader, node))
+        end = GPOINTER_TO_SIZE (g_hash_table_lookup (priv->window_ends, node));
+    }
+  else if (priv->has_offsets && node->_private != NULL)
+    {
+      XmlReaderNodeInfo *info = node->_private;
+
+      if (info->has_offsets)
+        end = info->outer_end;
+    }
+
+  /* the elements of the head end in the rest of the file */
+  if (end <= priv->checkpoint_head_len)
+    return NULL;
+
+  head = xml_reader_checkpoint_head (reader, node);
+  retval = xml_reader_new_checkpoint (priv->checkpoint_offset + end - priv->checkpoint_head_len,
+                                      head);
+  g_free (head);
+
+  return retval;
+}
+
+/**
+ * xml_reader_resume_from_checkpoint:
+ * @reader: a #XmlReader
+ * @filename: the full path to the XML file the checkpoint was taken in
+ * @checkpoint: a checkpoint returned by xml_reader_get_checkpoint()
+ * @interval: the longest time between two checks of the file, in
+ *   milliseconds
+ * @error: return location for a #GError, or %NULL
+ *
+ * Follows the file at @filename, like xml_reader_follow_file() does,
+ * starting where @checkpoint was taken: the next call to
+ * xml_reader_next_record() loads the record after the one current
+ * when @checkpoint was taken, without reading the file before it.
+ * Besides the checkpoints of followed files, those taken after a child
+ * of the root element can be resumed this way.
+ *
+ * A @checkpoint that was not returned by xml_reader_get_checkpoint(),
+ * that was taken deeper in the file or that is past the end of the
+ * file is reported with the %XML_READER_ERROR_INVALID error.
+ *
+ * Return value: %TRUE if the file was successfully opened.
+ */
+gboolean
+xml_reader_resume_from_checkpoint (XmlReader    *reader,
+                                   const gchar  *filename,
+                                   GBytes       *checkpoint,
+                                   guint         interval,
+                                   GError      **error)
+{
+  XmlReaderFollower *follower = NULL;
+  GVariant *variant;
+  const gchar *head;
+  guint64 offset;
+  gsize start, end;
+  gboolean is_open;
+
+  g_return_val_if_fail (XML_IS_READER (reader), FALSE);
+  g_return_val_if_fail (filename != NULL, FALSE);
+  g_return_val_if_fail (checkpoint != NULL, FALSE);
+  g_return_val_if_fail (interval > 0, FALSE);
+
+  variant = xml_reader_open_checkpoint (checkpoint, &offset, &head, error);
+  if (!variant)
+    return FALSE;
+
+  if (!_xml_reader_find_root (head, strlen (head), &start, &end, &is_open) ||
+      end != strlen (head) || !is_open)
+    {
+      g_set_error_literal (error, XML_READER_ERROR,
+                           XML_READER_ERROR_INVALID,
+                           "Invalid checkpoint");
+    }
+  else
+    follower = _xml_reader_follower_new (filename, offset, interval, error);
+
+  if (follower)
+    {
+      xml_reader_stop_following (reader);
+      xml_reader_reset (reader);
+
+      reader->priv->follower = follower;
+
+      xml_reader_set_follow_root (reader, head, start, end);
+    }
+
+  g_variant_unref (variant);
+
+  return follower != NULL;
+}
+
+/**
+ * xml_reader_load_from_checkpoint:
+ * @reader: a #XmlReader
+ * @filename: the full path to the XML file the checkpoint was taken in
+ * @checkpoint: a checkpoint returned by xml_reader_get_checkpoint()
+ * @error: return location for a #GError, or %NULL
+ *
+ * Loads the XML file at @filename into @reader from where @checkpoint
+ * was taken, like xml_reader_load_from_file() loads it whole, without
+ * reading the file before it.
+ *
+ * The document loaded is the rest of the file inside the elements that
+ * enclosed the element @checkpoint was taken after: the cursor finds
+ * them first, from the root element down, each holding the elements
+ * that followed in the file, starting with the one after that
+ * element. The modes of @reader apply to the document, so a long file
+ * can be read in bounded memory mode, see
+ * xml_reader_set_bounded_memory(), taking checkpoints along the way.
+ *
+ * A @checkpoint that was not returned by xml_reader_get_checkpoint(),
+ * or that is past the end of the file, and a compressed file are
+ * reported with the %XML_READER_ERROR_INVALID error.
+ *
+ * Return value: %TRUE if the file was successfully loaded.
+ */
+gboolean
+xml_reader_load_from_checkpoint (XmlReader    *reader,
+                                 const gchar  *filename,
+                                 GBytes       *checkpoint,
+                                 GError      **error)
+{
+  XmlReaderPrivate *priv;
+  GVariant *variant;
+  GBytes *source;
+  const gchar *head, *data;
+  guint64 offset;
+  gsize length, head_len;
+  gboolean retval;
+
+  g_return_val_if_fail (XML_IS_READER (reader), FALSE);
+  g_return_val_if_fail (filename != NULL, FALSE);
+  g_return_val_if_fail (checkpoint != NULL, FALSE);
+
+  priv = reader->priv;
+
+  variant = xml_reader_open_checkpoint (checkpoint, &offset, &head, error);
+  if (!variant)
+    return FALSE;
+
+  source = xml_reader_map_file (reader, filename, error);
+  if (!source)
+    {
+      g_variant_unref (variant);
+      return FALSE;
+    }
+
+  data = g_bytes_get_data (source, &length);
+  head_len = strlen (head);
+
+  if (offset > length ||
+      _xml_reader_detect_compression (data, length) != XML_READER_COMPRESSION_NONE)
+    {
+      g_set_error (error, XML_READER_ERROR,
+                   XML_READER_ERROR_INVALID,
+                   "Invalid checkpoint for file `%s'",
+                   filename);
+      retval = FALSE;
+    }
+  else if (priv->release_depth > 0)
+    {
+      /* the head is copied, and the rest of the file parsed in place */
+      retval = xml_reader_check_modes (reader, error);
+
+      if (retval)
+        {
+          xml_reader_reset (reader);
+
+          g_queue_push_tail (&priv->window_sources, g_bytes_new (head, head_len));
+          g_queue_push_tail (&priv->window_sources,
+                             g_bytes_new_from_bytes (source, offset, length - offset));
+          priv->progress_total = head_len + (length - offset);
+
+          retval = xml_reader_load_window (reader, error);
+        }
+    }
+  else
+    {
+      XmlReaderVector vectors[2];
+
+      vectors[0].buffer = head;
+      vectors[0].size = head_len;
+      vectors[1].buffer = data + offset;
+      vectors[1].size = length - offset;
+
+      retval = xml_reader_load_vectors (reader, vectors, 2, error);
+    }
+
+  if (retval)
+    {
+      priv->from_file = TRUE;
+      priv->checkpoint_head_len = head_len;
+      priv->checkpoint_offset = offset;
+    }
+
+  g_bytes_unref (source);
+  g_variant_unref (variant);
+
+  return retval;
+}
+
+/**
+ * xml_reader_get_error:
+ * @reader: a #XmlReader
+ * @error: return location for a #GError, or %NULL
+ *
+ * Checks the state of @reader and returns whether the #XmlReader instance
+ * is in an error state and cannot be used to walk the DOM tree or not.
+ *
  * #XmlReader API does not require a #GError argument for the DOM tree
  * walking; in case of error, #XmlReader methods will return an invalid
  * value (either %FALSE, %NULL or a negative integer). To check whether an
@@ -277,234 +4201,1290 @@ xml_reader_load_from_file (XmlReader    *reader,
  * if it returns %TRUE, the passed #GError can be used to retrieve the
  * last error occurred.
  *
- * Return value: %TRUE is the #XmlReader is in error state
+ * Return value: %TRUE is the #XmlReader is in error state
+ */
+gboolean
+xml_reader_get_error (XmlReader  *reader,
+                      GError    **error)
+{
+  g_return_val_if_fail (XML_IS_READER (reader), FALSE);
+
+  if (error && *error == NULL)
+    g_set_error (error, XML_READER_ERROR,
+                 reader->priv->last_error,
+                 "XmlReader error");
+
+  return reader->priv->error_state;
+}
+
+/**
+ * xml_reader_set_adaptive_indexing:
+ * @reader: a #XmlReader
+ * @enabled: whether the indexes should follow the observed lookups
+ * @memory_budget: the memory the indexes of a document may use, in
+ *   bytes, or 0 for no limit
+ *
+ * By default the children of an element are packed for faster scans
+ * on the second lookup below it, and a filter of the names of its
+ * descendants is built on the first miss, whatever the shape of the
+ * document.
+ *
+ * With adaptive indexing @reader instead tracks the cost of the
+ * lookups below each element: the children they compare and the
+ * misses. The children of an element are packed once lookups compared
+ * enough of them, wide elements looked up repeatedly get their
+ * children indexed by name, and elements with repeated misses get a
+ * descendant names filter. Indexes that would take @reader over
+ * @memory_budget are not built.
+ *
+ * xml_reader_get_index_report() lists the indexes built under adaptive
+ * indexing and the reasons for building them.
+ */
+void
+xml_reader_set_adaptive_indexing (XmlReader *reader,
+                                  gboolean   enabled,
+                                  gsize      memory_budget)
+{
+  g_return_if_fail (XML_IS_READER (reader));
+
+  reader->priv->adaptive_indexing = enabled != FALSE;
+  reader->priv->memory_budget = memory_budget;
+}
+
+/**
+ * xml_reader_set_succinct:
+ * @reader: a #XmlReader
+ * @succinct: whether documents should be loaded in succinct mode
+ *
+ * Sets whether the documents loaded from now on by @reader are kept in
+ * a succinct, read-only representation instead of a libxml2 tree. A
+ * libxml2 tree takes well over a hundred bytes per element; the
+ * succinct representation takes about ten: two bits of tree structure,
+ * the id of the element name and the offset of the element inside the
+ * source document, which @reader keeps mapped, or copied when loading
+ * from data. Attributes and values are decoded from the source when
+ * they are accessed.
+ *
+ * The cursor API works the same on both representations; moving to the
+ * next sibling of an element scans up to a few hundred words of tree
+ * structure, plus a number of steps logarithmic in the size of the
+ * element, so this mode is meant for documents too large for a tree
+ * rather than for speed.
+ *
+ * Only UTF-8 documents can be loaded in succinct mode, and they must be
+ * well-formed: unlike the default mode no recovery is attempted. The
+ * value of an element is its leading text. xml_reader_walk() and the
+ * bulk extraction functions are not available in this mode.
+ */
+void
+xml_reader_set_succinct (XmlReader *reader,
+                         gboolean   succinct)
+{
+  g_return_if_fail (XML_IS_READER (reader));
+
+  reader->priv->use_succinct = succinct != FALSE;
+}
+
+/**
+ * xml_reader_set_out_of_core:
+ * @reader: a #XmlReader
+ * @enabled: whether documents should be kept out of core
+ * @directory: the directory of the temporary files, or %NULL for the
+ *   default temporary directory
+ *
+ * Sets whether the documents loaded from now on by @reader are kept in
+ * temporary files instead of memory, for documents larger than the
+ * available memory.
+ *
+ * Out-of-core documents use the succinct representation, see
+ * xml_reader_set_succinct(), stored in unlinked files inside
+ * @directory that are mapped in memory: the kernel writes their pages
+ * back and evicts them under memory pressure instead of running out of
+ * memory. The source document is read from its own mapping when loaded
+ * from a file, and copied to a temporary file when loaded from data.
+ * Since both are laid out in document order, reading the document in
+ * order touches them in order; see xml_reader_set_access_pattern().
+ *
+ * On systems without memory mapped files the documents are kept in
+ * memory.
+ */
+void
+xml_reader_set_out_of_core (XmlReader   *reader,
+                            gboolean     enabled,
+                            const gchar *directory)
+{
+  XmlReaderPrivate *priv;
+
+  g_return_if_fail (XML_IS_READER (reader));
+
+  priv = reader->priv;
+
+  priv->out_of_core = enabled != FALSE;
+
+  g_free (priv->out_of_core_directory);
+  priv->out_of_core_directory = g_strdup (directory != NULL
+                                          ? directory
+                                          : g_get_tmp_dir ());
+}
+
+/**
+ * xml_reader_set_access_pattern:
+ * @reader: a #XmlReader
+ * @pattern: how the document is going to be read
+ *
+ * Tells @reader how the cursor is going to move over the loaded
+ * document and the documents loaded from now on, so that the memory
+ * mappings of succinct and out-of-core documents are read ahead for
+ * sequential reads, or not at all for random ones. It has no effect on
+ * documents loaded in the default mode.
+ */
+void
+xml_reader_set_access_pattern (XmlReader              *reader,
+                               XmlReaderAccessPattern  pattern)
+{
+  g_return_if_fail (XML_IS_READER (reader));
+
+  reader->priv->access_pattern = pattern;
+
+  if (reader->priv->succinct)
+    _xml_reader_succinct_set_access_pattern (reader->priv->succinct, pattern);
+}
+
+/**
+ * xml_reader_set_deduplication:
+ * @reader: a #XmlReader
+ * @enabled: whether values should be deduplicated
+ * @max_length: the length of the longest value to deduplicate, in
+ *   bytes, or 0 for the default of 64
+ *
+ * Sets whether the documents loaded from now on by @reader share a
+ * single copy of each distinct text or attribute value no longer than
+ * @max_length. Documents repeating the same short values, like codes,
+ * enumerations or names, take less memory this way; the values are
+ * interned as each element is parsed, so duplicates never pile up.
+ *
+ * xml_reader_get_element_value() and xml_reader_get_attribute_value()
+ * then return the shared copies. The number of values deduplicated and
+ * the memory saved are part of the #XmlReaderStatistics.
+ *
+ * Values shorter than two pointers are stored inside their node by
+ * libxml2, and are left alone. Deduplication has no effect in succinct
+ * mode, where values are not stored at all.
+ */
+void
+xml_reader_set_deduplication (XmlReader *reader,
+                              gboolean   enabled,
+                              gsize      max_length)
+{
+  g_return_if_fail (XML_IS_READER (reader));
+
+  reader->priv->dedup = enabled != FALSE;
+  reader->priv->dedup_max_length = max_length > 0
+                                 ? max_length
+                                 : DEDUP_DEFAULT_MAX_LENGTH;
+}
+
+/**
+ * xml_reader_set_keep_source:
+ * @reader: a #XmlReader
+ * @keep_source: whether the source of the documents should be kept
+ *
+ * Sets whether @reader keeps the source of the documents it loads from
+ * now on, and records where each element starts and ends inside it.
+ * xml_reader_get_outer_xml() and xml_reader_get_inner_xml() then return
+ * slices of the source instead of serializing the elements again. The
+ * source of a file is its mapping; the source of a buffer is copied.
+ *
+ * The source is always kept in succinct mode.
+ */
+void
+xml_reader_set_keep_source (XmlReader *reader,
+                            gboolean   keep_source)
+{
+  g_return_if_fail (XML_IS_READER (reader));
+
+  reader->priv->keep_source = keep_source != FALSE;
+}
+
+/**
+ * xml_reader_set_bounded_memory:
+ * @reader: a #XmlReader
+ * @release_depth: the depth of the elements released once the cursor
+ *   leaves them, or 0 to parse the documents whole
+ * @memory_limit: the memory the elements of a document may take, in
+ *   bytes, or 0 for no limit
+ *
+ * Sets whether the documents loaded from now on by @reader are parsed
+ * as the cursor moves forward, instead of whole, and released behind
+ * it: an element at @release_depth is freed, with everything inside
+ * it, as soon as the cursor leaves it through
+ * xml_reader_read_end_element() or xml_reader_read_next_in_document().
+ * The root element is at depth 1, so the records of a file holding a
+ * list of them are released with a @release_depth of 2:
+ *
+ * |[
+ *   xml_reader_set_bounded_memory (reader, 2, 64 * 1024 * 1024);
+ *   xml_reader_load_from_file (reader, "catalog.xml", &amp;error);
+ *
+ *   xml_reader_read_start_element (reader, "catalog");
+ *   while (xml_reader_try_start_element (reader, "item"))
+ *     {
+ *       parse_item (reader);
+ *       xml_reader_read_end_element (reader);
+ *     }
+ * ]|
+ *
+ * The memory taken by a document then stays within the size of its
+ * largest record and of the elements enclosing it, plus the few
+ * records the parser reads ahead. As the elements left behind are
+ * gone, looking up an element finds the first one not released yet;
+ * counting elements, and reading the value or the XML of an element,
+ * parse it whole first. No indexes are built on these documents.
+ *
+ * The memory taken by the elements of the document, as estimated
+ * while parsing them, its peak and the number of subtrees released
+ * are part of the #XmlReaderStatistics. A document taking more than
+ * @memory_limit stops being parsed: loading it fails, or else the
+ * cursor movement that needed the rest of it fails, with the
+ * %XML_READER_ERROR_MEMORY_LIMIT error, and so do the following ones.
+ *
+ * Compressed files are decompressed as they are parsed, and the
+ * buffers loaded by xml_reader_load_from_vectors() are copied one at a
+ * time. The source of the documents is not kept, and loading a
+ * document fails with %XML_READER_ERROR_INVALID in succinct and
+ * out-of-core mode, which build no tree to release.
+ */
+void
+xml_reader_set_bounded_memory (XmlReader *reader,
+                               gint       release_depth,
+                               gsize      memory_limit)
+{
+  g_return_if_fail (XML_IS_READER (reader));
+  g_return_if_fail (release_depth >= 0);
+
+  reader->priv->release_depth = release_depth;
+  reader->priv->memory_limit = memory_limit;
+}
+
+/**
+ * xml_reader_set_limits:
+ * @reader: a #XmlReader
+ * @limits: the limits on the documents, or %NULL for none
+ *
+ * Sets the limits on the documents loaded from now on by @reader, for
+ * loading untrusted input: on the depth of the elements, the number of
+ * nodes, the attributes of an element, the length of the texts and
+ * attribute values and the text the entity references expand to.
+ *
+ * The limits are checked as the document is parsed, and the parser
+ * stops at the first one exceeded, without building the rest of the
+ * tree: loading the document fails with the error of that limit,
+ * %XML_READER_ERROR_DEPTH_LIMIT for instance. In bounded memory mode,
+ * the cursor movement that needed the rest of the document fails
+ * instead, see xml_reader_set_bounded_memory().
+ *
+ * The succinct mode only stores the elements, and so counts them
+ * alone as nodes; it does not expand the entities declared by the
+ * documents. libxml2 expands the references in attribute values
+ * itself, within its own limits, and they only count for the length
+ * of the values.
+ */
+void
+xml_reader_set_limits (XmlReader             *reader,
+                       const XmlReaderLimits *limits)
+{
+  XmlReaderPrivate *priv;
+
+  g_return_if_fail (XML_IS_READER (reader));
+
+  priv = reader->priv;
+
+  if (limits)
+    priv->limits = *limits;
+  else
+    memset (&priv->limits, 0, sizeof (XmlReaderLimits));
+
+  priv->has_limits = priv->limits.max_depth > 0 ||
+                     priv->limits.max_nodes > 0 ||
+                     priv->limits.max_attributes > 0 ||
+                     priv->limits.max_text_length > 0 ||
+                     priv->limits.max_entity_expansion > 0;
+}
+
+/**
+ * xml_reader_set_progress_func:
+ * @reader: a #XmlReader
+ * @interval: the time between two reports, in milliseconds
+ * @func: the function to report the progress to, or %NULL
+ * @user_data: the data to pass to @func
+ * @notify: the function to call on @user_data once @func is replaced,
+ *   or %NULL
+ *
+ * Sets the function told of the progress of @reader while it parses
+ * the documents it loads: of the bytes parsed, of the size of the
+ * document when known and of the number of elements parsed so far.
+ * @func is called at most every @interval milliseconds while parsing,
+ * and once more when the parser is done, so the progress of a large
+ * file can be displayed, and a stalled load noticed, while
+ * xml_reader_load_from_file() or xml_reader_load_step() runs.
+ *
+ * The clock is only looked at every few elements, and nothing is
+ * counted without a function, so that parsing costs the same as
+ * before. In bounded memory mode the document keeps being parsed as
+ * the cursor moves, and so keeps being reported. The succinct mode
+ * does not go through the parser, and reports nothing.
+ *
+ * @func must not load a document with @reader, nor move its cursor.
+ */
+void
+xml_reader_set_progress_func (XmlReader             *reader,
+                              guint                  interval,
+                              XmlReaderProgressFunc  func,
+                              gpointer               user_data,
+                              GDestroyNotify         notify)
+{
+  XmlReaderPrivate *priv;
+
+  g_return_if_fail (XML_IS_READER (reader));
+
+  priv = reader->priv;
+
+  if (priv->progress_notify)
+    priv->progress_notify (priv->progress_data);
+
+  priv->progress_func = func;
+  priv->progress_data = user_data;
+  priv->progress_notify = notify;
+  priv->progress_interval = (gint64) interval * 1000;
+  priv->progress_next = g_get_monotonic_time () + priv->progress_interval;
+}
+
+/**
+ * xml_reader_get_statistics:
+ * @reader: a #XmlReader
+ * @statistics: return location for the statistics
+ *
+ * Retrieves the lookup statistics of the document loaded by @reader,
+ * and the memory its elements take in bounded memory mode, see
+ * xml_reader_set_bounded_memory(). The statistics are reset every time
+ * a document is loaded, except for the memory of the followed file,
+ * which is the current one.
+ */
+void
+xml_reader_get_statistics (XmlReader           *reader,
+                           XmlReaderStatistics *statistics)
+{
+  g_return_if_fail (XML_IS_READER (reader));
+  g_return_if_fail (statistics != NULL);
+
+  *statistics = reader->priv->stats;
+
+  if (statistics->n_dedup_values > 0)
+    statistics->dedup_ratio = 1.0 - (gdouble) statistics->n_dedup_unique
+                                  / statistics->n_dedup_values;
+
+  if (reader->priv->follower != NULL)
+    statistics->follow_memory =
+      _xml_reader_follower_get_memory (reader->priv->follower);
+}
+
+/**
+ * xml_reader_get_index_report:
+ * @reader: a #XmlReader
+ *
+ * Describes the indexes that adaptive indexing built, or declined to
+ * build, for the loaded document, one line per index: the path of the
+ * element and the lookup costs that led to the decision. See
+ * xml_reader_set_adaptive_indexing().
+ *
+ * Return value: a newly allocated string. Use g_free() when done
+ */
+gchar *
+xml_reader_get_index_report (XmlReader *reader)
+{
+  XmlReaderPrivate *priv;
+  GString *report;
+  guint i;
+
+  g_return_val_if_fail (XML_IS_READER (reader), NULL);
+
+  priv = reader->priv;
+
+  report = g_string_new (NULL);
+
+  for (i = 0; i < priv->index_report->len; i++)
+    {
+      g_string_append (report, g_ptr_array_index (priv->index_report, i));
+      g_string_append_c (report, '\n');
+    }
+
+  if (priv->n_report_dropped > 0)
+    g_string_append_printf (report, "(%u more)\n", priv->n_report_dropped);
+
+  return g_string_free (report, FALSE);
+}
+
+/**
+ * xml_reader_read_start_element:
+ * @reader: a #XmlReader
+ * @element_name: the name of the element to position the cursor on
+ *
+ * Moves the internal cursor to the first element named @element_name
+ * inside the XML document object model.
+ *
+ * For instance, this example will find the &lt;book&gt; element and
+ * iterate over its children "author" and "copyright" and retrieve
+ * their value:
+ *
+ * |[
+ *   gchar *author, *title;
+ *
+ *   xml_reader_read_start_element (reader, "book");
+ *   xml_reader_read_start_element (reader, "author");
+ *   author = g_strdup (xml_reader_get_element_value (reader));
+ *   xml_reader_read_end_element (reader);
+ *   xml_reader_read_start_element (reader, "title");
+ *   title = g_strdup (xml_reader_get_element_value (reader));
+ *   xml_reader_read_end_element (reader);
+ *   xml_reader_read_end_element (reader);
+ *
+ *   g_print ("The author of the book '%s' is %s\n", author, title);
+ *   g_free (author);
+ *   g_free (title);
+ * ]|
+ *
+ * Return value: %TRUE if the cursor positioning was successful
+ */
+gboolean
+xml_reader_read_start_element (XmlReader   *reader,
+                               const gchar *element_name)
+{
+  xmlNodePtr node;
+
+  g_return_val_if_fail (XML_IS_READER (reader), FALSE);
+  g_return_val_if_fail (element_name != NULL, FALSE);
+
+  if (xml_reader_get_error (reader, NULL))
+    return FALSE;
+
+  if (reader->priv->succinct)
+    return _xml_reader_succinct_read_start_element (reader, element_name, FALSE);
+
+  node = xml_reader_find_element (reader, element_name);
+  if (node)
+    {
+      xml_reader_enter_element (reader, node);
+      return TRUE;
+    }
+
+  xml_reader_set_unknown_node (reader);
+
+  return FALSE;
+}
+
+/**
+ * xml_reader_try_start_element:
+ * @reader: a #XmlReader
+ * @element_name: the name of the element to position the cursor on
+ *
+ * Moves the internal cursor to the first element named @element_name,
+ * like xml_reader_read_start_element() does, but is meant for optional
+ * elements: if no such element exists the cursor stays where it was
+ * and @reader is not put in an error state, so no call to
+ * xml_reader_read_end_element() is needed to recover from the miss.
+ *
+ * |[
+ *   if (xml_reader_try_start_element (reader, "subtitle"))
+ *     {
+ *       subtitle = g_strdup (xml_reader_get_element_value (reader));
+ *       xml_reader_read_end_element (reader);
+ *     }
+ * ]|
+ *
+ * Return value: %TRUE if the cursor was moved on the element
+ */
+gboolean
+xml_reader_try_start_element (XmlReader   *reader,
+                              const gchar *element_name)
+{
+  xmlNodePtr node;
+
+  g_return_val_if_fail (XML_IS_READER (reader), FALSE);
+  g_return_val_if_fail (element_name != NULL, FALSE);
+
+  if (xml_reader_get_error (reader, NULL))
+    return FALSE;
+
+  if (reader->priv->succinct)
+    return _xml_reader_succinct_read_start_element (reader, element_name, TRUE);
+
+  node = xml_reader_find_element (reader, element_name);
+  if (!node)
+    return FALSE;
+
+  xml_reader_enter_element (reader, node);
+
+  return TRUE;
+}
+
+/**
+ * xml_reader_count_elements:
+ * @reader: a #XmlReader
+ * @element_name: the name of the elements to count, or %NULL
+ *
+ * Counts the child elements of the element the cursor is on that are
+ * named @element_name, or all of them if @element_name is %NULL. If the
+ * cursor has not been moved yet, the root element is counted.
+ *
+ * Together with xml_reader_read_nth_element() this allows sizing and
+ * slicing repeated elements without entering each of them:
+ *
+ * |[
+ *   n_items = xml_reader_count_elements (reader, "item");
+ *   items = g_new (Item, n_items);
+ *
+ *   for (i = 0; i < n_items; i++)
+ *     {
+ *       xml_reader_read_nth_element (reader, "item", i);
+ *       parse_item (reader, &amp;items[i]);
+ *       xml_reader_read_end_element (reader);
+ *     }
+ * ]|
+ *
+ * The children of an element are indexed by name the first time they
+ * are counted or accessed by position, after which both operations
+ * take constant time.
+ *
+ * Return value: the number of elements, or -1 on failure
+ */
+gint
+xml_reader_count_elements (XmlReader   *reader,
+                           const gchar *element_name)
+{
+  guint n_elements;
+
+  g_return_val_if_fail (XML_IS_READER (reader), -1);
+
+  if (xml_reader_get_error (reader, NULL))
+    return -1;
+
+  if (reader->priv->succinct)
+    return _xml_reader_succinct_count_elements (reader, element_name);
+
+  if (!reader->priv->current_doc)
+    return -1;
+
+  xml_reader_find_nth_element (reader, element_name, 0, &n_elements);
+
+  /* in bounded memory mode, the memory limit may have been hit */
+  if (reader->priv->error_state)
+    return -1;
+
+  return n_elements;
+}
+
+/**
+ * xml_reader_read_nth_element:
+ * @reader: a #XmlReader
+ * @element_name: the name of the element to position the cursor on,
+ *   or %NULL
+ * @index_: the position of the element among its siblings named
+ *   @element_name, or among all its siblings if @element_name is
+ *   %NULL, starting from 0
+ *
+ * Moves the internal cursor to the child element at position @index_,
+ * counting only the elements named @element_name if it is not %NULL.
+ * Like xml_reader_read_start_element(), a miss puts @reader in error
+ * state. See xml_reader_count_elements().
+ *
+ * Return value: %TRUE if the cursor positioning was successful
+ */
+gboolean
+xml_reader_read_nth_element (XmlReader   *reader,
+                             const gchar *element_name,
+                             gint         index_)
+{
+  xmlNodePtr node = NULL;
+  guint n_elements;
+
+  g_return_val_if_fail (XML_IS_READER (reader), FALSE);
+
+  if (xml_reader_get_error (reader, NULL))
+    return FALSE;
+
+  if (reader->priv->succinct)
+    return _xml_reader_succinct_read_nth_element (reader, element_name, index_);
+
+  if (!reader->priv->current_doc)
+    return FALSE;
+
+  if (index_ >= 0)
+    node = xml_reader_find_nth_element (reader, element_name, index_,
+                                        &n_elements);
+
+  if (node)
+    {
+      xml_reader_enter_element (reader, node);
+      return TRUE;
+    }
+
+  xml_reader_set_unknown_node (reader);
+
+  return FALSE;
+}
+
+/**
+ * xml_reader_read_end_element:
+ * @reader: a #XmlReader
+ *
+ * Positions the internal cursor at the end of the current element
+ */
+void
+xml_reader_read_end_element (XmlReader *reader)
+{
+  XmlReaderPrivate *priv;
+  xmlNodePtr left;
+
+  g_return_if_fail (XML_IS_READER (reader));
+
+  priv = reader->priv;
+
+  if (priv->succinct)
+    {
+      _xml_reader_succinct_read_end_element (reader);
+      return;
+    }
+
+  /* if we are in error state, end-element will unset the
+   * error state
+   */
+  if (xml_reader_get_error (reader, NULL))
+    {
+      priv->error_state = FALSE;
+      priv->node_cursor = priv->parent;
+      if (!priv->node_cursor)
+        {
+          priv->node_cursor = priv->current_doc->xmlRootNode;
+          priv->parent = NULL;
+        }
+      else
+        priv->parent = priv->node_cursor->parent;
+      return;
+    }
+
+  if (!priv->node_cursor)
+    {
+      g_warning ("No cursor set");
+      return;
+    }
+
+  if (priv->attr_value)
+    {
+      xmlFree (priv->attr_value);
+      priv->attr_value = NULL;
+    }
+
+  left = priv->node_cursor;
+
+  priv->depth -= 1;
+
+  priv->node_cursor = priv->parent;
+  priv->parent = priv->parent ? priv->parent->parent : NULL;
+
+  xml_reader_window_release (reader, left, priv->depth + 1);
+
+  if (!priv->node_cursor)
+    priv->node_cursor = priv->current_doc->xmlRootNode;
+
+  priv->attr_cursor = NULL;
+}
+
+/**
+ * xml_reader_read_next_in_document:
+ * @reader: a #XmlReader
+ *
+ * Moves the internal cursor to the element following the current one
+ * in document order: its first child element if it has one, otherwise
+ * the next sibling element of the closest ancestor that has one. When
+ * called before any other cursor movement, the cursor is moved to the
+ * root element.
+ *
+ * This allows visiting every element of the document without knowing
+ * their names in advance:
+ *
+ * |[
+ *   while (xml_reader_read_next_in_document (reader))
+ *     index_element (xml_reader_get_depth (reader),
+ *                    xml_reader_get_element_name (reader),
+ *                    xml_reader_get_element_value (reader));
+ * ]|
+ *
+ * The walk is iterative and allocates no memory. The depth and the
+ * attributes of the cursor are updated as with
+ * xml_reader_read_start_element(), so xml_reader_read_end_element() and
+ * the attributes API can be used on the element the cursor is on.
+ *
+ * Return value: %TRUE if the cursor was moved, and %FALSE at the end of
+ *   the document, in which case the cursor is put back before the root
+ *   element
  */
 gboolean
-xml_reader_get_error (XmlReader  *reader,
-                      GError    **error)
+xml_reader_read_next_in_document (XmlReader *reader)
 {
+  XmlReaderPrivate *priv;
+  xmlNodePtr node, next;
+  gint depth;
+
   g_return_val_if_fail (XML_IS_READER (reader), FALSE);
 
-  if (error && *error == NULL)
-    g_set_error (error, XML_READER_ERROR,
-                 reader->priv->last_error,
-                 "XmlReader error");
+  if (xml_reader_get_error (reader, NULL))
+    return FALSE;
 
-  return reader->priv->error_state;
+  priv = reader->priv;
+
+  if (priv->succinct)
+    return _xml_reader_succinct_read_next_in_document (reader);
+
+  if (!priv->current_doc)
+    return FALSE;
+
+  node = priv->node_cursor;
+  depth = priv->depth;
+
+  if (!node)
+    {
+      next = xml_reader_next_element (reader, (xmlNodePtr) priv->current_doc, NULL);
+      depth = 0;
+    }
+  else
+    next = xml_reader_next_element (reader, node, NULL);
+
+  /* descend into the first element child, if any */
+  if (next != NULL)
+    {
+      xml_reader_set_cursor (reader, next, depth + 1);
+      return TRUE;
+    }
+
+  /* otherwise move to the next sibling element of the closest ancestor
+   * that has one, releasing the subtrees left behind in bounded memory
+   * mode
+   */
+  while (node != NULL && node->type == XML_ELEMENT_NODE)
+    {
+      xmlNodePtr parent = node->parent;
+
+      next = xml_reader_next_element (reader, parent, node);
+
+      if (next == NULL && priv->error_state)
+        return FALSE;
+
+      xml_reader_window_release (reader, node, depth);
+
+      if (next != NULL)
+        {
+          xml_reader_set_cursor (reader, next, depth);
+          return TRUE;
+        }
+
+      node = parent;
+      depth -= 1;
+    }
+
+  if (priv->error_state)
+    return FALSE;
+
+  priv->node_cursor = NULL;
+  priv->parent = priv->current_doc->xmlRootNode;
+  priv->attr_cursor = NULL;
+  priv->depth = 0;
+
+  return FALSE;
 }
 
 /**
- * xml_reader_read_start_element:
+ * xml_reader_get_depth:
  * @reader: a #XmlReader
- * @element_name: the name of the element to position the cursor on
  *
- * Moves the internal cursor to the first element named @element_name
- * inside the XML document object model.
+ * Retrieves the depth of the element the cursor is currently on; the
+ * root element is at depth 1.
  *
- * For instance, this example will find the &lt;book&gt; element and
- * iterate over its children "author" and "copyright" and retrieve
- * their value:
+ * Return value: the depth of the cursor, or 0 if the cursor is not on
+ *   an element
+ */
+gint
+xml_reader_get_depth (XmlReader *reader)
+{
+  g_return_val_if_fail (XML_IS_READER (reader), 0);
+
+  if (xml_reader_get_error (reader, NULL))
+    return 0;
+
+  if (reader->priv->succinct)
+    return _xml_reader_succinct_get_depth (reader);
+
+  if (!reader->priv->node_cursor)
+    return 0;
+
+  return reader->priv->depth;
+}
+
+/**
+ * xml_reader_get_element_name:
+ * @reader: a #XmlReader
  *
- * |[
- *   gchar *author, *title;
+ * Retrieves the name of the element the cursor is currently on.
  *
- *   xml_reader_read_start_element (reader, "book");
- *   xml_reader_read_start_element (reader, "author");
- *   author = g_strdup (xml_reader_get_element_value (reader));
- *   xml_reader_read_end_element (reader);
- *   xml_reader_read_start_element (reader, "title");
- *   title = g_strdup (xml_reader_get_element_value (reader));
- *   xml_reader_read_end_element (reader);
- *   xml_reader_read_end_element (reader);
+ * Return value: the name of the current element. The string is owned
+ *   by the #XmlReader instance and should never be modified or freed.
+ */
+G_CONST_RETURN gchar *
+xml_reader_get_element_name (XmlReader *reader)
+{
+  XmlReaderPrivate *priv;
+
+  g_return_val_if_fail (XML_IS_READER (reader), NULL);
+
+  priv = reader->priv;
+
+  if (xml_reader_get_error (reader, NULL))
+    return NULL;
+
+  if (priv->succinct)
+    return _xml_reader_succinct_get_element_name (reader);
+
+  if (priv->node_cursor)
+    return XML_TO_CHAR (priv->node_cursor->name);
+
+  return NULL;
+}
+
+/**
+ * xml_reader_get_element_value:
+ * @reader: a #XmlReader
  *
- *   g_print ("The author of the book '%s' is %s\n", author, title);
- *   g_free (author);
- *   g_free (title);
- * ]|
+ * Retrieves the value of the element the cursor is currently on, that
+ * is the text it starts with.
  *
- * Return value: %TRUE if the cursor positioning was successful
+ * Return value: the value of the current element. The string is owned
+ *   by the #XmlReader instance and should never be modified or freed.
  */
-gboolean
-xml_reader_read_start_element (XmlReader   *reader,
-                               const gchar *element_name)
+G_CONST_RETURN gchar *
+xml_reader_get_element_value (XmlReader *reader)
 {
   XmlReaderPrivate *priv;
-  xmlNodePtr cursor, node;
+  xmlNodePtr child;
 
-  g_return_val_if_fail (XML_IS_READER (reader), FALSE);
-  g_return_val_if_fail (element_name != NULL, FALSE);
+  g_return_val_if_fail (XML_IS_READER (reader), NULL);
+
+  priv = reader->priv;
+
+  if (xml_reader_get_error (reader, NULL))
+    return NULL;
+
+  if (priv->succinct)
+    return _xml_reader_succinct_get_element_value (reader);
+
+  if (!priv->node_cursor)
+    return NULL;
+
+  /* the text node content is handed out as it is, without copies; in
+   * bounded memory mode, the text is complete once something follows
+   * it, or once the element ends
+   */
+  child = priv->node_cursor->xmlChildrenNode;
+  while ((child == NULL || (child->next == NULL && xmlNodeIsText (child))) &&
+         xml_reader_window_is_open (reader, priv->node_cursor))
+    {
+      if (!xml_reader_window_feed (reader))
+        return NULL;
+
+      child = priv->node_cursor->xmlChildrenNode;
+    }
+
+  if (child && xmlNodeIsText (child))
+    return XML_TO_CHAR (child->content);
+
+  return NULL;
+}
+
+/* finds the outer or inner XML of the current element inside the kept
+ * source
+ */
+static gboolean
+xml_reader_get_xml_range (XmlReader *reader,
+                          gboolean   inner,
+                          gsize     *start,
+                          gsize     *end)
+{
+  XmlReaderPrivate *priv = reader->priv;
+  XmlReaderNodeInfo *info;
+
+  if (priv->succinct)
+    return _xml_reader_succinct_get_xml_range (reader, inner, start, end);
+
+  if (!priv->has_offsets)
+    return FALSE;
+
+  info = priv->node_cursor->_private;
+  if (info == NULL || !info->has_offsets)
+    return FALSE;
+
+  *start = info->outer_start;
+  *end = info->outer_end;
+
+  if (inner)
+    {
+      *start += info->start_tag_len;
+      *end -= info->end_tag_len;
+    }
+
+  return TRUE;
+}
+
+/* serializes the outer or inner XML of the current element */
+static GBytes *
+xml_reader_dump_xml (XmlReader *reader,
+                     gboolean   inner)
+{
+  XmlReaderPrivate *priv = reader->priv;
+  xmlBufferPtr buffer;
+  GBytes *retval;
+
+  if (!xml_reader_window_complete (reader, priv->node_cursor))
+    return NULL;
+
+  buffer = xmlBufferCreate ();
+
+  if (!inner)
+    xmlNodeDump (buffer, priv->current_doc, priv->node_cursor, 0, 0);
+  else
+    {
+      xmlNodePtr child;
+
+      for (child = priv->node_cursor->xmlChildrenNode;
+           child != NULL;
+           child = child->next)
+        xmlNodeDump (buffer, priv->current_doc, child, 0, 0);
+    }
+
+  retval = g_bytes_new (xmlBufferContent (buffer), xmlBufferLength (buffer));
+
+  xmlBufferFree (buffer);
+
+  return retval;
+}
+
+static const gchar *
+xml_reader_get_xml (XmlReader *reader,
+                    gboolean   inner,
+                    gsize     *length)
+{
+  XmlReaderPrivate *priv = reader->priv;
+  gsize start, end, size;
+  const gchar *data;
+
+  if (xml_reader_get_error (reader, NULL))
+    return NULL;
+
+  if (!priv->succinct && !priv->node_cursor)
+    return NULL;
+
+  if (xml_reader_get_xml_range (reader, inner, &start, &end))
+    {
+      if (length)
+        *length = end - start;
+
+      return (const gchar *) g_bytes_get_data (priv->source, NULL) + start;
+    }
+
+  if (priv->succinct)
+    return NULL;
+
+  if (priv->xml_copy)
+    g_bytes_unref (priv->xml_copy);
+
+  priv->xml_copy = xml_reader_dump_xml (reader, inner);
+  if (!priv->xml_copy)
+    return NULL;
+
+  data = g_bytes_get_data (priv->xml_copy, &size);
+  if (length)
+    *length = size;
+
+  return data;
+}
+
+static GBytes *
+xml_reader_get_xml_bytes (XmlReader *reader,
+                          gboolean   inner)
+{
+  XmlReaderPrivate *priv = reader->priv;
+  gsize start, end;
 
   if (xml_reader_get_error (reader, NULL))
-    return FALSE;
+    return NULL;
 
-  priv = reader->priv;
+  if (!priv->succinct && !priv->node_cursor)
+    return NULL;
 
-  cursor = priv->node_cursor;
-  if (!cursor)
-    cursor = priv->current_doc->xmlRootNode;
-  else
-    cursor = cursor->xmlChildrenNode;
+  if (xml_reader_get_xml_range (reader, inner, &start, &end))
+    return g_bytes_new_from_bytes (priv->source, start, end - start);
+
+  if (priv->succinct)
+    return NULL;
 
-  for (node = cursor;
-       node != NULL;
-       node = node->next)
+  return xml_reader_dump_xml (reader, inner);
+}
+
+/* finds the value of @attr inside the start tag of its element */
+static gboolean
+xml_reader_find_attribute (const gchar *tag,
+                           gsize        tag_len,
+                           xmlAttrPtr   attr,
+                           gsize       *start,
+                           gsize       *end)
+{
+  const gchar *tag_end = tag + tag_len;
+  const gchar *prefix = NULL;
+  gsize prefix_len = 0, name_len = xmlStrlen (attr->name);
+  const gchar *p = tag + 1;
+
+  if (attr->ns != NULL && attr->ns->prefix != NULL)
     {
-      if (node->type == XML_ELEMENT_NODE &&
-          node->name != NULL &&
-          strcmp (XML_TO_CHAR (node->name), element_name) == 0)
-        {
-          xmlNodePtr child;
+      prefix = XML_TO_CHAR (attr->ns->prefix);
+      prefix_len = strlen (prefix);
+    }
 
-          priv->parent = priv->node_cursor;
-          priv->node_cursor = node;
-          priv->depth += 1;
+  /* the element name */
+  while (p < tag_end && !g_ascii_isspace (*p) && *p != '/' && *p != '>')
+    p += 1;
 
-          /* preload the text, if any */
-          child = priv->node_cursor->xmlChildrenNode;
-          if (child && xmlNodeIsText (child))
-            {
-              if (priv->cursor_value)
-                xmlFree (priv->cursor_value);
+  while (p < tag_end)
+    {
+      const gchar *name, *quote;
+      gsize len;
 
-              priv->cursor_value = xmlNodeGetContent (child);
-            }
+      while (p < tag_end && g_ascii_isspace (*p))
+        p += 1;
 
-          /* unset the attributes cache */
-          priv->attr_cursor = priv->node_cursor->properties;
-          if (priv->attr_value)
-            {
-              xmlFree (priv->attr_value);
-              priv->attr_value = NULL;
-            }
+      if (p == tag_end || *p == '/' || *p == '>')
+        break;
+
+      name = p;
+      while (p < tag_end && !g_ascii_isspace (*p) && *p != '=')
+        p += 1;
+      len = p - name;
+
+      while (p < tag_end && *p != '"' && *p != '\'')
+        p += 1;
+
+      if (p == tag_end)
+        break;
+
+      quote = memchr (p + 1, *p, tag_end - p - 1);
+      if (quote == NULL)
+        break;
 
+      if (prefix != NULL
+          ? (len == prefix_len + 1 + name_len &&
+             memcmp (name, prefix, prefix_len) == 0 &&
+             name[prefix_len] == ':' &&
+             memcmp (name + prefix_len + 1, attr->name, name_len) == 0)
+          : (len == name_len && memcmp (name, attr->name, name_len) == 0))
+        {
+          *start = p + 1 - tag;
+          *end = quote - tag;
           return TRUE;
         }
-    }
 
-  priv->error_state = TRUE;
-  priv->last_error = XML_READER_ERROR_UNKNOWN_NODE;
-  priv->parent = priv->node_cursor;
-  if (!priv->parent)
-    priv->parent = priv->current_doc->xmlRootNode;
-  priv->node_cursor = NULL;
-  priv->attr_cursor = NULL;
+      p = quote + 1;
+    }
 
   return FALSE;
 }
 
-/**
- * xml_reader_read_end_element:
- * @reader: a #XmlReader
- *
- * Positions the internal cursor at the end of the current element
+/* finds the value of the current element or attribute inside the kept
+ * source, if it is there as it is
  */
-void
-xml_reader_read_end_element (XmlReader *reader)
+static gboolean
+xml_reader_get_value_range (XmlReader   *reader,
+                            gboolean     attribute,
+                            const gchar *value,
+                            gsize       *start,
+                            gsize       *end)
 {
-  XmlReaderPrivate *priv;
+  XmlReaderPrivate *priv = reader->priv;
+  XmlReaderNodeInfo *info;
+  const gchar *source;
+  gsize len;
 
-  g_return_if_fail (XML_IS_READER (reader));
+  if (priv->succinct)
+    return _xml_reader_succinct_get_value_range (reader, attribute, start, end);
 
-  priv = reader->priv;
+  if (!priv->has_offsets)
+    return FALSE;
 
-  /* if we are in error state, end-element will unset the
-   * error state
-   */
-  if (xml_reader_get_error (reader, NULL))
-    {
-      priv->error_state = FALSE;
-      priv->node_cursor = priv->parent;
-      if (!priv->node_cursor)
-        {
-          priv->node_cursor = priv->current_doc->xmlRootNode;
-          priv->parent = NULL;
-        }
-      else
-        priv->parent = priv->node_cursor->parent;
-      return;
-    }
+  info = priv->node_cursor->_private;
+  if (info == NULL || !info->has_offsets)
+    return FALSE;
 
-  if (!priv->node_cursor)
-    {
-      g_warning ("No cursor set");
-      return;
-    }
+  source = g_bytes_get_data (priv->source, NULL);
 
-  if (priv->cursor_value)
+  if (!attribute)
+    *start = info->outer_start + info->start_tag_len;
+  else
     {
-      xmlFree (priv->cursor_value);
-      priv->cursor_value = NULL;
-    }
+      gsize attr_start, attr_end;
 
-  if (priv->attr_value)
-    {
-      xmlFree (priv->attr_value);
-      priv->attr_value = NULL;
+      if (!xml_reader_find_attribute (source + info->outer_start,
+                                      info->start_tag_len,
+                                      priv->attr_cursor,
+                                      &attr_start, &attr_end))
+        return FALSE;
+
+      *start = info->outer_start + attr_start;
+      if (attr_end - attr_start != strlen (value))
+        return FALSE;
     }
 
-  priv->depth -= 1;
+  len = strlen (value);
+  *end = *start + len;
 
-  priv->node_cursor = priv->parent;
-  priv->parent = priv->parent ? priv->parent->parent : NULL;
+  /* references and line ends were replaced while parsing */
+  return *end <= info->outer_end && memcmp (source + *start, value, len) == 0;
+}
 
-  if (!priv->node_cursor)
-    priv->node_cursor = priv->current_doc->xmlRootNode;
+static GBytes *
+xml_reader_get_value_bytes (XmlReader *reader,
+                            gboolean   attribute)
+{
+  const gchar *value;
+  gsize start, end;
 
-  priv->attr_cursor = NULL;
+  if (attribute)
+    value = xml_reader_get_attribute_value (reader);
+  else
+    value = xml_reader_get_element_value (reader);
+
+  if (value == NULL)
+    return NULL;
+
+  if (xml_reader_get_value_range (reader, attribute, value, &start, &end))
+    return g_bytes_new_from_bytes (reader->priv->source, start, end - start);
+
+  return g_bytes_new (value, strlen (value));
 }
 
 /**
- * xml_reader_get_element_name:
+ * xml_reader_get_element_value_bytes:
  * @reader: a #XmlReader
  *
- * Retrieves the name of the element the cursor is currently on.
+ * Retrieves the value of the element the cursor is currently on, like
+ * xml_reader_get_element_value() does, as a #GBytes, which is not
+ * terminated by a %NULL.
  *
- * Return value: the name of the current element. The string is owned
- *   by the #XmlReader instance and should never be modified or freed.
+ * If the source of the document is kept, see xml_reader_load_from_bytes()
+ * and xml_reader_set_keep_source(), and the value needed no unescaping,
+ * the returned #GBytes is a slice of the source; otherwise it holds a
+ * copy of the value.
+ *
+ * Return value: the value of the current element, or %NULL. Use
+ *   g_bytes_unref() when done using it.
  */
-G_CONST_RETURN gchar *
-xml_reader_get_element_name (XmlReader *reader)
+GBytes *
+xml_reader_get_element_value_bytes (XmlReader *reader)
 {
-  XmlReaderPrivate *priv;
-
   g_return_val_if_fail (XML_IS_READER (reader), NULL);
 
-  priv = reader->priv;
-
-  if (xml_reader_get_error (reader, NULL))
-    return NULL;
+  return xml_reader_get_value_bytes (reader, FALSE);
+}
 
-  if (priv->node_cursor)
-    return XML_TO_CHAR (priv->node_cursor->name);
+/**
+ * xml_reader_get_outer_xml:
+ * @reader: a #XmlReader
+ * @length: return location for the length of the XML, or %NULL
+ *
+ * Retrieves the XML of the element the cursor is currently on, tags
+ * included. If the source of the document is kept, see
+ * xml_reader_set_keep_source(), the XML is the slice of the source
+ * spanning the element, exactly as it was written; otherwise, or if
+ * the source had to be converted to UTF-8 or repaired while parsing,
+ * the element is serialized again.
+ *
+ * Return value: the XML of the current element, which is not
+ *   terminated by a %NULL. The data is owned by the #XmlReader instance,
+ *   and is valid until the next call to this function or to
+ *   xml_reader_get_inner_xml(), or until another document is loaded.
+ */
+G_CONST_RETURN gchar *
+xml_reader_get_outer_xml (XmlReader *reader,
+                          gsize     *length)
+{
+  g_return_val_if_fail (XML_IS_READER (reader), NULL);
 
-  return NULL;
+  return xml_reader_get_xml (reader, FALSE, length);
 }
 
 /**
- * xml_reader_get_element_value:
+ * xml_reader_get_inner_xml:
  * @reader: a #XmlReader
+ * @length: return location for the length of the XML, or %NULL
  *
- * Retrieves the value of the element the cursor is currently on.
+ * Retrieves the XML of the content of the element the cursor is
+ * currently on, tags excluded. See xml_reader_get_outer_xml().
  *
- * Return value: the value of the current element. The string is owned
- *   by the #XmlReader instance and should never be modified or freed.
+ * Return value: the XML of the content of the current element, which is
+ *   not terminated by a %NULL. The data is owned by the #XmlReader
+ *   instance, and is valid until the next call to this function or to
+ *   xml_reader_get_outer_xml(), or until another document is loaded.
  */
 G_CONST_RETURN gchar *
-xml_reader_get_element_value (XmlReader *reader)
+xml_reader_get_inner_xml (XmlReader *reader,
+                          gsize     *length)
 {
-  XmlReaderPrivate *priv;
-
   g_return_val_if_fail (XML_IS_READER (reader), NULL);
 
-  priv = reader->priv;
+  return xml_reader_get_xml (reader, TRUE, length);
+}
 
-  if (xml_reader_get_error (reader, NULL))
-    return NULL;
+/**
+ * xml_reader_get_outer_xml_bytes:
+ * @reader: a #XmlReader
+ *
+ * Retrieves the XML of the element the cursor is currently on, like
+ * xml_reader_get_outer_xml() does. If the source of the document is
+ * kept, the returned #GBytes shares it, mapping included, without
+ * copies, and keeps it alive after the @reader moves on.
+ *
+ * Return value: the XML of the current element. Use g_bytes_unref()
+ *   when done using it.
+ */
+GBytes *
+xml_reader_get_outer_xml_bytes (XmlReader *reader)
+{
+  g_return_val_if_fail (XML_IS_READER (reader), NULL);
 
-  if (priv->cursor_value)
-    return XML_TO_CHAR (priv->cursor_value);
+  return xml_reader_get_xml_bytes (reader, FALSE);
+}
 
-  return NULL;
+/**
+ * xml_reader_get_inner_xml_bytes:
+ * @reader: a #XmlReader
+ *
+ * Retrieves the XML of the content of the element the cursor is
+ * currently on, like xml_reader_get_inner_xml() does, as a #GBytes. See
+ * xml_reader_get_outer_xml_bytes().
+ *
+ * Return value: the XML of the content of the current element. Use
+ *   g_bytes_unref() when done using it.
+ */
+GBytes *
+xml_reader_get_inner_xml_bytes (XmlReader *reader)
+{
+  g_return_val_if_fail (XML_IS_READER (reader), NULL);
+
+  return xml_reader_get_xml_bytes (reader, TRUE);
 }
 
 /**
@@ -527,6 +5507,9 @@ xml_reader_has_attributes (XmlReader *reader)
 
   priv = reader->priv;
 
+  if (priv->succinct)
+    return _xml_reader_succinct_count_attributes (reader) > 0;
+
   if (!priv->node_cursor)
     {
       g_warning ("No cursor set");
@@ -558,6 +5541,9 @@ xml_reader_count_attributes (XmlReader *reader)
 
   priv = reader->priv;
 
+  if (priv->succinct)
+    return _xml_reader_succinct_count_attributes (reader);
+
   if (!priv->node_cursor)
     return -1;
 
@@ -596,6 +5582,9 @@ xml_reader_read_attribute_pos (XmlReader *reader,
 
   priv = reader->priv;
 
+  if (priv->succinct)
+    return _xml_reader_succinct_read_attribute_pos (reader, index_);
+
   if (!priv->node_cursor)
     return FALSE;
 
@@ -609,6 +5598,10 @@ xml_reader_read_attribute_pos (XmlReader *reader,
       if (i == index_)
         {
           priv->attr_cursor = attr;
+
+          if (priv->attr_value)
+            xmlFree (priv->attr_value);
+
           priv->attr_value = xmlGetProp (priv->node_cursor, attr->name);
 
           return TRUE;
@@ -663,6 +5656,9 @@ xml_reader_read_attribute_name (XmlReader   *reader,
 
   priv = reader->priv;
 
+  if (priv->succinct)
+    return _xml_reader_succinct_read_attribute_name (reader, attribute_name);
+
   if (!priv->node_cursor)
     return FALSE;
 
@@ -676,6 +5672,10 @@ xml_reader_read_attribute_name (XmlReader   *reader,
       if (strcmp (XML_TO_CHAR (attr->name), attribute_name) == 0)
         {
           priv->attr_cursor = attr;
+
+          if (priv->attr_value)
+            xmlFree (priv->attr_value);
+
           priv->attr_value = xmlGetProp (priv->node_cursor, attr->name);
 
           return TRUE;
@@ -702,9 +5702,261 @@ xml_reader_get_attribute_value (XmlReader *reader)
 
   priv = reader->priv;
 
+  if (priv->succinct)
+    return _xml_reader_succinct_get_attribute_value (reader);
+
   return XML_TO_CHAR (priv->attr_value);
 }
 
+/**
+ * xml_reader_get_attribute_value_bytes:
+ * @reader: a #XmlReader
+ *
+ * Retrieves the value of the currently read attribute, like
+ * xml_reader_get_attribute_value() does, as a #GBytes. See
+ * xml_reader_get_element_value_bytes().
+ *
+ * Return value: the content of the attribute, or %NULL. Use
+ *   g_bytes_unref() when done using it.
+ */
+GBytes *
+xml_reader_get_attribute_value_bytes (XmlReader *reader)
+{
+  g_return_val_if_fail (XML_IS_READER (reader), NULL);
+
+  return xml_reader_get_value_bytes (reader, TRUE);
+}
+
+/* returns the value of @attr, borrowed from its text node whenever the
+ * value is made of a single one, or copied in @copy otherwise
+ */
+const gchar *
+_xml_reader_peek_attribute_value (xmlAttrPtr   attr,
+                                  xmlChar    **copy)
+{
+  xmlNodePtr child = attr->children;
+
+  *copy = NULL;
+
+  if (child == NULL)
+    return "";
+
+  if (child->next == NULL && child->type == XML_TEXT_NODE)
+    return XML_TO_CHAR (child->content);
+
+  *copy = xmlNodeListGetString (attr->doc, child, 1);
+
+  return XML_TO_CHAR (*copy);
+}
+
+/* visits the attributes of the element under the cursor */
+static XmlReaderVisitResult
+xml_reader_walk_attributes (XmlReader              *reader,
+                            xmlNodePtr              node,
+                            const XmlReaderVisitor *visitor,
+                            gpointer                user_data)
+{
+  XmlReaderVisitResult res = XML_READER_VISIT_CONTINUE;
+  xmlAttrPtr attr;
+
+  for (attr = node->properties;
+       attr != NULL && res == XML_READER_VISIT_CONTINUE;
+       attr = attr->next)
+    {
+      const gchar *value;
+      xmlChar *copy;
+
+      reader->priv->attr_cursor = attr;
+
+      value = _xml_reader_peek_attribute_value (attr, &copy);
+      res = visitor->attribute (reader, XML_TO_CHAR (attr->name), value,
+                                user_data);
+
+      if (copy)
+        xmlFree (copy);
+    }
+
+  reader->priv->attr_cursor = node->properties;
+
+  return res;
+}
+
+/**
+ * xml_reader_walk:
+ * @reader: a #XmlReader
+ * @visitor: the callbacks to invoke
+ * @user_data: data to pass to the callbacks
+ *
+ * Walks the element the cursor is on and everything inside it, or the
+ * whole document if the cursor has not been moved yet, invoking the
+ * callbacks of @visitor for each element, attribute and text node in
+ * document order.
+ *
+ * This is a faster alternative to driving the cursor from the outside
+ * when every node has to be inspected: the walk runs in a single loop
+ * inside the library, without recursion. While a callback runs the
+ * cursor is on the element being visited, so the cursor accessors,
+ * like xml_reader_get_depth(), can be used; the cursor must not be
+ * moved by the callbacks, and it is put back where it was once the
+ * walk is over.
+ *
+ * A callback returning %XML_READER_VISIT_SKIP_SUBTREE makes the walk
+ * skip whatever is left of the current element; the @leave_element
+ * callback is still invoked for it. A callback returning
+ * %XML_READER_VISIT_STOP ends the walk.
+ *
+ * Return value: %TRUE if the walk reached the end, and %FALSE if it was
+ *   stopped by a callback or if @reader is in an error state
+ */
+gboolean
+xml_reader_walk (XmlReader              *reader,
+                 const XmlReaderVisitor *visitor,
+                 gpointer                user_data)
+{
+  XmlReaderPrivate *priv;
+  XmlReaderVisitResult res;
+  xmlNodePtr saved_cursor, saved_parent, root, node;
+  xmlAttrPtr saved_attr_cursor;
+  xmlChar *saved_attr_value;
+  gint saved_depth, depth;
+  gboolean retval = FALSE;
+
+  g_return_val_if_fail (XML_IS_READER (reader), FALSE);
+  g_return_val_if_fail (visitor != NULL, FALSE);
+
+  if (xml_reader_get_error (reader, NULL))
+    return FALSE;
+
+  priv = reader->priv;
+
+  if (priv->succinct)
+    {
+      g_warning ("%s: Walking is not available in succinct mode", G_STRLOC);
+      return FALSE;
+    }
+
+  if (!priv->current_doc)
+    return FALSE;
+
+  /* in bounded memory mode, the walk needs the whole subtree */
+  if (!xml_reader_window_complete (reader,
+                                   priv->node_cursor != NULL
+                                     ? priv->node_cursor
+                                     : xmlDocGetRootElement (priv->current_doc)))
+    return FALSE;
+
+  saved_cursor = priv->node_cursor;
+  saved_parent = priv->parent;
+  saved_attr_cursor = priv->attr_cursor;
+  saved_attr_value = priv->attr_value;
+  saved_depth = priv->depth;
+
+  priv->attr_value = NULL;
+
+  if (saved_cursor)
+    {
+      root = saved_cursor;
+      depth = saved_depth;
+    }
+  else
+    {
+      root = xmlDocGetRootElement (priv->current_doc);
+      depth = 1;
+    }
+
+  node = root;
+  while (node != NULL)
+    {
+      gboolean descend = FALSE;
+
+      if (node->type == XML_ELEMENT_NODE)
+        {
+          xml_reader_set_cursor (reader, node, depth);
+
+          res = XML_READER_VISIT_CONTINUE;
+          if (visitor->enter_element)
+            res = visitor->enter_element (reader, XML_TO_CHAR (node->name),
+                                          user_data);
+
+          if (res == XML_READER_VISIT_CONTINUE && visitor->attribute)
+            res = xml_reader_walk_attributes (reader, node, visitor, user_data);
+
+          if (res == XML_READER_VISIT_STOP)
+            goto out;
+
+          descend = (res == XML_READER_VISIT_CONTINUE &&
+                     node->xmlChildrenNode != NULL);
+        }
+      else if (visitor->text &&
+               (node->type == XML_TEXT_NODE ||
+                node->type == XML_CDATA_SECTION_NODE))
+        {
+          res = visitor->text (reader, XML_TO_CHAR (node->content), user_data);
+          if (res == XML_READER_VISIT_STOP)
+            goto out;
+
+          /* skip the rest of the enclosing element */
+          if (res == XML_READER_VISIT_SKIP_SUBTREE)
+            {
+              node = node->parent;
+              depth -= 1;
+            }
+        }
+
+      if (descend)
+        {
+          node = node->xmlChildrenNode;
+          depth += 1;
+          continue;
+        }
+
+      /* leave the nodes that are done, climbing up until one of them
+       * has a sibling left to visit
+       */
+      while (TRUE)
+        {
+          if (node->type == XML_ELEMENT_NODE && visitor->leave_element)
+            {
+              xml_reader_set_cursor (reader, node, depth);
+
+              res = visitor->leave_element (reader, XML_TO_CHAR (node->name),
+                                            user_data);
+              if (res == XML_READER_VISIT_STOP)
+                goto out;
+            }
+
+          if (node == root)
+            {
+              node = NULL;
+              break;
+            }
+
+          if (node->next != NULL)
+            {
+              node = node->next;
+              break;
+            }
+
+          node = node->parent;
+          depth -= 1;
+        }
+    }
+
+  retval = TRUE;
+
+out:
+  if (priv->attr_value)
+    xmlFree (priv->attr_value);
+
+  priv->node_cursor = saved_cursor;
+  priv->parent = saved_parent;
+  priv->attr_cursor = saved_attr_cursor;
+  priv->attr_value = saved_attr_value;
+  priv->depth = saved_depth;
+
+  return retval;
+}
+
 GQuark
 xml_reader_error_quark (void)
 {
@@ -42,20 +42,73 @@ G_BEGIN_DECLS
  * @XML_READER_ERROR_INVALID: Invalid XML
  * @XML_READER_ERROR_UNKNOWN_NODE: The requested node was not found
  * @XML_READER_ERROR_EMPTY_FILE: The parsed file was empty
+ * @XML_READER_ERROR_MEMORY_LIMIT: The document took more memory than
+ *   allowed, see xml_reader_set_bounded_memory()
+ * @XML_READER_ERROR_DEPTH_LIMIT: The elements of the document were nested
+ *   deeper than allowed, see xml_reader_set_limits()
+ * @XML_READER_ERROR_NODE_LIMIT: The document had more nodes than allowed
+ * @XML_READER_ERROR_ATTRIBUTE_LIMIT: An element had more attributes than
+ *   allowed
+ * @XML_READER_ERROR_TEXT_LIMIT: A text or an attribute value was longer
+ *   than allowed
+ * @XML_READER_ERROR_ENTITY_LIMIT: The entity references of the document
+ *   expanded to more text than allowed
  *
  * #XmlReader error enumeration.
  */
 typedef enum {
   XML_READER_ERROR_INVALID,
   XML_READER_ERROR_UNKNOWN_NODE,
-  XML_READER_ERROR_EMPTY_FILE
+  XML_READER_ERROR_EMPTY_FILE,
+  XML_READER_ERROR_MEMORY_LIMIT,
+  XML_READER_ERROR_DEPTH_LIMIT,
+  XML_READER_ERROR_NODE_LIMIT,
+  XML_READER_ERROR_ATTRIBUTE_LIMIT,
+  XML_READER_ERROR_TEXT_LIMIT,
+  XML_READER_ERROR_ENTITY_LIMIT
 } XmlReaderError;
 
 GQuark xml_reader_error_quark (void);
 
+/**
+ * XmlReaderVisitResult:
+ * @XML_READER_VISIT_CONTINUE: Keep walking
+ * @XML_READER_VISIT_SKIP_SUBTREE: Skip whatever is left of the element
+ *   being visited: its attributes and its content
+ * @XML_READER_VISIT_STOP: Stop the walk
+ *
+ * Return values of the #XmlReaderVisitor callbacks.
+ */
+typedef enum {
+  XML_READER_VISIT_CONTINUE,
+  XML_READER_VISIT_SKIP_SUBTREE,
+  XML_READER_VISIT_STOP
+} XmlReaderVisitResult;
+
+/**
+ * XmlReaderAccessPattern:
+ * @XML_READER_ACCESS_NORMAL: No particular access pattern
+ * @XML_READER_ACCESS_SEQUENTIAL: The document is mostly read in
+ *   document order, for instance with
+ *   xml_reader_read_next_in_document()
+ * @XML_READER_ACCESS_RANDOM: The document is mostly read by looking up
+ *   elements in no particular order
+ *
+ * The ways of moving the cursor, see xml_reader_set_access_pattern().
+ */
+typedef enum {
+  XML_READER_ACCESS_NORMAL,
+  XML_READER_ACCESS_SEQUENTIAL,
+  XML_READER_ACCESS_RANDOM
+} XmlReaderAccessPattern;
+
 typedef struct _XmlReader          XmlReader;
 typedef struct _XmlReaderPrivate   XmlReaderPrivate;
 typedef struct _XmlReaderClass     XmlReaderClass;
+typedef struct _XmlReaderVisitor   XmlReaderVisitor;
+typedef struct _XmlReaderStatistics XmlReaderStatistics;
+typedef struct _XmlReaderVector    XmlReaderVector;
+typedef struct _XmlReaderLimits    XmlReaderLimits;
 
 /**
  * XmlReader:
@@ -82,6 +135,162 @@ struct _XmlReaderClass
   GObjectClass parent_class;
 };
 
+/**
+ * XmlReaderVisitor:
+ * @enter_element: called when an element is entered, before its
+ *   attributes and its content
+ * @attribute: called for each attribute of an element, with the
+ *   attribute name and value
+ * @text: called for each text or CDATA node
+ * @leave_element: called when an element is left; the return value is
+ *   only checked for %XML_READER_VISIT_STOP
+ *
+ * Table of callbacks invoked by xml_reader_walk(). Every callback can
+ * be %NULL. The strings passed to the callbacks are owned by the
+ * #XmlReader and are only valid for the duration of the call.
+ */
+struct _XmlReaderVisitor
+{
+  XmlReaderVisitResult (* enter_element) (XmlReader   *reader,
+                                          const gchar *element_name,
+                                          gpointer     user_data);
+  XmlReaderVisitResult (* attribute)     (XmlReader   *reader,
+                                          const gchar *attribute_name,
+                                          const gchar *attribute_value,
+                                          gpointer     user_data);
+  XmlReaderVisitResult (* text)          (XmlReader   *reader,
+                                          const gchar *text,
+                                          gpointer     user_data);
+  XmlReaderVisitResult (* leave_element) (XmlReader   *reader,
+                                          const gchar *element_name,
+                                          gpointer     user_data);
+};
+
+/**
+ * XmlReaderStatistics:
+ * @n_lookups: the number of element lookups below an element
+ * @n_siblings_scanned: the number of children compared by those lookups
+ * @n_misses: the number of lookups that found no element
+ * @n_filter_rejections: the number of misses answered by a descendant
+ *   names filter without looking at the children
+ * @n_child_arrays: the number of elements whose children were packed
+ * @n_name_maps: the number of elements whose children were indexed by
+ *   name
+ * @n_filters: the number of descendant names filters built
+ * @n_declined: the number of indexes not built because of the memory
+ *   budget
+ * @index_memory: the memory used by the indexes, in bytes
+ * @n_dedup_values: the number of values interned by deduplication
+ * @n_dedup_unique: the number of distinct values among them
+ * @dedup_bytes_saved: the memory saved by deduplication, in bytes
+ * @dedup_ratio: the fraction of the interned values that were shared
+ *   with an earlier one
+ * @tree_memory: the memory taken by the elements of the document in
+ *   bounded memory mode, as estimated while parsing them, in bytes
+ * @tree_memory_peak: the largest value @tree_memory reached
+ * @n_released: the number of subtrees released behind the cursor in
+ *   bounded memory mode, see xml_reader_set_bounded_memory()
+ * @follow_memory: the memory of the buffer holding the data read from
+ *   the followed file, in bytes, see xml_reader_follow_file()
+ *
+ * Lookup and memory statistics of an #XmlReader for the loaded
+ * document, filled by xml_reader_get_statistics().
+ */
+struct _XmlReaderStatistics
+{
+  guint64 n_lookups;
+  guint64 n_siblings_scanned;
+  guint64 n_misses;
+  guint64 n_filter_rejections;
+
+  guint n_child_arrays;
+  guint n_name_maps;
+  guint n_filters;
+  guint n_declined;
+
+  gsize index_memory;
+
+  guint64 n_dedup_values;
+  guint64 n_dedup_unique;
+  guint64 dedup_bytes_saved;
+  gdouble dedup_ratio;
+
+  gsize tree_memory;
+  gsize tree_memory_peak;
+  guint64 n_released;
+
+  gsize follow_memory;
+};
+
+/**
+ * XmlReaderVector:
+ * @buffer: the data of the buffer
+ * @size: the size of @buffer, in bytes
+ *
+ * A piece of an XML stream, for xml_reader_load_from_vectors(). It has
+ * the same layout as a <structname>struct iovec</structname>.
+ */
+struct _XmlReaderVector
+{
+  gconstpointer buffer;
+  gsize size;
+};
+
+/**
+ * XmlReaderLimits:
+ * @max_depth: the maximum depth of the elements, the root element being
+ *   at depth 1
+ * @max_nodes: the maximum number of elements, texts, comments, processing
+ *   instructions and entity references of a document
+ * @max_attributes: the maximum number of attributes of an element
+ * @max_text_length: the maximum length of a text or of an attribute
+ *   value, in bytes
+ * @max_entity_expansion: the maximum length of the text the entity
+ *   references of a document expand to, in bytes
+ *
+ * Limits on the documents loaded by an #XmlReader, for untrusted input;
+ * see xml_reader_set_limits(). A limit of 0 means no limit.
+ */
+struct _XmlReaderLimits
+{
+  guint max_depth;
+  guint64 max_nodes;
+  guint max_attributes;
+  gsize max_text_length;
+  gsize max_entity_expansion;
+};
+
+/**
+ * XmlReaderLoadFunc:
+ * @reader: the #XmlReader that loaded the document
+ * @error: the error that occurred while loading, or %NULL
+ * @user_data: the data passed to xml_reader_load_in_idle()
+ *
+ * The function called by xml_reader_load_in_idle() once the document
+ * is loaded, or failed to load.
+ */
+typedef void (* XmlReaderLoadFunc) (XmlReader    *reader,
+                                    const GError *error,
+                                    gpointer      user_data);
+
+/**
+ * XmlReaderProgressFunc:
+ * @reader: the #XmlReader loading a document
+ * @bytes_read: the bytes of the document parsed so far
+ * @total_bytes: the size of the document, in bytes, or -1 if it is not
+ *   known, as when decompressing it
+ * @n_elements: the elements parsed so far
+ * @user_data: the data passed to xml_reader_set_progress_func()
+ *
+ * The function told of the progress of @reader while it parses a
+ * document, see xml_reader_set_progress_func().
+ */
+typedef void (* XmlReaderProgressFunc) (XmlReader *reader,
+                                        goffset    bytes_read,
+                                        goffset    total_bytes,
+                                        guint64    n_elements,
+                                        gpointer   user_data);
+
 GType                 xml_reader_get_type            (void) G_GNUC_CONST;
 
 XmlReader *           xml_reader_new                 (void);
@@ -91,14 +300,77 @@ gboolean              xml_reader_load_from_data      (XmlReader    *reader,
 gboolean              xml_reader_load_from_file      (XmlReader    *reader,
                                                       const gchar  *filename,
                                                       GError      **error);
+gboolean              xml_reader_load_from_bytes     (XmlReader    *reader,
+                                                      GBytes       *bytes,
+                                                      GError      **error);
+gboolean              xml_reader_load_from_vectors   (XmlReader              *reader,
+                                                      const XmlReaderVector  *vectors,
+                                                      guint                   n_vectors,
+                                                      GError                **error);
+gboolean              xml_reader_begin_load_from_file  (XmlReader    *reader,
+                                                        const gchar  *filename,
+                                                        GError      **error);
+void                  xml_reader_begin_load_from_bytes (XmlReader    *reader,
+                                                        GBytes       *bytes);
+gboolean              xml_reader_load_step           (XmlReader    *reader,
+                                                      gint64        budget,
+                                                      GError      **error);
+gboolean              xml_reader_is_loading          (XmlReader    *reader);
+guint                 xml_reader_load_in_idle        (XmlReader         *reader,
+                                                      GMainContext      *context,
+                                                      gint64             budget,
+                                                      XmlReaderLoadFunc  callback,
+                                                      gpointer           user_data,
+                                                      GDestroyNotify     notify);
+void                  xml_reader_open_documents      (XmlReader    *reader,
+                                                      GBytes       *stream);
+gboolean              xml_reader_open_documents_from_file (XmlReader    *reader,
+                                                           const gchar  *filename,
+                                                           GError      **error);
+gboolean              xml_reader_next_document       (XmlReader    *reader,
+                                                      GError      **error);
+gboolean              xml_reader_follow_file         (XmlReader    *reader,
+                                                      const gchar  *filename,
+                                                      guint         interval,
+                                                      GError      **error);
+gboolean              xml_reader_next_record         (XmlReader    *reader,
+                                                      gint          timeout,
+                                                      GError      **error);
+gboolean              xml_reader_is_following        (XmlReader    *reader);
+GBytes *              xml_reader_get_checkpoint      (XmlReader    *reader);
+gboolean              xml_reader_resume_from_checkpoint (XmlReader    *reader,
+                                                         const gchar  *filename,
+                                                         GBytes       *checkpoint,
+                                                         guint         interval,
+                                                         GError      **error);
+gboolean              xml_reader_load_from_checkpoint (XmlReader    *reader,
+                                                       const gchar  *filename,
+                                                       GBytes       *checkpoint,
+                                                       GError      **error);
 gboolean              xml_reader_get_error           (XmlReader    *reader,
                                                       GError      **error);
 
 gboolean              xml_reader_read_start_element  (XmlReader    *reader,
                                                       const gchar  *element_name);
+gboolean              xml_reader_try_start_element   (XmlReader    *reader,
+                                                      const gchar  *element_name);
+gint                  xml_reader_count_elements      (XmlReader    *reader,
+                                                      const gchar  *element_name);
+gboolean              xml_reader_read_nth_element    (XmlReader    *reader,
+                                                      const gchar  *element_name,
+                                                      gint          index_);
 void                  xml_reader_read_end_element    (XmlReader    *reader);
+gboolean              xml_reader_read_next_in_document (XmlReader  *reader);
+gint                  xml_reader_get_depth           (XmlReader    *reader);
 G_CONST_RETURN gchar *xml_reader_get_element_name    (XmlReader    *reader);
 G_CONST_RETURN gchar *xml_reader_get_element_value   (XmlReader    *reader);
+GBytes *              xml_reader_get_element_value_bytes (XmlReader  *reader);
+G_CONST_RETURN gchar *xml_reader_get_outer_xml       (XmlReader    *reader,
+                                                      gsize        *length);
+G_CONST_RETURN gchar *xml_reader_get_inner_xml       (XmlReader    *reader,
+                                                      gsize        *length);
+GBytes *              xml_reader_get_outer_xml_bytes (XmlReader    *reader);
+GBytes *              xml_reader_get_inner_xml_bytes (XmlReader    *reader);
 
 gboolean              xml_reader_has_attributes      (XmlReader    *reader);
 gint                  xml_reader_count_attributes    (XmlReader    *reader);
@@ -107,6 +379,40 @@ gboolean              xml_reader_read_attribute_pos  (XmlReader    *reader,
 gboolean              xml_reader_read_attribute_name (XmlReader    *reader,
                                                       const gchar  *attribute_name);
 G_CONST_RETURN gchar *xml_reader_get_attribute_value (XmlReader    *reader);
+GBytes *              xml_reader_get_attribute_value_bytes (XmlReader *reader);
+
+void                  xml_reader_set_adaptive_indexing (XmlReader *reader,
+                                                        gboolean   enabled,
+                                                        gsize      memory_budget);
+void                  xml_reader_set_succinct        (XmlReader    *reader,
+                                                      gboolean      succinct);
+void                  xml_reader_set_out_of_core     (XmlReader    *reader,
+                                                      gboolean      enabled,
+                                                      const gchar  *directory);
+void                  xml_reader_set_access_pattern  (XmlReader    *reader,
+                                                      XmlReaderAccessPattern pattern);
+void                  xml_reader_set_deduplication   (XmlReader    *reader,
+                                                      gboolean      enabled,
+                                                      gsize         max_length);
+void                  xml_reader_set_keep_source     (XmlReader    *reader,
+                                                      gboolean      keep_source);
+void                  xml_reader_set_bounded_memory  (XmlReader    *reader,
+                                                      gint          release_depth,
+                                                      gsize         memory_limit);
+void                  xml_reader_set_limits          (XmlReader             *reader,
+                                                      const XmlReaderLimits *limits);
+void                  xml_reader_set_progress_func   (XmlReader             *reader,
+                                                      guint                  interval,
+                                                      XmlReaderProgressFunc  func,
+                                                      gpointer               user_data,
+                                                      GDestroyNotify         notify);
+void                  xml_reader_get_statistics      (XmlReader           *reader,
+                                                      XmlReaderStatistics *statistics);
+gchar *               xml_reader_get_index_report    (XmlReader    *reader);
+
+gboolean              xml_reader_walk                (XmlReader              *reader,
+                                                      const XmlReaderVisitor *visitor,
+                                                      gpointer                user_data);
 
 G_END_DECLS
 